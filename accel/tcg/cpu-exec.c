@@ -28,6 +28,7 @@
 #include "tcg/tcg.h"
 #include "qemu/atomic.h"
 #include "qemu/rcu.h"
+#include "qemu/memalign.h"
 #include "exec/log.h"
 #include "qemu/main-loop.h"
 #include "sysemu/cpus.h"
@@ -194,7 +195,7 @@ static bool tb_lookup_cmp(const void *p, const void *d)
         tb_page_addr0(tb) == desc->page_addr0 &&
         tb->cs_base == desc->cs_base &&
         tb->flags == desc->flags &&
-        tb_cflags(tb) == desc->cflags) {
+        tb_lookup_cflags(tb) == desc->cflags) {
         /* check next page if needed */
         tb_page_addr_t tb_phys_page1 = tb_page_addr1(tb);
         if (tb_phys_page1 == -1) {
@@ -222,9 +223,9 @@ static bool tb_lookup_cmp(const void *p, const void *d)
     return false;
 }
 
-static TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
-                                          uint64_t cs_base, uint32_t flags,
-                                          uint32_t cflags)
+TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
+                                   uint64_t cs_base, uint32_t flags,
+                                   uint32_t cflags)
 {
     tb_page_addr_t phys_pc;
     struct tb_desc desc;
@@ -252,6 +253,7 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
 {
     TranslationBlock *tb;
     CPUJumpCache *jc;
+    CPUJumpCacheEntry *set;
     uint32_t hash;
 
     /* we should never be trying to look up an INVALID tb */
@@ -259,23 +261,27 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
 
     hash = tb_jmp_cache_hash_func(pc);
     jc = cpu->tb_jmp_cache;
-
-    tb = qatomic_read(&jc->array[hash].tb);
-    if (likely(tb &&
-               jc->array[hash].pc == pc &&
-               tb->cs_base == cs_base &&
-               tb->flags == flags &&
-               tb_cflags(tb) == cflags)) {
-        goto hit;
+    set = tb_jmp_cache_set(jc, hash);
+
+    for (int i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+        tb = qatomic_read(&set[i].tb);
+        if (likely(tb &&
+                   set[i].pc == pc &&
+                   tb->cs_base == cs_base &&
+                   tb->flags == flags &&
+                   tb_lookup_cflags(tb) == cflags)) {
+            qatomic_set(&jc->hits, jc->hits + 1);
+            goto hit;
+        }
     }
 
+    qatomic_set(&jc->misses, jc->misses + 1);
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
     }
 
-    jc->array[hash].pc = pc;
-    qatomic_set(&jc->array[hash].tb, tb);
+    tb_jmp_cache_insert(jc, hash, pc, tb);
 
 hit:
     /*
@@ -393,19 +399,28 @@ static inline bool check_for_breakpoints(CPUState *cpu, vaddr pc,
 /**
  * helper_lookup_tb_ptr: quick check for next tb
  * @env: current cpu state
+ * @src: the TB ending in the indirect branch
  *
- * Look for an existing TB matching the current cpu state.
+ * Look for an existing TB matching the current cpu state, first
+ * among the previous targets of @src's branch, then in the jump cache.
  * If found, return the code pointer.  If not found, return
  * the tcg epilogue so that we return into cpu_tb_exec.
  */
-const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
+const void *HELPER(lookup_tb_ptr)(CPUArchState *env, const void *src)
 {
     CPUState *cpu = env_cpu(env);
+    CPUIndirectCacheEntry *ic = tb_ibtc_entry(cpu->tb_jmp_cache, src);
     TranslationBlock *tb;
     vaddr pc;
     uint64_t cs_base;
     uint32_t flags, cflags;
 
+    /* Fetch the predicted TB while the cpu state is being computed. */
+    tb = qatomic_read(&ic->tb);
+    if (tb) {
+        __builtin_prefetch(tb);
+    }
+
     /*
      * By definition we've just finished a TB, so I/O is OK.
      * Avoid the possibility of calling cpu_io_recompile() if
@@ -421,16 +436,30 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
         cpu_loop_exit(cpu);
     }
 
-    tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
-    if (tb == NULL) {
-        return tcg_code_gen_epilogue;
+    if (tb &&
+        ic->src == src &&
+        ic->pc == pc &&
+        tb->cs_base == cs_base &&
+        tb->flags == flags &&
+        tb_lookup_cflags(tb) == cflags) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+        qatomic_set(&jc->ibtc_hits, jc->ibtc_hits + 1);
+    } else {
+        tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
+        if (tb == NULL) {
+            return tcg_code_gen_epilogue;
+        }
+        ic->src = src;
+        ic->pc = pc;
+        qatomic_set(&ic->tb, tb);
     }
 
     if (qemu_loglevel_mask(CPU_LOG_TB_CPU | CPU_LOG_EXEC)) {
         log_cpu_exec(pc, cpu, tb);
     }
 
-    return tb->tc.ptr;
+    return tb_warm_ptr(tb);
 }
 
 /* Execute a TB, and fix up the CPU state afterwards if necessary */
@@ -538,6 +567,8 @@ static void cpu_exec_longjmp_cleanup(CPUState *cpu)
     if (have_mmap_lock()) {
         mmap_unlock();
     }
+    /* A fault during a parallel translation lands here too. */
+    tcg_ctx_return();
 #else
     /*
      * For softmmu, a tlb_fill fault during translation will land here,
@@ -657,7 +688,7 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
     }
 
     /* patch the native jump address */
-    tb_set_jmp_target(tb, n, (uintptr_t)tb_next->tc.ptr);
+    tb_set_jmp_target(tb, n, (uintptr_t)tb_warm_ptr(tb_next));
 
     /* add in TB jmp list */
     tb->jmp_list_next[n] = tb_next->jmp_list_head;
@@ -912,6 +943,11 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
     }
 
     *last_tb = NULL;
+#ifndef CONFIG_USER_ONLY
+    if (unlikely(qatomic_read(&cpu->tb_profile_request))) {
+        tb_profile_sample(cpu, log_pc(cpu, tb));
+    }
+#endif
     if (cpu_loop_exit_requested(cpu)) {
         /* Something asked us to stop executing chained TBs; just
          * continue round the main loop. Whatever requested the exit
@@ -923,6 +959,11 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
         return;
     }
 
+    if (tb_tier_counted(tb_cflags(tb))) {
+        /* @tb became hot, see gen_tier_count().  */
+        return;
+    }
+
     /* Instruction counter expired.  */
     assert(icount_enabled());
 #ifndef CONFIG_USER_ONLY
@@ -941,7 +982,8 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
     if (insns_left > 0 && insns_left < tb->icount)  {
         assert(insns_left <= CF_COUNT_MASK);
         assert(cpu->icount_extra == 0);
-        cpu->cflags_next_tb = (tb->cflags & ~CF_COUNT_MASK) | insns_left;
+        cpu->cflags_next_tb = (tb->cflags & ~(CF_COUNT_MASK | CF_TIER2)) |
+                              insns_left;
     }
 #endif
 }
@@ -985,12 +1027,23 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
             }
 
             tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
-            if (tb == NULL) {
+            if (tb == NULL || unlikely(tb_tier_hot(cpu, tb))) {
                 CPUJumpCache *jc;
                 uint32_t h;
 
+                if (unlikely(tcg_pin_due())) {
+                    /* Pin globals and flush, then translate again. */
+                    tb_pin_select(cpu);
+                    cpu->exception_index = EXCP_INTERRUPT;
+                    cpu_loop_exit(cpu);
+                }
+
                 mmap_lock();
-                tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+                if (tb) {
+                    tb = tb_tier_up(cpu, tb, pc, cs_base, flags, cflags);
+                } else {
+                    tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+                }
                 mmap_unlock();
 
                 /*
@@ -999,8 +1052,7 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                  */
                 h = tb_jmp_cache_hash_func(pc);
                 jc = cpu->tb_jmp_cache;
-                jc->array[h].pc = pc;
-                qatomic_set(&jc->array[h].tb, tb);
+                tb_jmp_cache_insert(jc, h, pc, tb);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -1082,7 +1134,13 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
     }
 
-    cpu->tb_jmp_cache = g_new0(CPUJumpCache, 1);
+    /* Keep each set of the jump cache within one host cache line. */
+    cpu->tb_jmp_cache = qemu_memalign(__alignof__(CPUJumpCache),
+                                      sizeof(CPUJumpCache));
+    memset(cpu->tb_jmp_cache, 0, sizeof(CPUJumpCache));
+    if (tb_tier_threshold) {
+        cpu->tb_jmp_cache->tier_counts = g_new0(uint32_t, TB_TIER_SLOTS);
+    }
     tlb_init(cpu);
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_init_notifier_list(cpu);
@@ -1092,6 +1150,12 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
     return true;
 }
 
+static void tb_jmp_cache_free(CPUJumpCache *jc)
+{
+    g_free(jc->tier_counts);
+    qemu_vfree(jc);
+}
+
 /* undo the initializations in reverse order */
 void tcg_exec_unrealizefn(CPUState *cpu)
 {
@@ -1100,5 +1164,5 @@ void tcg_exec_unrealizefn(CPUState *cpu)
 #endif /* !CONFIG_USER_ONLY */
 
     tlb_destroy(cpu);
-    g_free_rcu(cpu->tb_jmp_cache, rcu);
+    call_rcu(cpu->tb_jmp_cache, tb_jmp_cache_free, rcu);
 }
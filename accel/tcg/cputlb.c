@@ -157,15 +157,23 @@ static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
 static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
 {
     CPUJumpCache *jc = cpu->tb_jmp_cache;
-    int i, i0;
+    CPUJumpCacheEntry *set;
+    int i;
 
     if (unlikely(!jc)) {
         return;
     }
 
-    i0 = tb_jmp_cache_hash_page(page_addr);
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&jc->array[i0 + i].tb, NULL);
+    set = tb_jmp_cache_set(jc, tb_jmp_cache_hash_page(page_addr));
+    for (i = 0; i < TB_JMP_PAGE_SIZE * TB_JMP_CACHE_WAYS; i++) {
+        qatomic_set(&set[i].tb, NULL);
+    }
+
+    /* The indirect branch targets are not grouped by page. */
+    for (i = 0; i < TB_IBTC_SIZE; i++) {
+        if (((jc->ibtc[i].pc ^ page_addr) & TARGET_PAGE_MASK) == 0) {
+            qatomic_set(&jc->ibtc[i].tb, NULL);
+        }
     }
 }
 
@@ -287,6 +295,7 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
+    desc->n_large_pages = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
     desc->vindex = 0;
@@ -507,23 +516,82 @@ static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(cpu, mmu_idx, page, -1);
 }
 
+/* A page or range flush hit large pages we no longer track: flush all. */
+static void tlb_flush_escalate_locked(CPUState *cpu, int midx, vaddr addr)
+{
+    trace_tlb_flush_escalate(cpu->cpu_index, midx, addr);
+    qatomic_set(&cpu->neg.tlb.c.escalate_flush_count,
+                cpu->neg.tlb.c.escalate_flush_count + 1);
+    tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
+}
+
+/*
+ * Evict every entry of large_page[@i], and stop tracking it.
+ * The entries of the large page are wherever the pages they map hash to,
+ * so look at each of those pages, unless the tlb is smaller.
+ */
+static void tlb_flush_large_page_locked(CPUState *cpu, int midx, unsigned i)
+{
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+    CPUTLBDescFast *f = &cpu->neg.tlb.f[midx];
+    vaddr lp_addr = d->large_page[i].addr;
+    vaddr lp_mask = d->large_page[i].mask;
+    vaddr n_pages = (~lp_mask >> TARGET_PAGE_BITS) + 1;
+    size_t n_entries = tlb_n_entries(f);
+
+    tlb_debug("large page flush midx %d (%016" VADDR_PRIx "/%016" VADDR_PRIx
+              ")\n", midx, lp_addr, lp_mask);
+    trace_tlb_flush_large_page(cpu->cpu_index, midx, lp_addr, lp_mask);
+
+    if (n_pages < n_entries) {
+        for (vaddr p = 0; p < n_pages; p++) {
+            vaddr page = lp_addr + (p << TARGET_PAGE_BITS);
+
+            if (tlb_flush_entry_mask_locked(tlb_entry(cpu, midx, page),
+                                            lp_addr, lp_mask)) {
+                tlb_n_used_entries_dec(cpu, midx);
+            }
+        }
+    } else {
+        for (size_t k = 0; k < n_entries; k++) {
+            if (tlb_flush_entry_mask_locked(&f->table[k], lp_addr, lp_mask)) {
+                tlb_n_used_entries_dec(cpu, midx);
+            }
+        }
+    }
+    tlb_flush_vtlb_page_mask_locked(cpu, midx, lp_addr, lp_mask);
+
+    d->large_page[i] = d->large_page[--d->n_large_pages];
+    qatomic_set(&cpu->neg.tlb.c.large_flush_count,
+                cpu->neg.tlb.c.large_flush_count + 1);
+}
+
 static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
 {
-    vaddr lp_addr = cpu->neg.tlb.d[midx].large_page_addr;
-    vaddr lp_mask = cpu->neg.tlb.d[midx].large_page_mask;
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+    vaddr lp_addr = d->large_page_addr;
+    vaddr lp_mask = d->large_page_mask;
+    unsigned i;
 
-    /* Check if we need to flush due to large pages.  */
+    /* Check if we need to flush due to untracked large pages.  */
     if ((page & lp_mask) == lp_addr) {
         tlb_debug("forcing full flush midx %d (%016"
                   VADDR_PRIx "/%016" VADDR_PRIx ")\n",
                   midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
-    } else {
-        if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
-            tlb_n_used_entries_dec(cpu, midx);
+        tlb_flush_escalate_locked(cpu, midx, page);
+        return;
+    }
+
+    /* Removal moves the last entry to i, which was already checked. */
+    for (i = d->n_large_pages; i-- > 0; ) {
+        if ((page & d->large_page[i].mask) == d->large_page[i].addr) {
+            tlb_flush_large_page_locked(cpu, midx, i);
         }
-        tlb_flush_vtlb_page_locked(cpu, midx, page);
     }
+    if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
+        tlb_n_used_entries_dec(cpu, midx);
+    }
+    tlb_flush_vtlb_page_locked(cpu, midx, page);
 }
 
 /**
@@ -690,12 +758,12 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
         tlb_debug("forcing full flush midx %d ("
                   "%016" VADDR_PRIx "/%016" VADDR_PRIx "+%016" VADDR_PRIx ")\n",
                   midx, addr, mask, len);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
+        tlb_flush_escalate_locked(cpu, midx, addr);
         return;
     }
 
     /*
-     * Check if we need to flush due to large pages.
+     * Check if we need to flush due to untracked large pages.
      * Because large_page_mask contains all 1's from the msb,
      * we only need to test the end of the range.
      */
@@ -703,10 +771,19 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
         tlb_debug("forcing full flush midx %d ("
                   "%016" VADDR_PRIx "/%016" VADDR_PRIx ")\n",
                   midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
+        tlb_flush_escalate_locked(cpu, midx, addr);
         return;
     }
 
+    for (unsigned i = d->n_large_pages; i-- > 0; ) {
+        vaddr lp_addr = d->large_page[i].addr;
+
+        if (lp_addr <= addr + len - 1 &&
+            addr <= (lp_addr | ~d->large_page[i].mask)) {
+            tlb_flush_large_page_locked(cpu, midx, i);
+        }
+    }
+
     for (vaddr i = 0; i < len; i += TARGET_PAGE_SIZE) {
         vaddr page = addr + i;
         CPUTLBEntry *entry = tlb_entry(cpu, midx, page);
@@ -744,10 +821,11 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 
     /*
-     * If the length is larger than the jump cache size, then it will take
-     * longer to clear each entry individually than it will to clear it all.
+     * If the range covers more pages than the jump cache has page groups,
+     * then it will take longer to clear each page individually (including
+     * a scan of the indirect branch targets) than it will to clear it all.
      */
-    if (d.len >= (TARGET_PAGE_SIZE * TB_JMP_CACHE_SIZE)) {
+    if (d.len >= (TARGET_PAGE_SIZE * (TB_JMP_CACHE_SETS / TB_JMP_PAGE_SIZE))) {
         tcg_flush_jmp_cache(cpu);
         return;
     }
@@ -985,13 +1063,32 @@ static void tlb_set_dirty(CPUState *cpu, vaddr addr)
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+/*
+ * Our TLB does not support large pages, so remember each large page, and
+ * evict all of its entries if it is invalidated.  Beyond
+ * CPU_TLB_LARGE_PAGES, remember the area covered by the others and
+ * trigger a full TLB flush if these are invalidated.
+ */
 static void tlb_add_large_page(CPUState *cpu, int mmu_idx,
                                vaddr addr, uint64_t size)
 {
-    vaddr lp_addr = cpu->neg.tlb.d[mmu_idx].large_page_addr;
+    CPUTLBDesc *d = &cpu->neg.tlb.d[mmu_idx];
+    vaddr lp_addr = d->large_page_addr;
     vaddr lp_mask = ~(size - 1);
+    unsigned i;
+
+    for (i = 0; i < d->n_large_pages; i++) {
+        if (d->large_page[i].addr == (addr & lp_mask) &&
+            d->large_page[i].mask == lp_mask) {
+            return;
+        }
+    }
+    if (i < CPU_TLB_LARGE_PAGES) {
+        d->large_page[i].addr = addr & lp_mask;
+        d->large_page[i].mask = lp_mask;
+        d->n_large_pages++;
+        return;
+    }
 
     if (lp_addr == (vaddr)-1) {
         /* No previous large page.  */
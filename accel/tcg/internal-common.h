@@ -11,12 +11,17 @@
 
 #include "exec/cpu-common.h"
 #include "exec/translation-block.h"
+#include "tb-jmp-cache.h"
 
 extern int64_t max_delay;
 extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
 
+#define TB_TIER_SLOTS (1 << 16)
+
+extern unsigned tb_tier_threshold;
+
 /*
  * Return true if CS is not running in parallel with other cpus, either
  * because there are no other cpus or we are within an exclusive context.
@@ -43,13 +48,38 @@ static inline bool cpu_plugin_mem_cbs_enabled(const CPUState *cpu)
 #endif
 }
 
+/*
+ * tb_tier_hot() - has @tb run often enough on @cpu to be retranslated
+ * as tier 2?  Only tier-1 TBs are counted, and only with
+ * -accel tcg,tier-threshold=N.
+ */
+static inline bool tb_tier_hot(CPUState *cpu, const TranslationBlock *tb)
+{
+    uint32_t slot = qatomic_read(&tb->tier_slot);
+
+    return slot &&
+           cpu->tb_jmp_cache->tier_counts[slot] >= tb_tier_threshold;
+}
+
 TranslationBlock *tb_gen_code(CPUState *cpu, vaddr pc,
                               uint64_t cs_base, uint32_t flags,
                               int cflags);
+TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
+                                   uint64_t cs_base, uint32_t flags,
+                                   uint32_t cflags);
+void tb_tier_init(unsigned threshold);
+bool tb_tier_counted(uint32_t cflags);
+void tb_tier_release(TranslationBlock *tb);
+void tb_tier_reset(void);
+TranslationBlock *tb_tier_up(CPUState *cpu, TranslationBlock *tb, vaddr pc,
+                             uint64_t cs_base, uint32_t flags, int cflags);
 void page_init(void);
 void tb_htable_init(void);
 void tb_reset_jump(TranslationBlock *tb, int n);
 TranslationBlock *tb_link_page(TranslationBlock *tb);
+void tb_reclaim(CPUState *cpu);
+void tb_pin_select(CPUState *cpu);
+void tb_profile_sample(CPUState *cpu, vaddr pc);
 void cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
                                uintptr_t host_pc);
 
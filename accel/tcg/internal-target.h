@@ -50,11 +50,18 @@ static inline void tb_lock_page0(tb_page_addr_t p0)
 
 static inline void tb_lock_page1(tb_page_addr_t p0, tb_page_addr_t p1)
 {
+    /* The translator may run without mmap_lock, see tb_gen_code(). */
+    mmap_lock();
     page_protect(p1);
+    mmap_unlock();
 }
 
 static inline void tb_unlock_page1(tb_page_addr_t p0, tb_page_addr_t p1) { }
 static inline void tb_unlock_pages(TranslationBlock *tb) { }
+
+/* Note a TB translated on a miss for the persistent cache, see tb-cache.c */
+void tb_cache_record(CPUState *cpu, vaddr pc, uint64_t cs_base,
+                     uint32_t flags, uint32_t cflags);
 #else
 void tb_lock_page0(tb_page_addr_t);
 void tb_lock_page1(tb_page_addr_t, tb_page_addr_t);
@@ -12,13 +12,16 @@
 #include "qapi/error.h"
 #include "qapi/type-helpers.h"
 #include "qapi/qapi-commands-machine.h"
+#include "monitor/hmp.h"
 #include "monitor/monitor.h"
+#include "qapi/qmp/qdict.h"
 #include "sysemu/cpus.h"
 #include "sysemu/cpu-timers.h"
 #include "sysemu/tcg.h"
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
 
 
 static void dump_drift_info(GString *buf)
@@ -126,19 +129,43 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
-static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide,
+                             size_t *plarge, size_t *pescalate)
 {
     CPUState *cpu;
-    size_t full = 0, part = 0, elide = 0;
+    size_t full = 0, part = 0, elide = 0, large = 0, escalate = 0;
 
     CPU_FOREACH(cpu) {
         full += qatomic_read(&cpu->neg.tlb.c.full_flush_count);
         part += qatomic_read(&cpu->neg.tlb.c.part_flush_count);
         elide += qatomic_read(&cpu->neg.tlb.c.elide_flush_count);
+        large += qatomic_read(&cpu->neg.tlb.c.large_flush_count);
+        escalate += qatomic_read(&cpu->neg.tlb.c.escalate_flush_count);
     }
     *pfull = full;
     *ppart = part;
     *pelide = elide;
+    *plarge = large;
+    *pescalate = escalate;
+}
+
+static void jmp_cache_counts(size_t *pibtc, size_t *phit, size_t *pmiss)
+{
+    CPUState *cpu;
+    size_t ibtc = 0, hit = 0, miss = 0;
+
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+        if (jc) {
+            ibtc += qatomic_read(&jc->ibtc_hits);
+            hit += qatomic_read(&jc->hits);
+            miss += qatomic_read(&jc->misses);
+        }
+    }
+    *pibtc = ibtc;
+    *phit = hit;
+    *pmiss = miss;
 }
 
 static void tcg_dump_info(GString *buf)
@@ -151,6 +178,8 @@ static void dump_exec_info(GString *buf)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t flush_large, flush_escalate;
+    size_t lookup_ibtc, lookup_hit, lookup_miss, lookups;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -191,11 +220,36 @@ static void dump_exec_info(GString *buf)
                            qatomic_read(&tb_ctx.tb_flush_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
-
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
+    g_string_append_printf(buf, "TB evict count      %u regions, %u TBs\n",
+                           qatomic_read(&tb_ctx.tb_evict_count),
+                           qatomic_read(&tb_ctx.tb_evict_tb_count));
+    g_string_append_printf(buf, "TB retranslations   %u\n",
+                           qatomic_read(&tb_ctx.tb_retranslate_count));
+    g_string_append_printf(buf, "TB tier-up count    %u (%u branches folded)\n",
+                           qatomic_read(&tb_ctx.tb_tier_up_count),
+                           qatomic_read(&tb_ctx.tb_trace_jmp_count));
+    tcg_pin_dump_info(buf);
+
+    jmp_cache_counts(&lookup_ibtc, &lookup_hit, &lookup_miss);
+    lookups = lookup_ibtc + lookup_hit + lookup_miss;
+    g_string_append_printf(buf, "TB lookups          %zu\n", lookups);
+    g_string_append_printf(buf, "  ibtc hits         %zu (%zu%%)\n",
+                           lookup_ibtc,
+                           lookups ? (lookup_ibtc * 100) / lookups : 0);
+    g_string_append_printf(buf, "  jmp cache hits    %zu (%zu%%)\n",
+                           lookup_hit,
+                           lookups ? (lookup_hit * 100) / lookups : 0);
+    g_string_append_printf(buf, "  qht lookups       %zu (%zu%%)\n",
+                           lookup_miss,
+                           lookups ? (lookup_miss * 100) / lookups : 0);
+
+    tlb_flush_counts(&flush_full, &flush_part, &flush_elide,
+                     &flush_large, &flush_escalate);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    g_string_append_printf(buf, "TLB large-page flushes %zu, escalated %zu\n",
+                           flush_large, flush_escalate);
     tcg_dump_info(buf);
 }
 
@@ -235,10 +289,26 @@ HumanReadableText *qmp_x_query_opcount(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+void hmp_jit_profile(Monitor *mon, const QDict *qdict)
+{
+    bool enable = qdict_get_bool(qdict, "enable");
+    bool has_frequency = qdict_haskey(qdict, "frequency");
+    int64_t frequency = qdict_get_try_int(qdict, "frequency", 0);
+    Error *err = NULL;
+
+    /* Out of range values are rejected as 0 is. */
+    if (frequency < 0 || frequency > UINT32_MAX) {
+        frequency = 0;
+    }
+    qmp_x_jit_profile(enable, has_frequency, frequency, &err);
+    hmp_handle_error(mon, err);
+}
+
 static void hmp_tcg_register(void)
 {
     monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
     monitor_register_hmp_info_hrt("opcount", qmp_x_query_opcount);
+    monitor_register_hmp_info_hrt("jit-profile", qmp_x_query_jit_profile);
 }
 
 type_init(hmp_tcg_register);
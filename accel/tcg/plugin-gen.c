@@ -212,6 +212,45 @@ static void gen_mem_cb(struct qemu_plugin_regular_cb *cb,
     tcg_temp_free_i32(cpu_index);
 }
 
+/*
+ * Append a record at the vCPU's cursor and only call out when this
+ * filled the buffer. The branch ends the extended basic block: if other
+ * callbacks follow, the caller must pass @addr in a TB temp.
+ */
+static void gen_mem_buf_cb(struct qemu_plugin_mem_buf_cb *cb,
+                           qemu_plugin_meminfo_t meminfo, TCGv_i64 addr)
+{
+    qemu_plugin_u64 entry = { .score = cb->buf->vcpus, .offset = 0 };
+    TCGv_ptr vcpu = gen_plugin_u64_ptr(entry);
+    TCGv_ptr cur = tcg_temp_ebb_new_ptr();
+    TCGv_ptr end = tcg_temp_ebb_new_ptr();
+    TCGLabel *not_full = gen_new_label();
+
+    tcg_gen_ld_ptr(cur, vcpu, offsetof(struct qemu_plugin_mem_buf_vcpu, cur));
+    tcg_gen_st_i64(addr, cur, offsetof(qemu_plugin_mem_record, vaddr));
+    tcg_gen_st_i64(tcg_constant_i64(cb->pc), cur,
+                   offsetof(qemu_plugin_mem_record, pc));
+    tcg_gen_st_ptr(tcg_constant_ptr(cb->userp), cur,
+                   offsetof(qemu_plugin_mem_record, userdata));
+    tcg_gen_st_i32(tcg_constant_i32(meminfo), cur,
+                   offsetof(qemu_plugin_mem_record, info));
+    tcg_gen_addi_ptr(cur, cur, sizeof(qemu_plugin_mem_record));
+    tcg_gen_st_ptr(cur, vcpu, offsetof(struct qemu_plugin_mem_buf_vcpu, cur));
+
+    tcg_gen_ld_ptr(end, vcpu, offsetof(struct qemu_plugin_mem_buf_vcpu, end));
+    tcg_gen_brcond_ptr(TCG_COND_LTU, cur, end, not_full);
+    TCGv_i32 cpu_index = gen_cpu_index();
+    tcg_gen_call2(cb->f.vcpu_udata, cb->info, NULL,
+                  tcgv_i32_temp(cpu_index),
+                  tcgv_ptr_temp(tcg_constant_ptr(cb->buf)));
+    tcg_temp_free_i32(cpu_index);
+    gen_set_label(not_full);
+
+    tcg_temp_free_ptr(end);
+    tcg_temp_free_ptr(cur);
+    tcg_temp_free_ptr(vcpu);
+}
+
 static void inject_cb(struct qemu_plugin_dyn_cb *cb)
 
 {
@@ -249,6 +288,11 @@ static void inject_mem_cb(struct qemu_plugin_dyn_cb *cb,
             inject_cb(cb);
         }
         break;
+    case PLUGIN_CB_MEM_BUF:
+        if (rw & cb->mem_buf.rw) {
+            gen_mem_buf_cb(&cb->mem_buf, meminfo, addr);
+        }
+        break;
     default:
         g_assert_not_reached();
     }
@@ -358,7 +402,24 @@ static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
             tcg_ctx->emit_before_op = op;
 
             cbs = insn->mem_cbs;
-            for (i = 0, n = (cbs ? cbs->len : 0); i < n; i++) {
+            n = cbs ? cbs->len : 0;
+
+            /*
+             * @addr is an ebb temp, dead after the label of a buffer
+             * callback: copy it for the callbacks that come later.
+             */
+            for (i = 0; i < n - 1; i++) {
+                if (g_array_index(cbs, struct qemu_plugin_dyn_cb, i).type ==
+                    PLUGIN_CB_MEM_BUF) {
+                    TCGv_i64 copy = tcg_temp_new_i64();
+
+                    tcg_gen_mov_i64(copy, addr);
+                    addr = copy;
+                    break;
+                }
+            }
+
+            for (i = 0; i < n; i++) {
                 inject_mem_cb(&g_array_index(cbs, struct qemu_plugin_dyn_cb, i),
                               rw, meminfo, addr);
             }
@@ -0,0 +1,497 @@
+/*
+ * Persistent translation cache for user-mode emulation
+ *
+ * Every qemu-<arch> process starts with an empty code buffer and
+ * retranslates the same libc and program text as the previous one.
+ * For short-lived processes (compilers, configure tests...) that
+ * warm-up dominates the run time.
+ *
+ * Host code itself is not worth saving: it is full of absolute host
+ * addresses (helpers, the epilogue, the TB itself) that change from one
+ * run to the next.  What is saved instead is, for each executable file,
+ * the list of TBs translated from it: file offset, cs_base, flags and
+ * cflags.  When a later process maps the same file, a helper thread
+ * translates those TBs ahead of the vCPU, in the order the previous run
+ * needed them, so that the vCPU finds them in the hash table instead of
+ * stopping to translate.
+ *
+ * The cache can never produce wrong code: entries only say *what* to
+ * translate; translation reads guest memory as it is at that point, and
+ * the resulting TBs are invalidated like any other when the guest
+ * writes to them.  A cache file is tied to the device, inode, size and
+ * mtime of the file it describes; once the file changes, the stale
+ * cache file is ignored and then overwritten.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/interval-tree.h"
+#include "qemu/queue.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qemu/xxhash.h"
+#include "exec/exec-all.h"
+#include "exec/page-protection.h"
+#include "hw/core/cpu.h"
+#include "tcg/startup.h"
+#include "tcg/tcg.h"
+#include "user/tb-cache.h"
+#include "trace.h"
+#include "internal-common.h"
+#include "internal-target.h"
+
+#define TB_CACHE_MAGIC        "QEMUTBC"
+#define TB_CACHE_VERSION      1
+#define TB_CACHE_MAX_ENTRIES  (1 << 20)
+
+typedef struct TBCacheEntry {
+    uint64_t offset;            /* file offset of the TB's pc */
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+} TBCacheEntry;
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_entries;
+    char target[16];
+    char qemu_version[16];
+    /* identity of the file the entries were translated from */
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t mtime_ns;
+} TBCacheHeader;
+
+/* An executable file, shared by all of its mappings. */
+typedef struct TBCacheFile {
+    TBCacheHeader hdr;          /* the header its cache file must have */
+    char *path;
+    const TBCacheEntry *entries;    /* in the cache file, mapped read-only */
+    size_t n_entries;
+    GArray *added;              /* TBCacheEntry translated on a miss */
+} TBCacheFile;
+
+/* An executable mapping of a file. */
+typedef struct TBCacheMapping {
+    IntervalTreeNode itree;
+    TBCacheFile *file;
+    uint64_t offset;            /* file offset mapped at itree.start */
+    size_t next;                /* next entry of file->entries to prefetch */
+    bool queued;
+    QTAILQ_ENTRY(TBCacheMapping) entry;
+} TBCacheMapping;
+
+/* Everything below dir is protected by mmap_lock. */
+static struct {
+    char *dir;
+    GHashTable *files;          /* path -> TBCacheFile */
+    IntervalTreeRoot mappings;
+    QTAILQ_HEAD(, TBCacheMapping) queue;
+    CPUState *cpu;              /* the helper's copy of the vCPU */
+    uint32_t cflags;            /* curr_cflags() of the vCPU */
+    QemuSemaphore sem;
+    unsigned prefetched;
+    unsigned recorded;
+} tb_cache;
+
+/* True in the helper thread, whose TBs are already in the cache. */
+static __thread bool tb_cache_prefetching;
+
+void tb_cache_enable(const char *dir)
+{
+    tb_cache.dir = g_strdup(dir);
+    tb_cache.files = g_hash_table_new(g_str_hash, g_str_equal);
+    QTAILQ_INIT(&tb_cache.queue);
+    qemu_sem_init(&tb_cache.sem, 0);
+}
+
+static bool tb_cache_check(const TBCacheFile *f, const TBCacheHeader *hdr,
+                           size_t size)
+{
+    return size >= sizeof(*hdr) &&
+           !memcmp(hdr, &f->hdr, offsetof(TBCacheHeader, n_entries)) &&
+           !memcmp(hdr->target, f->hdr.target,
+                   sizeof(*hdr) - offsetof(TBCacheHeader, target)) &&
+           hdr->n_entries <= TB_CACHE_MAX_ENTRIES &&
+           size == sizeof(*hdr) + hdr->n_entries * sizeof(TBCacheEntry);
+}
+
+/* Map the cache file of @f, if there is a valid one. */
+static void tb_cache_load(TBCacheFile *f)
+{
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(f->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size >= sizeof(TBCacheHeader)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            if (tb_cache_check(f, map, st.st_size)) {
+                f->entries = (const TBCacheEntry *)((TBCacheHeader *)map + 1);
+                f->n_entries = ((TBCacheHeader *)map)->n_entries;
+            } else {
+                munmap(map, st.st_size);
+            }
+        }
+    }
+    close(fd);
+    trace_tb_cache_load(f->path, f->n_entries);
+}
+
+static TBCacheFile *tb_cache_file(int fd)
+{
+    TBCacheHeader hdr = { };
+    TBCacheFile *f;
+    struct stat st;
+    char *path;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+    memcpy(hdr.magic, TB_CACHE_MAGIC, sizeof(TB_CACHE_MAGIC));
+    hdr.version = TB_CACHE_VERSION;
+    pstrcpy(hdr.target, sizeof(hdr.target), TARGET_NAME);
+    pstrcpy(hdr.qemu_version, sizeof(hdr.qemu_version), QEMU_VERSION);
+    hdr.dev = st.st_dev;
+    hdr.ino = st.st_ino;
+    hdr.size = st.st_size;
+    hdr.mtime_ns = st.st_mtim.tv_sec * NANOSECONDS_PER_SECOND +
+                   st.st_mtim.tv_nsec;
+
+    path = g_strdup_printf("%s/%s-%" PRIx64 "-%" PRIx64 ".tbc", tb_cache.dir,
+                           TARGET_NAME, hdr.dev, hdr.ino);
+    f = g_hash_table_lookup(tb_cache.files, path);
+    if (f && !memcmp(&f->hdr, &hdr, sizeof(hdr))) {
+        g_free(path);
+        return f;
+    }
+
+    /*
+     * First mapping of this file, or the file changed since we last saw
+     * it: what was recorded for the old contents is dropped with it.
+     */
+    f = g_new0(TBCacheFile, 1);
+    f->hdr = hdr;
+    f->path = path;
+    f->added = g_array_new(false, false, sizeof(TBCacheEntry));
+    tb_cache_load(f);
+    g_hash_table_replace(tb_cache.files, path, f);
+    return f;
+}
+
+void tb_cache_map(vaddr start, vaddr last, int fd, uint64_t offset)
+{
+    TBCacheMapping *m;
+    TBCacheFile *f;
+
+    if (!tb_cache.dir) {
+        return;
+    }
+    f = tb_cache_file(fd);
+    if (!f) {
+        return;
+    }
+
+    m = g_new0(TBCacheMapping, 1);
+    m->itree.start = start;
+    m->itree.last = last;
+    m->file = f;
+    m->offset = offset;
+    interval_tree_insert(&m->itree, &tb_cache.mappings);
+
+    if (f->n_entries) {
+        m->queued = true;
+        QTAILQ_INSERT_TAIL(&tb_cache.queue, m, entry);
+        qemu_sem_post(&tb_cache.sem);
+    }
+}
+
+void tb_cache_unmap(vaddr start, vaddr last)
+{
+    IntervalTreeNode *i, *n;
+
+    if (!tb_cache.dir) {
+        return;
+    }
+    for (i = interval_tree_iter_first(&tb_cache.mappings, start, last);
+         i; i = n) {
+        TBCacheMapping *m = container_of(i, TBCacheMapping, itree);
+
+        n = interval_tree_iter_next(i, start, last);
+        if (m->queued) {
+            QTAILQ_REMOVE(&tb_cache.queue, m, entry);
+        }
+        interval_tree_remove(i, &tb_cache.mappings);
+        g_free(m);
+    }
+}
+
+void tb_cache_record(CPUState *cpu, vaddr pc, uint64_t cs_base,
+                     uint32_t flags, uint32_t cflags)
+{
+    IntervalTreeNode *i;
+    TBCacheMapping *m;
+    TBCacheEntry e;
+
+    if (!tb_cache.dir || tb_cache_prefetching) {
+        return;
+    }
+    /* Only TBs that a later lookup from the main loop would ask for. */
+    tb_cache.cflags = curr_cflags(cpu);
+    if (cflags != tb_cache.cflags) {
+        return;
+    }
+    i = interval_tree_iter_first(&tb_cache.mappings, pc, pc);
+    if (!i) {
+        return;
+    }
+    m = container_of(i, TBCacheMapping, itree);
+    if (m->file->added->len >= TB_CACHE_MAX_ENTRIES) {
+        return;
+    }
+
+    e.offset = m->offset + (pc - i->start);
+    e.cs_base = cs_base;
+    e.flags = flags;
+    e.cflags = cflags;
+    g_array_append_val(m->file->added, e);
+    tb_cache.recorded++;
+}
+
+/*
+ * Translate the TB described by @e in mapping @m, if it is safe to.
+ * Return false if the code buffer is full.
+ */
+static bool tb_cache_prefetch(CPUState *cpu, TBCacheMapping *m,
+                              const TBCacheEntry *e)
+{
+    uint32_t cflags = tb_cache.cflags;
+    uint64_t page_offset;
+    vaddr pc, page;
+
+    if (e->cflags != cflags || e->offset < m->offset ||
+        e->offset - m->offset > m->itree.last - m->itree.start) {
+        return true;
+    }
+    pc = m->itree.start + (e->offset - m->offset);
+    page = pc & TARGET_PAGE_MASK;
+    page_offset = e->offset - (pc - page);
+
+    /*
+     * A fault in this thread could not be delivered to the guest.  The TB
+     * may extend into the next page, so both pages must be executable and
+     * backed by the file (a read past its end raises SIGBUS).
+     */
+    if (m->itree.last - page < 2 * TARGET_PAGE_SIZE - 1 ||
+        page_offset > m->file->hdr.size ||
+        m->file->hdr.size - page_offset < 2 * TARGET_PAGE_SIZE ||
+        !(page_get_flags(page) & PAGE_EXEC) ||
+        !(page_get_flags(page + TARGET_PAGE_SIZE) & PAGE_EXEC)) {
+        return true;
+    }
+
+    if (tb_htable_lookup(cpu, pc, e->cs_base, e->flags, cflags)) {
+        return true;
+    }
+    /* Only the vCPU can evict or flush, see tb_gen_code(). */
+    if (!tb_gen_code(cpu, pc, e->cs_base, e->flags, cflags)) {
+        return false;
+    }
+    qemu_thread_jit_execute();
+    tb_cache.prefetched++;
+    return true;
+}
+
+static void tb_cache_drain(void)
+{
+    TBCacheMapping *m, *n;
+
+    QTAILQ_FOREACH_SAFE(m, &tb_cache.queue, entry, n) {
+        QTAILQ_REMOVE(&tb_cache.queue, m, entry);
+        m->queued = false;
+    }
+}
+
+/* Prefetch one TB; return false once the queue is empty. */
+static bool tb_cache_prefetch_one(CPUState *cpu)
+{
+    TBCacheMapping *m;
+
+    mmap_lock();
+    m = QTAILQ_FIRST(&tb_cache.queue);
+    if (m && !tcg_region_available()) {
+        /*
+         * Only a hint: a vCPU translating in a spare context takes
+         * regions without mmap_lock, so tb_gen_code() may still find
+         * the buffer full.  A guess is not worth an eviction anyway.
+         */
+        tb_cache_drain();
+        m = NULL;
+    }
+    if (m) {
+        const TBCacheEntry *e = &m->file->entries[m->next++];
+
+        if (m->next == m->file->n_entries) {
+            QTAILQ_REMOVE(&tb_cache.queue, m, entry);
+            m->queued = false;
+        }
+        if (!tb_cache_prefetch(cpu, m, e)) {
+            tb_cache_drain();
+        }
+    }
+    mmap_unlock();
+    return m != NULL;
+}
+
+static void *tb_cache_thread(void *opaque)
+{
+    CPUState *cpu = opaque;
+
+    rcu_register_thread();
+    tcg_register_thread();
+    tb_cache_prefetching = true;
+
+    while (true) {
+        qemu_sem_wait(&tb_cache.sem);
+        while (tb_cache_prefetch_one(cpu)) {
+            /* mmap_lock is dropped between TBs, for the vCPU. */
+        }
+    }
+    return NULL;
+}
+
+/*
+ * The helper must not translate with the live state of a vCPU that is
+ * running guest code meanwhile.  It gets a CPU of its own instead: the
+ * same model and configuration, and a copy of @cpu's state that nothing
+ * changes afterwards.  Code generation only depends on the flags of each
+ * entry and on the configuration; the copy is there for the translators
+ * that peek at anything else.  The copy is not in the CPU list, so that
+ * neither the gdbstub nor exclusive sections ever see it.
+ */
+static void tb_cache_snapshot(CPUState *cpu)
+{
+    if (!tb_cache.cpu) {
+        tb_cache.cpu = cpu_create(object_get_typename(OBJECT(cpu)));
+        cpu_list_remove(tb_cache.cpu);
+        cpu_reset(tb_cache.cpu);
+    }
+    tb_cache.cpu->tcg_cflags = cpu->tcg_cflags;
+    tb_cache.cpu->opaque = cpu->opaque;
+    memcpy(cpu_env(tb_cache.cpu), cpu_env(cpu), sizeof(CPUArchState));
+    tb_cache.cflags = curr_cflags(cpu);
+}
+
+void tb_cache_start(CPUState *cpu)
+{
+    QemuThread thread;
+
+    if (!tb_cache.dir) {
+        return;
+    }
+    tb_cache_snapshot(cpu);
+    qemu_thread_create(&thread, "tb-cache", tb_cache_thread, tb_cache.cpu,
+                       QEMU_THREAD_DETACHED);
+}
+
+void tb_cache_fork_end(CPUState *cpu, bool child)
+{
+    if (!child || !tb_cache.cpu) {
+        return;
+    }
+    /* The helper thread did not survive fork(), nor can its semaphore. */
+    qemu_sem_init(&tb_cache.sem, QTAILQ_EMPTY(&tb_cache.queue) ? 0 : 1);
+    tb_cache_start(cpu);
+}
+
+static guint tb_cache_entry_hash(gconstpointer p)
+{
+    const TBCacheEntry *e = p;
+
+    return qemu_xxhash6(e->offset, e->cs_base, e->flags, e->cflags);
+}
+
+static gboolean tb_cache_entry_equal(gconstpointer a, gconstpointer b)
+{
+    return !memcmp(a, b, sizeof(TBCacheEntry));
+}
+
+static void tb_cache_merge(GArray *out, GHashTable *seen,
+                           const TBCacheEntry *e, size_t n)
+{
+    for (size_t i = 0; i < n && out->len < TB_CACHE_MAX_ENTRIES; i++) {
+        if (g_hash_table_add(seen, (gpointer)&e[i])) {
+            g_array_append_val(out, e[i]);
+        }
+    }
+}
+
+static void tb_cache_write(TBCacheFile *f)
+{
+    g_autoptr(GHashTable) seen = NULL;
+    g_autoptr(GArray) out = NULL;
+    g_autoptr(GError) err = NULL;
+    g_autofree char *old = NULL;
+    TBCacheHeader *hdr;
+    gsize old_size;
+
+    seen = g_hash_table_new(tb_cache_entry_hash, tb_cache_entry_equal);
+    out = g_array_new(false, false, sizeof(TBCacheEntry));
+
+    /*
+     * Another process may have saved since we loaded: start from what is
+     * on disk now, in its order, then append what this process added.
+     */
+    if (g_file_get_contents(f->path, &old, &old_size, NULL) &&
+        tb_cache_check(f, (TBCacheHeader *)old, old_size)) {
+        tb_cache_merge(out, seen, (TBCacheEntry *)((TBCacheHeader *)old + 1),
+                       ((TBCacheHeader *)old)->n_entries);
+    } else {
+        tb_cache_merge(out, seen, f->entries, f->n_entries);
+    }
+    tb_cache_merge(out, seen, (TBCacheEntry *)f->added->data, f->added->len);
+
+    hdr = g_malloc(sizeof(*hdr) + out->len * sizeof(TBCacheEntry));
+    *hdr = f->hdr;
+    hdr->n_entries = out->len;
+    memcpy(hdr + 1, out->data, out->len * sizeof(TBCacheEntry));
+
+    /* Written to a temporary file and renamed: readers see old or new. */
+    if (g_file_set_contents(f->path, (char *)hdr,
+                            sizeof(*hdr) + out->len * sizeof(TBCacheEntry),
+                            &err)) {
+        g_array_set_size(f->added, 0);
+        trace_tb_cache_save(f->path, out->len);
+    } else {
+        warn_report_once("tb-cache: %s", err->message);
+    }
+    g_free(hdr);
+}
+
+void tb_cache_save(void)
+{
+    GHashTableIter iter;
+    TBCacheFile *f;
+
+    if (!tb_cache.dir) {
+        return;
+    }
+    mmap_lock();
+    g_hash_table_iter_init(&iter, tb_cache.files);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&f)) {
+        if (f->added->len) {
+            tb_cache_write(f);
+        }
+    }
+    trace_tb_cache_stats(tb_cache.prefetched, tb_cache.recorded);
+    mmap_unlock();
+}
@@ -32,9 +32,21 @@ struct TBContext {
 
     struct qht htable;
 
+    /*
+     * user-mode: bumped under mmap_lock by every invalidation of a range,
+     * so that a translation done without the lock can tell that its
+     * source may have changed meanwhile.
+     */
+    unsigned tb_inval_gen;
+
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tb_evict_count;        /* regions recycled by tb_reclaim() */
+    unsigned tb_evict_tb_count;     /* TBs dropped by those evictions */
+    unsigned tb_retranslate_count;  /* TBs translated again after a drop */
+    unsigned tb_tier_up_count;      /* hot TBs retranslated as tier 2 */
+    unsigned tb_trace_jmp_count;    /* branches folded into tier-2 TBs */
 };
 
 extern TBContext tb_ctx;
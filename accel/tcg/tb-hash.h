@@ -29,11 +29,12 @@
 
 /* Only the bottom TB_JMP_PAGE_BITS of the jump cache hash bits vary for
    addresses on the same page.  The top bits are the same.  This allows
-   TLB invalidation to quickly clear a subset of the hash table.  */
+   TLB invalidation to quickly clear a subset of the hash table.  The
+   hash selects a set of TB_JMP_CACHE_WAYS entries.  */
 #define TB_JMP_PAGE_BITS (TB_JMP_CACHE_BITS / 2)
 #define TB_JMP_PAGE_SIZE (1 << TB_JMP_PAGE_BITS)
 #define TB_JMP_ADDR_MASK (TB_JMP_PAGE_SIZE - 1)
-#define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SIZE - TB_JMP_PAGE_SIZE)
+#define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SETS - TB_JMP_PAGE_SIZE)
 
 static inline unsigned int tb_jmp_cache_hash_page(vaddr pc)
 {
@@ -55,7 +56,7 @@ static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
 /* In user-mode we can get better hashing because we do not have a TLB */
 static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
 {
-    return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
+    return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SETS - 1);
 }
 
 #endif /* CONFIG_SOFTMMU */
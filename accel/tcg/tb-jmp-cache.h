@@ -12,8 +12,19 @@
 #include "qemu/rcu.h"
 #include "exec/cpu-common.h"
 
-#define TB_JMP_CACHE_BITS 12
-#define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+/*
+ * The cache is set-associative: the hash selects one of the
+ * TB_JMP_CACHE_SETS sets, whose TB_JMP_CACHE_WAYS entries are adjacent
+ * in memory, so that a lookup scans a single host cache line.
+ */
+#define TB_JMP_CACHE_BITS 11
+#define TB_JMP_CACHE_WAYS 4
+#define TB_JMP_CACHE_SETS (1 << TB_JMP_CACHE_BITS)
+#define TB_JMP_CACHE_SIZE (TB_JMP_CACHE_SETS * TB_JMP_CACHE_WAYS)
+
+/* Indirect branch target cache, indexed by the TB ending in the branch. */
+#define TB_IBTC_BITS 9
+#define TB_IBTC_SIZE (1 << TB_IBTC_BITS)
 
 /*
  * Invalidated in parallel; all accesses to 'tb' must be atomic.
@@ -22,12 +33,72 @@
  * non-NULL value of 'tb'.  Strictly speaking pc is only needed for
  * CF_PCREL, but it's used always for simplicity.
  */
+typedef struct CPUJumpCacheEntry {
+    TranslationBlock *tb;
+    vaddr pc;
+} CPUJumpCacheEntry;
+
+/*
+ * An ibtc entry remembers where the indirect branch at the end of @src
+ * went last time.  Per-TB invalidation does not look for the entries
+ * (their index depends on @src, not on the target): a hit relies on the
+ * cflags comparison to reject a CF_INVALID 'tb'.  The entries are cleared
+ * along with the jump cache whenever TBs may be freed or the virtual
+ * mapping changes.
+ */
+typedef struct CPUIndirectCacheEntry {
+    const TranslationBlock *src;
+    TranslationBlock *tb;
+    vaddr pc;
+} CPUIndirectCacheEntry;
+
 typedef struct CPUJumpCache {
     struct rcu_head rcu;
-    struct {
-        TranslationBlock *tb;
-        vaddr pc;
-    } array[TB_JMP_CACHE_SIZE];
+    /* Round-robin replacement within a full set. */
+    unsigned victim;
+    /* Written by the owning CPU only, read by "info jit". */
+    size_t ibtc_hits;
+    size_t hits;
+    size_t misses;
+    /* Executions of tier-1 TBs on this CPU, by TB tier_slot. */
+    uint32_t *tier_counts;
+    CPUJumpCacheEntry array[TB_JMP_CACHE_SIZE]
+        QEMU_ALIGNED(sizeof(CPUJumpCacheEntry) * TB_JMP_CACHE_WAYS);
+    CPUIndirectCacheEntry ibtc[TB_IBTC_SIZE];
 } CPUJumpCache;
 
+static inline CPUJumpCacheEntry *tb_jmp_cache_set(CPUJumpCache *jc,
+                                                  uint32_t hash)
+{
+    return &jc->array[hash * TB_JMP_CACHE_WAYS];
+}
+
+static inline CPUIndirectCacheEntry *tb_ibtc_entry(CPUJumpCache *jc,
+                                                   const void *src)
+{
+    uintptr_t h = (uintptr_t)src;
+
+    /* TranslationBlocks are more than 64 bytes apart. */
+    return &jc->ibtc[(h >> 6 ^ h >> (6 + TB_IBTC_BITS)) & (TB_IBTC_SIZE - 1)];
+}
+
+/* Called by the owning CPU, after a miss. */
+static inline void tb_jmp_cache_insert(CPUJumpCache *jc, uint32_t hash,
+                                       vaddr pc, TranslationBlock *tb)
+{
+    CPUJumpCacheEntry *set = tb_jmp_cache_set(jc, hash);
+    int i;
+
+    for (i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+        if (qatomic_read(&set[i].tb) == NULL) {
+            break;
+        }
+    }
+    if (i == TB_JMP_CACHE_WAYS) {
+        i = jc->victim++ % TB_JMP_CACHE_WAYS;
+    }
+    set[i].pc = pc;
+    qatomic_set(&set[i].tb, tb);
+}
+
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
@@ -32,6 +32,7 @@
 #include "tb-context.h"
 #include "internal-common.h"
 #include "internal-target.h"
+#include "trace.h"
 
 
 /* List iterators for lists of tagged pointers in TranslationBlock. */
@@ -51,7 +52,8 @@ static bool tb_cmp(const void *ap, const void *bp)
     return ((tb_cflags(a) & CF_PCREL || a->pc == b->pc) &&
             a->cs_base == b->cs_base &&
             a->flags == b->flags &&
-            (tb_cflags(a) & ~CF_INVALID) == (tb_cflags(b) & ~CF_INVALID) &&
+            (tb_lookup_cflags(a) & ~CF_INVALID) ==
+            (tb_lookup_cflags(b) & ~CF_INVALID) &&
             tb_page_addr0(a) == tb_page_addr0(b) &&
             tb_page_addr1(a) == tb_page_addr1(b));
 }
@@ -755,6 +757,36 @@ static void tb_remove(TranslationBlock *tb)
 }
 #endif /* CONFIG_USER_ONLY */
 
+/*
+ * Approximate set of the TB hashes dropped by a flush or an eviction, so
+ * that tb_link_page() can count retranslations.  Collisions only make the
+ * count slightly pessimistic.
+ */
+#define TB_DROPPED_BITS 16
+static unsigned long tb_dropped_map[BITS_TO_LONGS(1 << TB_DROPPED_BITS)];
+
+static inline void tb_note_dropped(uint32_t h)
+{
+    set_bit_atomic(h & ((1 << TB_DROPPED_BITS) - 1), tb_dropped_map);
+}
+
+static inline void tb_note_linked(uint32_t h)
+{
+    unsigned long bit = h & ((1 << TB_DROPPED_BITS) - 1);
+    unsigned long *p = &tb_dropped_map[BIT_WORD(bit)];
+    unsigned long mask = BIT_MASK(bit);
+
+    if (unlikely(qatomic_read(p) & mask) &&
+        (qatomic_fetch_and(p, ~mask) & mask)) {
+        qatomic_inc(&tb_ctx.tb_retranslate_count);
+    }
+}
+
+static void tb_note_dropped_iter(void *p, uint32_t h, void *userp)
+{
+    tb_note_dropped(h);
+}
+
 /* flush all the translation blocks */
 static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 {
@@ -771,8 +803,10 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
         tcg_flush_jmp_cache(cpu);
     }
 
+    qht_iter(&tb_ctx.htable, tb_note_dropped_iter, NULL);
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     tb_remove_all();
+    tb_tier_reset();
 
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is expensive */
@@ -888,10 +922,12 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
         uint32_t h = tb_jmp_cache_hash_func(tb->pc);
 
         CPU_FOREACH(cpu) {
-            CPUJumpCache *jc = cpu->tb_jmp_cache;
+            CPUJumpCacheEntry *set = tb_jmp_cache_set(cpu->tb_jmp_cache, h);
 
-            if (qatomic_read(&jc->array[h].tb) == tb) {
-                qatomic_set(&jc->array[h].tb, NULL);
+            for (int i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+                if (qatomic_read(&set[i].tb) == tb) {
+                    qatomic_set(&set[i].tb, NULL);
+                }
             }
         }
     }
@@ -901,8 +937,10 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
  * In user-mode, call with mmap_lock held.
  * In !user-mode, if @rm_from_page_list is set, call with the TB's pages'
  * locks held.
+ * With @evict, the caller takes care of the jump caches (see do_tb_evict).
  */
-static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
+static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list,
+                                  bool evict)
 {
     uint32_t h;
     tb_page_addr_t phys_pc;
@@ -914,11 +952,12 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     qemu_spin_lock(&tb->jmp_lock);
     qatomic_set(&tb->cflags, tb->cflags | CF_INVALID);
     qemu_spin_unlock(&tb->jmp_lock);
+    tb_tier_release(tb);
 
     /* remove the TB from the hash list */
     phys_pc = tb_page_addr0(tb);
     h = tb_hash_func(phys_pc, (orig_cflags & CF_PCREL ? 0 : tb->pc),
-                     tb->flags, tb->cs_base, orig_cflags);
+                     tb->flags, tb->cs_base, orig_cflags & ~CF_TIER2);
     if (!qht_remove(&tb_ctx.htable, tb, h)) {
         return;
     }
@@ -929,7 +968,9 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     }
 
     /* remove the TB from the hash list */
-    tb_jmp_cache_inval_tb(tb);
+    if (!evict) {
+        tb_jmp_cache_inval_tb(tb);
+    }
 
     /* suppress this TB from the two jump lists */
     tb_remove_from_jmp_list(tb, 0);
@@ -938,14 +979,19 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     /* suppress any remaining jumps to this TB */
     tb_jmp_unlink(tb);
 
-    qatomic_set(&tb_ctx.tb_phys_invalidate_count,
-                tb_ctx.tb_phys_invalidate_count + 1);
+    if (evict) {
+        tb_note_dropped(h);
+        qatomic_set(&tb_ctx.tb_evict_tb_count, tb_ctx.tb_evict_tb_count + 1);
+    } else {
+        qatomic_set(&tb_ctx.tb_phys_invalidate_count,
+                    tb_ctx.tb_phys_invalidate_count + 1);
+    }
 }
 
 static void tb_phys_invalidate__locked(TranslationBlock *tb)
 {
     qemu_thread_jit_write();
-    do_tb_phys_invalidate(tb, true);
+    do_tb_phys_invalidate(tb, true, false);
     qemu_thread_jit_execute();
 }
 
@@ -957,10 +1003,132 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 {
     if (page_addr == -1 && tb_page_addr0(tb) != -1) {
         tb_lock_pages(tb);
-        do_tb_phys_invalidate(tb, true);
+        do_tb_phys_invalidate(tb, true, false);
+        tb_unlock_pages(tb);
+    } else {
+        do_tb_phys_invalidate(tb, false, false);
+    }
+}
+
+static gboolean tb_evict_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+
+    if (tb_page_addr0(tb) != -1) {
+        tb_lock_pages(tb);
+        do_tb_phys_invalidate(tb, true, true);
         tb_unlock_pages(tb);
     } else {
-        do_tb_phys_invalidate(tb, false);
+        do_tb_phys_invalidate(tb, false, true);
+    }
+    return false;
+}
+
+/*
+ * Make room in the code buffer by recycling its coldest regions, see
+ * tcg_region_evict().  Hot TBs, and the jumps chained between them, survive;
+ * fall back to a full flush if no region can be recycled.
+ */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    CPUState *other;
+    size_t n;
+
+    mmap_lock();
+    /* A flush or another eviction may have made room in the meantime. */
+    if (tb_ctx.tb_flush_count != tb_flush_count.host_int ||
+        tcg_region_available()) {
+        mmap_unlock();
+        return;
+    }
+
+    /* The jump caches hold what each vCPU ran last: sample them as hot. */
+    CPU_FOREACH(other) {
+        CPUJumpCache *jc = other->tb_jmp_cache;
+
+        if (jc) {
+            for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+                TranslationBlock *tb = qatomic_read(&jc->array[i].tb);
+
+                if (tb) {
+                    tcg_region_sample(tb->tc.ptr);
+                }
+            }
+        }
+    }
+
+    qemu_thread_jit_write();
+    n = tcg_region_evict(tb_evict_iter, NULL);
+    qemu_thread_jit_execute();
+    trace_tb_evict(cpu->cpu_index, n);
+
+    if (n == 0) {
+        mmap_unlock();
+        do_tb_flush(cpu, tb_flush_count);
+        return;
+    }
+
+    /* Drop the jump cache entries of the evicted TBs, and only those. */
+    CPU_FOREACH(other) {
+        CPUJumpCache *jc = other->tb_jmp_cache;
+
+        if (jc) {
+            for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+                TranslationBlock *tb = qatomic_read(&jc->array[i].tb);
+
+                if (tb && (tb_cflags(tb) & CF_INVALID)) {
+                    qatomic_set(&jc->array[i].tb, NULL);
+                }
+            }
+            /* The branch TB of an entry may have been evicted as well. */
+            for (int i = 0; i < TB_IBTC_SIZE; i++) {
+                TranslationBlock *tb = qatomic_read(&jc->ibtc[i].tb);
+
+                if (tb && ((tb_cflags(tb) & CF_INVALID) ||
+                           (tb_cflags(jc->ibtc[i].src) & CF_INVALID))) {
+                    qatomic_set(&jc->ibtc[i].tb, NULL);
+                }
+            }
+        }
+    }
+    qatomic_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + n);
+    mmap_unlock();
+}
+
+void tb_reclaim(CPUState *cpu)
+{
+    unsigned tb_flush_count = qatomic_read(&tb_ctx.tb_flush_count);
+
+    if (cpu_in_serial_context(cpu)) {
+        do_tb_evict(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict,
+                              RUN_ON_CPU_HOST_INT(tb_flush_count));
+    }
+}
+
+/*
+ * Keep the most used globals in host registers, see tcg_pin_select().
+ * Chained TBs pass the pinned registers along, so all of them must be
+ * translated with the same selection: flush the ones translated before.
+ */
+static void do_tb_pin(CPUState *cpu, run_on_cpu_data data)
+{
+    unsigned flush_count;
+
+    mmap_lock();
+    tcg_pin_select();
+    mmap_unlock();
+    flush_count = qatomic_read(&tb_ctx.tb_flush_count);
+    do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(flush_count));
+}
+
+void tb_pin_select(CPUState *cpu)
+{
+    if (cpu_in_serial_context(cpu)) {
+        do_tb_pin(cpu, RUN_ON_CPU_NULL);
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_pin, RUN_ON_CPU_NULL);
     }
 }
 
@@ -969,8 +1137,8 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
  * Called with mmap_lock held for user-mode emulation.
  *
  * Returns a pointer @tb, or a pointer to an existing TB that matches @tb.
- * Note that in !user-mode, another thread might have already added a TB
- * for the same block of guest code that @tb corresponds to. In that case,
+ * Note that another thread might have already added a TB for the same
+ * block of guest code that @tb corresponds to. In that case,
  * the caller should discard the original @tb, and use instead the returned TB.
  */
 TranslationBlock *tb_link_page(TranslationBlock *tb)
@@ -985,7 +1153,7 @@ TranslationBlock *tb_link_page(TranslationBlock *tb)
 
     /* add in the hash table */
     h = tb_hash_func(tb_page_addr0(tb), (tb->cflags & CF_PCREL ? 0 : tb->pc),
-                     tb->flags, tb->cs_base, tb->cflags);
+                     tb->flags, tb->cs_base, tb_lookup_cflags(tb));
     qht_insert(&tb_ctx.htable, tb, h, &existing_tb);
 
     /* remove TB from the page(s) if we couldn't insert it */
@@ -994,6 +1162,7 @@ TranslationBlock *tb_link_page(TranslationBlock *tb)
         tb_unlock_pages(tb);
         return existing_tb;
     }
+    tb_note_linked(h);
 
     tb_unlock_pages(tb);
     return tb;
@@ -1012,6 +1181,7 @@ void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t last)
 
     assert_memory_lock();
 
+    tb_ctx.tb_inval_gen++;
     PAGE_FOR_EACH_TB(start, last, unused, tb, n) {
         tb_phys_invalidate__locked(tb);
     }
@@ -1061,6 +1231,7 @@ bool tb_invalidate_phys_page_unwind(tb_page_addr_t addr, uintptr_t pc)
     assert_memory_lock();
     current_tb = tcg_tb_lookup(pc);
 
+    tb_ctx.tb_inval_gen++;
     last = addr | ~TARGET_PAGE_MASK;
     addr &= TARGET_PAGE_MASK;
     current_tb_modified = false;
@@ -0,0 +1,165 @@
+/*
+ * Sampling profiler for translated code
+ *
+ * A timer asks every running vCPU to leave its chain of translation
+ * blocks; the vCPU then counts the guest address of the block it was
+ * about to enter.  This needs no guest instrumentation and costs one
+ * TB exit per sample, at the price of attributing a sample to the block
+ * following the one that was running when the timer fired.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "qapi/type-helpers.h"
+#include "qapi/qapi-commands-machine.h"
+#include "disas/disas.h"
+#include "hw/core/cpu.h"
+#include "sysemu/tcg.h"
+#include "internal-common.h"
+
+#define TB_PROFILE_DEFAULT_FREQ 1000
+#define TB_PROFILE_MAX_FREQ     10000
+
+typedef struct TBProfileEntry {
+    vaddr pc;
+    uint64_t samples;
+} TBProfileEntry;
+
+static QemuMutex tb_profile_lock;
+/* Guest address -> TBProfileEntry, protected by tb_profile_lock. */
+static GHashTable *tb_profile_hist;
+static QEMUTimer *tb_profile_timer;
+static int64_t tb_profile_period;
+
+static void tb_profile_tick(void *opaque)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (cpu->halted) {
+            continue;
+        }
+        qatomic_set(&cpu->tb_profile_request, true);
+        /* As cpu_exit(), without leaving cpu_exec(). */
+        smp_wmb();
+        qatomic_set(&cpu->neg.icount_decr.u16.high, -1);
+    }
+    timer_mod(tb_profile_timer,
+              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + tb_profile_period);
+}
+
+void tb_profile_sample(CPUState *cpu, vaddr pc)
+{
+    TBProfileEntry *e;
+
+    qatomic_set(&cpu->tb_profile_request, false);
+
+    qemu_mutex_lock(&tb_profile_lock);
+    if (tb_profile_hist) {
+        e = g_hash_table_lookup(tb_profile_hist, &pc);
+        if (!e) {
+            e = g_new0(TBProfileEntry, 1);
+            e->pc = pc;
+            g_hash_table_insert(tb_profile_hist, &e->pc, e);
+        }
+        e->samples++;
+    }
+    qemu_mutex_unlock(&tb_profile_lock);
+}
+
+void qmp_x_jit_profile(bool enable, bool has_frequency, uint32_t frequency,
+                       Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_setg(errp, "JIT profiling is only available with accel=tcg");
+        return;
+    }
+    if (!has_frequency) {
+        frequency = TB_PROFILE_DEFAULT_FREQ;
+    } else if (frequency == 0 || frequency > TB_PROFILE_MAX_FREQ) {
+        error_setg(errp, "frequency must be between 1 and %d",
+                   TB_PROFILE_MAX_FREQ);
+        return;
+    }
+
+    if (!tb_profile_timer) {
+        qemu_mutex_init(&tb_profile_lock);
+        tb_profile_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                        tb_profile_tick, NULL);
+    }
+    if (!enable) {
+        timer_del(tb_profile_timer);
+        return;
+    }
+
+    qemu_mutex_lock(&tb_profile_lock);
+    if (tb_profile_hist) {
+        g_hash_table_remove_all(tb_profile_hist);
+    } else {
+        tb_profile_hist = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                                NULL, g_free);
+    }
+    qemu_mutex_unlock(&tb_profile_lock);
+
+    tb_profile_period = NANOSECONDS_PER_SECOND / frequency;
+    timer_mod(tb_profile_timer,
+              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + tb_profile_period);
+}
+
+static gint tb_profile_cmp(gconstpointer a, gconstpointer b)
+{
+    const TBProfileEntry *ea = *(const TBProfileEntry **)a;
+    const TBProfileEntry *eb = *(const TBProfileEntry **)b;
+
+    if (ea->samples != eb->samples) {
+        return ea->samples > eb->samples ? -1 : 1;
+    }
+    return ea->pc < eb->pc ? -1 : ea->pc > eb->pc;
+}
+
+HumanReadableText *qmp_x_query_jit_profile(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    g_autoptr(GPtrArray) entries = NULL;
+    GHashTableIter iter;
+    TBProfileEntry *e;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "JIT profiling is only available with accel=tcg");
+        return NULL;
+    }
+    if (!tb_profile_hist) {
+        error_setg(errp, "JIT profiling was never enabled");
+        return NULL;
+    }
+
+    /*
+     * Copy the entries out so that symbol lookups do not hold up
+     * the vCPUs.
+     */
+    entries = g_ptr_array_new_with_free_func(g_free);
+    qemu_mutex_lock(&tb_profile_lock);
+    g_hash_table_iter_init(&iter, tb_profile_hist);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&e)) {
+        g_ptr_array_add(entries, g_memdup2(e, sizeof(*e)));
+    }
+    qemu_mutex_unlock(&tb_profile_lock);
+    g_ptr_array_sort(entries, tb_profile_cmp);
+
+    /* Folded stacks: the function, then the translation block. */
+    for (guint i = 0; i < entries->len; i++) {
+        const char *sym;
+
+        e = g_ptr_array_index(entries, i);
+        sym = lookup_symbol(e->pc);
+
+        g_string_append_printf(buf, "%s;0x%" VADDR_PRIx " %" PRIu64 "\n",
+                               *sym ? sym : "[unknown]", e->pc, e->samples);
+    }
+
+    return human_readable_text_from_str(buf);
+}
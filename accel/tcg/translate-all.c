@@ -283,7 +283,120 @@ static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
     return tcg_gen_code(tcg_ctx, tb, pc);
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
+/*
+ * Tiered translation (-accel tcg,tier-threshold=N).
+ *
+ * A tier-1 TB counts its executions in one slot of the tier_counts[]
+ * array of the CPU running it, outside the code buffer so that the
+ * increment never dirties a page holding host code.  Each CPU only
+ * writes its own counts, so the plain load/add/store loses nothing
+ * under MTTCG; a TB is hot once it is hot on one CPU.
+ *
+ * The TB compares the count with tb_tier_threshold itself, so that it
+ * is noticed whichever way the TB was entered, chained jumps included:
+ * on reaching it, the TB leaves before its first instruction as if an
+ * exit had been requested.  The execution loop then calls tb_tier_up(),
+ * which replaces the TB with a CF_TIER2 translation under the same
+ * lookup key.  Tier-2 TBs are not counted; the front end may follow
+ * direct branches into them (see translator_trace_jump()), so that the
+ * optimizer and the register allocator see a forward path through
+ * several basic blocks instead of one.  Only Arm does so far, and there
+ * are no loop traces: elsewhere the tier-2 TB is the tier-1 TB again.
+ *
+ * Slots are handed out round-robin once a TB is linked.  When they wrap,
+ * the previous owner of a slot loses it: its tb->tier_slot drops to 0,
+ * a sink that never makes a TB hot.  The generated code reads
+ * tb->tier_slot on each execution, so a stale TB never counts into the
+ * slot of another.
+ */
+unsigned tb_tier_threshold;
+static TranslationBlock **tb_tier_owners;
+static unsigned tb_tier_next;
+
+void tb_tier_init(unsigned threshold)
+{
+    if (threshold) {
+        tb_tier_owners = g_new0(TranslationBlock *, TB_TIER_SLOTS);
+        tb_tier_threshold = threshold;
+    }
+}
+
+bool tb_tier_counted(uint32_t cflags)
+{
+    /* icount has subtracted the TB's instructions before the check. */
+    return tb_tier_threshold &&
+           !(cflags & (CF_TIER2 | CF_COUNT_MASK | CF_NOIRQ | CF_SINGLE_STEP |
+                       CF_USE_ICOUNT));
+}
+
+/* Give the newly linked @tb a counter, taking it from its previous owner. */
+static void tb_tier_assign(TranslationBlock *tb)
+{
+    TranslationBlock *old;
+    CPUState *cpu;
+    uint32_t slot;
+
+    do {
+        slot = qatomic_fetch_inc(&tb_tier_next) & (TB_TIER_SLOTS - 1);
+    } while (slot == 0);
+
+    old = qatomic_xchg(&tb_tier_owners[slot], tb);
+    if (old) {
+        qatomic_set(&old->tier_slot, 0);
+    }
+    /*
+     * A CPU still running @old may count once more into the slot after
+     * this; @tb then tiers up one execution early.
+     */
+    WITH_RCU_READ_LOCK_GUARD() {
+        CPU_FOREACH(cpu) {
+            qatomic_set(&cpu->tb_jmp_cache->tier_counts[slot], 0);
+        }
+    }
+    qatomic_set(&tb->tier_slot, slot);
+}
+
+/* @tb is being invalidated: its TranslationBlock may be freed after this. */
+void tb_tier_release(TranslationBlock *tb)
+{
+    uint32_t slot = qatomic_read(&tb->tier_slot);
+
+    if (slot) {
+        qatomic_cmpxchg(&tb_tier_owners[slot], tb, NULL);
+        qatomic_set(&tb->tier_slot, 0);
+    }
+}
+
+/* All TBs are gone.  Called from an exclusive context. */
+void tb_tier_reset(void)
+{
+    if (tb_tier_owners) {
+        memset(tb_tier_owners, 0, TB_TIER_SLOTS * sizeof(*tb_tier_owners));
+    }
+}
+
+/*
+ * Replace the hot tier-1 @tb with its tier-2 translation.
+ * Called with mmap_lock held for user mode emulation.
+ */
+TranslationBlock *tb_tier_up(CPUState *cpu, TranslationBlock *tb, vaddr pc,
+                             uint64_t cs_base, uint32_t flags, int cflags)
+{
+    qemu_thread_jit_write();
+    tb_phys_invalidate(tb, -1);
+    qatomic_inc(&tb_ctx.tb_tier_up_count);
+    return tb_gen_code(cpu, pc, cs_base, flags, cflags | CF_TIER2);
+}
+
+/*
+ * Called with mmap_lock held for user mode emulation; the lock may be
+ * dropped and taken again while generating code.
+ *
+ * When the code buffer is full, the vCPU evicts or flushes and leaves
+ * through cpu_loop_exit().  A thread translating on behalf of a vCPU
+ * other than its own (@cpu != current_cpu) can do neither: it gets NULL
+ * instead, with the lock still held.
+ */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               vaddr pc, uint64_t cs_base,
                               uint32_t flags, int cflags)
@@ -295,12 +408,24 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     int gen_code_size, search_size, max_insns;
     int64_t ti;
     void *host_pc;
+    unsigned inval_gen = 0;
+    bool parallel;
 
     assert_memory_lock();
     qemu_thread_jit_write();
 
     phys_pc = get_page_addr_code_hostp(env, pc, &host_pc);
 
+    /*
+     * In user-mode, a vCPU thread (which flushes and evictions wait for,
+     * since they run in an exclusive context) can generate code into a
+     * spare context of its own without holding mmap_lock.  The pages are
+     * protected before the lock is dropped, so any change to the guest
+     * code meanwhile goes through an invalidation, and is noticed before
+     * linking the TB.
+     */
+    parallel = cpu == current_cpu && tcg_ctx_borrow();
+
     if (phys_pc == -1) {
         /* Generate a one-shot TB with 1 insn in it */
         cflags = (cflags & ~CF_COUNT_MASK) | 1;
@@ -316,8 +441,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     assert_no_pages_locked();
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        tcg_ctx_return();
+        if (cpu != current_cpu) {
+            return NULL;
+        }
+        /* evict cold regions, or flush */
+        tb_reclaim(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -332,6 +461,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
+    tb->tier_slot = 0;
     tb_set_page_addr0(tb, phys_pc);
     tb_set_page_addr1(tb, -1);
     if (phys_pc != -1) {
@@ -352,6 +482,11 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tcg_ctx->guest_mo = TCG_MO_ALL;
 #endif
 
+    if (parallel) {
+        inval_gen = tb_ctx.tb_inval_gen;
+        mmap_unlock();
+    }
+
  restart_translate:
     trace_translate_block(tb, pc, tb->tc.ptr);
 
@@ -373,6 +508,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                           "code_gen_buffer overflow\n");
             tb_unlock_pages(tb);
             tcg_ctx->gen_tb = NULL;
+            if (parallel) {
+                mmap_lock();
+            }
             goto buffer_overflow;
 
         case -2:
@@ -422,6 +560,22 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tcg_ctx->gen_tb = NULL;
 
     search_size = encode_search(tb, (void *)gen_code_buf + gen_code_size);
+
+    if (parallel) {
+        mmap_lock();
+        if (unlikely(inval_gen != tb_ctx.tb_inval_gen)) {
+            /*
+             * The guest code may have been written, unmapped or had its
+             * protection changed while translating: start over, this
+             * time under the lock.
+             */
+            tb_unlock_pages(tb);
+            tcg_ctx_return();
+            parallel = false;
+            phys_pc = get_page_addr_code_hostp(env, pc, &host_pc);
+            goto buffer_overflow;
+        }
+    }
     if (unlikely(search_size < 0)) {
         tb_unlock_pages(tb);
         goto buffer_overflow;
@@ -534,6 +688,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
      */
     if (tb_page_addr0(tb) == -1) {
         assert_no_pages_locked();
+        tcg_ctx_return();
         return tb;
     }
 
@@ -558,8 +713,16 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
         qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
         tcg_tb_remove(tb);
+        tcg_ctx_return();
         return existing_tb;
     }
+    tcg_ctx_return();
+    if (tb_tier_counted(tb_cflags(tb))) {
+        tb_tier_assign(tb);
+    }
+#ifdef CONFIG_USER_ONLY
+    tb_cache_record(cpu, pc, cs_base, flags, cflags);
+#endif
     return tb;
 }
 
@@ -662,4 +825,7 @@ void tcg_flush_jmp_cache(CPUState *cpu)
     for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
         qatomic_set(&jc->array[i].tb, NULL);
     }
+    for (int i = 0; i < TB_IBTC_SIZE; i++) {
+        qatomic_set(&jc->ibtc[i].tb, NULL);
+    }
 }
@@ -16,7 +16,9 @@
 #include "exec/plugin-gen.h"
 #include "exec/cpu_ldst.h"
 #include "tcg/tcg-op-common.h"
+#include "internal-common.h"
 #include "internal-target.h"
+#include "tb-context.h"
 #include "disas/disas.h"
 
 static void set_can_do_io(DisasContextBase *db, bool val)
@@ -113,6 +115,63 @@ bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
     return ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
 }
 
+bool translator_trace_jump(DisasContextBase *db, vaddr dest)
+{
+    uint32_t cflags = tb_cflags(db->tb);
+
+    if (!(cflags & CF_TIER2) || (cflags & (CF_NO_GOTO_TB | CF_SINGLE_STEP))) {
+        return false;
+    }
+    /* Plugins expect the instructions of a TB to be contiguous. */
+    if (db->plugin_enabled) {
+        return false;
+    }
+    /*
+     * Only forward within the first page: [pc_first, pc_next) must keep
+     * covering every instruction of the TB for invalidation.
+     */
+    if (dest < db->pc_next || ((db->pc_first ^ dest) & TARGET_PAGE_MASK)) {
+        return false;
+    }
+    if (db->num_insns >= db->max_insns) {
+        return false;
+    }
+    db->pc_next = dest;
+    qatomic_inc(&tb_ctx.tb_trace_jmp_count);
+    return true;
+}
+
+/*
+ * Count one execution of a tier-1 TB on this CPU, and leave through
+ * the exit request path when it becomes hot, see tb_tier_up().  The slot
+ * is loaded from the TB each time because it is assigned only once the
+ * TB is linked, and may be taken away for another TB later.  Leaving
+ * only when the count equals the threshold, rather than from then on,
+ * keeps the 0 sink slot from making TBs leave on every execution.
+ */
+static void gen_tier_count(const TranslationBlock *tb)
+{
+    TCGv_i32 slot = tcg_temp_new_i32();
+    TCGv_ptr ptr = tcg_temp_new_ptr();
+    TCGv_ptr counts = tcg_temp_new_ptr();
+    TCGv_i32 count = tcg_temp_new_i32();
+
+    tcg_gen_ld_i32(slot, tcg_constant_ptr(tb),
+                   offsetof(TranslationBlock, tier_slot));
+    tcg_gen_shli_i32(slot, slot, 2);
+    tcg_gen_ext_i32_ptr(ptr, slot);
+    tcg_gen_ld_ptr(counts, tcg_env,
+                   offsetof(ArchCPU, parent_obj.tb_jmp_cache)
+                   - offsetof(ArchCPU, env));
+    tcg_gen_ld_ptr(counts, counts, offsetof(CPUJumpCache, tier_counts));
+    tcg_gen_add_ptr(ptr, ptr, counts);
+    tcg_gen_ld_i32(count, ptr, 0);
+    tcg_gen_addi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, 0);
+    tcg_gen_brcondi_i32(TCG_COND_EQ, count, tb_tier_threshold,
+                        tcg_ctx->exitreq_label);
+}
+
 void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
                      vaddr pc, void *host_pc, const TranslatorOps *ops,
                      DisasContextBase *db)
@@ -141,6 +200,9 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
 
     /* Start translating.  */
     icount_start_insn = gen_tb_start(db, cflags);
+    if (tb_tier_counted(cflags)) {
+        gen_tier_count(tb);
+    }
     ops->tb_start(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
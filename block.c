@@ -422,6 +422,7 @@ BlockDriverState *bdrv_new(void)
     }
     qemu_mutex_init(&bs->reqs_lock);
     qemu_mutex_init(&bs->dirty_bitmap_mutex);
+    seqlock_init(&bs->dirty_known_seqlock);
     bs->refcnt = 1;
     bs->aio_context = qemu_get_aio_context();
 
@@ -29,6 +29,7 @@
 #include "block/blockjob.h"
 #include "block/dirty-bitmap.h"
 #include "qemu/main-loop.h"
+#include "qemu/range.h"
 
 struct BdrvDirtyBitmap {
     BlockDriverState *bs;
@@ -81,6 +82,32 @@ void bdrv_dirty_bitmap_unlock(BdrvDirtyBitmap *bitmap)
     bdrv_dirty_bitmaps_unlock(bitmap->bs);
 }
 
+/*
+ * Stop assuming that the range [offset, offset + bytes) is dirty in all
+ * enabled bitmaps of @bs.  Must be called, with the dirty_bitmap_mutex
+ * held, before clearing bits or enabling a bitmap that may lack them.
+ */
+static void bdrv_dirty_known_forget(BlockDriverState *bs,
+                                    int64_t offset, int64_t bytes)
+{
+    int64_t start = bs->dirty_known_start;
+    int64_t end = bs->dirty_known_end;
+
+    if (start == end || !ranges_overlap(offset, bytes, start, end - start)) {
+        return;
+    }
+
+    seqlock_write_begin(&bs->dirty_known_seqlock);
+    qatomic_set_i64(&bs->dirty_known_start, 0);
+    qatomic_set_i64(&bs->dirty_known_end, 0);
+    seqlock_write_end(&bs->dirty_known_seqlock);
+}
+
+static void bdrv_dirty_known_forget_all(BlockDriverState *bs)
+{
+    bdrv_dirty_known_forget(bs, 0, INT64_MAX);
+}
+
 /* Called with BQL or dirty_bitmap lock taken.  */
 BdrvDirtyBitmap *bdrv_find_dirty_bitmap(BlockDriverState *bs, const char *name)
 {
@@ -129,6 +156,7 @@ BdrvDirtyBitmap *bdrv_create_dirty_bitmap(BlockDriverState *bs,
     bitmap->name = g_strdup(name);
     bitmap->disabled = false;
     bdrv_dirty_bitmaps_lock(bs);
+    bdrv_dirty_known_forget_all(bs);
     QLIST_INSERT_HEAD(&bs->dirty_bitmaps, bitmap, list);
     bdrv_dirty_bitmaps_unlock(bs);
     return bitmap;
@@ -241,6 +269,9 @@ int bdrv_dirty_bitmap_create_successor(BdrvDirtyBitmap *bitmap, Error **errp)
 
 void bdrv_enable_dirty_bitmap_locked(BdrvDirtyBitmap *bitmap)
 {
+    if (bitmap->disabled) {
+        bdrv_dirty_known_forget_all(bitmap->bs);
+    }
     bitmap->disabled = false;
 }
 
@@ -343,6 +374,7 @@ void bdrv_dirty_bitmap_truncate(BlockDriverState *bs, int64_t bytes)
     BdrvDirtyBitmap *bitmap;
 
     bdrv_dirty_bitmaps_lock(bs);
+    bdrv_dirty_known_forget_all(bs);
     QLIST_FOREACH(bitmap, &bs->dirty_bitmaps, list) {
         assert(!bdrv_dirty_bitmap_busy(bitmap));
         assert(!bdrv_dirty_bitmap_has_successor(bitmap));
@@ -560,6 +592,7 @@ void bdrv_reset_dirty_bitmap_locked(BdrvDirtyBitmap *bitmap,
                                     int64_t offset, int64_t bytes)
 {
     assert(!bdrv_dirty_bitmap_readonly(bitmap));
+    bdrv_dirty_known_forget(bitmap->bs, offset, bytes);
     hbitmap_reset(bitmap->bitmap, offset, bytes);
 }
 
@@ -576,6 +609,7 @@ void bdrv_clear_dirty_bitmap(BdrvDirtyBitmap *bitmap, HBitmap **out)
     IO_CODE();
     assert(!bdrv_dirty_bitmap_readonly(bitmap));
     bdrv_dirty_bitmaps_lock(bitmap->bs);
+    bdrv_dirty_known_forget_all(bitmap->bs);
     if (!out) {
         hbitmap_reset_all(bitmap->bitmap);
     } else {
@@ -592,7 +626,10 @@ void bdrv_restore_dirty_bitmap(BdrvDirtyBitmap *bitmap, HBitmap *backup)
     HBitmap *tmp = bitmap->bitmap;
     assert(!bdrv_dirty_bitmap_readonly(bitmap));
     GLOBAL_STATE_CODE();
+    bdrv_dirty_bitmaps_lock(bitmap->bs);
+    bdrv_dirty_known_forget_all(bitmap->bs);
     bitmap->bitmap = backup;
+    bdrv_dirty_bitmaps_unlock(bitmap->bs);
     hbitmap_free(tmp);
 }
 
@@ -631,6 +668,9 @@ void bdrv_dirty_bitmap_deserialize_part(BdrvDirtyBitmap *bitmap,
                                         uint8_t *buf, uint64_t offset,
                                         uint64_t bytes, bool finish)
 {
+    bdrv_dirty_bitmaps_lock(bitmap->bs);
+    bdrv_dirty_known_forget(bitmap->bs, offset, bytes);
+    bdrv_dirty_bitmaps_unlock(bitmap->bs);
     hbitmap_deserialize_part(bitmap->bitmap, buf, offset, bytes, finish);
 }
 
@@ -638,6 +678,9 @@ void bdrv_dirty_bitmap_deserialize_zeroes(BdrvDirtyBitmap *bitmap,
                                           uint64_t offset, uint64_t bytes,
                                           bool finish)
 {
+    bdrv_dirty_bitmaps_lock(bitmap->bs);
+    bdrv_dirty_known_forget(bitmap->bs, offset, bytes);
+    bdrv_dirty_bitmaps_unlock(bitmap->bs);
     hbitmap_deserialize_zeroes(bitmap->bitmap, offset, bytes, finish);
 }
 
@@ -653,6 +696,55 @@ void bdrv_dirty_bitmap_deserialize_finish(BdrvDirtyBitmap *bitmap)
     hbitmap_deserialize_finish(bitmap->bitmap);
 }
 
+/*
+ * Return true if [offset, offset + bytes) is dirty in all enabled bitmaps
+ * of @bs, without taking the dirty_bitmap_mutex.
+ */
+static bool bdrv_dirty_known(BlockDriverState *bs,
+                             int64_t offset, int64_t bytes)
+{
+    unsigned seq;
+    bool known;
+
+    /*
+     * Order the write that is being recorded before the check.  A job that
+     * clears the range calls bdrv_dirty_known_forget() before reading the
+     * data to copy, so either it sees the new data or we see that the range
+     * is not known to be dirty anymore.
+     */
+    smp_mb();
+
+    do {
+        seq = seqlock_read_begin(&bs->dirty_known_seqlock);
+        known = offset >= qatomic_read_i64(&bs->dirty_known_start) &&
+                offset + bytes <= qatomic_read_i64(&bs->dirty_known_end);
+    } while (seqlock_read_retry(&bs->dirty_known_seqlock, seq));
+
+    return known;
+}
+
+/* Called with the dirty_bitmap_mutex held, after setting the range.  */
+static void bdrv_dirty_known_add(BlockDriverState *bs,
+                                 int64_t offset, int64_t bytes)
+{
+    int64_t start = bs->dirty_known_start;
+    int64_t end = bs->dirty_known_end;
+
+    /* Grow the known range if possible, otherwise replace it */
+    if (start != end && offset <= end && offset + bytes >= start) {
+        start = MIN(start, offset);
+        end = MAX(end, offset + bytes);
+    } else {
+        start = offset;
+        end = offset + bytes;
+    }
+
+    seqlock_write_begin(&bs->dirty_known_seqlock);
+    qatomic_set_i64(&bs->dirty_known_start, start);
+    qatomic_set_i64(&bs->dirty_known_end, end);
+    seqlock_write_end(&bs->dirty_known_seqlock);
+}
+
 void bdrv_set_dirty(BlockDriverState *bs, int64_t offset, int64_t bytes)
 {
     BdrvDirtyBitmap *bitmap;
@@ -662,6 +754,11 @@ void bdrv_set_dirty(BlockDriverState *bs, int64_t offset, int64_t bytes)
         return;
     }
 
+    /* Guests often rewrite the same blocks; no need to set them again */
+    if (bdrv_dirty_known(bs, offset, bytes)) {
+        return;
+    }
+
     bdrv_dirty_bitmaps_lock(bs);
     QLIST_FOREACH(bitmap, &bs->dirty_bitmaps, list) {
         if (!bdrv_dirty_bitmap_enabled(bitmap)) {
@@ -670,6 +767,7 @@ void bdrv_set_dirty(BlockDriverState *bs, int64_t offset, int64_t bytes)
         assert(!bdrv_dirty_bitmap_readonly(bitmap));
         hbitmap_set(bitmap->bitmap, offset, bytes);
     }
+    bdrv_dirty_known_add(bs, offset, bytes);
     bdrv_dirty_bitmaps_unlock(bs);
 }
 
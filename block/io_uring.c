@@ -11,11 +11,14 @@
 #include "qemu/osdep.h"
 #include <liburing.h>
 #include "block/aio.h"
+#include "block/aio-wait.h"
 #include "qemu/queue.h"
 #include "block/block.h"
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
 #include "qemu/defer-call.h"
+#include "qemu/lockable.h"
+#include "qemu/main-loop.h"
 #include "qapi/error.h"
 #include "sysemu/block-backend.h"
 #include "trace.h"
@@ -26,6 +29,17 @@
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Files registered with a single ring, enough for the disks of a context */
+#define MAX_FIXED_FILES 64
+
+/* Largest buffer that older kernels accept in io_uring_register_buffers() */
+#define MAX_FIXED_BUF_SIZE (1ULL << 30)
+
+/* Linux 5.11+, may be missing from older liburing headers */
+#ifndef IORING_FEAT_SQPOLL_NONFIXED
+#define IORING_FEAT_SQPOLL_NONFIXED (1U << 7)
+#endif
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -58,8 +72,336 @@ struct LuringState {
     LuringQueue io_q;
 
     QEMUBH *completion_bh;
+
+    /* Updates the registered buffers, see luring_bufs_bh() */
+    QEMUBH *bufs_bh;
+    bool bufs_pending;
+    QLIST_ENTRY(LuringState) next;
+
+    /*
+     * Registered files: fds[i] is registered in slot i for
+     * i < nr_registered_fds; the rest were seen since the last update and
+     * are registered the next time the ring is idle.  Slots of closed
+     * files hold -1 until another file takes them.
+     */
+    int fds[MAX_FIXED_FILES];
+    unsigned int nr_fds;
+    unsigned int nr_registered_fds;
+    bool files_failed;
+
+    /* Registered buffers, sorted by address; bufs[i] is buf_index i */
+    struct iovec *bufs;
+    unsigned int nr_bufs;
+    unsigned int bufs_gen;
+    bool bufs_failed;
 };
 
+typedef struct LuringBuf {
+    void *host;
+    size_t size;
+    unsigned int refcnt;
+} LuringBuf;
+
+/*
+ * Buffers registered with luring_register_buf(), shared by all rings.
+ * Each ring catches up in its bufs_bh, see luring_bufs_bh(); until then
+ * the generation tells it not to trust its own registrations, which may
+ * point to memory that has gone away.
+ */
+static QemuMutex luring_bufs_lock;
+static GArray *luring_bufs;
+static unsigned int luring_bufs_gen;
+
+/* All rings, protected by luring_bufs_lock */
+static QLIST_HEAD(, LuringState) luring_states =
+    QLIST_HEAD_INITIALIZER(luring_states);
+
+static void __attribute__((__constructor__)) luring_bufs_init(void)
+{
+    qemu_mutex_init(&luring_bufs_lock);
+    luring_bufs = g_array_new(false, false, sizeof(LuringBuf));
+}
+
+/* Called with luring_bufs_lock held */
+static void luring_bufs_changed(void)
+{
+    LuringState *s;
+
+    qatomic_store_release(&luring_bufs_gen, luring_bufs_gen + 1);
+    QLIST_FOREACH(s, &luring_states, next) {
+        if (s->bufs_bh) {
+            qemu_bh_schedule(s->bufs_bh);
+        }
+    }
+}
+
+void luring_register_buf(void *host, size_t size)
+{
+    LuringBuf *buf;
+    guint i;
+
+    QEMU_LOCK_GUARD(&luring_bufs_lock);
+    for (i = 0; i < luring_bufs->len; i++) {
+        buf = &g_array_index(luring_bufs, LuringBuf, i);
+        if (buf->host == host && buf->size == size) {
+            buf->refcnt++;
+            return;
+        }
+        if ((uintptr_t)buf->host > (uintptr_t)host) {
+            break;
+        }
+    }
+    g_array_insert_vals(luring_bufs, i,
+                        &(LuringBuf) { .host = host, .size = size,
+                                       .refcnt = 1 }, 1);
+    luring_bufs_changed();
+    trace_luring_register_buf(host, size);
+}
+
+void luring_unregister_buf(void *host, size_t size)
+{
+    LuringBuf *buf;
+
+    QEMU_LOCK_GUARD(&luring_bufs_lock);
+    for (guint i = 0; i < luring_bufs->len; i++) {
+        buf = &g_array_index(luring_bufs, LuringBuf, i);
+        if (buf->host == host && buf->size == size) {
+            if (--buf->refcnt == 0) {
+                g_array_remove_index(luring_bufs, i);
+                luring_bufs_changed();
+                trace_luring_unregister_buf(host, size);
+            }
+            return;
+        }
+    }
+}
+
+typedef struct LuringCloseFd {
+    LuringState *s;
+    int fd;
+} LuringCloseFd;
+
+/*
+ * Runs in the ring's AioContext, see luring_close_fd().  Unregistering
+ * the whole table, rather than updating the slot to -1, makes the kernel
+ * drop its reference to the file before returning; after an update, the
+ * reference may only go away later, from a kernel worker.
+ */
+static void luring_unregister_file_bh(void *opaque)
+{
+    LuringCloseFd *c = opaque;
+    LuringState *s = c->s;
+
+    for (unsigned int i = 0; i < s->nr_fds; i++) {
+        if (s->fds[i] != c->fd) {
+            continue;
+        }
+        s->fds[i] = -1;
+        trace_luring_unregister_file(s, c->fd, i);
+        if (i < s->nr_registered_fds) {
+            /* The other files are registered again once the ring is idle */
+            io_uring_unregister_files(&s->ring);
+            s->nr_registered_fds = 0;
+        }
+    }
+}
+
+void luring_close_fd(int fd)
+{
+    g_autoptr(GPtrArray) rings = g_ptr_array_new();
+
+    GLOBAL_STATE_CODE();
+
+    /*
+     * Rings are only created and destroyed along with their AioContext,
+     * from the main loop thread, so they outlive this function.
+     */
+    WITH_QEMU_LOCK_GUARD(&luring_bufs_lock) {
+        LuringState *s;
+
+        QLIST_FOREACH(s, &luring_states, next) {
+            if (s->bufs_bh) {
+                g_ptr_array_add(rings, s);
+            }
+        }
+    }
+
+    for (guint i = 0; i < rings->len; i++) {
+        LuringCloseFd c = { .s = g_ptr_array_index(rings, i), .fd = fd };
+
+        aio_wait_bh_oneshot(c.s->aio_context, luring_unregister_file_bh, &c);
+    }
+}
+
+static void luring_update_bufs(LuringState *s)
+{
+    unsigned int gen;
+    int ret;
+
+    if (qatomic_load_acquire(&luring_bufs_gen) == s->bufs_gen) {
+        return;
+    }
+
+    if (s->nr_bufs) {
+        io_uring_unregister_buffers(&s->ring);
+        s->nr_bufs = 0;
+    }
+    if (s->bufs_failed) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&luring_bufs_lock) {
+        gen = luring_bufs_gen;
+        for (guint i = 0; i < luring_bufs->len; i++) {
+            LuringBuf *buf = &g_array_index(luring_bufs, LuringBuf, i);
+
+            for (size_t done = 0; done < buf->size;
+                 done += MAX_FIXED_BUF_SIZE) {
+                s->bufs = g_renew(struct iovec, s->bufs, s->nr_bufs + 1);
+                s->bufs[s->nr_bufs++] = (struct iovec) {
+                    .iov_base = buf->host + done,
+                    .iov_len = MIN(buf->size - done, MAX_FIXED_BUF_SIZE),
+                };
+            }
+        }
+    }
+    s->bufs_gen = gen;
+
+    if (s->nr_bufs == 0) {
+        return;
+    }
+    ret = io_uring_register_buffers(&s->ring, s->bufs, s->nr_bufs);
+    trace_luring_register_buffers(s, s->nr_bufs, ret);
+    if (ret < 0) {
+        /*
+         * Usually RLIMIT_MEMLOCK is too low to pin guest RAM.  Do not try
+         * again for every change of the memory map.
+         */
+        s->bufs_failed = true;
+        s->nr_bufs = 0;
+    }
+}
+
+static bool luring_idle(LuringState *s)
+{
+    return s->io_q.in_flight == 0 && s->io_q.in_queue == 0;
+}
+
+/*
+ * Registering buffers pins the guest RAM, which takes a while for a large
+ * guest, and waits for the requests in flight.  Keep it out of the submit
+ * path: the bottom half runs when the memory map changes and, if the ring
+ * is busy then, again once the last request has completed.  Requests keep
+ * using readv/writev in the meantime.
+ */
+static void luring_bufs_bh(void *opaque)
+{
+    LuringState *s = opaque;
+
+    if (!luring_idle(s)) {
+        s->bufs_pending = true;
+        return;
+    }
+    s->bufs_pending = false;
+    luring_update_bufs(s);
+}
+
+/*
+ * Returns the slot of @fd in the registered files, registering it if
+ * possible, or -1.
+ */
+static int luring_fixed_file(LuringState *s, int fd)
+{
+    int slot = -1, free_slot = -1;
+    int ret;
+
+    for (unsigned int i = 0; i < s->nr_fds; i++) {
+        if (s->fds[i] == fd) {
+            slot = i;
+            break;
+        }
+        if (s->fds[i] == -1 && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+    if (slot >= 0 && slot < s->nr_registered_fds) {
+        return slot;
+    }
+    if (s->files_failed) {
+        return -1;
+    }
+
+    if (slot < 0) {
+        if (free_slot >= 0 && free_slot < s->nr_registered_fds) {
+            /* A closed file's slot; updating it does not wait for requests */
+            ret = io_uring_register_files_update(&s->ring, free_slot, &fd, 1);
+            trace_luring_update_file(s, fd, free_slot, ret);
+            if (ret < 0) {
+                return -1;
+            }
+            s->fds[free_slot] = fd;
+            return free_slot;
+        }
+        if (free_slot >= 0) {
+            slot = free_slot;
+        } else if (s->nr_fds < MAX_FIXED_FILES) {
+            slot = s->nr_fds++;
+        } else {
+            return -1;
+        }
+        s->fds[slot] = fd;
+    }
+
+    /*
+     * Registering the table waits for the requests in flight, so only do
+     * it when there are none.  Each file is registered with its first
+     * request, so this does not need to happen under load.
+     */
+    if (!luring_idle(s)) {
+        return -1;
+    }
+    if (s->nr_registered_fds) {
+        io_uring_unregister_files(&s->ring);
+        s->nr_registered_fds = 0;
+    }
+    ret = io_uring_register_files(&s->ring, s->fds, s->nr_fds);
+    trace_luring_register_files(s, s->nr_fds, ret);
+    if (ret < 0) {
+        s->files_failed = true;
+        return -1;
+    }
+    s->nr_registered_fds = s->nr_fds;
+    return slot;
+}
+
+/* Returns the index of the registered buffer holding @qiov, or -1 */
+static int luring_fixed_buf(LuringState *s, QEMUIOVector *qiov)
+{
+    uintptr_t start, end;
+    unsigned int lo = 0, hi = s->nr_bufs;
+
+    if (s->nr_bufs == 0 || qiov->niov != 1 ||
+        s->bufs_gen != qatomic_load_acquire(&luring_bufs_gen)) {
+        return -1;
+    }
+
+    start = (uintptr_t)qiov->iov[0].iov_base;
+    end = start + qiov->iov[0].iov_len;
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        uintptr_t buf_start = (uintptr_t)s->bufs[mid].iov_base;
+
+        if (start < buf_start) {
+            hi = mid;
+        } else if (start >= buf_start + s->bufs[mid].iov_len) {
+            lo = mid + 1;
+        } else {
+            return end <= buf_start + s->bufs[mid].iov_len ? mid : -1;
+        }
+    }
+    return -1;
+}
+
 /**
  * luring_resubmit:
  *
@@ -102,6 +444,13 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 
     /* Update sqe */
     luringcb->sqeq.off += nread;
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        /* The rest is still in the same registered buffer */
+        luringcb->sqeq.addr += nread;
+        luringcb->sqeq.len -= nread;
+        luring_resubmit(s, luringcb);
+        return;
+    }
     luringcb->sqeq.addr = (uintptr_t)luringcb->resubmit_qiov.iov;
     luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
 
@@ -223,6 +572,10 @@ end:
 
     qemu_bh_cancel(s->completion_bh);
 
+    if (s->bufs_pending && luring_idle(s)) {
+        qemu_bh_schedule(s->bufs_bh);
+    }
+
     defer_call_end();
 }
 
@@ -338,20 +691,33 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                             uint64_t offset, int type)
 {
     int ret;
+    int file_index, buf_index = -1;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
 
+    file_index = luring_fixed_file(s, fd);
+    if (luringcb->qiov) {
+        buf_index = luring_fixed_buf(s, luringcb->qiov);
+    }
+
     switch (type) {
     case QEMU_AIO_WRITE:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
-        break;
     case QEMU_AIO_ZONE_APPEND:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                      luringcb->qiov->size, offset, buf_index);
+        } else {
+            io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
+                                 luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_READ:
-        io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
-                            luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                     luringcb->qiov->size, offset, buf_index);
+        } else {
+            io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
+                                luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_FLUSH:
         io_uring_prep_fsync(sqes, fd, IORING_FSYNC_DATASYNC);
@@ -361,6 +727,10 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (file_index >= 0) {
+        sqes->fd = file_index;
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -410,6 +780,10 @@ void luring_detach_aio_context(LuringState *s, AioContext *old_context)
     aio_set_fd_handler(old_context, s->ring.ring_fd,
                        NULL, NULL, NULL, NULL, s);
     qemu_bh_delete(s->completion_bh);
+    WITH_QEMU_LOCK_GUARD(&luring_bufs_lock) {
+        qemu_bh_delete(s->bufs_bh);
+        s->bufs_bh = NULL;
+    }
     s->aio_context = NULL;
 }
 
@@ -420,17 +794,44 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
     aio_set_fd_handler(s->aio_context, s->ring.ring_fd,
                        qemu_luring_completion_cb, NULL,
                        qemu_luring_poll_cb, qemu_luring_poll_ready, s);
+
+    /* Pick up the buffers that were registered before this ring existed */
+    WITH_QEMU_LOCK_GUARD(&luring_bufs_lock) {
+        s->bufs_bh = aio_bh_new(new_context, luring_bufs_bh, s);
+        qemu_bh_schedule(s->bufs_bh);
+    }
 }
 
-LuringState *luring_init(Error **errp)
+LuringState *luring_init(bool sqpoll, Error **errp)
 {
-    int rc;
+    int rc = -EINVAL;
     LuringState *s = g_new0(LuringState, 1);
     struct io_uring *ring = &s->ring;
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    if (sqpoll) {
+        struct io_uring_params params = { .flags = IORING_SETUP_SQPOLL };
+
+        /*
+         * A kernel thread polls the submission queue, so submitting does
+         * not need a system call while it is busy.  Older kernels only
+         * allow this to privileged users, and without
+         * IORING_FEAT_SQPOLL_NONFIXED (before Linux 5.11) every request
+         * must use a registered file, which cannot be guaranteed (see
+         * luring_fixed_file()); use a normal ring then.  The trace event
+         * tells which ring was set up.
+         */
+        rc = io_uring_queue_init_params(MAX_ENTRIES, ring, &params);
+        if (rc == 0 && !(params.features & IORING_FEAT_SQPOLL_NONFIXED)) {
+            io_uring_queue_exit(ring);
+            rc = -EOPNOTSUPP;
+        }
+        trace_luring_init_sqpoll(s, rc, params.features);
+    }
+    if (rc < 0) {
+        rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    }
     if (rc < 0) {
         error_setg_errno(errp, -rc, "failed to init linux io_uring ring");
         g_free(s);
@@ -438,13 +839,20 @@ LuringState *luring_init(Error **errp)
     }
 
     ioq_init(&s->io_q);
+    WITH_QEMU_LOCK_GUARD(&luring_bufs_lock) {
+        QLIST_INSERT_HEAD(&luring_states, s, next);
+    }
     return s;
 
 }
 
 void luring_cleanup(LuringState *s)
 {
+    WITH_QEMU_LOCK_GUARD(&luring_bufs_lock) {
+        QLIST_REMOVE(s, next);
+    }
     io_uring_queue_exit(&s->ring);
+    g_free(s->bufs);
     trace_luring_cleanup_state(s);
     g_free(s);
 }
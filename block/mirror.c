@@ -13,6 +13,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/coroutine.h"
 #include "qemu/range.h"
 #include "trace.h"
@@ -24,11 +25,18 @@
 #include "qemu/ratelimit.h"
 #include "qemu/bitmap.h"
 #include "qemu/memalign.h"
+#include "qemu/stats64.h"
 
 #define MAX_IN_FLIGHT 16
 #define MAX_IO_BYTES (1 << 20) /* 1 Mb */
 #define DEFAULT_MIRROR_BUF_SIZE (MAX_IN_FLIGHT * MAX_IO_BYTES)
 
+/* How often an adaptive job reconsiders its in-flight limit */
+#define MIRROR_TUNE_PERIOD_NS (100 * SCALE_MS)
+
+/* Sampling periods over which the best latency is taken */
+#define MIRROR_TUNE_WINDOW 32
+
 /* The mirroring buffer is a list of granularity-sized chunks.
  * Free chunks are organized in a list.
  */
@@ -38,6 +46,33 @@ typedef struct MirrorBuffer {
 
 typedef struct MirrorOp MirrorOp;
 
+/*
+ * Samples collected by an adaptive job over one MIRROR_TUNE_PERIOD_NS,
+ * see mirror_tune().  Only copy requests are sampled; zero and discard
+ * requests complete too quickly to say anything about the target.
+ */
+typedef struct MirrorTuneState {
+    int64_t period_start_ns;
+    uint64_t bytes;
+    int64_t latency_ns;
+    /* Set when a request had to wait for the in-flight limit */
+    bool saturated;
+    /*
+     * Latency per MiB of the last MIRROR_TUNE_WINDOW periods with copy
+     * requests, 0 if unused; base_latency is the lowest of them
+     */
+    uint64_t latency_window[MIRROR_TUNE_WINDOW];
+    unsigned latency_window_pos;
+    uint64_t base_latency;
+    uint64_t last_throughput;
+    /* Bytes dirtied by the guest since the job started */
+    Stat64 guest_bytes;
+    uint64_t last_guest_bytes;
+    /* Reported by mirror_query(), to be accessed with atomics */
+    uint64_t throughput;
+    uint64_t dirty_rate;
+} MirrorTuneState;
+
 typedef struct MirrorBlockJob {
     BlockJob common;
     BlockBackend *target;
@@ -81,7 +116,20 @@ typedef struct MirrorBlockJob {
 
     uint64_t last_pause_ns;
     unsigned long *in_flight_bitmap;
+    /*
+     * in_flight, in_flight_limit and max_io_bytes are read by mirror_query()
+     * with atomics.
+     */
     unsigned in_flight;
+    /*
+     * Number of background requests allowed in flight.  Equal to
+     * max_in_flight unless the job is adaptive.
+     */
+    unsigned in_flight_limit;
+    unsigned max_in_flight;
+    uint64_t max_io_bytes;
+    bool adaptive;
+    MirrorTuneState tune;
     int64_t bytes_in_flight;
     QTAILQ_HEAD(, MirrorOp) ops_in_flight;
     int ret;
@@ -115,6 +163,8 @@ struct MirrorOp {
     bool is_pseudo_op;
     bool is_active_write;
     bool is_in_flight;
+    /* Submission time of copy requests of an adaptive job, else 0 */
+    int64_t start_ns;
     CoQueue waiting_requests;
     Coroutine *co;
     MirrorOp *waiting_for_op;
@@ -203,7 +253,13 @@ static void coroutine_fn mirror_iteration_done(MirrorOp *op, int ret)
 
     trace_mirror_iteration_done(s, op->offset, op->bytes, ret);
 
-    s->in_flight--;
+    if (op->start_ns && ret >= 0) {
+        s->tune.bytes += op->bytes;
+        s->tune.latency_ns += qemu_clock_get_ns(QEMU_CLOCK_REALTIME) -
+                              op->start_ns;
+    }
+
+    qatomic_dec(&s->in_flight);
     s->bytes_in_flight -= op->bytes;
     iov = op->qiov.iov;
     for (i = 0; i < op->qiov.niov; i++) {
@@ -393,9 +449,12 @@ static void coroutine_fn mirror_co_read(void *opaque)
     }
 
     /* Copy the dirty cluster.  */
-    s->in_flight++;
+    qatomic_inc(&s->in_flight);
     s->bytes_in_flight += op->bytes;
     op->is_in_flight = true;
+    if (s->adaptive && !s->initial_zeroing_ongoing) {
+        op->start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    }
     trace_mirror_one_iteration(s, op->offset, op->bytes);
 
     WITH_GRAPH_RDLOCK_GUARD() {
@@ -410,7 +469,7 @@ static void coroutine_fn mirror_co_zero(void *opaque)
     MirrorOp *op = opaque;
     int ret;
 
-    op->s->in_flight++;
+    qatomic_inc(&op->s->in_flight);
     op->s->bytes_in_flight += op->bytes;
     *op->bytes_handled = op->bytes;
     op->is_in_flight = true;
@@ -425,7 +484,7 @@ static void coroutine_fn mirror_co_discard(void *opaque)
     MirrorOp *op = opaque;
     int ret;
 
-    op->s->in_flight++;
+    qatomic_inc(&op->s->in_flight);
     op->s->bytes_in_flight += op->bytes;
     *op->bytes_handled = op->bytes;
     op->is_in_flight = true;
@@ -488,7 +547,7 @@ static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
     /* At least the first dirty chunk is mirrored in one iteration. */
     int nb_chunks = 1;
     bool write_zeroes_ok = bdrv_can_write_zeroes_with_unmap(blk_bs(s->target));
-    int max_io_bytes = MAX(s->buf_size / MAX_IN_FLIGHT, MAX_IO_BYTES);
+    int64_t max_io_bytes = s->max_io_bytes;
 
     bdrv_graph_co_rdlock();
     source = s->mirror_top_bs->backing->bs;
@@ -600,7 +659,8 @@ static void coroutine_fn GRAPH_UNLOCKED mirror_iteration(MirrorBlockJob *s)
             }
         }
 
-        while (s->in_flight >= MAX_IN_FLIGHT) {
+        while (s->in_flight >= s->in_flight_limit) {
+            s->tune.saturated = true;
             trace_mirror_yield_in_flight(s, offset, s->in_flight);
             mirror_wait_for_free_in_flight_slot(s);
         }
@@ -629,6 +689,79 @@ fail:
     g_free(pseudo_op);
 }
 
+/*
+ * Allow @limit background requests in flight.  Requests are made smaller as
+ * the limit grows, so that the buffer is shared among all of them.
+ */
+static void mirror_set_in_flight_limit(MirrorBlockJob *s, unsigned limit)
+{
+    qatomic_set(&s->in_flight_limit, limit);
+    qatomic_set_u64(&s->max_io_bytes, MAX(s->buf_size / limit, MAX_IO_BYTES));
+}
+
+/*
+ * Adjust the in-flight limit of an adaptive job once per
+ * MIRROR_TUNE_PERIOD_NS, AIMD-style: if copy requests take more than twice
+ * as long per byte as the best of the last MIRROR_TUNE_WINDOW periods and
+ * throughput did not improve, the target is only queueing requests and the
+ * limit is halved.  Otherwise, if the limit was actually reached, one more
+ * request is allowed.
+ */
+static void mirror_tune(MirrorBlockJob *s)
+{
+    MirrorTuneState *t = &s->tune;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t elapsed = now - t->period_start_ns;
+    unsigned limit = s->in_flight_limit;
+    uint64_t throughput, latency, guest_bytes;
+    int i;
+
+    if (!s->adaptive || elapsed < MIRROR_TUNE_PERIOD_NS) {
+        return;
+    }
+
+    throughput = muldiv64(t->bytes, NANOSECONDS_PER_SECOND, elapsed);
+    qatomic_set_u64(&t->throughput, throughput);
+    guest_bytes = stat64_get(&t->guest_bytes);
+    qatomic_set_u64(&t->dirty_rate,
+                    muldiv64(guest_bytes - t->last_guest_bytes,
+                             NANOSECONDS_PER_SECOND, elapsed));
+    t->last_guest_bytes = guest_bytes;
+
+    if (t->bytes) {
+        /*
+         * A minimum that the target no longer achieves drops out of the
+         * window, so the job does not keep comparing against it.
+         */
+        latency = muldiv64(t->latency_ns, MiB, t->bytes);
+        t->latency_window[t->latency_window_pos] = latency;
+        t->latency_window_pos = (t->latency_window_pos + 1) %
+                                MIRROR_TUNE_WINDOW;
+        t->base_latency = latency;
+        for (i = 0; i < MIRROR_TUNE_WINDOW; i++) {
+            if (t->latency_window[i]) {
+                t->base_latency = MIN(t->base_latency, t->latency_window[i]);
+            }
+        }
+
+        if (latency > 2 * t->base_latency &&
+            throughput <= t->last_throughput) {
+            limit = MAX(limit / 2, 1);
+        } else if (t->saturated && limit < s->max_in_flight) {
+            limit++;
+        }
+
+        trace_mirror_tune(s, latency, throughput, limit);
+        mirror_set_in_flight_limit(s, limit);
+        t->last_throughput = throughput;
+    }
+
+    t->period_start_ns = now;
+    t->bytes = 0;
+    t->latency_ns = 0;
+    t->saturated = false;
+}
+
 static void mirror_free_init(MirrorBlockJob *s)
 {
     int granularity = s->granularity;
@@ -866,7 +999,7 @@ static int coroutine_fn GRAPH_UNLOCKED mirror_dirty_init(MirrorBlockJob *s)
                 return 0;
             }
 
-            if (s->in_flight >= MAX_IN_FLIGHT) {
+            if (s->in_flight >= s->in_flight_limit) {
                 trace_mirror_yield(s, UINT64_MAX, s->buf_free_count,
                                    s->in_flight);
                 mirror_wait_for_free_in_flight_slot(s);
@@ -1018,6 +1151,7 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
     }
 
     mirror_free_init(s);
+    mirror_set_in_flight_limit(s, s->max_in_flight);
 
     s->last_pause_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     if (!s->is_none_mode) {
@@ -1035,6 +1169,7 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
 
     assert(!s->dbi);
     s->dbi = bdrv_dirty_iter_new(s->dirty_bitmap);
+    s->tune.period_start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     for (;;) {
         int64_t cnt, delta;
         bool should_complete;
@@ -1059,6 +1194,8 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
                                    s->bytes_in_flight + cnt +
                                    s->active_write_bytes_in_flight);
 
+        mirror_tune(s);
+
         /* Note that even when no rate limit is applied we need to yield
          * periodically with no pending I/O so that bdrv_drain_all() returns.
          * We do so every BLKOCK_JOB_SLICE_TIME nanoseconds, or when there is
@@ -1069,7 +1206,11 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
         }
         if (delta < BLOCK_JOB_SLICE_TIME &&
             iostatus == BLOCK_DEVICE_IO_STATUS_OK) {
-            if (s->in_flight >= MAX_IN_FLIGHT || s->buf_free_count == 0 ||
+            if (s->in_flight >= s->in_flight_limit) {
+                s->tune.saturated = true;
+            }
+            if (s->in_flight >= s->in_flight_limit ||
+                s->buf_free_count == 0 ||
                 (cnt == 0 && s->in_flight > 0)) {
                 trace_mirror_yield(s, cnt, s->buf_free_count, s->in_flight);
                 mirror_wait_for_free_in_flight_slot(s);
@@ -1298,6 +1439,21 @@ static void mirror_query(BlockJob *job, BlockJobInfo *info)
     info->u.mirror = (BlockJobInfoMirror) {
         .actively_synced = qatomic_read(&s->actively_synced),
     };
+
+    if (s->adaptive) {
+        BlockJobInfoMirror *mirror = &info->u.mirror;
+
+        mirror->has_in_flight = true;
+        mirror->in_flight = qatomic_read(&s->in_flight);
+        mirror->has_in_flight_limit = true;
+        mirror->in_flight_limit = qatomic_read(&s->in_flight_limit);
+        mirror->has_chunk_size = true;
+        mirror->chunk_size = qatomic_read_u64(&s->max_io_bytes);
+        mirror->has_throughput = true;
+        mirror->throughput = qatomic_read_u64(&s->tune.throughput);
+        mirror->has_dirty_rate = true;
+        mirror->dirty_rate = qatomic_read_u64(&s->tune.dirty_rate);
+    }
 }
 
 static const BlockJobDriver mirror_job_driver = {
@@ -1560,6 +1716,9 @@ bdrv_mirror_top_do_write(BlockDriverState *bs, MirrorMethod method,
     if (!copy_to_target && s->job && s->job->dirty_bitmap) {
         qatomic_set(&s->job->actively_synced, false);
         bdrv_set_dirty_bitmap(s->job->dirty_bitmap, offset, bytes);
+        if (s->job->adaptive) {
+            stat64_add(&s->job->tune.guest_bytes, bytes);
+        }
     }
 
     if (ret < 0) {
@@ -1722,6 +1881,7 @@ static BlockJob *mirror_start_job(
                              bool is_none_mode, BlockDriverState *base,
                              bool auto_complete, const char *filter_node_name,
                              bool is_mirror, MirrorCopyMode copy_mode,
+                             int max_in_flight, bool adaptive,
                              bool base_ro,
                              Error **errp)
 {
@@ -1745,8 +1905,14 @@ static BlockJob *mirror_start_job(
         return NULL;
     }
 
+    if (max_in_flight == 0) {
+        max_in_flight = MAX_IN_FLIGHT;
+    }
+    assert(max_in_flight > 0);
+
     if (buf_size == 0) {
-        buf_size = DEFAULT_MIRROR_BUF_SIZE;
+        buf_size = MAX(DEFAULT_MIRROR_BUF_SIZE,
+                       (int64_t)max_in_flight * MAX_IO_BYTES);
     }
 
     bdrv_graph_rdlock_main_loop();
@@ -1886,6 +2052,8 @@ static BlockJob *mirror_start_job(
     s->base_overlay = bdrv_find_overlay(bs, base);
     s->granularity = granularity;
     s->buf_size = ROUND_UP(buf_size, granularity);
+    s->max_in_flight = max_in_flight;
+    s->adaptive = adaptive;
     s->unmap = unmap;
     if (auto_complete) {
         s->should_complete = true;
@@ -2013,7 +2181,8 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                   BlockdevOnError on_source_error,
                   BlockdevOnError on_target_error,
                   bool unmap, const char *filter_node_name,
-                  MirrorCopyMode copy_mode, Error **errp)
+                  MirrorCopyMode copy_mode, int max_in_flight,
+                  bool adaptive, Error **errp)
 {
     bool is_none_mode;
     BlockDriverState *base;
@@ -2036,7 +2205,8 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                      speed, granularity, buf_size, backing_mode, zero_target,
                      on_source_error, on_target_error, unmap, NULL, NULL,
                      &mirror_job_driver, is_none_mode, base, false,
-                     filter_node_name, true, copy_mode, false, errp);
+                     filter_node_name, true, copy_mode, max_in_flight,
+                     adaptive, false, errp);
 }
 
 BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
@@ -2065,7 +2235,7 @@ BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
                      on_error, on_error, true, cb, opaque,
                      &commit_active_job_driver, false, base, auto_complete,
                      filter_node_name, false, MIRROR_COPY_MODE_BACKGROUND,
-                     base_read_only, errp);
+                     0, false, base_read_only, errp);
     if (!job) {
         goto error_restore_flags;
     }
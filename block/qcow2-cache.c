@@ -44,6 +44,7 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+    unsigned                write_gen;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -59,6 +60,12 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+/* Where the search for the table at @offset starts. */
+static inline int qcow2_cache_lookup_index(Qcow2Cache *c, uint64_t offset)
+{
+    return (offset / c->table_size * 4) % c->size;
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -228,6 +235,7 @@ qcow2_cache_entry_flush(BlockDriverState *bs, Qcow2Cache *c, int i)
 
     ret = bdrv_pwrite(bs->file, c->entries[i].offset, c->table_size,
                       qcow2_cache_get_table_addr(c, i), 0);
+    c->write_gen++;
     if (ret < 0) {
         return ret;
     }
@@ -344,7 +352,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
+    i = lookup_index = qcow2_cache_lookup_index(c, offset);
     do {
         const Qcow2CachedTable *t = &c->entries[i];
         if (t->offset == offset) {
@@ -436,6 +444,55 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
     c->entries[i].dirty = true;
 }
 
+/*
+ * Put a copy of @table, read from @offset by the caller, in the cache,
+ * as if qcow2_cache_get() had read it.  The caller must make sure that
+ * @offset was not cached and that the disk did not change meanwhile,
+ * see qcow2_cache_get_write_gen().
+ */
+int qcow2_cache_insert(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
+                       const void *table)
+{
+    void *cached;
+    int ret;
+
+    ret = qcow2_cache_do_get(bs, c, offset, &cached, false);
+    if (ret < 0) {
+        return ret;
+    }
+    memcpy(cached, table, c->table_size);
+    qcow2_cache_put(c, &cached);
+    return 0;
+}
+
+/*
+ * Return a counter that changes whenever a table of @c is written back,
+ * successfully or not.  A table read from the disk without s->lock is
+ * current if the counter did not change since before the read.
+ */
+unsigned qcow2_cache_get_write_gen(Qcow2Cache *c)
+{
+    return c->write_gen;
+}
+
+/* Return true if the table at @offset is cached. */
+bool qcow2_cache_contains(Qcow2Cache *c, uint64_t offset)
+{
+    int i, lookup_index;
+
+    /* Same search order as qcow2_cache_do_get(), so that hits are cheap */
+    i = lookup_index = qcow2_cache_lookup_index(c, offset);
+    do {
+        if (c->entries[i].offset == offset) {
+            return true;
+        }
+        if (++i == c->size) {
+            i = 0;
+        }
+    } while (i != lookup_index);
+    return false;
+}
+
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
     int i;
@@ -30,6 +30,7 @@
 #include "qcow2.h"
 #include "qemu/bswap.h"
 #include "qemu/memalign.h"
+#include "qemu/range.h"
 #include "trace.h"
 
 int coroutine_fn qcow2_shrink_l1_table(BlockDriverState *bs,
@@ -563,6 +564,67 @@ do_perform_cow_write(BlockDriverState *bs, uint64_t cluster_offset,
 }
 
 
+/*
+ * Make sure that the L2 slice for the guest @offset is cached, if it
+ * exists.  On a cache miss, qcow2_cache_get() would read it with s->lock
+ * held, and every other request, including those whose slices are
+ * cached, would wait for that read.  Instead, the slice is read here
+ * without the lock, so that only requests that need the same slice end
+ * up waiting for it, and put in the cache once the lock is taken again.
+ *
+ * The copy is dropped if the L1 entry changed or any L2 slice was written
+ * back meanwhile (it may be this one); the lookup that follows then reads
+ * the slice again, with the lock held as before.
+ *
+ * Called with s->lock held, which is dropped and taken again on a miss.
+ * Returns 0 on success, -errno if the slice could not be read.
+ */
+int coroutine_fn qcow2_co_preload_l2_slice(BlockDriverState *bs,
+                                           uint64_t offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t l1_index = offset_to_l1_index(s, offset);
+    uint64_t l1_entry, l2_offset, slice_offset;
+    size_t slice_size = s->l2_slice_size * l2_entry_size(s);
+    unsigned write_gen;
+    void *slice;
+    int ret;
+
+    if (l1_index >= s->l1_size) {
+        return 0;
+    }
+    l1_entry = s->l1_table[l1_index];
+    l2_offset = l1_entry & L1E_OFFSET_MASK;
+    if (!l2_offset || offset_into_cluster(s, l2_offset)) {
+        return 0;
+    }
+    slice_offset = l2_offset + l2_entry_size(s) *
+        (offset_to_l2_index(s, offset) - offset_to_l2_slice_index(s, offset));
+    if (qcow2_cache_contains(s->l2_table_cache, slice_offset)) {
+        return 0;
+    }
+
+    slice = qemu_try_blockalign(bs->file->bs, slice_size);
+    if (!slice) {
+        return -ENOMEM;
+    }
+
+    write_gen = qcow2_cache_get_write_gen(s->l2_table_cache);
+    qemu_co_mutex_unlock(&s->lock);
+    BLKDBG_CO_EVENT(bs->file, BLKDBG_L2_LOAD);
+    ret = bdrv_co_pread(bs->file, slice_offset, slice_size, slice, 0);
+    qemu_co_mutex_lock(&s->lock);
+
+    if (ret >= 0 && l1_index < s->l1_size &&
+        s->l1_table[l1_index] == l1_entry &&
+        qcow2_cache_get_write_gen(s->l2_table_cache) == write_gen &&
+        !qcow2_cache_contains(s->l2_table_cache, slice_offset)) {
+        ret = qcow2_cache_insert(bs, s->l2_table_cache, slice_offset, slice);
+    }
+    qemu_vfree(slice);
+    return ret < 0 ? ret : 0;
+}
+
 /*
  * get_host_offset
  *
@@ -1621,12 +1683,16 @@ do_alloc_cluster_offset(BlockDriverState *bs, uint64_t guest_offset,
     trace_qcow2_cluster_alloc_phys(qemu_coroutine_self());
     if (*host_offset == INV_OFFSET) {
         int64_t cluster_offset =
-            qcow2_alloc_clusters(bs, *nb_clusters * s->cluster_size);
+            qcow2_alloc_data_clusters(bs, nb_clusters, false);
         if (cluster_offset < 0) {
             return cluster_offset;
         }
         *host_offset = cluster_offset;
         return 0;
+    } else if (*host_offset == s->reserved_offset && s->reserved_clusters) {
+        /* Continue in the clusters reserved by a previous allocation */
+        qcow2_alloc_data_clusters(bs, nb_clusters, true);
+        return 0;
     } else {
         int64_t ret = qcow2_alloc_clusters_at(bs, *host_offset, *nb_clusters);
         if (ret < 0) {
@@ -1793,6 +1859,12 @@ int coroutine_fn qcow2_alloc_host_offset(BlockDriverState *bs, uint64_t offset,
 
     trace_qcow2_alloc_clusters_offset(qemu_coroutine_self(), offset, *bytes);
 
+    /* Before anything is looked up, as the lock may be dropped */
+    ret = qcow2_co_preload_l2_slice(bs, offset);
+    if (ret < 0) {
+        return ret;
+    }
+
 again:
     start = offset;
     remaining = *bytes;
@@ -1890,9 +1962,158 @@ again:
     assert(offset_into_cluster(s, *host_offset) ==
            offset_into_cluster(s, offset));
 
+    if (s->dedup) {
+        /* The data in these clusters is about to change */
+        qcow2_dedup_forget(bs, *host_offset, *bytes);
+    }
+
     return 0;
 }
 
+/*
+ * Makes the unallocated (or zero) cluster at guest offset @offset share the
+ * data cluster at @host_offset with the cluster at guest offset @src_offset,
+ * by increasing its refcount and clearing QCOW_OFLAG_COPIED in both L2
+ * entries.  The caller is responsible for knowing that the contents of
+ * @host_offset are what should be written to @offset.
+ *
+ * Returns 1 if the cluster is now shared, 2 if @offset maps @host_offset
+ * already, 0 if @src_offset does not map @host_offset (any more), -EAGAIN
+ * if @offset cannot be linked right now (it is allocated elsewhere, has an
+ * allocation in flight, or the refcount is at its maximum) and -errno on
+ * other errors.
+ */
+int GRAPH_RDLOCK
+qcow2_cluster_share(BlockDriverState *bs, uint64_t offset,
+                    uint64_t src_offset, uint64_t host_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    QCowL2Meta *m;
+    uint64_t *l2_slice, l2_entry, dst_entry, refcount;
+    QCow2ClusterType type;
+    int l2_index, ret;
+
+    assert(!has_subclusters(s) && !has_data_file(bs));
+    assert(offset_into_cluster(s, offset) == 0);
+
+    QLIST_FOREACH(m, &s->cluster_allocs, next_in_flight) {
+        uint64_t bytes = (uint64_t)m->nb_clusters << s->cluster_bits;
+
+        if (ranges_overlap(m->offset, bytes, offset, s->cluster_size) ||
+            ranges_overlap(m->offset, bytes, src_offset, s->cluster_size)) {
+            return -EAGAIN;
+        }
+    }
+
+    ret = get_cluster_table(bs, src_offset, &l2_slice, &l2_index);
+    if (ret < 0) {
+        return ret;
+    }
+    l2_entry = get_l2_entry(s, l2_slice, l2_index);
+    qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+
+    if (qcow2_get_cluster_type(bs, l2_entry) != QCOW2_CLUSTER_NORMAL ||
+        (l2_entry & L2E_OFFSET_MASK) != host_offset) {
+        return 0;
+    }
+
+    ret = get_cluster_table(bs, offset, &l2_slice, &l2_index);
+    if (ret < 0) {
+        return ret;
+    }
+    dst_entry = get_l2_entry(s, l2_slice, l2_index);
+    type = qcow2_get_cluster_type(bs, dst_entry);
+    qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+
+    if (type == QCOW2_CLUSTER_NORMAL &&
+        (dst_entry & L2E_OFFSET_MASK) == host_offset) {
+        return 2;
+    }
+    if (type != QCOW2_CLUSTER_UNALLOCATED && type != QCOW2_CLUSTER_ZERO_PLAIN) {
+        return -EAGAIN;
+    }
+
+    ret = qcow2_get_refcount(bs, host_offset >> s->cluster_bits, &refcount);
+    if (ret < 0) {
+        return ret;
+    }
+    if (refcount >= s->refcount_max) {
+        return -EAGAIN;
+    }
+
+    ret = qcow2_update_cluster_refcount(bs, host_offset >> s->cluster_bits, 1,
+                                        false, QCOW2_DISCARD_NEVER);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (s->use_lazy_refcounts) {
+        qcow2_mark_dirty(bs);
+    }
+    if (qcow2_need_accurate_refcounts(s)) {
+        qcow2_cache_set_dependency(bs, s->l2_table_cache,
+                                   s->refcount_block_cache);
+    }
+
+    /*
+     * If updating the L2 tables fails, the cluster is left with a refcount
+     * that is too high, which only leaks space.
+     */
+    ret = get_cluster_table(bs, src_offset, &l2_slice, &l2_index);
+    if (ret < 0) {
+        return ret;
+    }
+    qcow2_cache_entry_mark_dirty(s->l2_table_cache, l2_slice);
+    set_l2_entry(s, l2_slice, l2_index, l2_entry & ~QCOW_OFLAG_COPIED);
+    qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+
+    ret = get_cluster_table(bs, offset, &l2_slice, &l2_index);
+    if (ret < 0) {
+        return ret;
+    }
+    qcow2_cache_entry_mark_dirty(s->l2_table_cache, l2_slice);
+    set_l2_entry(s, l2_slice, l2_index, host_offset);
+    qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+
+    return 1;
+}
+
+/*
+ * Sets QCOW_OFLAG_COPIED in the L2 entry of guest offset @offset if it maps
+ * the data cluster at @host_offset, whose refcount the caller knows to be 1.
+ *
+ * Returns 1 if the entry was updated, 0 if @offset does not map
+ * @host_offset and -errno on error.
+ */
+int GRAPH_RDLOCK
+qcow2_cluster_set_copied(BlockDriverState *bs, uint64_t offset,
+                         uint64_t host_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t *l2_slice, l2_entry;
+    int l2_index, ret;
+
+    ret = get_cluster_table(bs, offset, &l2_slice, &l2_index);
+    if (ret < 0) {
+        return ret;
+    }
+
+    l2_entry = get_l2_entry(s, l2_slice, l2_index);
+    if (qcow2_get_cluster_type(bs, l2_entry) != QCOW2_CLUSTER_NORMAL ||
+        (l2_entry & L2E_OFFSET_MASK) != host_offset) {
+        qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+        return 0;
+    }
+
+    if (!(l2_entry & QCOW_OFLAG_COPIED)) {
+        qcow2_cache_entry_mark_dirty(s->l2_table_cache, l2_slice);
+        set_l2_entry(s, l2_slice, l2_index, l2_entry | QCOW_OFLAG_COPIED);
+    }
+    qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+
+    return 1;
+}
+
 /*
  * This discards as many clusters of nb_clusters as possible at once (i.e.
  * all clusters in the same L2 slice) and returns the number of discarded
@@ -0,0 +1,338 @@
+/*
+ * Deduplication of qcow2 data clusters
+ *
+ * With the "dedup" option, the SHA-256 digest of every cluster written as
+ * a whole is computed in a worker thread.  Clusters that are newly
+ * allocated are entered into a table once their L2 entry has been
+ * updated; a later write of the same data to an unallocated cluster then
+ * only increases the refcount of the existing host cluster and points the
+ * new L2 entry at it.  Writing a cluster with the data it maps already is
+ * skipped.  Shared clusters are written to with the usual COW because they
+ * lose QCOW_OFLAG_COPIED.
+ *
+ * The table only lives in memory.  An entry is dropped when its host
+ * cluster may be written in place or is freed, and is checked against the
+ * L2 table before it is used, so a stale entry never leads to sharing a
+ * cluster that does not hold the data.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qcow2.h"
+#include "trace.h"
+
+/* Bounds the memory used by the table to roughly 128 MiB */
+#define QCOW2_DEDUP_MAX_ENTRIES (1 << 20)
+
+typedef struct Qcow2DedupEntry {
+    uint8_t digest[QCOW2_DEDUP_DIGEST_SIZE];
+    uint64_t host_offset;
+    /* Guest offsets that were made to map host_offset; some may be stale */
+    uint64_t *guest_offsets;
+    unsigned int nb_guest_offsets;
+} Qcow2DedupEntry;
+
+struct Qcow2Dedup {
+    GHashTable *by_digest;
+    GHashTable *by_host;
+    /* Host offsets of shared clusters whose refcount dropped to 1 */
+    GArray *unshared;
+};
+
+static guint dedup_digest_hash(gconstpointer key)
+{
+    guint hash;
+
+    /* The digest is uniformly distributed already */
+    memcpy(&hash, key, sizeof(hash));
+    return hash;
+}
+
+static gboolean dedup_digest_equal(gconstpointer a, gconstpointer b)
+{
+    return memcmp(a, b, QCOW2_DEDUP_DIGEST_SIZE) == 0;
+}
+
+static void dedup_entry_free(gpointer opaque)
+{
+    Qcow2DedupEntry *e = opaque;
+
+    g_free(e->guest_offsets);
+    g_free(e);
+}
+
+static void dedup_entry_remove(Qcow2Dedup *d, Qcow2DedupEntry *e)
+{
+    g_hash_table_remove(d->by_host, &e->host_offset);
+    g_hash_table_remove(d->by_digest, e->digest);
+}
+
+static void dedup_entry_add_guest(Qcow2DedupEntry *e, uint64_t offset)
+{
+    e->guest_offsets = g_renew(uint64_t, e->guest_offsets,
+                               e->nb_guest_offsets + 1);
+    e->guest_offsets[e->nb_guest_offsets++] = offset;
+}
+
+static void dedup_entry_del_guest(Qcow2DedupEntry *e, unsigned int i)
+{
+    e->guest_offsets[i] = e->guest_offsets[--e->nb_guest_offsets];
+}
+
+void qcow2_dedup_enable(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2Dedup *d;
+
+    if (s->dedup) {
+        return;
+    }
+
+    d = g_new0(Qcow2Dedup, 1);
+    d->by_digest = g_hash_table_new_full(dedup_digest_hash,
+                                         dedup_digest_equal,
+                                         NULL, dedup_entry_free);
+    d->by_host = g_hash_table_new(g_int64_hash, g_int64_equal);
+    d->unshared = g_array_new(false, false, sizeof(uint64_t));
+    s->dedup = d;
+}
+
+void qcow2_dedup_free(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2Dedup *d = s->dedup;
+
+    if (!d) {
+        return;
+    }
+
+    s->dedup = NULL;
+    g_hash_table_destroy(d->by_host);
+    g_hash_table_destroy(d->by_digest);
+    g_array_free(d->unshared, true);
+    g_free(d);
+}
+
+/*
+ * Tries to link the clusters starting at guest offset @offset to existing
+ * host clusters with the same contents.  @digests holds the digests of the
+ * *@bytes bytes to be written, which must be cluster aligned.
+ *
+ * Returns 1 if one or more clusters were linked, or map a cluster with the
+ * same contents already, and don't need to be written; *@bytes is then set
+ * to the number of bytes linked.  Returns 0 if the first cluster must be
+ * written normally; *@bytes is then shortened to the clusters before the
+ * next one that was linked.  Returns -errno on error.
+ *
+ * Called with s->lock held.
+ */
+int coroutine_fn GRAPH_RDLOCK
+qcow2_dedup_link(BlockDriverState *bs, uint64_t offset, unsigned int *bytes,
+                 const uint8_t *digests)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2Dedup *d = s->dedup;
+    unsigned int nb_clusters = *bytes >> s->cluster_bits;
+    unsigned int i, linked = 0;
+
+    assert(QEMU_IS_ALIGNED(offset | *bytes, s->cluster_size));
+
+    for (i = 0; i < nb_clusters; i++) {
+        uint64_t cluster_offset = offset + ((uint64_t)i << s->cluster_bits);
+        Qcow2DedupEntry *e;
+        int ret = 0;
+
+        e = g_hash_table_lookup(d->by_digest,
+                                digests + i * QCOW2_DEDUP_DIGEST_SIZE);
+
+        while (e && e->nb_guest_offsets > 0) {
+            ret = qcow2_cluster_share(bs, cluster_offset,
+                                      e->guest_offsets[0], e->host_offset);
+            if (ret != 0) {
+                break;
+            }
+            dedup_entry_del_guest(e, 0);
+        }
+        if (e && e->nb_guest_offsets == 0) {
+            /* No cluster maps it any more, the host cluster may be reused */
+            dedup_entry_remove(d, e);
+            e = NULL;
+        }
+
+        if (ret < 0 && ret != -EAGAIN) {
+            return ret;
+        } else if (ret <= 0) {
+            /*
+             * No usable duplicate, e.g. because the cluster is allocated
+             * elsewhere; it is written together with its neighbours.
+             */
+            if (linked > 0) {
+                break;
+            }
+            continue;
+        }
+
+        if (ret == 1) {
+            trace_qcow2_dedup_link(qemu_coroutine_self(), cluster_offset,
+                                   e->host_offset);
+            dedup_entry_add_guest(e, cluster_offset);
+        }
+        if (linked == 0 && i > 0) {
+            /*
+             * Write the clusters before this one; it maps the data now, so
+             * it is skipped next time.
+             */
+            break;
+        }
+        linked++;
+    }
+
+    if (linked > 0) {
+        *bytes = linked << s->cluster_bits;
+        return 1;
+    }
+
+    assert(i > 0);
+    *bytes = i << s->cluster_bits;
+    return 0;
+}
+
+/*
+ * Enters the clusters that @m has just linked into the table.
+ *
+ * Called with s->lock held.
+ */
+void qcow2_dedup_insert(BlockDriverState *bs, QCowL2Meta *m)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2Dedup *d = s->dedup;
+    int i;
+
+    if (!d || !m->dedup_digests) {
+        return;
+    }
+
+    for (i = 0; i < m->nb_clusters; i++) {
+        const uint8_t *digest = m->dedup_digests + i * QCOW2_DEDUP_DIGEST_SIZE;
+        uint64_t host_offset = m->alloc_offset +
+                               ((uint64_t)i << s->cluster_bits);
+        Qcow2DedupEntry *e;
+
+        if (g_hash_table_size(d->by_digest) >= QCOW2_DEDUP_MAX_ENTRIES ||
+            g_hash_table_contains(d->by_digest, digest)) {
+            continue;
+        }
+
+        e = g_hash_table_lookup(d->by_host, &host_offset);
+        if (e) {
+            dedup_entry_remove(d, e);
+        }
+
+        e = g_new0(Qcow2DedupEntry, 1);
+        memcpy(e->digest, digest, QCOW2_DEDUP_DIGEST_SIZE);
+        e->host_offset = host_offset;
+        dedup_entry_add_guest(e, m->offset + ((uint64_t)i << s->cluster_bits));
+        g_hash_table_insert(d->by_digest, e->digest, e);
+        g_hash_table_insert(d->by_host, &e->host_offset, e);
+    }
+}
+
+/*
+ * Drops the entries for host clusters in the given range, whose contents
+ * are about to change.
+ *
+ * Called with s->lock held.
+ */
+void qcow2_dedup_forget(BlockDriverState *bs, uint64_t host_offset,
+                        uint64_t bytes)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2Dedup *d = s->dedup;
+    uint64_t start = start_of_cluster(s, host_offset);
+    uint64_t end = ROUND_UP(host_offset + bytes, s->cluster_size);
+    uint64_t offset;
+
+    if (g_hash_table_size(d->by_host) == 0) {
+        return;
+    }
+
+    for (offset = start; offset < end; offset += s->cluster_size) {
+        Qcow2DedupEntry *e = g_hash_table_lookup(d->by_host, &offset);
+
+        if (e) {
+            dedup_entry_remove(d, e);
+        }
+    }
+}
+
+/*
+ * Called when the refcount of the cluster at @host_offset was changed to
+ * @refcount.
+ */
+void qcow2_dedup_refcount_changed(BlockDriverState *bs, uint64_t host_offset,
+                                  uint64_t refcount)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2Dedup *d = s->dedup;
+
+    if (refcount == 0) {
+        qcow2_dedup_forget(bs, host_offset, s->cluster_size);
+    } else if (refcount == 1 &&
+               g_hash_table_contains(d->by_host, &host_offset)) {
+        /*
+         * The remaining L2 entry needs QCOW_OFLAG_COPIED again, but the
+         * caller may be holding L2 slices, so do that later.
+         */
+        g_array_append_val(d->unshared, host_offset);
+    }
+}
+
+/*
+ * Sets QCOW_OFLAG_COPIED for the clusters that are no longer shared, so
+ * that the L2 entries agree with the refcounts when the metadata is
+ * written out.
+ *
+ * Called with s->lock held.
+ */
+int GRAPH_RDLOCK qcow2_dedup_restore_copied(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2Dedup *d = s->dedup;
+    int ret = 0;
+
+    if (!d) {
+        return 0;
+    }
+
+    while (d->unshared->len > 0 && ret >= 0) {
+        uint64_t host_offset = g_array_index(d->unshared, uint64_t,
+                                             d->unshared->len - 1);
+        Qcow2DedupEntry *e = g_hash_table_lookup(d->by_host, &host_offset);
+        uint64_t refcount;
+
+        ret = qcow2_get_refcount(bs, host_offset >> s->cluster_bits,
+                                 &refcount);
+        if (ret < 0) {
+            break;
+        }
+        g_array_set_size(d->unshared, d->unshared->len - 1);
+        if (!e || refcount != 1) {
+            continue;
+        }
+
+        while (e->nb_guest_offsets > 0) {
+            ret = qcow2_cluster_set_copied(bs, e->guest_offsets[0],
+                                           host_offset);
+            if (ret != 0) {
+                break;
+            }
+            dedup_entry_del_guest(e, 0);
+        }
+        if (e->nb_guest_offsets == 0) {
+            dedup_entry_remove(d, e);
+        }
+    }
+
+    return ret < 0 ? ret : 0;
+}
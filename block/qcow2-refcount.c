@@ -23,6 +23,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "block/aio_task.h"
 #include "block/block-io.h"
 #include "qapi/error.h"
 #include "qcow2.h"
@@ -30,6 +31,7 @@
 #include "qemu/bswap.h"
 #include "qemu/cutils.h"
 #include "qemu/memalign.h"
+#include "qemu/qemu-progress.h"
 #include "trace.h"
 
 static int64_t alloc_clusters_noref(BlockDriverState *bs, uint64_t size,
@@ -885,6 +887,10 @@ update_refcount(BlockDriverState *bs, int64_t offset, int64_t length,
         }
         s->set_refcount(refcount_block, block_index, refcount);
 
+        if (s->dedup) {
+            qcow2_dedup_refcount_changed(bs, cluster_offset, refcount);
+        }
+
         if (refcount == 0) {
             void *table;
 
@@ -1011,6 +1017,9 @@ int64_t qcow2_alloc_clusters(BlockDriverState *bs, uint64_t size)
     int64_t offset;
     int ret;
 
+    /* Keep metadata where it would be without a data cluster reservation */
+    qcow2_release_reserved_clusters(bs);
+
     BLKDBG_EVENT(bs->file, BLKDBG_CLUSTER_ALLOC);
     do {
         offset = alloc_clusters_noref(bs, size, QCOW_MAX_CLUSTER_OFFSET);
@@ -1028,6 +1037,76 @@ int64_t qcow2_alloc_clusters(BlockDriverState *bs, uint64_t size)
     return offset;
 }
 
+/*
+ * Allocates *@nb_clusters contiguous clusters for guest data.
+ *
+ * The refcounts of data clusters are updated in batches: the free clusters
+ * following an allocation are reserved, up to QCOW2_ALLOC_BATCH_SIZE bytes
+ * in all, and the following allocations are carved out of them without
+ * going through the refcount blocks again.  The part that was not handed
+ * out yet is given back by qcow2_release_reserved_clusters(), which runs
+ * on every flush and before any other allocation, so a flushed image has
+ * no leaked clusters and metadata is placed as without the reservation.
+ *
+ * If @partial is true, only hand out what is left of the current run, and
+ * reduce *@nb_clusters accordingly (possibly to 0).  This lets callers grow
+ * a previous allocation in place.
+ */
+int64_t coroutine_fn
+qcow2_alloc_data_clusters(BlockDriverState *bs, uint64_t *nb_clusters,
+                          bool partial)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t batch = QCOW2_ALLOC_BATCH_SIZE >> s->cluster_bits;
+    int64_t offset, extra;
+
+    if (partial) {
+        *nb_clusters = MIN(*nb_clusters, s->reserved_clusters);
+    } else if (*nb_clusters > s->reserved_clusters) {
+        /* Releases the old reservation first */
+        offset = qcow2_alloc_clusters(bs, *nb_clusters << s->cluster_bits);
+        if (offset < 0) {
+            return offset;
+        }
+
+        /*
+         * Grow in place only, so that an image without free holes gets
+         * the same layout as without batching.  Failing to reserve is not
+         * an error.
+         */
+        extra = 0;
+        if (batch > *nb_clusters) {
+            extra = qcow2_alloc_clusters_at(bs,
+                        offset + (*nb_clusters << s->cluster_bits),
+                        batch - *nb_clusters);
+        }
+        s->reserved_offset = offset;
+        s->reserved_clusters = *nb_clusters + MAX(extra, 0);
+    }
+
+    offset = s->reserved_offset;
+    s->reserved_offset += *nb_clusters << s->cluster_bits;
+    s->reserved_clusters -= *nb_clusters;
+    return offset;
+}
+
+/*
+ * Frees the clusters reserved by qcow2_alloc_data_clusters().  Must be
+ * called before anything that expects every cluster with a refcount to be
+ * referenced, like a refcount check or a clean shutdown.
+ */
+void qcow2_release_reserved_clusters(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (s->reserved_clusters) {
+        qcow2_free_clusters(bs, s->reserved_offset,
+                            s->reserved_clusters << s->cluster_bits,
+                            QCOW2_DISCARD_NEVER);
+        s->reserved_clusters = 0;
+    }
+}
+
 int64_t coroutine_fn qcow2_alloc_clusters_at(BlockDriverState *bs, uint64_t offset,
                                              int64_t nb_clusters)
 {
@@ -1074,6 +1153,8 @@ int64_t coroutine_fn GRAPH_RDLOCK qcow2_alloc_bytes(BlockDriverState *bs, int si
     size_t free_in_cluster;
     int ret;
 
+    qcow2_release_reserved_clusters(bs);
+
     BLKDBG_CO_EVENT(bs->file, BLKDBG_CLUSTER_ALLOC_BYTES);
     assert(size > 0 && size <= s->cluster_size);
     assert(!s->free_byte_offset || offset_into_cluster(s, s->free_byte_offset));
@@ -1453,18 +1534,74 @@ fail:
 /* refcount checking functions */
 
 
-static uint64_t refcount_array_byte_size(BDRVQcow2State *s, uint64_t entries)
+/*
+ * The in-memory refcount table (IMRT) is an array of pointers to
+ * refblocks: chunk i holds the refcounts of the clusters covered by
+ * refblock i, in the on-disk format, and is only allocated once one of
+ * them is referenced.  Memory use thus follows the referenced clusters
+ * rather than the length of the image file, which can be much larger
+ * after discards, and growing the table never copies the refcounts.
+ */
+
+/* Returns the number of chunks covering @entries clusters */
+static uint64_t refcount_array_chunks(BDRVQcow2State *s, uint64_t entries)
 {
-    /* This assertion holds because there is no way we can address more than
-     * 2^(64 - 9) clusters at once (with cluster size 512 = 2^9, and because
-     * offsets have to be representable in bytes); due to every cluster
-     * corresponding to one refcount entry, we are well below that limit */
-    assert(entries < (UINT64_C(1) << (64 - 9)));
+    return DIV_ROUND_UP(entries, s->refcount_block_size);
+}
 
-    /* Thanks to the assertion this will not overflow, because
-     * s->refcount_order < 7.
-     * (note: x << s->refcount_order == x * s->refcount_bits) */
-    return DIV_ROUND_UP(entries << s->refcount_order, 8);
+static uint64_t refcount_array_get(BDRVQcow2State *s, void *array,
+                                   uint64_t cluster)
+{
+    void *chunk = ((void **)array)[cluster >> s->refcount_block_bits];
+
+    if (!chunk) {
+        return 0;
+    }
+    return s->get_refcount(chunk, cluster & (s->refcount_block_size - 1));
+}
+
+/* Returns 0 or -ENOMEM if the chunk holding @cluster cannot be allocated */
+static int refcount_array_set(BDRVQcow2State *s, void *array,
+                              uint64_t cluster, uint64_t value)
+{
+    void **chunk = &((void **)array)[cluster >> s->refcount_block_bits];
+
+    if (!*chunk) {
+        if (!value) {
+            return 0;
+        }
+        *chunk = g_try_malloc0(s->cluster_size);
+        if (!*chunk) {
+            return -ENOMEM;
+        }
+    }
+    s->set_refcount(*chunk, cluster & (s->refcount_block_size - 1), value);
+    return 0;
+}
+
+/* Sets all refcounts in the array of @size entries to 0 */
+static void clear_refcount_array(BDRVQcow2State *s, void *array, int64_t size)
+{
+    void **chunks = array;
+
+    for (uint64_t i = 0; i < refcount_array_chunks(s, size); i++) {
+        if (chunks[i]) {
+            memset(chunks[i], 0, s->cluster_size);
+        }
+    }
+}
+
+static void free_refcount_array(BDRVQcow2State *s, void *array, int64_t size)
+{
+    void **chunks = array;
+
+    if (!chunks) {
+        return;
+    }
+    for (uint64_t i = 0; i < refcount_array_chunks(s, size); i++) {
+        g_free(chunks[i]);
+    }
+    g_free(chunks);
 }
 
 /**
@@ -1472,41 +1609,37 @@ static uint64_t refcount_array_byte_size(BDRVQcow2State *s, uint64_t entries)
  * the current number of entries in *array. If the reallocation fails, *array
  * and *size will not be modified and -errno will be returned. If the
  * reallocation is successful, *array will be set to the new buffer, *size
- * will be set to new_size and 0 will be returned. The size of the reallocated
- * refcount array buffer will be aligned to a cluster boundary, and the newly
- * allocated area will be zeroed.
+ * will be set to new_size and 0 will be returned. The refcounts of the new
+ * entries are 0.
  */
 static int realloc_refcount_array(BDRVQcow2State *s, void **array,
                                   int64_t *size, int64_t new_size)
 {
-    int64_t old_byte_size, new_byte_size;
-    void *new_ptr;
+    uint64_t old_chunks, new_chunks;
+    void **new_ptr;
 
-    /* Round to clusters so the array can be directly written to disk */
-    old_byte_size = size_to_clusters(s, refcount_array_byte_size(s, *size))
-                    * s->cluster_size;
-    new_byte_size = size_to_clusters(s, refcount_array_byte_size(s, new_size))
-                    * s->cluster_size;
+    old_chunks = refcount_array_chunks(s, *size);
+    new_chunks = refcount_array_chunks(s, new_size);
 
-    if (new_byte_size == old_byte_size) {
+    if (new_chunks == old_chunks) {
         *size = new_size;
         return 0;
     }
 
-    assert(new_byte_size > 0);
+    assert(new_chunks > 0);
 
-    if (new_byte_size > SIZE_MAX) {
+    if (new_chunks > SIZE_MAX / sizeof(void *)) {
         return -ENOMEM;
     }
 
-    new_ptr = g_try_realloc(*array, new_byte_size);
+    new_ptr = g_try_renew(void *, *array, new_chunks);
     if (!new_ptr) {
         return -ENOMEM;
     }
 
-    if (new_byte_size > old_byte_size) {
-        memset((char *)new_ptr + old_byte_size, 0,
-               new_byte_size - old_byte_size);
+    if (new_chunks > old_chunks) {
+        memset(new_ptr + old_chunks, 0,
+               (new_chunks - old_chunks) * sizeof(void *));
     }
 
     *array = new_ptr;
@@ -1569,7 +1702,7 @@ qcow2_inc_refcounts_imrt(BlockDriverState *bs, BdrvCheckResult *res,
             }
         }
 
-        refcount = s->get_refcount(*refcount_table, k);
+        refcount = refcount_array_get(s, *refcount_table, k);
         if (refcount == s->refcount_max) {
             fprintf(stderr, "ERROR: overflow cluster offset=0x%" PRIx64
                     "\n", cluster_offset);
@@ -1579,7 +1712,11 @@ qcow2_inc_refcounts_imrt(BlockDriverState *bs, BdrvCheckResult *res,
             res->corruptions++;
             continue;
         }
-        s->set_refcount(*refcount_table, k, refcount + 1);
+        ret = refcount_array_set(s, *refcount_table, k, refcount + 1);
+        if (ret < 0) {
+            res->check_errors++;
+            return ret;
+        }
     }
 
     return 0;
@@ -1656,6 +1793,9 @@ fail:
  * referenced in the L2 table. While doing so, performs some checks on L2
  * entries.
  *
+ * @l2_table is the L2 table that has been read from @l2_offset.  Entries
+ * that are repaired are updated both on disk and in @l2_table.
+ *
  * Returns the number of errors found by the checks or -errno if an internal
  * error occurred.
  */
@@ -1663,24 +1803,15 @@ static int coroutine_fn GRAPH_RDLOCK
 check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
                    void **refcount_table,
                    int64_t *refcount_table_size, int64_t l2_offset,
+                   uint64_t *l2_table,
                    int flags, BdrvCheckMode fix, bool active)
 {
     BDRVQcow2State *s = bs->opaque;
     uint64_t l2_entry, l2_bitmap;
     uint64_t next_contiguous_offset = 0;
     int i, ret;
-    size_t l2_size_bytes = s->l2_size * l2_entry_size(s);
-    g_autofree uint64_t *l2_table = g_malloc(l2_size_bytes);
     bool metadata_overlap;
 
-    /* Read L2 table from disk */
-    ret = bdrv_co_pread(bs->file, l2_offset, l2_size_bytes, l2_table, 0);
-    if (ret < 0) {
-        fprintf(stderr, "ERROR: I/O error in check_refcounts_l2\n");
-        res->check_errors++;
-        return ret;
-    }
-
     /* Do the actual checks */
     for (i = 0; i < s->l2_size; i++) {
         uint64_t coffset;
@@ -1851,11 +1982,66 @@ check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
     return 0;
 }
 
+typedef struct Qcow2CheckProgress {
+    int64_t l1_entries_done;
+    int64_t l1_entries_total;
+} Qcow2CheckProgress;
+
+/* An L2 table that check_refcounts_l1() reads ahead of checking it */
+typedef struct Qcow2CheckL2Read {
+    uint64_t *l2_table;
+    bool done;
+    int ret;
+} Qcow2CheckL2Read;
+
+typedef struct Qcow2CheckL2Task {
+    AioTask task;
+    BlockDriverState *bs;
+    uint64_t l2_offset;
+    Qcow2CheckL2Read *read;
+} Qcow2CheckL2Task;
+
+static int coroutine_fn GRAPH_RDLOCK check_l2_read_task_entry(AioTask *task)
+{
+    Qcow2CheckL2Task *t = container_of(task, Qcow2CheckL2Task, task);
+    BDRVQcow2State *s = t->bs->opaque;
+
+    t->read->ret = bdrv_co_pread(t->bs->file, t->l2_offset,
+                                 s->l2_size * l2_entry_size(s),
+                                 t->read->l2_table, 0);
+    t->read->done = true;
+
+    /* Errors are reported by check_refcounts_l1() when it gets to the table */
+    return 0;
+}
+
+static void coroutine_fn check_l2_read_start(BlockDriverState *bs,
+                                             AioTaskPool *pool,
+                                             uint64_t l2_offset,
+                                             Qcow2CheckL2Read *read)
+{
+    Qcow2CheckL2Task *task = g_new(Qcow2CheckL2Task, 1);
+
+    *task = (Qcow2CheckL2Task) {
+        .task.func = check_l2_read_task_entry,
+        .bs = bs,
+        .l2_offset = l2_offset,
+        .read = read,
+    };
+
+    read->done = false;
+    aio_task_pool_start_task(pool, &task->task);
+}
+
 /*
  * Increases the refcount for the L1 table, its L2 tables and all referenced
  * clusters in the given refcount table. While doing so, performs some checks
  * on L1 and L2 entries.
  *
+ * Up to QCOW2_CHECK_L2_READAHEAD L2 tables are read in parallel ahead of the
+ * one being checked.  The tables are still checked in L1 order, so messages
+ * and repairs happen in the same order as with one table at a time.
+ *
  * Returns the number of errors found by the checks or -errno if an internal
  * error occurred.
  */
@@ -1863,13 +2049,19 @@ static int coroutine_fn GRAPH_RDLOCK
 check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
                    void **refcount_table, int64_t *refcount_table_size,
                    int64_t l1_table_offset, int l1_size,
-                   int flags, BdrvCheckMode fix, bool active)
+                   int flags, BdrvCheckMode fix, bool active,
+                   Qcow2CheckProgress *progress)
 {
     BDRVQcow2State *s = bs->opaque;
     size_t l1_size_bytes = l1_size * L1E_SIZE;
+    size_t l2_size_bytes = s->l2_size * l2_entry_size(s);
     g_autofree uint64_t *l1_table = NULL;
+    g_autofree Qcow2CheckL2Read *reads = NULL;
+    AioTaskPool *pool;
     uint64_t l2_offset;
-    int i, ret;
+    int64_t issued = 0, checked = 0;
+    int i, j, next_read = 0, nb_reads;
+    int ret;
 
     if (!l1_size) {
         return 0;
@@ -1900,12 +2092,52 @@ check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
         be64_to_cpus(&l1_table[i]);
     }
 
+    nb_reads = MIN(l1_size, QCOW2_CHECK_L2_READAHEAD);
+    reads = g_new0(Qcow2CheckL2Read, nb_reads);
+    for (j = 0; j < nb_reads; j++) {
+        reads[j].l2_table = g_try_malloc(l2_size_bytes);
+        if (!reads[j].l2_table) {
+            ret = -ENOMEM;
+            res->check_errors++;
+            goto out_free;
+        }
+    }
+    pool = aio_task_pool_new(nb_reads);
+
     /* Do the actual checks */
     for (i = 0; i < l1_size; i++) {
+        Qcow2CheckL2Read *read;
+
+        if (progress) {
+            progress->l1_entries_done++;
+            qemu_progress_print(100.f * progress->l1_entries_done /
+                                progress->l1_entries_total, 0);
+        }
+
         if (!l1_table[i]) {
             continue;
         }
 
+        /*
+         * Start reading the next L2 tables.  The buffer of the table checked
+         * last is free again at this point.
+         */
+        for (; next_read < l1_size && issued - checked < nb_reads;
+             next_read++) {
+            if (l1_table[next_read]) {
+                check_l2_read_start(bs, pool,
+                                    l1_table[next_read] & L1E_OFFSET_MASK,
+                                    &reads[issued % nb_reads]);
+                issued++;
+            }
+        }
+
+        read = &reads[checked % nb_reads];
+        checked++;
+        while (!read->done) {
+            aio_task_pool_wait_one(pool);
+        }
+
         if (l1_table[i] & L1E_RESERVED_MASK) {
             fprintf(stderr, "ERROR found L1 entry with reserved bits set: "
                     "%" PRIx64 "\n", l1_table[i]);
@@ -1919,7 +2151,7 @@ check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
                                        refcount_table, refcount_table_size,
                                        l2_offset, s->cluster_size);
         if (ret < 0) {
-            return ret;
+            goto out;
         }
 
         /* L2 tables are cluster aligned */
@@ -1929,16 +2161,32 @@ check_refcounts_l1(BlockDriverState *bs, BdrvCheckResult *res,
             res->corruptions++;
         }
 
+        if (read->ret < 0) {
+            fprintf(stderr, "ERROR: I/O error in check_refcounts_l2\n");
+            res->check_errors++;
+            ret = read->ret;
+            goto out;
+        }
+
         /* Process and check L2 entries */
         ret = check_refcounts_l2(bs, res, refcount_table,
-                                 refcount_table_size, l2_offset, flags,
-                                 fix, active);
+                                 refcount_table_size, l2_offset,
+                                 read->l2_table, flags, fix, active);
         if (ret < 0) {
-            return ret;
+            goto out;
         }
     }
 
-    return 0;
+    ret = 0;
+out:
+    /* Tables that were read ahead must not land in freed buffers */
+    aio_task_pool_wait_all(pool);
+    aio_task_pool_free(pool);
+out_free:
+    for (j = 0; j < nb_reads; j++) {
+        g_free(reads[j].l2_table);
+    }
+    return ret;
 }
 
 /*
@@ -2181,10 +2429,10 @@ resize_fail:
             if (ret < 0) {
                 return ret;
             }
-            if (s->get_refcount(*refcount_table, cluster) != 1) {
+            if (refcount_array_get(s, *refcount_table, cluster) != 1) {
                 fprintf(stderr, "ERROR refcount block %" PRId64
                         " refcount=%" PRIu64 "\n", i,
-                        s->get_refcount(*refcount_table, cluster));
+                        refcount_array_get(s, *refcount_table, cluster));
                 res->corruptions++;
                 *rebuild = true;
             }
@@ -2195,18 +2443,27 @@ resize_fail:
 }
 
 /*
- * Calculates an in-memory refcount table.
+ * Calculates an in-memory refcount table.  If @report_progress is true,
+ * the share of L1 entries that have been checked is reported with
+ * qemu_progress_print().
  */
 static int coroutine_fn GRAPH_RDLOCK
 calculate_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
                     BdrvCheckMode fix, bool *rebuild,
-                    void **refcount_table, int64_t *nb_clusters)
+                    void **refcount_table, int64_t *nb_clusters,
+                    bool report_progress)
 {
     BDRVQcow2State *s = bs->opaque;
+    Qcow2CheckProgress progress = { 0 };
     int64_t i;
     QCowSnapshot *sn;
     int ret;
 
+    progress.l1_entries_total = s->l1_size;
+    for (i = 0; i < s->nb_snapshots; i++) {
+        progress.l1_entries_total += s->snapshots[i].l1_size;
+    }
+
     if (!*refcount_table) {
         int64_t old_size = 0;
         ret = realloc_refcount_array(s, refcount_table,
@@ -2227,7 +2484,7 @@ calculate_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
     /* current L1 table */
     ret = check_refcounts_l1(bs, res, refcount_table, nb_clusters,
                              s->l1_table_offset, s->l1_size, CHECK_FRAG_INFO,
-                             fix, true);
+                             fix, true, report_progress ? &progress : NULL);
     if (ret < 0) {
         return ret;
     }
@@ -2257,7 +2514,7 @@ calculate_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
         }
         ret = check_refcounts_l1(bs, res, refcount_table, nb_clusters,
                                  sn->l1_table_offset, sn->l1_size, 0, fix,
-                                 false);
+                                 false, report_progress ? &progress : NULL);
         if (ret < 0) {
             return ret;
         }
@@ -2287,6 +2544,16 @@ calculate_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
         }
     }
 
+    /* compression dictionary */
+    if (s->compression_dict.length) {
+        ret = qcow2_inc_refcounts_imrt(bs, res, refcount_table, nb_clusters,
+                                       s->compression_dict.offset,
+                                       s->compression_dict.length);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
     /* bitmaps */
     ret = qcow2_check_bitmaps_refcounts(bs, res, refcount_table, nb_clusters);
     if (ret < 0) {
@@ -2320,7 +2587,7 @@ compare_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
             continue;
         }
 
-        refcount2 = s->get_refcount(refcount_table, i);
+        refcount2 = refcount_array_get(s, refcount_table, i);
 
         if (refcount1 > 0 || refcount2 > 0) {
             *highest_cluster = i;
@@ -2396,7 +2663,7 @@ static int64_t alloc_clusters_imrt(BlockDriverState *bs,
          contiguous_free_clusters < cluster_count;
          cluster++)
     {
-        if (!s->get_refcount(*refcount_table, cluster)) {
+        if (!refcount_array_get(s, *refcount_table, cluster)) {
             contiguous_free_clusters++;
             if (first_gap) {
                 /* If this is the first free cluster found, update
@@ -2434,7 +2701,10 @@ static int64_t alloc_clusters_imrt(BlockDriverState *bs,
     /* Go back to the first free cluster */
     cluster -= contiguous_free_clusters;
     for (i = 0; i < cluster_count; i++) {
-        s->set_refcount(*refcount_table, cluster + i, 1);
+        ret = refcount_array_set(s, *refcount_table, cluster + i, 1);
+        if (ret < 0) {
+            return ret;
+        }
     }
 
     return cluster << s->cluster_bits;
@@ -2446,8 +2716,8 @@ static int64_t alloc_clusters_imrt(BlockDriverState *bs,
  * Scan the range of clusters [first_cluster, end_cluster) for allocated
  * clusters and write all corresponding refblocks to disk.  The refblock
  * and allocation data is taken from the in-memory refcount table
- * *refcount_table[] (of size *nb_clusters), which is basically one big
- * (unlimited size) refblock for the whole image.
+ * *refcount_table[] (of size *nb_clusters), whose chunks already are the
+ * refblocks for the whole image.
  *
  * For these refblocks, clusters are allocated using said in-memory
  * refcount table.  Care is taken that these allocations are reflected
@@ -2485,14 +2755,14 @@ rebuild_refcounts_write_refblocks(
 
     for (cluster = first_cluster; cluster < end_cluster; cluster++) {
         /* Check all clusters to find refblocks that contain non-zero entries */
-        if (!s->get_refcount(*refcount_table, cluster)) {
+        if (!refcount_array_get(s, *refcount_table, cluster)) {
             continue;
         }
 
         /*
          * This cluster is allocated, so we need to create a refblock
          * for it.  The data we will write to disk is just the
-         * respective slice from *refcount_table, so it will contain
+         * respective chunk of *refcount_table, so it will contain
          * accurate refcounts for all clusters belonging to this
          * refblock.  After we have written it, we will therefore skip
          * all remaining clusters in this refblock.
@@ -2573,13 +2843,11 @@ rebuild_refcounts_write_refblocks(
         }
 
         /*
-         * The refblock is simply a slice of *refcount_table.
-         * Note that the size of *refcount_table is always aligned to
-         * whole clusters, so the write operation will not result in
-         * out-of-bounds accesses.
+         * The refblock is simply a chunk of *refcount_table, which exists
+         * because this cluster has a reference.
          */
-        on_disk_refblock = (void *)((char *) *refcount_table +
-                                    refblock_index * s->cluster_size);
+        on_disk_refblock = ((void **)*refcount_table)[refblock_index];
+        assert(on_disk_refblock);
 
         ret = bdrv_co_pwrite(bs->file, refblock_offset, s->cluster_size,
                              on_disk_refblock, 0);
@@ -2598,7 +2866,7 @@ rebuild_refcounts_write_refblocks(
 /*
  * Creates a new refcount structure based solely on the in-memory information
  * given through *refcount_table (this in-memory information is basically just
- * the concatenation of all refblocks).  All necessary allocations will be
+ * the array of all refblocks).  All necessary allocations will be
  * reflected in that array.
  *
  * On success, the old refcount structure is leaked (it will be covered by the
@@ -2629,7 +2897,7 @@ rebuild_refcount_structure(BlockDriverState *bs, BdrvCheckResult *res,
      * For each refblock containing entries, we try to allocate a
      * cluster (in the in-memory refcount table) and write its offset
      * into on_disk_reftable[].  We then write the whole refblock to
-     * disk (as a slice of the in-memory refcount table).
+     * disk (as a chunk of the in-memory refcount table).
      * This is done by rebuild_refcounts_write_refblocks().
      *
      * Once we have scanned all clusters, we try to find space for the
@@ -2805,7 +3073,7 @@ qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode
         size_to_clusters(s, bs->total_sectors * BDRV_SECTOR_SIZE);
 
     ret = calculate_refcounts(bs, res, fix, &rebuild, &refcount_table,
-                              &nb_clusters);
+                              &nb_clusters, s->check_progress);
     if (ret < 0) {
         goto fail;
     }
@@ -2836,9 +3104,9 @@ qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode
         /* Because the old reftable has been exchanged for a new one the
          * references have to be recalculated */
         rebuild = false;
-        memset(refcount_table, 0, refcount_array_byte_size(s, nb_clusters));
+        clear_refcount_array(s, refcount_table, nb_clusters);
         ret = calculate_refcounts(bs, res, 0, &rebuild, &refcount_table,
-                                  &nb_clusters);
+                                  &nb_clusters, false);
         if (ret < 0) {
             goto fail;
         }
@@ -2896,7 +3164,7 @@ qcow2_check_refcounts(BlockDriverState *bs, BdrvCheckResult *res, BdrvCheckMode
     ret = 0;
 
 fail:
-    g_free(refcount_table);
+    free_refcount_array(s, refcount_table, nb_clusters);
 
     return ret;
 }
@@ -3040,6 +3308,14 @@ int qcow2_check_metadata_overlap(BlockDriverState *bs, int ign, int64_t offset,
         }
     }
 
+    if ((chk & QCOW2_OL_COMPRESSION_DICT) && s->compression_dict.offset) {
+        if (overlaps_with(s->compression_dict.offset,
+                          s->compression_dict.length))
+        {
+            return QCOW2_OL_COMPRESSION_DICT;
+        }
+    }
+
     return 0;
 }
 
@@ -3053,6 +3329,7 @@ static const char *metadata_ol_names[] = {
     [QCOW2_OL_INACTIVE_L1_BITNR]        = "inactive L1 table",
     [QCOW2_OL_INACTIVE_L2_BITNR]        = "inactive L2 table",
     [QCOW2_OL_BITMAP_DIRECTORY_BITNR]   = "bitmap directory",
+    [QCOW2_OL_COMPRESSION_DICT_BITNR]   = "compression dictionary",
 };
 QEMU_BUILD_BUG_ON(QCOW2_OL_MAX_BITNR != ARRAY_SIZE(metadata_ol_names));
 
@@ -1,5 +1,5 @@
 /*
- * Threaded data processing for Qcow2: compression, encryption
+ * Threaded data processing for Qcow2: compression, encryption, hashing
  *
  * Copyright (c) 2004-2006 Fabrice Bellard
  * Copyright (c) 2018 Virtuozzo International GmbH. All rights reserved.
@@ -33,10 +33,13 @@
 #include <zstd_errors.h>
 #endif
 
+#include "qapi/error.h"
+#include "qemu/notify.h"
 #include "qcow2.h"
 #include "block/block-io.h"
 #include "block/thread-pool.h"
 #include "crypto.h"
+#include "crypto/hash.h"
 
 static int coroutine_fn
 qcow2_co_process(BlockDriverState *bs, ThreadPoolFunc *func, void *arg)
@@ -45,7 +48,7 @@ qcow2_co_process(BlockDriverState *bs, ThreadPoolFunc *func, void *arg)
     BDRVQcow2State *s = bs->opaque;
 
     qemu_co_mutex_lock(&s->lock);
-    while (s->nb_threads >= QCOW2_MAX_THREADS) {
+    while (s->nb_threads >= s->max_threads) {
         qemu_co_queue_wait(&s->thread_task_queue, &s->lock);
     }
     s->nb_threads++;
@@ -67,12 +70,14 @@ qcow2_co_process(BlockDriverState *bs, ThreadPoolFunc *func, void *arg)
  */
 
 typedef ssize_t (*Qcow2CompressFunc)(void *dest, size_t dest_size,
-                                     const void *src, size_t src_size);
+                                     const void *src, size_t src_size,
+                                     void *dict);
 typedef struct Qcow2CompressData {
     void *dest;
     size_t dest_size;
     const void *src;
     size_t src_size;
+    void *dict;
     ssize_t ret;
 
     Qcow2CompressFunc func;
@@ -85,13 +90,15 @@ typedef struct Qcow2CompressData {
  *
  * @dest - destination buffer, @dest_size bytes
  * @src - source buffer, @src_size bytes
+ * @dict - unused
  *
  * Returns: compressed size on success
  *          -ENOMEM destination buffer is not enough to store compressed data
  *          -EIO    on any other error
  */
 static ssize_t qcow2_zlib_compress(void *dest, size_t dest_size,
-                                   const void *src, size_t src_size)
+                                   const void *src, size_t src_size,
+                                   void *dict)
 {
     ssize_t ret;
     z_stream strm;
@@ -133,12 +140,14 @@ static ssize_t qcow2_zlib_compress(void *dest, size_t dest_size,
  *
  * @dest - destination buffer, @dest_size bytes
  * @src - source buffer, @src_size bytes
+ * @dict - unused
  *
  * Returns: 0 on success
  *          -EIO on fail
  */
 static ssize_t qcow2_zlib_decompress(void *dest, size_t dest_size,
-                                     const void *src, size_t src_size)
+                                     const void *src, size_t src_size,
+                                     void *dict)
 {
     int ret;
     z_stream strm;
@@ -173,6 +182,31 @@ static ssize_t qcow2_zlib_decompress(void *dest, size_t dest_size,
 
 #ifdef CONFIG_ZSTD
 
+/*
+ * zstd contexts are large and expensive to set up, so each worker thread
+ * keeps one for compression and one for decompression and reuses them for
+ * every cluster.
+ */
+static __thread ZSTD_CCtx *qcow2_zstd_cctx;
+static __thread ZSTD_DCtx *qcow2_zstd_dctx;
+static __thread Notifier qcow2_zstd_exit_notifier;
+
+static void qcow2_zstd_thread_exit(Notifier *n, void *unused)
+{
+    ZSTD_freeCCtx(qcow2_zstd_cctx);
+    qcow2_zstd_cctx = NULL;
+    ZSTD_freeDCtx(qcow2_zstd_dctx);
+    qcow2_zstd_dctx = NULL;
+}
+
+static void qcow2_zstd_thread_init(void)
+{
+    if (!qcow2_zstd_exit_notifier.notify) {
+        qcow2_zstd_exit_notifier.notify = qcow2_zstd_thread_exit;
+        qemu_thread_atexit_add(&qcow2_zstd_exit_notifier);
+    }
+}
+
 /*
  * qcow2_zstd_compress()
  *
@@ -180,13 +214,15 @@ static ssize_t qcow2_zlib_decompress(void *dest, size_t dest_size,
  *
  * @dest - destination buffer, @dest_size bytes
  * @src - source buffer, @src_size bytes
+ * @dict - ZSTD_CDict to compress with, or NULL
  *
  * Returns: compressed size on success
  *          -ENOMEM destination buffer is not enough to store compressed data
  *          -EIO    on any other error
  */
 static ssize_t qcow2_zstd_compress(void *dest, size_t dest_size,
-                                   const void *src, size_t src_size)
+                                   const void *src, size_t src_size,
+                                   void *dict)
 {
     ssize_t ret;
     size_t zstd_ret;
@@ -200,11 +236,21 @@ static ssize_t qcow2_zstd_compress(void *dest, size_t dest_size,
         .size = src_size,
         .pos = 0
     };
-    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ZSTD_CCtx *cctx = qcow2_zstd_cctx;
 
     if (!cctx) {
+        cctx = qcow2_zstd_cctx = ZSTD_createCCtx();
+        if (!cctx) {
+            return -EIO;
+        }
+        qcow2_zstd_thread_init();
+    }
+
+    ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+    if (dict && ZSTD_isError(ZSTD_CCtx_refCDict(cctx, dict))) {
         return -EIO;
     }
+
     /*
      * Use the zstd streamed interface for symmetry with decompression,
      * where streaming is essential since we don't record the exact
@@ -237,7 +283,6 @@ static ssize_t qcow2_zstd_compress(void *dest, size_t dest_size,
     assert(output.pos <= dest_size);
     ret = output.pos;
 out:
-    ZSTD_freeCCtx(cctx);
     return ret;
 }
 
@@ -249,12 +294,14 @@ out:
  *
  * @dest - destination buffer, @dest_size bytes
  * @src - source buffer, @src_size bytes
+ * @dict - ZSTD_DDict to decompress with, or NULL
  *
  * Returns: 0 on success
  *          -EIO on any error
  */
 static ssize_t qcow2_zstd_decompress(void *dest, size_t dest_size,
-                                     const void *src, size_t src_size)
+                                     const void *src, size_t src_size,
+                                     void *dict)
 {
     size_t zstd_ret = 0;
     ssize_t ret = 0;
@@ -268,9 +315,18 @@ static ssize_t qcow2_zstd_decompress(void *dest, size_t dest_size,
         .size = src_size,
         .pos = 0
     };
-    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    ZSTD_DCtx *dctx = qcow2_zstd_dctx;
 
     if (!dctx) {
+        dctx = qcow2_zstd_dctx = ZSTD_createDCtx();
+        if (!dctx) {
+            return -EIO;
+        }
+        qcow2_zstd_thread_init();
+    }
+
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+    if (dict && ZSTD_isError(ZSTD_DCtx_refDDict(dctx, dict))) {
         return -EIO;
     }
 
@@ -319,7 +375,6 @@ static ssize_t qcow2_zstd_decompress(void *dest, size_t dest_size,
         ret = -EIO;
     }
 
-    ZSTD_freeDCtx(dctx);
     assert(ret == 0 || ret == -EIO);
     return ret;
 }
@@ -330,20 +385,22 @@ static int qcow2_compress_pool_func(void *opaque)
     Qcow2CompressData *data = opaque;
 
     data->ret = data->func(data->dest, data->dest_size,
-                           data->src, data->src_size);
+                           data->src, data->src_size, data->dict);
 
     return 0;
 }
 
 static ssize_t coroutine_fn
 qcow2_co_do_compress(BlockDriverState *bs, void *dest, size_t dest_size,
-                     const void *src, size_t src_size, Qcow2CompressFunc func)
+                     const void *src, size_t src_size, Qcow2CompressFunc func,
+                     void *dict)
 {
     Qcow2CompressData arg = {
         .dest = dest,
         .dest_size = dest_size,
         .src = src,
         .src_size = src_size,
+        .dict = dict,
         .func = func,
     };
 
@@ -385,7 +442,8 @@ qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
         abort();
     }
 
-    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, fn);
+    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, fn,
+                                s->zstd_cdict);
 }
 
 /*
@@ -422,7 +480,64 @@ qcow2_co_decompress(BlockDriverState *bs, void *dest, size_t dest_size,
         abort();
     }
 
-    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, fn);
+    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, fn,
+                                s->zstd_ddict);
+}
+
+/*
+ * qcow2_compression_dict_load()
+ *
+ * Prepares the zstd dictionary @dict of @size bytes for use by
+ * qcow2_co_compress() and qcow2_co_decompress().
+ *
+ * Returns: 0 on success
+ *          -ENOTSUP if the image does not use zstd compression
+ *          -EINVAL if the dictionary cannot be used
+ */
+int qcow2_compression_dict_load(BlockDriverState *bs, const void *dict,
+                                size_t size, Error **errp)
+{
+#ifdef CONFIG_ZSTD
+    BDRVQcow2State *s = bs->opaque;
+    ZSTD_CDict *cdict;
+    ZSTD_DDict *ddict;
+
+    if (s->compression_type != QCOW2_COMPRESSION_TYPE_ZSTD) {
+        error_setg(errp, "Compression dictionaries require the zstd "
+                   "compression type");
+        return -ENOTSUP;
+    }
+
+    cdict = ZSTD_createCDict(dict, size, ZSTD_CLEVEL_DEFAULT);
+    ddict = ZSTD_createDDict(dict, size);
+    if (!cdict || !ddict) {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+        error_setg(errp, "Invalid zstd compression dictionary");
+        return -EINVAL;
+    }
+
+    qcow2_compression_dict_free(bs);
+    s->zstd_cdict = cdict;
+    s->zstd_ddict = ddict;
+    return 0;
+#else
+    error_setg(errp, "Compression dictionaries require the zstd "
+               "compression type");
+    return -ENOTSUP;
+#endif
+}
+
+void qcow2_compression_dict_free(BlockDriverState *bs)
+{
+#ifdef CONFIG_ZSTD
+    BDRVQcow2State *s = bs->opaque;
+
+    ZSTD_freeCDict(s->zstd_cdict);
+    s->zstd_cdict = NULL;
+    ZSTD_freeDDict(s->zstd_ddict);
+    s->zstd_ddict = NULL;
+#endif
 }
 
 
@@ -525,3 +640,66 @@ qcow2_co_decrypt(BlockDriverState *bs, uint64_t host_offset,
     return qcow2_co_encdec(bs, host_offset, guest_offset, buf, len,
                            qcrypto_block_decrypt);
 }
+
+
+/*
+ * Deduplication
+ */
+
+typedef struct Qcow2HashData {
+    QEMUIOVector *qiov;
+    size_t qiov_offset;
+    uint64_t bytes;
+    size_t cluster_size;
+    uint8_t *digests;
+} Qcow2HashData;
+
+static int qcow2_hash_pool_func(void *opaque)
+{
+    Qcow2HashData *data = opaque;
+    uint64_t done;
+
+    for (done = 0; done < data->bytes; done += data->cluster_size) {
+        QEMUIOVector slice;
+        uint8_t *digest = data->digests +
+            done / data->cluster_size * QCOW2_DEDUP_DIGEST_SIZE;
+        size_t digest_len = QCOW2_DEDUP_DIGEST_SIZE;
+        int ret;
+
+        qemu_iovec_init_slice(&slice, data->qiov, data->qiov_offset + done,
+                              data->cluster_size);
+        ret = qcrypto_hash_bytesv(QCRYPTO_HASH_ALGO_SHA256, slice.iov,
+                                  slice.niov, &digest, &digest_len, NULL);
+        qemu_iovec_destroy(&slice);
+        if (ret < 0) {
+            return -EIO;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * qcow2_co_dedup_hash()
+ *
+ * Computes the SHA-256 digest of each cluster in @bytes bytes of @qiov,
+ * starting at @qiov_offset, and stores them one after the other in
+ * @digests.  @bytes must be a multiple of the cluster size.
+ */
+int coroutine_fn
+qcow2_co_dedup_hash(BlockDriverState *bs, QEMUIOVector *qiov,
+                    size_t qiov_offset, uint64_t bytes, uint8_t *digests)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2HashData arg = {
+        .qiov = qiov,
+        .qiov_offset = qiov_offset,
+        .bytes = bytes,
+        .cluster_size = s->cluster_size,
+        .digests = digests,
+    };
+
+    assert(QEMU_IS_ALIGNED(bytes, s->cluster_size));
+
+    return bytes == 0 ? 0 : qcow2_co_process(bs, qcow2_hash_pool_func, &arg);
+}
@@ -73,6 +73,7 @@ typedef struct {
 #define  QCOW2_EXT_MAGIC_CRYPTO_HEADER 0x0537be77
 #define  QCOW2_EXT_MAGIC_BITMAPS 0x23852875
 #define  QCOW2_EXT_MAGIC_DATA_FILE 0x44415441
+#define  QCOW2_EXT_MAGIC_COMPRESSION_DICT 0x7a444943
 
 static int coroutine_fn
 qcow2_co_preadv_compressed(BlockDriverState *bs,
@@ -417,6 +418,60 @@ qcow2_read_extensions(BlockDriverState *bs, uint64_t start_offset,
 #endif
             break;
 
+        case QCOW2_EXT_MAGIC_COMPRESSION_DICT:
+        {
+            Qcow2CompressionDictHeaderExtension *dict = &s->compression_dict;
+            g_autofree void *buf = NULL;
+
+            if (!(s->incompatible_features & QCOW2_INCOMPAT_COMPRESSION_DICT) ||
+                s->compression_type != QCOW2_COMPRESSION_TYPE_ZSTD) {
+                error_setg(errp, "Compression dictionary extension only "
+                           "expected with zstd compression and the "
+                           "compression dictionary bit set");
+                return -EINVAL;
+            }
+            if (ext.len != sizeof(*dict)) {
+                error_setg(errp, "Compression dictionary extension size %u, "
+                           "but expected size %zu", ext.len, sizeof(*dict));
+                return -EINVAL;
+            }
+
+            ret = bdrv_co_pread(bs->file, offset, ext.len, dict, 0);
+            if (ret < 0) {
+                error_setg_errno(errp, -ret, "Unable to read compression "
+                                 "dictionary extension");
+                return ret;
+            }
+            dict->offset = be64_to_cpu(dict->offset);
+            dict->length = be64_to_cpu(dict->length);
+
+            if (!QEMU_IS_ALIGNED(dict->offset, s->cluster_size) ||
+                dict->length == 0 ||
+                dict->length > QCOW2_MAX_COMPRESSION_DICT_SIZE) {
+                error_setg(errp, "Invalid compression dictionary at offset "
+                           "%" PRIu64 " with length %" PRIu64,
+                           dict->offset, dict->length);
+                return -EINVAL;
+            }
+
+            if (flags & BDRV_O_NO_IO) {
+                break;
+            }
+
+            buf = g_malloc(dict->length);
+            ret = bdrv_co_pread(bs->file, dict->offset, dict->length, buf, 0);
+            if (ret < 0) {
+                error_setg_errno(errp, -ret, "Could not read compression "
+                                 "dictionary");
+                return ret;
+            }
+            ret = qcow2_compression_dict_load(bs, buf, dict->length, errp);
+            if (ret < 0) {
+                return ret;
+            }
+            break;
+        }
+
         case QCOW2_EXT_MAGIC_DATA_FILE:
         {
             s->image_data_file = g_malloc0(ext.len + 1);
@@ -614,6 +669,9 @@ qcow2_co_check_locked(BlockDriverState *bs, BdrvCheckResult *result,
 
     memset(result, 0, sizeof(*result));
 
+    /* Reserved clusters would count as leaks */
+    qcow2_release_reserved_clusters(bs);
+
     ret = qcow2_check_read_snapshot_table(bs, &snapshot_res, fix);
     if (ret < 0) {
         qcow2_add_check_result(result, &snapshot_res, false);
@@ -651,7 +709,9 @@ qcow2_co_check(BlockDriverState *bs, BdrvCheckResult *result,
     int ret;
 
     qemu_co_mutex_lock(&s->lock);
+    s->check_progress = true;
     ret = qcow2_co_check_locked(bs, result, fix);
+    s->check_progress = false;
     qemu_co_mutex_unlock(&s->lock);
     return ret;
 }
@@ -696,11 +756,14 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_OVERLAP_INACTIVE_L1,
     QCOW2_OPT_OVERLAP_INACTIVE_L2,
     QCOW2_OPT_OVERLAP_BITMAP_DIRECTORY,
+    QCOW2_OPT_OVERLAP_COMPRESSION_DICT,
     QCOW2_OPT_CACHE_SIZE,
     QCOW2_OPT_L2_CACHE_SIZE,
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_DEDUP,
+    QCOW2_OPT_WORKER_THREADS,
     NULL
 };
 
@@ -791,6 +854,12 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_BOOL,
             .help = "Check for unintended writes into the bitmap directory",
         },
+        {
+            .name = QCOW2_OPT_OVERLAP_COMPRESSION_DICT,
+            .type = QEMU_OPT_BOOL,
+            .help = "Check for unintended writes into the compression "
+                    "dictionary",
+        },
         {
             .name = QCOW2_OPT_CACHE_SIZE,
             .type = QEMU_OPT_SIZE,
@@ -817,6 +886,17 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_DEDUP,
+            .type = QEMU_OPT_BOOL,
+            .help = "Share data clusters with identical contents",
+        },
+        {
+            .name = QCOW2_OPT_WORKER_THREADS,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Maximum number of threads used for compression, "
+                    "decompression, encryption and checksums",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -833,6 +913,7 @@ static const char *overlap_bool_option_names[QCOW2_OL_MAX_BITNR] = {
     [QCOW2_OL_INACTIVE_L1_BITNR]      = QCOW2_OPT_OVERLAP_INACTIVE_L1,
     [QCOW2_OL_INACTIVE_L2_BITNR]      = QCOW2_OPT_OVERLAP_INACTIVE_L2,
     [QCOW2_OL_BITMAP_DIRECTORY_BITNR] = QCOW2_OPT_OVERLAP_BITMAP_DIRECTORY,
+    [QCOW2_OL_COMPRESSION_DICT_BITNR] = QCOW2_OPT_OVERLAP_COMPRESSION_DICT,
 };
 
 static void cache_clean_timer_cb(void *opaque)
@@ -979,6 +1060,8 @@ typedef struct Qcow2ReopenState {
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
     uint64_t cache_clean_interval;
+    bool dedup;
+    int max_threads;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -1032,6 +1115,33 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    r->dedup = qemu_opt_get_bool(opts, QCOW2_OPT_DEDUP, false);
+    if (r->dedup) {
+        if (s->crypt_method_header != QCOW_CRYPT_NONE ||
+            (s->incompatible_features & QCOW2_INCOMPAT_DATA_FILE) ||
+            has_subclusters(s) || s->refcount_max < 2) {
+            error_setg(errp, "dedup is not supported for images with "
+                       "encryption, an external data file, extended L2 "
+                       "entries or 1-bit refcounts");
+            ret = -EINVAL;
+            goto fail;
+        }
+    }
+
+    if (s->dedup && !r->dedup) {
+        /*
+         * The table goes away on commit, so the L2 entries of clusters that
+         * are no longer shared must get QCOW_OFLAG_COPIED back now, before
+         * the old caches are flushed.
+         */
+        ret = qcow2_dedup_restore_copied(bs);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Failed to update L2 entries of "
+                             "unshared clusters");
+            goto fail;
+        }
+    }
+
     /* alloc new L2 table/refcount block cache, flush old one */
     if (s->l2_table_cache) {
         ret = qcow2_cache_flush(bs, s->l2_table_cache);
@@ -1157,6 +1267,15 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    r->max_threads = qemu_opt_get_number(opts, QCOW2_OPT_WORKER_THREADS,
+                                         QCOW2_MAX_THREADS);
+    if (r->max_threads < 1 || r->max_threads > QCOW2_MAX_WORKER_THREADS) {
+        error_setg(errp, "worker-threads must be between 1 and %d",
+                   QCOW2_MAX_WORKER_THREADS);
+        ret = -EINVAL;
+        goto fail;
+    }
+
     switch (s->crypt_method_header) {
     case QCOW_CRYPT_NONE:
         if (encryptfmt) {
@@ -1239,6 +1358,14 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
 
     s->discard_no_unref = r->discard_no_unref;
 
+    if (r->dedup) {
+        qcow2_dedup_enable(bs);
+    } else {
+        qcow2_dedup_free(bs);
+    }
+
+    s->max_threads = r->max_threads;
+
     if (s->cache_clean_interval != r->cache_clean_interval) {
         cache_clean_timer_del(bs);
         s->cache_clean_interval = r->cache_clean_interval;
@@ -1729,6 +1856,13 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
         }
     }
 
+    if ((s->incompatible_features & QCOW2_INCOMPAT_COMPRESSION_DICT) &&
+        s->compression_dict.offset == 0) {
+        error_setg(errp, "Missing compression dictionary extension");
+        ret = -EINVAL;
+        goto fail;
+    }
+
     /* read the backing file name */
     if (header.backing_file_offset != 0) {
         len = header.backing_file_size;
@@ -1903,6 +2037,8 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
     cleanup_unknown_header_ext(bs);
     qcow2_free_snapshots(bs);
     qcow2_refcount_close(bs);
+    qcow2_dedup_free(bs);
+    qcow2_compression_dict_free(bs);
     qemu_vfree(s->l1_table);
     /* else pre-write overlap checks in cache_destroy may crash */
     s->l1_table = NULL;
@@ -2006,6 +2142,8 @@ qcow2_reopen_prepare(BDRVReopenState *state,BlockReopenQueue *queue,
 
     /* We need to write out any unwritten data if we reopen read-only. */
     if ((state->flags & BDRV_O_RDWR) == 0) {
+        qcow2_release_reserved_clusters(state->bs);
+
         ret = qcow2_reopen_bitmaps_ro(state->bs, errp);
         if (ret < 0) {
             goto fail;
@@ -2207,6 +2345,7 @@ qcow2_handle_l2meta(BlockDriverState *bs, QCowL2Meta **pl2meta, bool link_l2)
             if (ret) {
                 goto out;
             }
+            qcow2_dedup_insert(bs, l2meta);
         } else {
             qcow2_alloc_cluster_abort(bs, l2meta);
         }
@@ -2404,8 +2543,11 @@ qcow2_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
         }
 
         qemu_co_mutex_lock(&s->lock);
-        ret = qcow2_get_host_offset(bs, offset, &cur_bytes,
-                                    &host_offset, &type);
+        ret = qcow2_co_preload_l2_slice(bs, offset);
+        if (ret == 0) {
+            ret = qcow2_get_host_offset(bs, offset, &cur_bytes,
+                                        &host_offset, &type);
+        }
         qemu_co_mutex_unlock(&s->lock);
         if (ret < 0) {
             goto out;
@@ -2419,7 +2561,7 @@ qcow2_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
             qemu_iovec_memset(qiov, qiov_offset, 0, cur_bytes);
         } else {
             if (!aio && cur_bytes != bytes) {
-                aio = aio_task_pool_new(QCOW2_MAX_WORKERS);
+                aio = aio_task_pool_new(MAX(QCOW2_MAX_WORKERS, s->max_threads));
             }
             ret = qcow2_add_task(bs, aio, qcow2_co_preadv_task_entry, type,
                                  host_offset, offset, cur_bytes,
@@ -2685,10 +2827,24 @@ qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
     uint64_t host_offset;
     QCowL2Meta *l2meta = NULL;
     AioTaskPool *aio = NULL;
+    uint64_t dedup_start = offset;
+    g_autofree uint8_t *digests = NULL;
 
     trace_qcow2_writev_start_req(qemu_coroutine_self(), offset, bytes);
 
+    if (s->dedup && QEMU_IS_ALIGNED(offset | bytes, s->cluster_size)) {
+        digests = g_try_malloc((bytes >> s->cluster_bits) *
+                               QCOW2_DEDUP_DIGEST_SIZE);
+        if (digests &&
+            qcow2_co_dedup_hash(bs, qiov, qiov_offset, bytes, digests) < 0) {
+            /* Write the data without deduplication */
+            g_free(digests);
+            digests = NULL;
+        }
+    }
+
     while (bytes != 0 && aio_task_pool_status(aio) == 0) {
+        const uint8_t *digest = NULL;
 
         l2meta = NULL;
 
@@ -2703,6 +2859,20 @@ qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
         qemu_co_mutex_lock(&s->lock);
 
+        if (digests && s->dedup) {
+            digest = digests + ((offset - dedup_start) >> s->cluster_bits) *
+                               QCOW2_DEDUP_DIGEST_SIZE;
+            cur_bytes = QEMU_ALIGN_DOWN(cur_bytes, s->cluster_size);
+            ret = qcow2_dedup_link(bs, offset, &cur_bytes, digest);
+            if (ret < 0) {
+                goto out_locked;
+            } else if (ret > 0) {
+                /* Already linked to clusters with the same data */
+                qemu_co_mutex_unlock(&s->lock);
+                goto next;
+            }
+        }
+
         ret = qcow2_alloc_host_offset(bs, offset, &cur_bytes,
                                       &host_offset, &l2meta);
         if (ret < 0) {
@@ -2715,10 +2885,22 @@ qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto out_locked;
         }
 
+        if (digest) {
+            QCowL2Meta *m;
+
+            for (m = l2meta; m != NULL; m = m->next) {
+                if (m->cow_start.nb_bytes == 0 && m->cow_end.nb_bytes == 0) {
+                    m->dedup_digests = digests +
+                        ((m->offset - dedup_start) >> s->cluster_bits) *
+                        QCOW2_DEDUP_DIGEST_SIZE;
+                }
+            }
+        }
+
         qemu_co_mutex_unlock(&s->lock);
 
         if (!aio && cur_bytes != bytes) {
-            aio = aio_task_pool_new(QCOW2_MAX_WORKERS);
+            aio = aio_task_pool_new(MAX(QCOW2_MAX_WORKERS, s->max_threads));
         }
         ret = qcow2_add_task(bs, aio, qcow2_co_pwritev_task_entry, 0,
                              host_offset, offset,
@@ -2728,6 +2910,7 @@ qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto fail_nometa;
         }
 
+next:
         bytes -= cur_bytes;
         offset += cur_bytes;
         qiov_offset += cur_bytes;
@@ -2762,6 +2945,15 @@ static int GRAPH_RDLOCK qcow2_inactivate(BlockDriverState *bs)
     int ret, result = 0;
     Error *local_err = NULL;
 
+    qcow2_release_reserved_clusters(bs);
+
+    ret = qcow2_dedup_restore_copied(bs);
+    if (ret) {
+        result = ret;
+        error_report("Failed to update L2 entries of unshared clusters: %s",
+                     strerror(-ret));
+    }
+
     qcow2_store_persistent_dirty_bitmaps(bs, true, &local_err);
     if (local_err != NULL) {
         result = -EINVAL;
@@ -2795,6 +2987,12 @@ static void coroutine_mixed_fn GRAPH_RDLOCK
 qcow2_do_close(BlockDriverState *bs, bool close_data_file)
 {
     BDRVQcow2State *s = bs->opaque;
+
+    if (!(s->flags & BDRV_O_INACTIVE)) {
+        qcow2_dedup_restore_copied(bs);
+    }
+    qcow2_dedup_free(bs);
+
     qemu_vfree(s->l1_table);
     /* else pre-write overlap checks in cache_destroy may crash */
     s->l1_table = NULL;
@@ -2810,6 +3008,7 @@ qcow2_do_close(BlockDriverState *bs, bool close_data_file)
     qcrypto_block_free(s->crypto);
     s->crypto = NULL;
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
+    qcow2_compression_dict_free(bs);
 
     g_free(s->unknown_header_fields);
     cleanup_unknown_header_ext(bs);
@@ -3046,6 +3245,22 @@ int qcow2_update_header(BlockDriverState *bs)
         buflen -= ret;
     }
 
+    /* Compression dictionary pointer extension */
+    if (s->compression_dict.offset != 0) {
+        Qcow2CompressionDictHeaderExtension dict = {
+            .offset = cpu_to_be64(s->compression_dict.offset),
+            .length = cpu_to_be64(s->compression_dict.length),
+        };
+
+        ret = header_ext_add(buf, QCOW2_EXT_MAGIC_COMPRESSION_DICT,
+                             &dict, sizeof(dict), buflen);
+        if (ret < 0) {
+            goto fail;
+        }
+        buf += ret;
+        buflen -= ret;
+    }
+
     /*
      * Feature table.  A mere 8 feature names occupies 392 bytes, and
      * when coupled with the v3 minimum header of 104 bytes plus the
@@ -3081,6 +3296,11 @@ int qcow2_update_header(BlockDriverState *bs)
                 .bit  = QCOW2_INCOMPAT_EXTL2_BITNR,
                 .name = "extended L2 entries",
             },
+            {
+                .type = QCOW2_FEAT_TYPE_INCOMPATIBLE,
+                .bit  = QCOW2_INCOMPAT_COMPRESSION_DICT_BITNR,
+                .name = "compression dictionary",
+            },
             {
                 .type = QCOW2_FEAT_TYPE_COMPATIBLE,
                 .bit  = QCOW2_COMPAT_LAZY_REFCOUNTS_BITNR,
@@ -3247,6 +3467,50 @@ qcow2_set_up_encryption(BlockDriverState *bs,
     return ret;
 }
 
+static int coroutine_fn GRAPH_RDLOCK
+qcow2_set_up_compression_dict(BlockDriverState *bs, const void *dict,
+                              size_t size, Error **errp)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int64_t offset;
+    int ret;
+
+    ret = qcow2_compression_dict_load(bs, dict, size, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    offset = qcow2_alloc_clusters(bs, size);
+    if (offset < 0) {
+        error_setg_errno(errp, -offset, "Cannot allocate clusters for the "
+                         "compression dictionary");
+        return offset;
+    }
+
+    ret = qcow2_pre_write_overlap_check(bs, 0, offset, size, false);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Cannot write compression dictionary");
+        return ret;
+    }
+    ret = bdrv_co_pwrite(bs->file, offset, size, dict, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not write compression dictionary");
+        return ret;
+    }
+
+    s->compression_dict.offset = offset;
+    s->compression_dict.length = size;
+    s->incompatible_features |= QCOW2_INCOMPAT_COMPRESSION_DICT;
+
+    ret = qcow2_update_header(bs);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not update qcow2 header");
+        return ret;
+    }
+
+    return 0;
+}
+
 /**
  * Preallocates metadata structures for data clusters between @offset (in the
  * guest disk) and @new_length (which is thus generally the new guest disk
@@ -3523,6 +3787,8 @@ qcow2_co_create(BlockdevCreateOptions *create_options, Error **errp)
     uint64_t *refcount_table;
     int ret;
     uint8_t compression_type = QCOW2_COMPRESSION_TYPE_ZLIB;
+    g_autofree char *compression_dict = NULL;
+    gsize compression_dict_size = 0;
 
     assert(create_options->driver == BLOCKDEV_DRIVER_QCOW2);
     qcow2_opts = &create_options->u.qcow2;
@@ -3701,6 +3967,33 @@ qcow2_co_create(BlockdevCreateOptions *create_options, Error **errp)
         compression_type = qcow2_opts->compression_type;
     }
 
+    if (qcow2_opts->compression_dict) {
+        g_autoptr(GError) gerr = NULL;
+
+        if (compression_type != QCOW2_COMPRESSION_TYPE_ZSTD) {
+            error_setg(errp, "Compression dictionaries require the zstd "
+                       "compression type");
+            ret = -EINVAL;
+            goto out;
+        }
+        if (!g_file_get_contents(qcow2_opts->compression_dict,
+                                 &compression_dict, &compression_dict_size,
+                                 &gerr)) {
+            error_setg(errp, "Could not read compression dictionary: %s",
+                       gerr->message);
+            ret = -EIO;
+            goto out;
+        }
+        if (compression_dict_size == 0 ||
+            compression_dict_size > QCOW2_MAX_COMPRESSION_DICT_SIZE) {
+            error_setg(errp, "Compression dictionary size must be between 1 "
+                       "and %" PRId64 " bytes",
+                       QCOW2_MAX_COMPRESSION_DICT_SIZE);
+            ret = -EINVAL;
+            goto out;
+        }
+    }
+
     /* Create BlockBackend to write to the image */
     blk = blk_co_new_with_bs(bs, BLK_PERM_WRITE | BLK_PERM_RESIZE, BLK_PERM_ALL,
                              errp);
@@ -3861,6 +4154,18 @@ qcow2_co_create(BlockdevCreateOptions *create_options, Error **errp)
         }
     }
 
+    /* Want a compression dictionary? There you go. */
+    if (compression_dict) {
+        bdrv_graph_co_rdlock();
+        ret = qcow2_set_up_compression_dict(blk_bs(blk), compression_dict,
+                                            compression_dict_size, errp);
+        bdrv_graph_co_rdunlock();
+
+        if (ret < 0) {
+            goto out;
+        }
+    }
+
     blk_co_unref(blk);
     blk = NULL;
 
@@ -3945,6 +4250,7 @@ qcow2_co_create_opts(BlockDriver *drv, const char *filename, QemuOpts *opts,
         { BLOCK_OPT_COMPAT_LEVEL,       "version" },
         { BLOCK_OPT_DATA_FILE_RAW,      "data-file-raw" },
         { BLOCK_OPT_COMPRESSION_TYPE,   "compression-type" },
+        { BLOCK_OPT_COMPRESSION_DICT,   "compression-dict" },
         { NULL, NULL },
     };
 
@@ -4321,6 +4627,9 @@ qcow2_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
 
     qemu_co_mutex_lock(&s->lock);
 
+    /* Shrinking and preallocation look at which clusters are in use */
+    qcow2_release_reserved_clusters(bs);
+
     /*
      * Even though we store snapshot size for all images, it was not
      * required until v3, so it is not safe to proceed for v2.
@@ -4794,7 +5103,7 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
         uint64_t chunk_size = MIN(bytes, s->cluster_size);
 
         if (!aio && chunk_size != bytes) {
-            aio = aio_task_pool_new(QCOW2_MAX_WORKERS);
+            aio = aio_task_pool_new(MAX(QCOW2_MAX_WORKERS, s->max_threads));
         }
 
         ret = qcow2_add_task(bs, aio, qcow2_co_pwritev_compressed_task_entry,
@@ -5019,21 +5328,24 @@ static int GRAPH_RDLOCK qcow2_make_empty(BlockDriverState *bs)
     int step = QEMU_ALIGN_DOWN(INT_MAX, s->cluster_size);
     int l1_clusters, ret = 0;
 
+    qcow2_release_reserved_clusters(bs);
+
     l1_clusters = DIV_ROUND_UP(s->l1_size, s->cluster_size / L1E_SIZE);
 
     if (s->qcow_version >= 3 && !s->snapshots && !s->nb_bitmaps &&
         3 + l1_clusters <= s->refcount_block_size &&
         s->crypt_method_header != QCOW_CRYPT_LUKS &&
+        !s->compression_dict.offset &&
         !has_data_file(bs)) {
         /* The following function only works for qcow2 v3 images (it
          * requires the dirty flag) and only as long as there are no
          * features that reserve extra clusters (such as snapshots,
-         * LUKS header, or persistent bitmaps), because it completely
-         * empties the image.  Furthermore, the L1 table and three
-         * additional clusters (image header, refcount table, one
-         * refcount block) have to fit inside one refcount block. It
-         * only resets the image file, i.e. does not work with an
-         * external data file. */
+         * LUKS header, compression dictionary or persistent bitmaps),
+         * because it completely empties the image.  Furthermore, the
+         * L1 table and three additional clusters (image header, refcount
+         * table, one refcount block) have to fit inside one refcount
+         * block. It only resets the image file, i.e. does not work with
+         * an external data file. */
         return make_completely_empty(bs);
     }
 
@@ -5062,7 +5374,12 @@ static coroutine_fn GRAPH_RDLOCK int qcow2_co_flush_to_os(BlockDriverState *bs)
     int ret;
 
     qemu_co_mutex_lock(&s->lock);
-    ret = qcow2_write_caches(bs);
+    /* Reserved data clusters would be leaks after a crash */
+    qcow2_release_reserved_clusters(bs);
+    ret = qcow2_dedup_restore_copied(bs);
+    if (ret == 0) {
+        ret = qcow2_write_caches(bs);
+    }
     qemu_co_mutex_unlock(&s->lock);
 
     return ret;
@@ -6113,6 +6430,12 @@ static QemuOptsList qcow2_create_opts = {
             .help = "Compression method used for image cluster "        \
                     "compression",                                      \
             .def_value_str = "zlib"                                     \
+        },                                                              \
+        {                                                               \
+            .name = BLOCK_OPT_COMPRESSION_DICT,                         \
+            .type = QEMU_OPT_STRING,                                    \
+            .help = "File with a zstd dictionary for compressed "       \
+                    "clusters",                                         \
         },
         QCOW_COMMON_OPTIONS,
         { /* end of list */ }
@@ -71,6 +71,12 @@
 /* Maximum of parallel sub-request per guest request */
 #define QCOW2_MAX_WORKERS 8
 
+/* Data clusters reserved ahead of allocating writes, see qcow2-refcount.c */
+#define QCOW2_ALLOC_BATCH_SIZE (4 * MiB)
+
+/* L2 tables read in parallel by the consistency check */
+#define QCOW2_CHECK_L2_READAHEAD 16
+
 /* indicate that the refcount of the referenced cluster is exactly one. */
 #define QCOW_OFLAG_COPIED     (1ULL << 63)
 /* indicate that the cluster is compressed (they never have the copied flag) */
@@ -145,11 +151,14 @@
 #define QCOW2_OPT_OVERLAP_INACTIVE_L1 "overlap-check.inactive-l1"
 #define QCOW2_OPT_OVERLAP_INACTIVE_L2 "overlap-check.inactive-l2"
 #define QCOW2_OPT_OVERLAP_BITMAP_DIRECTORY "overlap-check.bitmap-directory"
+#define QCOW2_OPT_OVERLAP_COMPRESSION_DICT "overlap-check.compression-dict"
 #define QCOW2_OPT_CACHE_SIZE "cache-size"
 #define QCOW2_OPT_L2_CACHE_SIZE "l2-cache-size"
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_DEDUP "dedup"
+#define QCOW2_OPT_WORKER_THREADS "worker-threads"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -236,6 +245,11 @@ typedef struct Qcow2CryptoHeaderExtension {
     uint64_t length;
 } QEMU_PACKED Qcow2CryptoHeaderExtension;
 
+typedef struct Qcow2CompressionDictHeaderExtension {
+    uint64_t offset;
+    uint64_t length;
+} QEMU_PACKED Qcow2CompressionDictHeaderExtension;
+
 typedef struct Qcow2UnknownHeaderExtension {
     uint32_t magic;
     uint32_t len;
@@ -256,17 +270,21 @@ enum {
     QCOW2_INCOMPAT_DATA_FILE_BITNR  = 2,
     QCOW2_INCOMPAT_COMPRESSION_BITNR = 3,
     QCOW2_INCOMPAT_EXTL2_BITNR      = 4,
+    QCOW2_INCOMPAT_COMPRESSION_DICT_BITNR = 5,
     QCOW2_INCOMPAT_DIRTY            = 1 << QCOW2_INCOMPAT_DIRTY_BITNR,
     QCOW2_INCOMPAT_CORRUPT          = 1 << QCOW2_INCOMPAT_CORRUPT_BITNR,
     QCOW2_INCOMPAT_DATA_FILE        = 1 << QCOW2_INCOMPAT_DATA_FILE_BITNR,
     QCOW2_INCOMPAT_COMPRESSION      = 1 << QCOW2_INCOMPAT_COMPRESSION_BITNR,
     QCOW2_INCOMPAT_EXTL2            = 1 << QCOW2_INCOMPAT_EXTL2_BITNR,
+    QCOW2_INCOMPAT_COMPRESSION_DICT =
+        1 << QCOW2_INCOMPAT_COMPRESSION_DICT_BITNR,
 
     QCOW2_INCOMPAT_MASK             = QCOW2_INCOMPAT_DIRTY
                                     | QCOW2_INCOMPAT_CORRUPT
                                     | QCOW2_INCOMPAT_DATA_FILE
                                     | QCOW2_INCOMPAT_COMPRESSION
-                                    | QCOW2_INCOMPAT_EXTL2,
+                                    | QCOW2_INCOMPAT_EXTL2
+                                    | QCOW2_INCOMPAT_COMPRESSION_DICT,
 };
 
 /* Compatible feature bits */
@@ -322,7 +340,18 @@ typedef struct Qcow2BitmapHeaderExt {
     uint64_t bitmap_directory_offset;
 } QEMU_PACKED Qcow2BitmapHeaderExt;
 
+/* Default for the number of threads used to (de)compress, encrypt or hash */
 #define QCOW2_MAX_THREADS 4
+/* Upper bound for the worker-threads option */
+#define QCOW2_MAX_WORKER_THREADS 64
+
+/* Limits the memory that a compression dictionary read from an image uses */
+#define QCOW2_MAX_COMPRESSION_DICT_SIZE (1 * MiB)
+
+/* Size of the SHA-256 digest that identifies cluster contents for dedup */
+#define QCOW2_DEDUP_DIGEST_SIZE 32
+
+typedef struct Qcow2Dedup Qcow2Dedup;
 
 typedef struct BDRVQcow2State {
     int cluster_bits;
@@ -357,6 +386,16 @@ typedef struct BDRVQcow2State {
     uint64_t free_cluster_index;
     uint64_t free_byte_offset;
 
+    /* Data clusters with a refcount but no L2 entry yet */
+    uint64_t reserved_offset;
+    uint64_t reserved_clusters;
+
+    /*
+     * Only checks requested through bdrv_co_check() report progress, not
+     * the ones that repair an image when it is opened
+     */
+    bool check_progress;
+
     CoMutex lock;
 
     Qcow2CryptoHeaderExtension crypto_header; /* QCow2 header extension */
@@ -410,6 +449,7 @@ typedef struct BDRVQcow2State {
 
     CoQueue thread_task_queue;
     int nb_threads;
+    int max_threads;
 
     BdrvChild *data_file;
 
@@ -422,6 +462,17 @@ typedef struct BDRVQcow2State {
      * is to convert the image with the desired compression type set.
      */
     Qcow2CompressionType compression_type;
+
+    /*
+     * Dictionary for zstd compression, if the image has one, and the
+     * ZSTD_CDict and ZSTD_DDict prepared from it
+     */
+    Qcow2CompressionDictHeaderExtension compression_dict;
+    void *zstd_cdict;
+    void *zstd_ddict;
+
+    /* Table of written clusters for deduplication, NULL if disabled */
+    Qcow2Dedup *dedup;
 } BDRVQcow2State;
 
 typedef struct Qcow2COWRegion {
@@ -496,6 +547,13 @@ typedef struct QCowL2Meta
     QEMUIOVector *data_qiov;
     size_t data_qiov_offset;
 
+    /**
+     * If non-NULL, the digests of the nb_clusters clusters written by this
+     * request, which are entered into the deduplication table once the
+     * L2 entries have been updated.
+     */
+    const uint8_t *dedup_digests;
+
     /** Pointer to next L2Meta of the same write request */
     struct QCowL2Meta *next;
 
@@ -557,8 +615,9 @@ typedef enum QCow2MetadataOverlap {
     QCOW2_OL_INACTIVE_L1_BITNR      = 6,
     QCOW2_OL_INACTIVE_L2_BITNR      = 7,
     QCOW2_OL_BITMAP_DIRECTORY_BITNR = 8,
+    QCOW2_OL_COMPRESSION_DICT_BITNR = 9,
 
-    QCOW2_OL_MAX_BITNR              = 9,
+    QCOW2_OL_MAX_BITNR              = 10,
 
     QCOW2_OL_NONE             = 0,
     QCOW2_OL_MAIN_HEADER      = (1 << QCOW2_OL_MAIN_HEADER_BITNR),
@@ -572,12 +631,14 @@ typedef enum QCow2MetadataOverlap {
      * reads. */
     QCOW2_OL_INACTIVE_L2      = (1 << QCOW2_OL_INACTIVE_L2_BITNR),
     QCOW2_OL_BITMAP_DIRECTORY = (1 << QCOW2_OL_BITMAP_DIRECTORY_BITNR),
+    QCOW2_OL_COMPRESSION_DICT = (1 << QCOW2_OL_COMPRESSION_DICT_BITNR),
 } QCow2MetadataOverlap;
 
 /* Perform all overlap checks which can be done in constant time */
 #define QCOW2_OL_CONSTANT \
     (QCOW2_OL_MAIN_HEADER | QCOW2_OL_ACTIVE_L1 | QCOW2_OL_REFCOUNT_TABLE | \
-     QCOW2_OL_SNAPSHOT_TABLE | QCOW2_OL_BITMAP_DIRECTORY)
+     QCOW2_OL_SNAPSHOT_TABLE | QCOW2_OL_BITMAP_DIRECTORY | \
+     QCOW2_OL_COMPRESSION_DICT)
 
 /* Perform all overlap checks which don't require disk access */
 #define QCOW2_OL_CACHED \
@@ -873,6 +934,11 @@ int64_t GRAPH_RDLOCK coroutine_fn
 qcow2_alloc_clusters_at(BlockDriverState *bs, uint64_t offset,
                         int64_t nb_clusters);
 
+int64_t coroutine_fn GRAPH_RDLOCK
+qcow2_alloc_data_clusters(BlockDriverState *bs, uint64_t *nb_clusters,
+                          bool partial);
+void GRAPH_RDLOCK qcow2_release_reserved_clusters(BlockDriverState *bs);
+
 int64_t coroutine_fn GRAPH_RDLOCK qcow2_alloc_bytes(BlockDriverState *bs, int size);
 void GRAPH_RDLOCK qcow2_free_clusters(BlockDriverState *bs,
                                       int64_t offset, int64_t size,
@@ -927,6 +993,9 @@ int GRAPH_RDLOCK qcow2_write_l1_entry(BlockDriverState *bs, int l1_index);
 int qcow2_encrypt_sectors(BDRVQcow2State *s, int64_t sector_num,
                           uint8_t *buf, int nb_sectors, bool enc, Error **errp);
 
+int coroutine_fn GRAPH_RDLOCK
+qcow2_co_preload_l2_slice(BlockDriverState *bs, uint64_t offset);
+
 int GRAPH_RDLOCK
 qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
                       unsigned int *bytes, uint64_t *host_offset,
@@ -963,6 +1032,13 @@ qcow2_expand_zero_clusters(BlockDriverState *bs,
                            BlockDriverAmendStatusCB *status_cb,
                            void *cb_opaque);
 
+int GRAPH_RDLOCK
+qcow2_cluster_share(BlockDriverState *bs, uint64_t offset,
+                    uint64_t src_offset, uint64_t host_offset);
+int GRAPH_RDLOCK
+qcow2_cluster_set_copied(BlockDriverState *bs, uint64_t offset,
+                         uint64_t host_offset);
+
 /* qcow2-snapshot.c functions */
 int GRAPH_RDLOCK
 qcow2_snapshot_create(BlockDriverState *bs, QEMUSnapshotInfo *sn_info);
@@ -1019,9 +1095,29 @@ qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                       void **table);
 
 void qcow2_cache_put(Qcow2Cache *c, void **table);
+
+int GRAPH_RDLOCK
+qcow2_cache_insert(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
+                   const void *table);
+
+unsigned qcow2_cache_get_write_gen(Qcow2Cache *c);
+bool qcow2_cache_contains(Qcow2Cache *c, uint64_t offset);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
 
+/* qcow2-dedup.c functions */
+void qcow2_dedup_enable(BlockDriverState *bs);
+void qcow2_dedup_free(BlockDriverState *bs);
+int coroutine_fn GRAPH_RDLOCK
+qcow2_dedup_link(BlockDriverState *bs, uint64_t offset, unsigned int *bytes,
+                 const uint8_t *digests);
+void qcow2_dedup_insert(BlockDriverState *bs, QCowL2Meta *m);
+void qcow2_dedup_forget(BlockDriverState *bs, uint64_t host_offset,
+                        uint64_t bytes);
+void qcow2_dedup_refcount_changed(BlockDriverState *bs, uint64_t host_offset,
+                                  uint64_t refcount);
+int GRAPH_RDLOCK qcow2_dedup_restore_copied(BlockDriverState *bs);
+
 /* qcow2-bitmap.c functions */
 int coroutine_fn GRAPH_RDLOCK
 qcow2_check_bitmaps_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
@@ -1070,5 +1166,11 @@ qcow2_co_encrypt(BlockDriverState *bs, uint64_t host_offset,
 int coroutine_fn
 qcow2_co_decrypt(BlockDriverState *bs, uint64_t host_offset,
                  uint64_t guest_offset, void *buf, size_t len);
+int qcow2_compression_dict_load(BlockDriverState *bs, const void *dict,
+                                size_t size, Error **errp);
+void qcow2_compression_dict_free(BlockDriverState *bs);
+int coroutine_fn
+qcow2_co_dedup_hash(BlockDriverState *bs, QEMUIOVector *qiov,
+                    size_t qiov_offset, uint64_t bytes, uint8_t *digests);
 
 #endif
@@ -0,0 +1,761 @@
+/*
+ * Read-ahead filter driver
+ *
+ * The filter detects sequential read streams and reads the data that
+ * follows them before the guest asks for it, so that sequential reads from
+ * a backend with high latency (nbd, ssh, curl, nfs, ...) don't wait for a
+ * round trip on every request.  Prefetched data is kept in a cache of
+ * bounded size; writes, discards and truncation through the filter drop
+ * the parts of it that they touch.
+ *
+ * With cache-reads=on, the data of all other reads is kept as well, in
+ * whole 64k chunks, and concurrent reads of the same data wait for a single
+ * read from the child.
+ * On top of a backing image that qemu-storage-daemon exports to many VMs,
+ * this makes the cache shared between all of them.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+
+#include "qapi/error.h"
+#include "qemu/memalign.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/units.h"
+#include "block/block-io.h"
+#include "block/block_int.h"
+#include "trace.h"
+
+/* Number of sequential streams that are tracked at the same time */
+#define READAHEAD_MAX_STREAMS 8
+
+/* Granularity of the cache */
+#define READAHEAD_CHUNK_SIZE (64 * KiB)
+
+typedef struct ReadaheadOpts {
+    int64_t window;
+    int64_t cache_size;
+    int64_t trigger;
+    bool cache_reads;
+} ReadaheadOpts;
+
+typedef struct ReadaheadChunk {
+    /* Aligned to READAHEAD_CHUNK_SIZE, the key in BDRVReadaheadState.chunks */
+    int64_t offset;
+    int64_t bytes;
+    void *buf;
+
+    /* References by the cache, the read and readers waiting for it */
+    int refcnt;
+    /* In the cache, i.e. not evicted or invalidated */
+    bool cached;
+    /* The read is still running, readers wait on @waiters */
+    bool in_flight;
+    /* @buf holds the data */
+    bool valid;
+    /* At least one request was served from the chunk */
+    bool used;
+    CoQueue waiters;
+
+    QTAILQ_ENTRY(ReadaheadChunk) next;
+} ReadaheadChunk;
+
+/* One read from the child that fills consecutive chunks */
+typedef struct ReadaheadRead {
+    BlockDriverState *bs;
+    GPtrArray *chunks;
+    QEMUIOVector qiov;
+    /* For a request with cache-reads=on rather than a prefetch */
+    bool demand;
+} ReadaheadRead;
+
+typedef struct ReadaheadStream {
+    /* End of the furthest request of the stream */
+    int64_t next_offset;
+    /* End of the data that was prefetched for the stream */
+    int64_t prefetch_end;
+    /* Number of requests that advanced the stream */
+    int64_t seq_count;
+    /* For replacing the least recently used stream; 0 if the slot is free */
+    uint64_t last_used;
+} ReadaheadStream;
+
+typedef struct BDRVReadaheadState {
+    ReadaheadOpts opts;
+
+    /* Protects all fields below */
+    CoMutex lock;
+
+    ReadaheadStream streams[READAHEAD_MAX_STREAMS];
+    uint64_t clock;
+
+    /* Chunks by offset */
+    GHashTable *chunks;
+    /* Most recently used first */
+    QTAILQ_HEAD(, ReadaheadChunk) lru;
+    int64_t cached_bytes;
+
+    BlockStatsSpecificReadahead stats;
+} BDRVReadaheadState;
+
+#define READAHEAD_OPT_WINDOW "window"
+#define READAHEAD_OPT_CACHE_SIZE "cache-size"
+#define READAHEAD_OPT_TRIGGER "trigger"
+#define READAHEAD_OPT_CACHE_READS "cache-reads"
+static QemuOptsList runtime_opts = {
+    .name = "readahead",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = READAHEAD_OPT_WINDOW,
+            .type = QEMU_OPT_SIZE,
+            .help = "how much to read ahead of a sequential stream, "
+                "default 1M",
+        },
+        {
+            .name = READAHEAD_OPT_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "maximum size of the cached data, default 16M",
+        },
+        {
+            .name = READAHEAD_OPT_TRIGGER,
+            .type = QEMU_OPT_NUMBER,
+            .help = "number of sequential reads that start read-ahead, "
+                "default 2",
+        },
+        {
+            .name = READAHEAD_OPT_CACHE_READS,
+            .type = QEMU_OPT_BOOL,
+            .help = "also cache the data of reads that were not prefetched, "
+                "default off",
+        },
+        { /* end of list */ }
+    },
+};
+
+static bool readahead_absorb_opts(ReadaheadOpts *dest, QDict *options,
+                                  Error **errp)
+{
+    QemuOpts *opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        qemu_opts_del(opts);
+        return false;
+    }
+
+    dest->window = qemu_opt_get_size(opts, READAHEAD_OPT_WINDOW, 1 * MiB);
+    dest->cache_size =
+        qemu_opt_get_size(opts, READAHEAD_OPT_CACHE_SIZE, 16 * MiB);
+    dest->trigger = qemu_opt_get_number(opts, READAHEAD_OPT_TRIGGER, 2);
+    dest->cache_reads =
+        qemu_opt_get_bool(opts, READAHEAD_OPT_CACHE_READS, false);
+
+    qemu_opts_del(opts);
+
+    if (dest->window < READAHEAD_CHUNK_SIZE || dest->window > INT_MAX) {
+        error_setg(errp, "window parameter of readahead filter must be "
+                   "between %" PRId64 " and %d", READAHEAD_CHUNK_SIZE,
+                   INT_MAX);
+        return false;
+    }
+
+    if (dest->cache_size < dest->window) {
+        error_setg(errp, "cache-size parameter of readahead filter must not "
+                   "be smaller than window");
+        return false;
+    }
+
+    if (dest->trigger < 1) {
+        error_setg(errp, "trigger parameter of readahead filter must be at "
+                   "least 1");
+        return false;
+    }
+
+    return true;
+}
+
+static int readahead_open(BlockDriverState *bs, QDict *options, int flags,
+                          Error **errp)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int ret;
+
+    GLOBAL_STATE_CODE();
+
+    qemu_co_mutex_init(&s->lock);
+    s->chunks = g_hash_table_new(g_int64_hash, g_int64_equal);
+    QTAILQ_INIT(&s->lru);
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    GRAPH_RDLOCK_GUARD_MAINLOOP();
+
+    if (!readahead_absorb_opts(&s->opts, options, errp)) {
+        return -EINVAL;
+    }
+
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+        (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+
+    return 0;
+}
+
+static void readahead_chunk_unref(ReadaheadChunk *c)
+{
+    if (--c->refcnt == 0) {
+        qemu_vfree(c->buf);
+        g_free(c);
+    }
+}
+
+/* Removes @c from the cache.  Called with s->lock held. */
+static void readahead_chunk_drop(BDRVReadaheadState *s, ReadaheadChunk *c)
+{
+    assert(c->cached);
+
+    g_hash_table_remove(s->chunks, &c->offset);
+    QTAILQ_REMOVE(&s->lru, c, next);
+    c->cached = false;
+    s->cached_bytes -= c->bytes;
+    if (c->valid && !c->used) {
+        s->stats.unused_bytes += c->bytes;
+    }
+
+    readahead_chunk_unref(c);
+}
+
+static void readahead_close(BlockDriverState *bs)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    ReadaheadChunk *c, *next;
+
+    /* Reads hold bs->in_flight, so they have all completed */
+    QTAILQ_FOREACH_SAFE(c, &s->lru, next, next) {
+        assert(!c->in_flight);
+        readahead_chunk_drop(s, c);
+    }
+    g_hash_table_destroy(s->chunks);
+}
+
+/* Called with s->lock held */
+static ReadaheadChunk *readahead_find_chunk(BDRVReadaheadState *s,
+                                            int64_t offset)
+{
+    int64_t key = QEMU_ALIGN_DOWN(offset, READAHEAD_CHUNK_SIZE);
+
+    return g_hash_table_lookup(s->chunks, &key);
+}
+
+/*
+ * Evicts least recently used chunks until @bytes more fit into the cache.
+ * Chunks that are still being read are kept.  Called with s->lock held.
+ */
+static bool readahead_make_room(BDRVReadaheadState *s, int64_t bytes)
+{
+    ReadaheadChunk *c, *prev;
+
+    QTAILQ_FOREACH_REVERSE_SAFE(c, &s->lru, next, prev) {
+        if (s->cached_bytes + bytes <= s->opts.cache_size) {
+            break;
+        }
+        if (!c->in_flight) {
+            readahead_chunk_drop(s, c);
+        }
+    }
+
+    return s->cached_bytes + bytes <= s->opts.cache_size;
+}
+
+/* Adds a chunk to be read to the cache.  Called with s->lock held. */
+static ReadaheadChunk * GRAPH_RDLOCK
+readahead_chunk_new(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    ReadaheadChunk *c;
+    void *buf;
+
+    if (!readahead_make_room(s, bytes)) {
+        return NULL;
+    }
+    buf = qemu_try_blockalign(bs->file->bs, bytes);
+    if (!buf) {
+        return NULL;
+    }
+
+    c = g_new0(ReadaheadChunk, 1);
+    c->offset = offset;
+    c->bytes = bytes;
+    c->buf = buf;
+    c->refcnt = 1;
+    c->cached = true;
+    c->in_flight = true;
+    qemu_co_queue_init(&c->waiters);
+
+    g_hash_table_insert(s->chunks, &c->offset, c);
+    QTAILQ_INSERT_HEAD(&s->lru, c, next);
+    s->cached_bytes += bytes;
+
+    return c;
+}
+
+static void coroutine_fn readahead_read_entry(void *opaque)
+{
+    ReadaheadRead *r = opaque;
+    BlockDriverState *bs = r->bs;
+    BDRVReadaheadState *s = bs->opaque;
+    ReadaheadChunk *first = g_ptr_array_index(r->chunks, 0);
+    int ret;
+    int i;
+
+    bdrv_graph_co_rdlock();
+    ret = bdrv_co_preadv(bs->file, first->offset, r->qiov.size, &r->qiov, 0);
+    bdrv_graph_co_rdunlock();
+    trace_readahead_read_done(bs, first->offset, r->qiov.size, ret);
+
+    qemu_co_mutex_lock(&s->lock);
+    for (i = 0; i < r->chunks->len; i++) {
+        ReadaheadChunk *c = g_ptr_array_index(r->chunks, i);
+
+        c->in_flight = false;
+        if (c->cached) {
+            if (ret < 0) {
+                readahead_chunk_drop(s, c);
+            } else {
+                c->valid = true;
+                if (r->demand) {
+                    s->stats.demand_read_bytes += c->bytes;
+                } else {
+                    s->stats.prefetched_bytes += c->bytes;
+                }
+            }
+        }
+        qemu_co_queue_restart_all(&c->waiters);
+        readahead_chunk_unref(c);
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+    qemu_iovec_destroy(&r->qiov);
+    g_ptr_array_free(r->chunks, true);
+    g_free(r);
+
+    bdrv_dec_in_flight(bs);
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+readahead_read_submit(BlockDriverState *bs, ReadaheadRead *r)
+{
+    ReadaheadChunk *first = g_ptr_array_index(r->chunks, 0);
+
+    trace_readahead_read(bs, first->offset, r->qiov.size);
+
+    /* Runs once the current coroutine yields or returns */
+    bdrv_inc_in_flight(bs);
+    aio_co_enter(qemu_get_current_aio_context(),
+                 qemu_coroutine_create(readahead_read_entry, r));
+}
+
+/*
+ * Starts reading the chunks in [@offset, @end) that are not cached yet,
+ * with one request per run of consecutive chunks.  @started is only
+ * passed for requests with cache-reads=on; *@started is then set to true if
+ * any chunk had to be read.
+ *
+ * Returns the end of the chunks that are cached or being read now, which is
+ * less than @end if the cache is full.  Called with s->lock held.
+ */
+static int64_t coroutine_fn GRAPH_RDLOCK
+readahead_read_chunks(BlockDriverState *bs, int64_t offset, int64_t end,
+                      bool *started)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int64_t len = bs->total_sectors * BDRV_SECTOR_SIZE;
+    ReadaheadRead *r = NULL;
+    int64_t pos;
+
+    end = MIN(end, len);
+    for (pos = QEMU_ALIGN_DOWN(offset, READAHEAD_CHUNK_SIZE); pos < end;
+         pos += READAHEAD_CHUNK_SIZE)
+    {
+        ReadaheadChunk *c = g_hash_table_lookup(s->chunks, &pos);
+
+        if (r && (c || r->chunks->len == IOV_MAX)) {
+            readahead_read_submit(bs, r);
+            r = NULL;
+        }
+        if (c) {
+            continue;
+        }
+
+        c = readahead_chunk_new(bs, pos, MIN(READAHEAD_CHUNK_SIZE, len - pos));
+        if (!c) {
+            break;
+        }
+        if (!r) {
+            r = g_new0(ReadaheadRead, 1);
+            r->bs = bs;
+            r->chunks = g_ptr_array_new();
+            r->demand = started != NULL;
+            qemu_iovec_init(&r->qiov, 1);
+        }
+        c->refcnt++;
+        g_ptr_array_add(r->chunks, c);
+        qemu_iovec_add(&r->qiov, c->buf, c->bytes);
+        if (started) {
+            *started = true;
+        }
+    }
+
+    if (r) {
+        readahead_read_submit(bs, r);
+    }
+
+    return MIN(pos, len);
+}
+
+/*
+ * Starts reading the data that follows @st, unless enough of it has been
+ * prefetched already.  Called with s->lock held.
+ */
+static void coroutine_fn GRAPH_RDLOCK
+readahead_prefetch(BlockDriverState *bs, ReadaheadStream *st)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int64_t len = bs->total_sectors * BDRV_SECTOR_SIZE;
+    int64_t start = MAX(st->prefetch_end, st->next_offset);
+    int64_t end;
+
+    if (start - st->next_offset >= s->opts.window / 2 || start >= len) {
+        return;
+    }
+
+    end = readahead_read_chunks(bs, start, start + s->opts.window, NULL);
+    st->prefetch_end = MAX(start, end);
+}
+
+/*
+ * Assigns a read request to a stream and prefetches for the stream once it
+ * is considered sequential.
+ *
+ * A request continues a stream if it starts at most one window before the
+ * end of the stream and not after the end of the data prefetched for it.
+ * This tolerates the reordering of requests that a guest with a deep queue
+ * submits at the same time.  Called with s->lock held.
+ */
+static void coroutine_fn GRAPH_RDLOCK
+readahead_update_streams(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    ReadaheadStream *st, *lru = &s->streams[0];
+    int64_t end = offset + bytes;
+    int i;
+
+    s->clock++;
+
+    for (i = 0; i < READAHEAD_MAX_STREAMS; i++) {
+        st = &s->streams[i];
+
+        if (st->last_used &&
+            offset >= st->next_offset - MIN(st->next_offset, s->opts.window) &&
+            offset <= MAX(st->next_offset, st->prefetch_end)) {
+            st->last_used = s->clock;
+            if (end > st->next_offset) {
+                st->next_offset = end;
+                st->seq_count++;
+            }
+            if (st->seq_count >= s->opts.trigger) {
+                readahead_prefetch(bs, st);
+            }
+            return;
+        }
+
+        if (st->last_used < lru->last_used) {
+            lru = st;
+        }
+    }
+
+    *lru = (ReadaheadStream) {
+        .next_offset = end,
+        .prefetch_end = end,
+        .seq_count = 1,
+        .last_used = s->clock,
+    };
+    if (s->opts.trigger == 1) {
+        readahead_prefetch(bs, lru);
+    }
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                         QEMUIOVector *qiov, size_t qiov_offset,
+                         BdrvRequestFlags flags)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    ReadaheadChunk *c;
+    bool started = false;
+
+    qemu_co_mutex_lock(&s->lock);
+
+    readahead_update_streams(bs, offset, bytes);
+    if (s->opts.cache_reads) {
+        readahead_read_chunks(bs, offset, offset + bytes, &started);
+    }
+
+    /* Copy what the cache has, the request may span several chunks */
+    while (bytes > 0) {
+        int64_t n;
+
+        c = readahead_find_chunk(s, offset);
+        if (!c) {
+            break;
+        }
+
+        c->refcnt++;
+        while (c->in_flight) {
+            qemu_co_queue_wait(&c->waiters, &s->lock);
+        }
+        if (!c->valid || !c->cached) {
+            readahead_chunk_unref(c);
+            continue;
+        }
+
+        n = MIN(bytes, c->offset + c->bytes - offset);
+        qemu_iovec_from_buf(qiov, qiov_offset, c->buf + (offset - c->offset),
+                            n);
+        c->used = true;
+        QTAILQ_REMOVE(&s->lru, c, next);
+        QTAILQ_INSERT_HEAD(&s->lru, c, next);
+        readahead_chunk_unref(c);
+
+        offset += n;
+        qiov_offset += n;
+        bytes -= n;
+    }
+
+    if (bytes == 0 && !started) {
+        s->stats.hits++;
+    } else {
+        s->stats.misses++;
+    }
+
+    qemu_co_mutex_unlock(&s->lock);
+
+    if (bytes == 0) {
+        return 0;
+    }
+
+    return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+}
+
+/*
+ * Drops the cached chunks that overlap [offset, offset + bytes) and makes
+ * the streams prefetch them again.
+ */
+static void coroutine_fn
+readahead_invalidate(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    ReadaheadChunk *c, *next;
+    int64_t start = QEMU_ALIGN_DOWN(offset, READAHEAD_CHUNK_SIZE);
+    int64_t end = offset + bytes;
+    int64_t pos;
+    int i;
+
+    qemu_co_mutex_lock(&s->lock);
+
+    if ((end - start) / READAHEAD_CHUNK_SIZE < g_hash_table_size(s->chunks)) {
+        for (pos = start; pos < end; pos += READAHEAD_CHUNK_SIZE) {
+            c = g_hash_table_lookup(s->chunks, &pos);
+            if (c) {
+                trace_readahead_invalidate(bs, c->offset, c->bytes);
+                s->stats.invalidations++;
+                readahead_chunk_drop(s, c);
+            }
+        }
+    } else {
+        QTAILQ_FOREACH_SAFE(c, &s->lru, next, next) {
+            if (c->offset < end && offset < c->offset + c->bytes) {
+                trace_readahead_invalidate(bs, c->offset, c->bytes);
+                s->stats.invalidations++;
+                readahead_chunk_drop(s, c);
+            }
+        }
+    }
+
+    for (i = 0; i < READAHEAD_MAX_STREAMS; i++) {
+        ReadaheadStream *st = &s->streams[i];
+
+        if (start < st->prefetch_end && end > st->next_offset) {
+            st->prefetch_end = MAX(start, st->next_offset);
+        }
+    }
+
+    qemu_co_mutex_unlock(&s->lock);
+}
+
+/*
+ * The cache is invalidated both before and after the request is passed
+ * down: a prefetch that starts while the request is in flight may still
+ * read the old data.
+ */
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                          QEMUIOVector *qiov, size_t qiov_offset,
+                          BdrvRequestFlags flags)
+{
+    int ret;
+
+    readahead_invalidate(bs, offset, bytes);
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+    readahead_invalidate(bs, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_pwrite_zeroes(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                           BdrvRequestFlags flags)
+{
+    int ret;
+
+    readahead_invalidate(bs, offset, bytes);
+    ret = bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+    readahead_invalidate(bs, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    int ret;
+
+    readahead_invalidate(bs, offset, bytes);
+    ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+    readahead_invalidate(bs, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+readahead_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
+                      PreallocMode prealloc, BdrvRequestFlags flags,
+                      Error **errp)
+{
+    /* Growing the image also changes the size of its last chunk */
+    int64_t start = MIN(offset, bs->total_sectors * BDRV_SECTOR_SIZE);
+    int ret;
+
+    readahead_invalidate(bs, start, INT64_MAX - start);
+    ret = bdrv_co_truncate(bs->file, offset, exact, prealloc, flags, errp);
+    readahead_invalidate(bs, start, INT64_MAX - start);
+
+    return ret;
+}
+
+static int64_t coroutine_fn GRAPH_RDLOCK
+readahead_co_getlength(BlockDriverState *bs)
+{
+    return bdrv_co_getlength(bs->file->bs);
+}
+
+static BlockStatsSpecific *readahead_get_specific_stats(BlockDriverState *bs)
+{
+    BlockStatsSpecific *stats = g_new(BlockStatsSpecific, 1);
+    BDRVReadaheadState *s = bs->opaque;
+
+    stats->driver = BLOCKDEV_DRIVER_READAHEAD;
+    stats->u.readahead = s->stats;
+    stats->u.readahead.cached_bytes = s->cached_bytes;
+
+    return stats;
+}
+
+static void readahead_child_perm(BlockDriverState *bs, BdrvChild *c,
+    BdrvChildRole role, BlockReopenQueue *reopen_queue,
+    uint64_t perm, uint64_t shared, uint64_t *nperm, uint64_t *nshared)
+{
+    bdrv_default_perms(bs, c, role, reopen_queue, perm, shared, nperm, nshared);
+
+    /*
+     * Writes that bypass the filter would leave stale data in the cache, so
+     * don't let anyone else write to the child.
+     */
+    *nshared &= ~BLK_PERM_WRITE;
+}
+
+static int readahead_reopen_prepare(BDRVReopenState *reopen_state,
+                                    BlockReopenQueue *queue, Error **errp)
+{
+    ReadaheadOpts *opts = g_new0(ReadaheadOpts, 1);
+
+    GLOBAL_STATE_CODE();
+
+    if (!readahead_absorb_opts(opts, reopen_state->options, errp)) {
+        g_free(opts);
+        return -EINVAL;
+    }
+
+    reopen_state->opaque = opts;
+
+    return 0;
+}
+
+static void readahead_reopen_commit(BDRVReopenState *state)
+{
+    BDRVReadaheadState *s = state->bs->opaque;
+
+    /* The cache may exceed a smaller cache-size until chunks are evicted */
+    s->opts = *(ReadaheadOpts *)state->opaque;
+
+    g_free(state->opaque);
+    state->opaque = NULL;
+}
+
+static void readahead_reopen_abort(BDRVReopenState *state)
+{
+    g_free(state->opaque);
+    state->opaque = NULL;
+}
+
+static BlockDriver bdrv_readahead_filter = {
+    .format_name = "readahead",
+    .instance_size = sizeof(BDRVReadaheadState),
+
+    .bdrv_co_getlength    = readahead_co_getlength,
+    .bdrv_open            = readahead_open,
+    .bdrv_close           = readahead_close,
+
+    .bdrv_reopen_prepare  = readahead_reopen_prepare,
+    .bdrv_reopen_commit   = readahead_reopen_commit,
+    .bdrv_reopen_abort    = readahead_reopen_abort,
+
+    .bdrv_co_preadv_part = readahead_co_preadv_part,
+    .bdrv_co_pwritev_part = readahead_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes = readahead_co_pwrite_zeroes,
+    .bdrv_co_pdiscard = readahead_co_pdiscard,
+    .bdrv_co_truncate = readahead_co_truncate,
+
+    .bdrv_get_specific_stats = readahead_get_specific_stats,
+    .bdrv_child_perm = readahead_child_perm,
+
+    .is_filter = true,
+};
+
+static void bdrv_readahead_init(void)
+{
+    bdrv_register(&bdrv_readahead_filter);
+}
+
+block_init(bdrv_readahead_init);
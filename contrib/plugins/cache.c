@@ -24,6 +24,11 @@ static GRand *rng;
 
 static int limit;
 static bool sys;
+static bool batch;
+
+/* records per vCPU between two calls of vcpu_mem_buf */
+#define MEM_BUF_RECORDS 4096
+static struct qemu_plugin_mem_buf *mem_buf;
 
 enum EvictionPolicy {
     LRU,
@@ -385,32 +390,18 @@ static bool access_cache(Cache *cache, uint64_t addr)
     return false;
 }
 
-static void vcpu_mem_access(unsigned int vcpu_index, qemu_plugin_meminfo_t info,
-                            uint64_t vaddr, void *userdata)
+/* called with l1_dcache_locks[cache_idx] held */
+static void dcache_access(int cache_idx, uint64_t effective_addr,
+                          InsnData *insn)
 {
-    uint64_t effective_addr;
-    struct qemu_plugin_hwaddr *hwaddr;
-    int cache_idx;
-    InsnData *insn;
     bool hit_in_l1;
 
-    hwaddr = qemu_plugin_get_hwaddr(info, vaddr);
-    if (hwaddr && qemu_plugin_hwaddr_is_io(hwaddr)) {
-        return;
-    }
-
-    effective_addr = hwaddr ? qemu_plugin_hwaddr_phys_addr(hwaddr) : vaddr;
-    cache_idx = vcpu_index % cores;
-
-    g_mutex_lock(&l1_dcache_locks[cache_idx]);
     hit_in_l1 = access_cache(l1_dcaches[cache_idx], effective_addr);
     if (!hit_in_l1) {
-        insn = userdata;
         __atomic_fetch_add(&insn->l1_dmisses, 1, __ATOMIC_SEQ_CST);
         l1_dcaches[cache_idx]->misses++;
     }
     l1_dcaches[cache_idx]->accesses++;
-    g_mutex_unlock(&l1_dcache_locks[cache_idx]);
 
     if (hit_in_l1 || !use_l2) {
         /* No need to access L2 */
@@ -419,7 +410,6 @@ static void vcpu_mem_access(unsigned int vcpu_index, qemu_plugin_meminfo_t info,
 
     g_mutex_lock(&l2_ucache_locks[cache_idx]);
     if (!access_cache(l2_ucaches[cache_idx], effective_addr)) {
-        insn = userdata;
         __atomic_fetch_add(&insn->l2_misses, 1, __ATOMIC_SEQ_CST);
         l2_ucaches[cache_idx]->misses++;
     }
@@ -427,6 +417,45 @@ static void vcpu_mem_access(unsigned int vcpu_index, qemu_plugin_meminfo_t info,
     g_mutex_unlock(&l2_ucache_locks[cache_idx]);
 }
 
+static void vcpu_mem_access(unsigned int vcpu_index, qemu_plugin_meminfo_t info,
+                            uint64_t vaddr, void *userdata)
+{
+    uint64_t effective_addr;
+    struct qemu_plugin_hwaddr *hwaddr;
+    int cache_idx;
+
+    hwaddr = qemu_plugin_get_hwaddr(info, vaddr);
+    if (hwaddr && qemu_plugin_hwaddr_is_io(hwaddr)) {
+        return;
+    }
+
+    effective_addr = hwaddr ? qemu_plugin_hwaddr_phys_addr(hwaddr) : vaddr;
+    cache_idx = vcpu_index % cores;
+
+    g_mutex_lock(&l1_dcache_locks[cache_idx]);
+    dcache_access(cache_idx, effective_addr, userdata);
+    g_mutex_unlock(&l1_dcache_locks[cache_idx]);
+}
+
+/*
+ * Batched data accesses: virtual addresses only.  vcpu_insn_exec()
+ * delivers them before an instruction fetch reaches L2, so each cache
+ * still sees the accesses of a vCPU in program order.
+ */
+static void vcpu_mem_buf(unsigned int vcpu_index,
+                         const qemu_plugin_mem_record *records,
+                         size_t n_records, void *userdata)
+{
+    int cache_idx = vcpu_index % cores;
+    size_t i;
+
+    g_mutex_lock(&l1_dcache_locks[cache_idx]);
+    for (i = 0; i < n_records; i++) {
+        dcache_access(cache_idx, records[i].vaddr, records[i].userdata);
+    }
+    g_mutex_unlock(&l1_dcache_locks[cache_idx]);
+}
+
 static void vcpu_insn_exec(unsigned int vcpu_index, void *userdata)
 {
     uint64_t insn_addr;
@@ -452,6 +481,15 @@ static void vcpu_insn_exec(unsigned int vcpu_index, void *userdata)
         return;
     }
 
+    /*
+     * The data accesses of the previous instructions come first in the
+     * unified L2.  icache misses are rare, so this leaves most of the
+     * data accesses batched.
+     */
+    if (batch) {
+        qemu_plugin_mem_buf_flush(mem_buf, vcpu_index);
+    }
+
     g_mutex_lock(&l2_ucache_locks[cache_idx]);
     if (!access_cache(l2_ucaches[cache_idx], insn_addr)) {
         insn = userdata;
@@ -496,9 +534,13 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
         }
         g_mutex_unlock(&hashtable_lock);
 
-        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
-                                         QEMU_PLUGIN_CB_NO_REGS,
-                                         rw, data);
+        if (batch) {
+            qemu_plugin_register_vcpu_mem_buf(insn, rw, mem_buf, data);
+        } else {
+            qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
+                                             QEMU_PLUGIN_CB_NO_REGS,
+                                             rw, data);
+        }
 
         qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
                                                QEMU_PLUGIN_CB_NO_REGS, data);
@@ -702,6 +744,11 @@ finish:
 
 static void plugin_exit(qemu_plugin_id_t id, void *p)
 {
+    if (mem_buf) {
+        qemu_plugin_mem_buf_free(mem_buf);
+        mem_buf = NULL;
+    }
+
     log_stats();
     log_top_insns();
 
@@ -752,6 +799,8 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
 
     limit = 32;
     sys = info->system_emulation;
+    /* batched accesses only carry virtual addresses */
+    batch = !sys;
 
     l1_dassoc = 8;
     l1_dblksize = 64;
@@ -803,6 +852,11 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
                 fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
                 return -1;
             }
+        } else if (g_strcmp0(tokens[0], "batch") == 0) {
+            if (!qemu_plugin_bool_parse(tokens[0], tokens[1], &batch)) {
+                fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
+                return -1;
+            }
         } else if (g_strcmp0(tokens[0], "evict") == 0) {
             if (g_strcmp0(tokens[1], "rand") == 0) {
                 policy = RAND;
@@ -850,6 +904,10 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
     l1_icache_locks = g_new0(GMutex, cores);
     l2_ucache_locks = use_l2 ? g_new0(GMutex, cores) : NULL;
 
+    if (batch) {
+        mem_buf = qemu_plugin_mem_buf_new(MEM_BUF_RECORDS, vcpu_mem_buf, NULL);
+    }
+
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
 
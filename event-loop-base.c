@@ -77,6 +77,24 @@ static void event_loop_base_set_param(Object *obj, Visitor *v,
     return;
 }
 
+static bool event_loop_base_get_io_uring_sqpoll(Object *obj, Error **errp)
+{
+    return EVENT_LOOP_BASE(obj)->io_uring_sqpoll;
+}
+
+static void event_loop_base_set_io_uring_sqpoll(Object *obj, bool value,
+                                                Error **errp)
+{
+    EventLoopBaseClass *bc = EVENT_LOOP_BASE_GET_CLASS(obj);
+    EventLoopBase *base = EVENT_LOOP_BASE(obj);
+
+    base->io_uring_sqpoll = value;
+
+    if (bc->update_params) {
+        bc->update_params(base, errp);
+    }
+}
+
 static void event_loop_base_complete(UserCreatable *uc, Error **errp)
 {
     EventLoopBaseClass *bc = EVENT_LOOP_BASE_GET_CLASS(uc);
@@ -109,6 +127,9 @@ static void event_loop_base_class_init(ObjectClass *klass, void *class_data)
                               event_loop_base_get_param,
                               event_loop_base_set_param,
                               NULL, &aio_max_batch_info);
+    object_class_property_add_bool(klass, "io-uring-sqpoll",
+                                   event_loop_base_get_io_uring_sqpoll,
+                                   event_loop_base_set_io_uring_sqpoll);
     object_class_property_add(klass, "thread-pool-min", "int",
                               event_loop_base_get_param,
                               event_loop_base_set_param,
@@ -2825,7 +2825,8 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(&p, s, fmt);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -2834,6 +2835,27 @@ float32 float64_to_float32(float64 a, float_status *s)
     return float32_round_pack_canonical(&p, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    if (likely(float64_is_normal(a)) && can_use_fpu(s)) {
+        union_float64 ud;
+        union_float32 uf;
+
+        ud.s = a;
+        uf.h = ud.h;
+        /*
+         * Leave overflow and results that may be tiny, whose flags
+         * depend on the detection of tininess, to the soft path.
+         */
+        if (likely(fabsf(uf.h) > FLT_MIN && !float32_is_infinity(uf.s))) {
+            return uf.s;
+        }
+    } else if (float64_is_zero(a)) {
+        return float32_set_sign(float32_zero, float64_is_neg(a));
+    }
+    return soft_float64_to_float32(a, s);
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
@@ -3039,6 +3061,42 @@ floatx80 floatx80_round_to_int(floatx80 a, float_status *status)
     return floatx80_round_pack_canonical(&p, status);
 }
 
+/*
+ * Hardfloat part of the float to integer conversions, for a zero or
+ * normal input of value @d.  Only the unscaled conversions rounding to
+ * nearest-even or towards zero are done on the host, and only when the
+ * result is in [@min, @max]; as for the arithmetic operations, the host
+ * does not tell whether the result is exact, so the inexact flag must
+ * already be set.
+ */
+static inline bool hard_float_to_int(double *d, FloatRoundMode rmode,
+                                     int scale, double min, double max,
+                                     const float_status *s)
+{
+    double r;
+
+    if (QEMU_NO_HARDFLOAT || scale ||
+        !(s->float_exception_flags & float_flag_inexact)) {
+        return false;
+    }
+    switch (rmode) {
+    case float_round_nearest_even:
+        r = rint(*d);
+        break;
+    case float_round_to_zero:
+        r = trunc(*d);
+        break;
+    default:
+        return false;
+    }
+    /* @max + 1 is a power of two, exact even where @max is not. */
+    if (likely(r >= min && r < max + 1)) {
+        *d = r;
+        return true;
+    }
+    return false;
+}
+
 /*
  * Floating-point to signed integer conversions
  */
@@ -3092,6 +3150,15 @@ int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float32 ua;
+    double d;
+
+    ua.s = a;
+    d = ua.h;
+    if (likely(float32_is_zero_or_normal(a)) &&
+        hard_float_to_int(&d, rmode, scale, INT32_MIN, INT32_MAX, s)) {
+        return d;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3101,6 +3168,15 @@ int64_t float32_to_int64_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float32 ua;
+    double d;
+
+    ua.s = a;
+    d = ua.h;
+    if (likely(float32_is_zero_or_normal(a)) &&
+        hard_float_to_int(&d, rmode, scale, INT64_MIN, INT64_MAX, s)) {
+        return d;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3119,6 +3195,15 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float64 ua;
+    double d;
+
+    ua.s = a;
+    d = ua.h;
+    if (likely(float64_is_zero_or_normal(a)) &&
+        hard_float_to_int(&d, rmode, scale, INT32_MIN, INT32_MAX, s)) {
+        return d;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3128,6 +3213,15 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float64 ua;
+    double d;
+
+    ua.s = a;
+    d = ua.h;
+    if (likely(float64_is_zero_or_normal(a)) &&
+        hard_float_to_int(&d, rmode, scale, INT64_MIN, INT64_MAX, s)) {
+        return d;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3519,6 +3613,15 @@ uint32_t float32_to_uint32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    union_float32 ua;
+    double d;
+
+    ua.s = a;
+    d = ua.h;
+    if (likely(float32_is_zero_or_normal(a)) &&
+        hard_float_to_int(&d, rmode, scale, 0, UINT32_MAX, s)) {
+        return d;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT32_MAX, s);
@@ -3528,6 +3631,15 @@ uint64_t float32_to_uint64_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    union_float32 ua;
+    double d;
+
+    ua.s = a;
+    d = ua.h;
+    if (likely(float32_is_zero_or_normal(a)) &&
+        hard_float_to_int(&d, rmode, scale, 0, UINT64_MAX, s)) {
+        return d;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT64_MAX, s);
@@ -3546,6 +3658,15 @@ uint32_t float64_to_uint32_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    union_float64 ua;
+    double d;
+
+    ua.s = a;
+    d = ua.h;
+    if (likely(float64_is_zero_or_normal(a)) &&
+        hard_float_to_int(&d, rmode, scale, 0, UINT32_MAX, s)) {
+        return d;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT32_MAX, s);
@@ -3555,6 +3676,15 @@ uint64_t float64_to_uint64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    union_float64 ua;
+    double d;
+
+    ua.s = a;
+    d = ua.h;
+    if (likely(float64_is_zero_or_normal(a)) &&
+        hard_float_to_int(&d, rmode, scale, 0, UINT64_MAX, s)) {
+        return d;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT64_MAX, s);
@@ -4279,7 +4409,8 @@ static bfloat16 bfloat16_minmax(bfloat16 a, bfloat16 b,
     return bfloat16_round_pack_canonical(pr, s);
 }
 
-static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float32_minmax(float32 a, float32 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -4290,7 +4421,40 @@ static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
     return float32_round_pack_canonical(pr, s);
 }
 
-static float64 float64_minmax(float64 a, float64 b, float_status *s, int flags)
+/*
+ * Between zeros and normal numbers, minimum and maximum raise no
+ * exception and need no rounding: compare on the host.  Equal numbers
+ * only differ in the sign of a zero, which the bitwise or (for the
+ * minimum) or and (for the maximum) of the operands picks.
+ */
+static float32 QEMU_FLATTEN
+float32_minmax(float32 a, float32 b, float_status *s, int flags)
+{
+    union_float32 ua, ub;
+    float ha, hb;
+
+    ua.s = a;
+    ub.s = b;
+    if (QEMU_NO_HARDFLOAT || unlikely(!f32_is_zon2(ua, ub))) {
+        return soft_float32_minmax(a, b, s, flags);
+    }
+
+    ha = ua.h;
+    hb = ub.h;
+    if ((flags & minmax_ismag) && fabsf(ha) != fabsf(hb)) {
+        ha = fabsf(ha);
+        hb = fabsf(hb);
+    }
+    if (ha == hb) {
+        return flags & minmax_ismin
+            ? make_float32(float32_val(a) | float32_val(b))
+            : make_float32(float32_val(a) & float32_val(b));
+    }
+    return (ha < hb) == !!(flags & minmax_ismin) ? a : b;
+}
+
+static float64 QEMU_SOFTFLOAT_ATTR
+soft_float64_minmax(float64 a, float64 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -4301,6 +4465,32 @@ static float64 float64_minmax(float64 a, float64 b, float_status *s, int flags)
     return float64_round_pack_canonical(pr, s);
 }
 
+static float64 QEMU_FLATTEN
+float64_minmax(float64 a, float64 b, float_status *s, int flags)
+{
+    union_float64 ua, ub;
+    double ha, hb;
+
+    ua.s = a;
+    ub.s = b;
+    if (QEMU_NO_HARDFLOAT || unlikely(!f64_is_zon2(ua, ub))) {
+        return soft_float64_minmax(a, b, s, flags);
+    }
+
+    ha = ua.h;
+    hb = ub.h;
+    if ((flags & minmax_ismag) && fabs(ha) != fabs(hb)) {
+        ha = fabs(ha);
+        hb = fabs(hb);
+    }
+    if (ha == hb) {
+        return flags & minmax_ismin
+            ? make_float64(float64_val(a) | float64_val(b))
+            : make_float64(float64_val(a) & float64_val(b));
+    }
+    return (ha < hb) == !!(flags & minmax_ismin) ? a : b;
+}
+
 static float128 float128_minmax(float128 a, float128 b,
                                 float_status *s, int flags)
 {
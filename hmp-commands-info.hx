@@ -270,6 +270,21 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "jit-profile",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the samples of the dynamic compiler profiler",
+    },
+#endif
+
+SRST
+  ``info jit-profile``
+    Show the samples taken since ``jit-profile on``, as folded stacks
+    with one ``symbol;address count`` line per translation block.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
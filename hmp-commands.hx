@@ -398,6 +398,25 @@ SRST
   If called with option off, the emulation returns to normal mode.
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "jit-profile",
+        .args_type  = "enable:b,frequency:i?",
+        .params     = "on|off [frequency]",
+        .help       = "start or stop sampling the translated guest code",
+        .cmd        = hmp_jit_profile,
+    },
+#endif
+
+SRST
+``jit-profile on|off [frequency]``
+  Start or stop sampling the guest code run by TCG, ``frequency`` times
+  per second of guest time (1000 by default). Starting discards the
+  previous samples; ``info jit-profile`` shows them. A sample counts the
+  translation block a vCPU enters after the sampling tick, so blocks
+  following long-running ones are somewhat favoured.
+ERST
+
     {
         .name       = "stop|s",
         .args_type  = "",
@@ -1859,3 +1878,21 @@ SRST
   List event channels in the guest
 ERST
 #endif
+
+#if defined(CONFIG_CALYPSO)
+    {
+        .name       = "calypso-ckpt",
+        .args_type  = "op:s,fn:i?,probes:s?",
+        .params     = "list|take|restore [fn] [probes]",
+        .help       = "list, take or restore Calypso in-memory checkpoints",
+    },
+
+SRST
+``calypso-ckpt list|take|restore`` [*fn*] [*probes*]
+  Manage the rolling in-memory checkpoints of the Calypso machine (ARM RAM,
+  C54x DSP and Calypso device state, see ``CALYPSO_CKPT``). ``restore`` goes
+  back to the most recent checkpoint taken at or before TDMA frame *fn* (the
+  latest one if omitted) and, if given, replaces the ``CALYPSO_DEBUG`` probe
+  list with *probes*.
+ERST
+#endif
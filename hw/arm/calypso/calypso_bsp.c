@@ -37,6 +37,10 @@
 #include "calypso_tint0.h"  /* GSM_HYPERFRAME */
 #include "calypso_full_pcb.h"  /* DARAM lock helpers — voir pcb.h gap #3 */
 #include "calypso_dsp_shunt.h"
+#include "calypso_iq_rec.h"
+#include "calypso_ckpt.h"
+#include "hw/arm/calypso/calypso_iqconv.h"
+#include "hw/arm/calypso/calypso_config.h"
 
 int calypso_rxfb_fired = 0;   /* [probe golive] 1 des que RX-FBFLAGS pose 3fad bit15 */
 
@@ -177,8 +181,6 @@ static struct {
     QEMUTimer *drain_timer;
 } bsp;
 
-#define BSP_DRAIN_PERIOD_MS  5
-
 /* === Deterministic replay (2026-05-28) ============================
  * Test discriminant : si CALYPSO_BSP_REPLAY_FILE est set, le BSP charge
  * un dump de bursts (format identique à BSP_DUMP_RX_FILE) et les injecte
@@ -210,8 +212,11 @@ static QEMUTimer   *replay_timer  = NULL;
  * tourner sur la même horloge qu'ARM fn (via TINT0) et tdma_tick. Avec
  * icount=auto, REALTIME avance ~9% plus vite que VIRTUAL → drift cumulatif
  * (~1300 fr / 6 sec wall observé, "1 seconde d'écart BTS↔L1"). NS variant pour
- * appairage avec QEMU_CLOCK_VIRTUAL (timer_new_ns / qemu_clock_get_ns). */
-#define BSP_DRAIN_PERIOD_NS  (BSP_DRAIN_PERIOD_MS * 1000000ULL)
+ * appairage avec QEMU_CLOCK_VIRTUAL (timer_new_ns / qemu_clock_get_ns).
+ * [2026-10-18] La période (ex BSP_DRAIN_PERIOD_MS=5) est la propriété
+ * bsp-drain-ms de la machine, réglable à chaud (calypso_config.c). */
+
+static inline void bsp_daram_wr_log(void);
 
 /* Incrémente le bucket selon `addr` puis émet une ligne stats périodiquement.
  * Appelé à chaque write DARAM côté BSP (rx_burst direct + deliver_buffered). */
@@ -233,6 +238,11 @@ static inline void bsp_daram_wr_bucket(uint16_t addr)
     } else {
         bsp.wr_other++;
     }
+    bsp_daram_wr_log();
+}
+
+static inline void bsp_daram_wr_log(void)
+{
     if (bsp.wr_total - bsp.wr_last_logged >= BSP_DARAM_WR_LOG_EVERY) {
         bsp.wr_last_logged = bsp.wr_total;
         BSP_LOG("DARAM-WR-STATS low=%llu target=%llu wrap=%llu other=%llu total=%llu",
@@ -244,6 +254,30 @@ static inline void bsp_daram_wr_bucket(uint16_t addr)
     }
 }
 
+/* Écrit un burst I/Q en DARAM à daram_addr[0..n-1] (n <= daram_len : pas de
+ * wrap dans le burst), décalé de `shift` (CALYPSO_BSP_IQ_SHIFT). Cas courant
+ * — cible au-dessus de la zone basse, sans wrap 16 bits — : une passe
+ * calypso_iq_pack (SSE2/AVX2) et un seul incrément du bucket target, au lieu
+ * de classer chaque mot. Les compteurs DARAM-WR-STATS restent identiques. */
+static void bsp_daram_write_iq(const int16_t *iq, int n, int shift)
+{
+    uint16_t base = bsp.daram_addr;
+
+    if (base > BSP_BUCKET_LOW_HI &&
+        (uint32_t)base + bsp.daram_len <= C54X_DATA_SIZE) {
+        calypso_iq_pack(&bsp.dsp->data[base], iq, n, shift);
+        bsp.wr_total  += n;
+        bsp.wr_target += n;
+        bsp_daram_wr_log();
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        uint16_t a = (uint16_t)(base + i);
+        bsp.dsp->data[a] = (uint16_t)(iq[i] >> shift);
+        bsp_daram_wr_bucket(a);
+    }
+}
+
 /* Signed hyperframe distance (entry_fn - reference_fn) in (-H/2, H/2]. */
 static int32_t bsp_fn_delta(uint32_t entry_fn, uint32_t ref_fn)
 {
@@ -327,9 +361,7 @@ static BspBurstSlot *bsp_take_for_fn(uint8_t tn, uint32_t current_fn)
      * (current_fn = calypso_trx_get_fn), côte à côte. delta CONSTANT = offset
      * (fix = une ligne) ; delta qui DÉRIVE = problème d'horloge. Cap 300 + 1/500. */
     {
-        static int fp = -1;
-        if (fp < 0) fp = calypso_gate("CALYPSO_BSP_FN_PROBE", 0);
-        if (fp && n_valid > 0) {
+        if (calypso_cfg.bsp_fn_probe && n_valid > 0) {
             static unsigned fpn = 0;
             if (fpn < 300 || (fpn % 500) == 0)
                 BSP_LOG("FN-PROBE tn=%u dispatcher_fn=%u burst_fn=%u delta=%d "
@@ -431,9 +463,7 @@ static void bsp_trxd_readable(void *opaque)
      * peuvent partager un prefixe. C'est precisement l'erreur de lecture qui
      * m'a fait conclure trop vite deux fois aujourd'hui. */
     {
-        static int fp_on = -1;
-        if (fp_on < 0) fp_on = calypso_gate("CALYPSO_BSP_FINGERPRINT", 0);
-        if (fp_on && n > 8) {
+        if (calypso_cfg.bsp_fingerprint && n > 8) {
             uint32_t h = 2166136261u;      /* FNV-1a 32 bits */
             unsigned nz = 0;
             for (ssize_t i = 8; i < n; i++) {
@@ -656,13 +686,7 @@ static void bsp_trxd_readable(void *opaque)
          * par CALYPSO_BSP_IQ_DECIM (defaut 4) : 1 sample sur decim -> le tone
          * +0.393/samp @4SPS devient +0.393*decim = +pi/2. decim=1 = ancien
          * comportement (148 premiers @4SPS = 37 symb, jamais correle). */
-        static int decim = -1;
-        if (decim < 0) {
-            const char *d = getenv("CALYPSO_BSP_IQ_DECIM");
-            decim = (d && *d) ? atoi(d) : 4;
-            if (decim < 1) decim = 1;
-            BSP_LOG("IQ_DECIM=%d (STEP3 decimation ->1SPS)", decim);
-        }
+        int decim = calypso_cfg.bsp_iq_decim;    /* bsp-iq-decim, >= 1 */
         const int16_t *isrc = (const int16_t *)(buf + 8);
         int total_cplx = iq_bytes / 4;   /* jusqu'a 592 (buf[4096]) */
         iq_count = 0;
@@ -672,6 +696,13 @@ static void bsp_trxd_readable(void *opaque)
         }
         nbits = iq_count / 2;
 
+        /* [2026-10-18] CALYPSO_BSP_DC_REMOVE=1 : retire la moyenne complexe du
+         * burst decime (offset DC du front-end SDR) avant l'extrapolation de
+         * fenetre, donc avant DARAM et le port BSP. Defaut 0 = inchange. */
+        if (calypso_cfg.bsp_dc_remove) {
+            calypso_iq_dc_remove(iq, nbits);
+        }
+
         /* [2026-07-30] ELARGISSEMENT DE LA FENETRE (branche passthrough).
          * Meme motif que la branche synthese : le DSP consomme 150 echantillons
          * pour un NB et 190 pour un SB (doc/DSP_CALYPSO_REFERENCE.md §5), nous
@@ -689,16 +720,8 @@ static void bsp_trxd_readable(void *opaque)
          *    QUE grace a eux est suspecte et doit etre citee comme telle.
          * Defaut 148 = comportement inchange. */
         {
-            static int win = -1;
-            if (win < 0) {
-                const char *e = getenv("CALYPSO_BSP_RX_WINDOW");
-                win = (e && *e) ? atoi(e) : 148;
-                if (win > BSP_IQ_MAX_I16 / 2) win = BSP_IQ_MAX_I16 / 2;
-                if (win != 148)
-                    BSP_LOG("RX_WINDOW=%d echantillons (passthrough) — "
-                            "prolongement par extrapolation de phase, SYNTHETIQUE",
-                            win);
-            }
+            /* bsp-rx-window, borne a BSP_IQ_MAX_I16 / 2 par calypso_config.c */
+            int win = calypso_cfg.bsp_rx_window;
             if (win > nbits && iq_count >= 4) {
                 double i1 = iq[iq_count - 2], q1 = iq[iq_count - 1];
                 double i0 = iq[iq_count - 4], q0 = iq[iq_count - 3];
@@ -743,21 +766,17 @@ static void bsp_trxd_readable(void *opaque)
     } else {
         /* Q15 full-scale amplitude: real BSP/IOTA delivers near-full-range Q15
          * samples. ±0x7FFE keeps one bit of headroom below INT16_MIN. */
-        static const int16_t cos_tab[4] = { 0x7FFE, 0, -0x7FFE, 0 };
-        static const int16_t sin_tab[4] = { 0, 0x7FFE, 0, -0x7FFE };
-        int phase_idx = 0;
-        for (int i = 0; i < nbits; i++) {
-            /* Anomaly A fix (2026-05-08) : émettre AVANT advance, donc le premier
-             * sample est à phase=0 au lieu de phase=π/2. Le code original
-             * advance-then-emit décalait tout le burst de 90°, faisant que la
-             * corrélation cohérente du DSP correlator tombait dans la partie
-             * quadrature au lieu d'in-phase → d_fb_det principalement négatif
-             * (pattern observé : +23k, +20k occasionnel puis 4× -5k consécutifs).
-             * À valider sur le prochain run. */
-            iq[iq_count++] = cos_tab[phase_idx];  /* I — phase_idx avant advance */
-            iq[iq_count++] = sin_tab[phase_idx];  /* Q */
-            phase_idx = (phase_idx + (bits[i] ? 3 : 1)) & 3;
-        }
+        /* Anomaly A fix (2026-05-08) : émettre AVANT advance, donc le premier
+         * sample est à phase=0 au lieu de phase=π/2. Le code original
+         * advance-then-emit décalait tout le burst de 90°, faisant que la
+         * corrélation cohérente du DSP correlator tombait dans la partie
+         * quadrature au lieu d'in-phase → d_fb_det principalement négatif
+         * (pattern observé : +23k, +20k occasionnel puis 4× -5k consécutifs).
+         * La table cos/sin et l'ordre emit-then-advance vivent désormais dans
+         * calypso_iq_gmsk() (calypso_iqconv.c). */
+        unsigned phase_idx = 0;
+        calypso_iq_gmsk(iq, bits, nbits, &phase_idx);
+        iq_count = 2 * nbits;
 
         /* [2026-07-30] ELARGISSEMENT DE LA FENETRE — CALYPSO_BSP_RX_WINDOW.
          *
@@ -792,23 +811,11 @@ static void bsp_trxd_readable(void *opaque)
          * Defaut 148 = comportement inchange. Pour le test SB : 190.
          */
         {
-            static int win = -1;
-            if (win < 0) {
-                const char *e = getenv("CALYPSO_BSP_RX_WINDOW");
-                win = (e && *e) ? atoi(e) : 148;
-                if (win < nbits) win = nbits;               /* jamais tronquer */
-                if (win > BSP_IQ_MAX_I16 / 2) win = BSP_IQ_MAX_I16 / 2;
-                if (win != 148)
-                    fprintf(stderr, "[bsp] RX_WINDOW = %d echantillons "
-                            "(burst=%d + %d de garde SYNTHETIQUE) — "
-                            "NB en demande 150, SB 190\n",
-                            win, nbits, win - nbits);
-            }
-            for (int g = nbits; g < win && iq_count + 1 < BSP_IQ_MAX_I16; g++) {
-                iq[iq_count++] = cos_tab[phase_idx];
-                iq[iq_count++] = sin_tab[phase_idx];
-                phase_idx = (phase_idx + 3) & 3;   /* bit de garde = 1 */
-            }
+            int win = calypso_cfg.bsp_rx_window;    /* bsp-rx-window */
+            if (win < nbits) win = nbits;               /* jamais tronquer */
+            /* win <= BSP_IQ_MAX_I16 / 2 : la garde tient toujours dans iq[]. */
+            calypso_iq_gmsk(iq + iq_count, NULL, win - nbits, &phase_idx);
+            iq_count += 2 * (win - nbits);   /* bits de garde = 1 */
         }
     }
 
@@ -910,9 +917,11 @@ static void bsp_drain_cb(void *opaque)
     }
     int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     if (last_target == 0) last_target = now;
-    int64_t target = last_target + BSP_DRAIN_PERIOD_NS;
+    /* bsp-drain-ms : relu a chaque tick, un calypso-set prend effet au suivant. */
+    int64_t period = (int64_t)calypso_cfg.bsp_drain_ms * 1000000LL;
+    int64_t target = last_target + period;
     while (target <= now) {
-        target += BSP_DRAIN_PERIOD_NS;
+        target += period;
     }
     last_target = target;
     timer_mod(bsp.drain_timer, target);
@@ -1060,34 +1069,25 @@ static void calypso_bsp_deliver(C54xState *dsp, int vec, int bit)
     c54x_interrupt_ex(dsp, vec, bit);
 }
 
+/* [2026-10-18] Lecture via calypso_iq_rec : accepte le dump IQ16 brut
+ * (BSP_DUMP_RX_FILE) comme le record du shunt, compresse zstd ou non. Si
+ * CALYPSO_BSP_REPLAY_START_FN est pose, saute directement (index <path>.idx)
+ * au premier burst de cette FN au lieu de rejouer depuis le boot. */
 static size_t bsp_replay_load(const char *path)
 {
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        BSP_LOG("REPLAY open '%s' failed: %s", path, strerror(errno));
+    const char *sf = getenv("CALYPSO_BSP_REPLAY_START_FN");
+    uint32_t start_fn = (sf && *sf) ? (uint32_t)strtoul(sf, NULL, 0)
+                                    : UINT32_MAX;
+    CalypsoIqReader *rd = calypso_iq_reader_open(path, start_fn);
+    if (!rd) {
+        BSP_LOG("REPLAY open '%s' failed", path);
         return 0;
     }
     size_t loaded = 0;
     size_t cap = 256;
     replay_bursts = calloc(cap, sizeof(ReplayBurst));
-    if (!replay_bursts) { fclose(f); return 0; }
+    if (!replay_bursts) { calypso_iq_reader_close(rd); return 0; }
     while (1) {
-        uint8_t hdr[12];
-        if (fread(hdr, 1, 12, f) != 12) break;
-        if (memcmp(hdr, "IQ16", 4) != 0) {
-            BSP_LOG("REPLAY bad magic at burst %zu, stop", loaded);
-            break;
-        }
-        uint32_t fn = (uint32_t)hdr[4]
-                    | ((uint32_t)hdr[5] << 8)
-                    | ((uint32_t)hdr[6] << 16)
-                    | ((uint32_t)hdr[7] << 24);
-        uint8_t  tn = hdr[8];
-        uint16_t n  = (uint16_t)hdr[9] | ((uint16_t)hdr[10] << 8);
-        if (n == 0 || n > BSP_IQ_MAX_I16) {
-            BSP_LOG("REPLAY out-of-range n=%u at burst %zu, stop", n, loaded);
-            break;
-        }
         if (loaded >= cap) {
             cap *= 2;
             ReplayBurst *grown = realloc(replay_bursts,
@@ -1099,16 +1099,18 @@ static size_t bsp_replay_load(const char *path)
             replay_bursts = grown;
         }
         ReplayBurst *r = &replay_bursts[loaded];
-        r->fn = fn;
-        r->tn = tn;
-        r->n  = n;
-        if (fread(r->iq, sizeof(int16_t), n, f) != (size_t)n) {
-            BSP_LOG("REPLAY truncated at burst %zu, stop", loaded);
+        int n = calypso_iq_reader_next(rd, &r->fn, &r->tn, r->iq,
+                                       BSP_IQ_MAX_I16);
+        if (n == 0) break;
+        if (n < 0) {
+            BSP_LOG("REPLAY %s at burst %zu, stop",
+                    calypso_iq_reader_error(rd), loaded);
             break;
         }
+        r->n = (uint16_t)n;
         loaded++;
     }
-    fclose(f);
+    calypso_iq_reader_close(rd);
     return loaded;
 }
 
@@ -1179,6 +1181,10 @@ void calypso_bsp_init(C54xState *dsp)
         BSP_LOG("REPLAY mode: loaded %zu bursts from %s (UDP socket bypassed)",
                 replay_count, replay_path);
         if (replay_count > 0) {
+            /* Le curseur fait partie des checkpoints : revenir à la trame N
+             * re-présente au DSP les mêmes bursts qu'au premier passage. */
+            calypso_ckpt_add_blob("bsp.replay_idx", &replay_idx,
+                                  sizeof(replay_idx));
             replay_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, bsp_replay_cb,
                                         NULL);
             timer_mod(replay_timer,
@@ -1259,9 +1265,10 @@ skip_udp_listener:
      * trop lent). */
     bsp.drain_timer = timer_new_ns(QEMU_CLOCK_REALTIME, bsp_drain_cb, NULL);
     timer_mod(bsp.drain_timer,
-              qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + BSP_DRAIN_PERIOD_NS);
-    BSP_LOG("BSP drain timer armed: %dms REALTIME wall-paced, monotonic",
-            BSP_DRAIN_PERIOD_MS);
+              qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+              (int64_t)calypso_cfg.bsp_drain_ms * 1000000LL);
+    BSP_LOG("BSP drain timer armed: %dms REALTIME wall-paced, monotonic "
+            "(bsp-drain-ms, live)", calypso_cfg.bsp_drain_ms);
 
     BSP_LOG("init dsp=%p daram_addr=0x%04x len=%u%s%s",
             (void *)dsp, bsp.daram_addr, bsp.daram_len,
@@ -1341,7 +1348,15 @@ void calypso_bsp_rx_burst(uint8_t tn, uint32_t fn,
     /* [2026-07-22] Sonde FCCH (gated CALYPSO_IQDUMP_FCCH=1) : coherence + dphi du
      * burst DECIME ecrit en DARAM. Vrai FCCH decime -> dphi ~ +1.571 (pi/2), coh~1.
      * Verifie la couche contenu du feed. fprintf inconditionnel (pas BSP_LOG). */
-    if (getenv("CALYPSO_IQDUMP_FCCH")) {
+    /* Gates lus une fois : un getenv() par burst se payait sur chaque ARFCN. */
+    static int iqdump_fcch = -1, iqdump = -1;
+    static const char *dump_rx_path;
+    if (iqdump < 0) {
+        iqdump_fcch  = getenv("CALYPSO_IQDUMP_FCCH") ? 1 : 0;
+        iqdump       = getenv("CALYPSO_IQDUMP") ? 1 : 0;
+        dump_rx_path = getenv("BSP_DUMP_RX_FILE");
+    }
+    if (iqdump_fcch) {
         int ns = n_int16 / 2;
         double accr = 0, acci = 0, den = 0;
         for (int k = 1; k < ns; k++) {
@@ -1548,11 +1563,8 @@ void calypso_bsp_rx_burst(uint8_t tn, uint32_t fn,
          * Ce chemin-ci alimente c54x_bsp_load (port BSP), qui mesure `BSP LOAD=0`
          * dans tous les runs — il n'est donc pas le chemin actif, mais on ne
          * laisse pas deux plafonds divergents dans le meme fichier. */
-        uint16_t samples[BSP_IQ_MAX_I16];
         int ns = n_int16 > BSP_IQ_MAX_I16 ? BSP_IQ_MAX_I16 : n_int16;
-        for (int i = 0; i < ns; i++)
-            samples[i] = (uint16_t)iq[i];
-        c54x_bsp_load(bsp.dsp, samples, ns);
+        c54x_bsp_load(bsp.dsp, (const uint16_t *)iq, ns);
     }
 
     /* Also write to DARAM for code that reads samples directly.
@@ -1564,8 +1576,8 @@ void calypso_bsp_rx_burst(uint8_t tn, uint32_t fn,
      * FIX 2026-05-29 : woff LOCAL (était static) — chaque burst écrit aligné
      * à daram_addr[0..n-1]. Le static faisait rouler l'offset cross-burst :
      * le burst FB d'une frame atterrissait à un offset que le DSP ne lit pas
-     * (fragmenté sur le wrap) → corrélateur sur données désalignées. */
-    unsigned woff = 0;
+     * (fragmenté sur le wrap) → corrélateur sur données désalignées.
+     * (Depuis bsp_daram_write_iq() l'alignement est structurel : plus d'offset.) */
     /* [2026-07-26 golive-mac] ROOT-CAUSE d_fb_det=0 : ce writer rx_burst ecrit
      * son iq[] (burst DC degenere = 0x12ed constant) en DARAM 0x2a00, CLOBBANT
      * les vrais samples FCCH que feed_iq (calypso_dsp_shunt.c, coh=0.999) y a
@@ -1581,40 +1593,23 @@ void calypso_bsp_rx_burst(uint8_t tn, uint32_t fn,
      *   retirer : quand feed_iq disparait au profit du seul chemin BSP (ou
      *             inversement) — il ne doit rester qu'un writer de bsp.daram_addr.
      */
-    static int _fbiq_owns = -1;
-    if (_fbiq_owns < 0) {
-        /* [2026-07-27] DECOUPLE : le SKIP rx_burst ne se declenche QUE sur opt-in
-         * explicite CALYPSO_FB_IQ_OWNS (defaut OFF). Avant gate sur FB_IQ_DARAM ->
-         * quand feed_iq n'ecrit pas 0x2a00 (marker=0), le buffer restait affame ->
-         * kernel correle du vide -> SHADOW-DADST PERDU. Par defaut rx_burst nourrit
-         * toujours 0x2a00 (kernel vivant). Mettre FB_IQ_OWNS=1 seulement quand le
-         * feed_iq->0x2a00 est prouve fonctionnel. */
-        const char *e = getenv("CALYPSO_FB_IQ_OWNS");
-        _fbiq_owns = (e && atoi(e) > 0) ? 1 : 0;
-    }
+    /* [2026-07-27] DECOUPLE : le SKIP rx_burst ne se declenche QUE sur opt-in
+     * explicite CALYPSO_FB_IQ_OWNS (defaut OFF). Avant gate sur FB_IQ_DARAM ->
+     * quand feed_iq n'ecrit pas 0x2a00 (marker=0), le buffer restait affame ->
+     * kernel correle du vide -> SHADOW-DADST PERDU. Par defaut rx_burst nourrit
+     * toujours 0x2a00 (kernel vivant). Mettre FB_IQ_OWNS=1 seulement quand le
+     * feed_iq->0x2a00 est prouve fonctionnel.
+     * [2026-10-18] Propriete fb-iq-owns (calypso_config.c), lue par burst. */
     calypso_pcb_daram_lock_acquire();
-    if (_fbiq_owns) {
+    if (calypso_cfg.fb_iq_owns) {
         static unsigned _sk = 0;
         if (_sk++ < 8)
             fprintf(stderr, "[BSP] FB-IQ-DARAM owns 0x2a00 : rx_burst DARAM write SKIP "
                     "(fn=%u tn=%u) -> feed_iq authoritative\n", (unsigned)fn, (unsigned)tn);
     } else {
-        /* [2026-07-27] CALYPSO_BSP_IQ_SHIFT : voir en-tete du patch (instrument). */
-        static int _iqsh = -1;
-        if (_iqsh < 0) {
-            const char *e = getenv("CALYPSO_BSP_IQ_SHIFT");
-            _iqsh = (e && *e) ? atoi(e) : 0;
-            if (_iqsh < 0) _iqsh = 0;
-            if (_iqsh > 12) _iqsh = 12;
-            if (_iqsh) BSP_LOG("IQ_SHIFT=%d (echantillons >>%d avant DARAM : test saturation)", _iqsh, _iqsh);
-        }
-        for (int i = 0; i < n; i++) {
-            uint16_t a = (uint16_t)(bsp.daram_addr + woff);
-            bsp.dsp->data[a] = (uint16_t)(int16_t)(_iqsh ? (iq[i] >> _iqsh) : iq[i]);
-            bsp_daram_wr_bucket(a);
-            woff++;
-            if (woff >= bsp.daram_len) woff = 0;
-        }
+        /* [2026-07-27] CALYPSO_BSP_IQ_SHIFT : voir en-tete du patch (instrument).
+         * Propriete bsp-iq-shift, bornee [0,12] par calypso_config.c. */
+        bsp_daram_write_iq(iq, n, calypso_cfg.bsp_iq_shift);
         /* [2026-07-27] DARAM-FNSTAMP : publie le fn et le nombre d'ecritures
          * pour que le dump c54x estampille CE QU'IL LIT (voir en-tete patch). */
         calypso_daram_last_fn = (unsigned)fn;
@@ -1629,7 +1624,7 @@ void calypso_bsp_rx_burst(uint8_t tn, uint32_t fn,
      * 24 premiers (startup non-FCCH). coh = meme math que FCCH-PROBE. Sorties :
      * /tmp/iq_rx_*.bin (CALYPSO_IQDUMP, raw int16) + bursts.cfile (BSP_DUMP_RX_FILE,
      * IQ16 : hdr 12o [magic|fn LE|tn|n_int16 LE|pad] + int16). */
-    if (getenv("CALYPSO_IQDUMP") || getenv("BSP_DUMP_RX_FILE")) {
+    if (iqdump || dump_rx_path) {
         int nsx = n / 2;
         double ar = 0, ai = 0, dn = 0;
         for (int k = 1; k < nsx; k++) {
@@ -1640,7 +1635,7 @@ void calypso_bsp_rx_burst(uint8_t tn, uint32_t fn,
         }
         double bcoh = dn > 0 ? sqrt(ar*ar+ai*ai)/dn : 0;
         if (bcoh > 0.85) {   /* burst coherent = FCCH */
-            if (getenv("CALYPSO_IQDUMP")) {
+            if (iqdump) {
                 static unsigned rx_dump_n;
                 if (rx_dump_n < 24) {
                     char path[80];
@@ -1650,7 +1645,7 @@ void calypso_bsp_rx_burst(uint8_t tn, uint32_t fn,
                     rx_dump_n++;
                 }
             }
-            const char *bp = getenv("BSP_DUMP_RX_FILE");
+            const char *bp = dump_rx_path;
             if (bp && *bp) {
                 static FILE *bf; static int binit;
                 if (!binit) { bf = fopen(bp, "wb"); binit = 1; }
@@ -1887,24 +1882,20 @@ void calypso_bsp_deliver_buffered(uint32_t current_fn)
         }
         calypso_twl3025_apply_phase(sl->iq, sl->n / 2, sl->fn, (uint8_t)tn);
 
-        uint16_t samples[296];
-        for (int i = 0; i < n && i < 296; i++)
-            samples[i] = (uint16_t)sl->iq[i];
-        c54x_bsp_load(bsp.dsp, samples, n > 296 ? 296 : n);
+        c54x_bsp_load(bsp.dsp, (const uint16_t *)sl->iq, n > 296 ? 296 : n);
 
-        /* ⚠️ TESTING : woff LOCAL (était static rolling cross-burst). */
-        unsigned woff = 0;
         calypso_pcb_daram_lock_acquire();
-        for (int i = 0; i < n; i++) {
-            uint16_t a = (uint16_t)(bsp.daram_addr + woff);
+        if (bsp.inject_canary) {
             /* HACK CALYPSO_BSP_INJECT_CANARY : overwrite avec marker 0xCAFE
              * pour identifier le vrai buffer cible cote DSP via le hook
              * canary-read en c54x. Voir doc/TODO.md. */
-            uint16_t v = bsp.inject_canary ? 0xCAFE : (uint16_t)sl->iq[i];
-            bsp.dsp->data[a] = v;
-            bsp_daram_wr_bucket(a);
-            woff++;
-            if (woff >= bsp.daram_len) woff = 0;
+            for (int i = 0; i < n; i++) {
+                uint16_t a = (uint16_t)(bsp.daram_addr + i);
+                bsp.dsp->data[a] = 0xCAFE;
+                bsp_daram_wr_bucket(a);
+            }
+        } else {
+            bsp_daram_write_iq(sl->iq, n, 0);
         }
         calypso_pcb_daram_lock_release();
         bsp.bursts_written++;
@@ -1912,7 +1903,9 @@ void calypso_bsp_deliver_buffered(uint32_t current_fn)
         /* PROBE 2026-05-31 fork-1 : dump I/Q (chemin deliver_buffered, le VIVANT
          * = samples post-AFC livrés au corrélateur). Gated CALYPSO_IQDUMP,
          * compteur indépendant, préfixe iq_dlv. À RETIRER. */
-        if (getenv("CALYPSO_IQDUMP")) {
+        static int dlv_iqdump = -1;
+        if (dlv_iqdump < 0) dlv_iqdump = getenv("CALYPSO_IQDUMP") ? 1 : 0;
+        if (dlv_iqdump) {
             static unsigned dlv_dump_n;
             if (dlv_dump_n < 24) {
                 char path[80];
@@ -41,6 +41,7 @@ static uint16_t g_vec28_sp_entry = 0;
 static unsigned g_vec28_trace_pops = 0;
 
 #include "hw/arm/calypso/calypso_debug.h"
+#include "hw/arm/calypso/calypso_config.h"
 
 /* Legacy C54_LOG : gated par CALYPSO_DEBUG containing "C54X" or "ALL".
  * Pour gating fin par probe, utiliser C54_DBG("PROBE_NAME", fmt, ...). */
@@ -12610,21 +12611,20 @@ unimpl:
  *   - PC moves outside the range (shouldn't happen while polling)
  *
  * Env vars (default ON) :
- *   CALYPSO_DSP_IDLE_FF=0          disable
+ *   CALYPSO_DSP_IDLE_FF=0          disable (= propriété dsp-idle-ff, live)
  *   CALYPSO_DSP_IDLE_RANGE=lo:hi   override hex PC range
  */
 #define DSP_IDLE_FF_MAX_RANGES 4
 static bool dsp_idle_fast_forward(C54xState *s, int *consumed_out)
 {
-    static int     ff_enabled = -1;
+    static int     ff_init = 0;
     static int     ff_n_ranges = 0;
     static uint16_t ff_lo[DSP_IDLE_FF_MAX_RANGES];
     static uint16_t ff_hi[DSP_IDLE_FF_MAX_RANGES];
     static uint64_t ff_hits = 0;
 
-    if (ff_enabled < 0) {
-        const char *e = getenv("CALYPSO_DSP_IDLE_FF");
-        ff_enabled = (!e || *e != '0') ? 1 : 0;
+    if (!ff_init) {
+        ff_init = 1;
         /* Defaults: two empirically observed dispatcher loops in the
          * stock layer1.highram.elf firmware:
          *   1) 0xe9ac..0xe9b7 — PROM1 mirror, init/SP-aware path
@@ -12658,9 +12658,10 @@ static bool dsp_idle_fast_forward(C54xState *s, int *consumed_out)
                              i ? "," : "", ff_lo[i], ff_hi[i]);
         }
         C54_LOG("DSP IDLE FF: %s, ranges=[%s]",
-                ff_enabled ? "enabled" : "disabled", buf);
+                calypso_cfg.dsp_idle_ff ? "enabled" : "disabled", buf);
     }
-    if (!ff_enabled) return false;
+    /* dsp-idle-ff (calypso_config.c) : réglable à chaud, lu à chaque passe. */
+    if (!calypso_cfg.dsp_idle_ff) return false;
     bool in_range = false;
     for (int i = 0; i < ff_n_ranges; i++) {
         if (s->pc >= ff_lo[i] && s->pc <= ff_hi[i]) {
@@ -19747,9 +19748,7 @@ void c54x_bsp_load(C54xState *s, const uint16_t *samples, int n)
      * On l'accepte parce que le symptome observe est une CONSTANTE, mais ne pas
      * en tirer de conclusion au-dela de ce cas. */
     {
-        static int fp_on = -1;
-        if (fp_on < 0) fp_on = calypso_gate("CALYPSO_BSP_FINGERPRINT", 0);
-        if (fp_on && n > 0) {
+        if (calypso_cfg.bsp_fingerprint && n > 0) {
             uint32_t h = 2166136261u;
             unsigned nz = 0;
             for (int i = 0; i < n; i++) {
@@ -0,0 +1,402 @@
+/*
+ * calypso_ckpt.c — checkpoints incrementaux en memoire (voir calypso_ckpt.h)
+ *
+ * Variables :
+ *   CALYPSO_CKPT=N          un checkpoint toutes les N trames TDMA (def 0 = off ;
+ *                           217 ~ une seconde de temps GSM)
+ *   CALYPSO_CKPT_KEEP=K     taille de l'anneau (def 64)
+ *   CALYPSO_CKPT_MAX_MB=M   plafond memoire des checkpoints (def 256) : au-dela
+ *                           le plus ancien est replie dans l'image de base
+ *
+ * MODELE : une image de BASE par zone (= contenu au checkpoint le plus ancien)
+ * et, par checkpoint plus recent, un DELTA = les blocs modifies depuis le
+ * checkpoint precedent. Restaurer le checkpoint k = recopier la base puis
+ * rejouer les deltas 1..k ; tout est en RAM hote, ca se chiffre en
+ * millisecondes pour les ~8 Mo de la machine. Quand l'anneau deborde, le delta
+ * du 2e plus ancien est applique a la base et libere (« repli »).
+ *
+ * Detection des blocs modifies :
+ *   - RAM (MemoryRegion) : dirty-log QEMU, client DIRTY_MEMORY_VGA (la Calypso
+ *     n'a pas d'affichage, le client est libre). snapshot_and_clear remet aussi
+ *     les TLB en TLB_NOTDIRTY : la 1re ecriture suivante de chaque page est a
+ *     nouveau vue. Granule = page cible.
+ *   - blob : memcmp par blocs de CKPT_BLOB_BLOC octets contre une « ombre »
+ *     (copie au dernier checkpoint). C54xState fait ~650 Ko dont quelques Ko
+ *     bougent par seconde : le memcmp coute moins qu'un suivi d'ecritures.
+ *
+ * COHERENCE : capture et restauration se font vCPU en pause
+ * (pause_all_vcpus), depuis la boucle principale, BQL tenu. Le C54x et les
+ * peripheriques tournent eux aussi dans la boucle principale : rien ne bouge
+ * pendant la copie. Apres restauration : tb_flush (le code guest a ete reecrit
+ * sans passer par le suivi SMC) et reconstruction des hflags ARM.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/main-loop.h"
+#include "qapi/qmp/qdict.h"
+#include "exec/memory.h"
+#include "exec/tb-flush.h"
+#include "exec/replay-core.h"
+#include "monitor/monitor.h"
+#include "sysemu/cpus.h"
+#include "target/arm/cpu.h"
+#include "hw/arm/calypso/calypso_debug.h"
+#include "hw/arm/calypso/calypso_trx.h"
+#include "calypso_ckpt.h"
+
+#define CKPT_MAX_ZONES   16
+#define CKPT_BLOB_BLOC   256
+#define CKPT_KEEP_DEF    64
+#define CKPT_MAX_MB_DEF  256
+
+/* CPUARMState jusqu'a end_reset_fields : ce que arm_cpu_reset_hold() remet a
+ * zero, donc l'etat architectural ; la suite est de la configuration (features,
+ * pointeurs vers le GIC/NVIC...) qui ne change pas pendant le run. */
+#define CKPT_CPU_LEN     offsetof(CPUARMState, end_reset_fields)
+
+typedef struct CkptZone {
+    const char   *nom;
+    MemoryRegion *mr;        /* NULL = blob */
+    uint8_t      *p;
+    size_t        len;
+    size_t        bloc;      /* granule de diff */
+    uint8_t      *base;      /* contenu au checkpoint le plus ancien */
+    uint8_t      *ombre;     /* blob : contenu au dernier checkpoint */
+} CkptZone;
+
+/* Blocs d'une zone modifies depuis le checkpoint precedent. */
+typedef struct CkptDelta {
+    uint32_t  n;
+    uint32_t *idx;
+    uint8_t  *data;          /* n x zone->bloc */
+} CkptDelta;
+
+typedef struct Ckpt {
+    uint32_t   fn;
+    int64_t    vclock_ns;
+    size_t     octets;       /* deltas + etat CPU */
+    uint8_t    cpu[CKPT_CPU_LEN];
+    uint32_t   halted;
+    CkptDelta  d[CKPT_MAX_ZONES];
+} Ckpt;
+
+static CkptZone  g_zone[CKPT_MAX_ZONES];
+static int       g_nzones;
+
+static Ckpt    **g_ring;       /* g_keep cases, g_first = le plus ancien */
+static int       g_keep = CKPT_KEEP_DEF;
+static int       g_first, g_count;
+static size_t    g_base_octets, g_delta_octets;
+static int64_t   g_max_octets;
+
+static CPUState *g_cpu;
+static uint32_t  g_period;     /* 0 = pas de checkpoint periodique */
+static uint32_t  g_frames;
+static QEMUBH   *g_bh;
+static bool      g_armed;      /* base prise, dirty-log actif */
+
+static Ckpt *ckpt_at(int i)    /* i = rang depuis le plus ancien */
+{
+    return g_ring[(g_first + i) % g_keep];
+}
+
+static size_t zone_nblocs(const CkptZone *z)
+{
+    return DIV_ROUND_UP(z->len, z->bloc);
+}
+
+static size_t zone_bloc_len(const CkptZone *z, size_t i)
+{
+    return MIN(z->bloc, z->len - i * z->bloc);
+}
+
+static void zone_add(const char *nom, MemoryRegion *mr, void *p, size_t len,
+                     size_t bloc)
+{
+    if (g_armed) {
+        warn_report("calypso-ckpt: zone '%s' enregistree apres le 1er "
+                    "checkpoint, ignoree", nom);
+        return;
+    }
+    if (g_nzones == CKPT_MAX_ZONES) {
+        error_report("calypso-ckpt: plus de %d zones, '%s' ignoree",
+                     CKPT_MAX_ZONES, nom);
+        return;
+    }
+    g_zone[g_nzones++] = (CkptZone) {
+        .nom = nom, .mr = mr, .p = p, .len = len, .bloc = bloc,
+    };
+}
+
+void calypso_ckpt_add_ram(const char *nom, MemoryRegion *mr)
+{
+    zone_add(nom, mr, memory_region_get_ram_ptr(mr),
+             memory_region_size(mr), TARGET_PAGE_SIZE);
+}
+
+void calypso_ckpt_add_blob(const char *nom, void *p, size_t len)
+{
+    zone_add(nom, NULL, p, len, CKPT_BLOB_BLOC);
+}
+
+/* ---- capture ---- */
+
+static void delta_push(CkptDelta *d, const CkptZone *z, size_t i, size_t *cap)
+{
+    if (d->n == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        d->idx = g_renew(uint32_t, d->idx, *cap);
+        d->data = g_realloc(d->data, *cap * z->bloc);
+    }
+    memcpy(d->data + d->n * z->bloc, z->p + i * z->bloc, zone_bloc_len(z, i));
+    d->idx[d->n++] = i;
+}
+
+/* Blocs de z modifies depuis le checkpoint precedent -> d ; remet a zero le
+ * suivi (dirty-log ou ombre). */
+static void zone_capture(CkptZone *z, CkptDelta *d)
+{
+    size_t cap = 0;
+
+    if (z->mr) {
+        DirtyBitmapSnapshot *snap =
+            memory_region_snapshot_and_clear_dirty(z->mr, 0, z->len,
+                                                   DIRTY_MEMORY_VGA);
+        for (size_t i = 0; i < zone_nblocs(z); i++) {
+            if (memory_region_snapshot_get_dirty(z->mr, snap, i * z->bloc,
+                                                 zone_bloc_len(z, i))) {
+                delta_push(d, z, i, &cap);
+            }
+        }
+        g_free(snap);
+    } else {
+        for (size_t i = 0; i < zone_nblocs(z); i++) {
+            size_t off = i * z->bloc, l = zone_bloc_len(z, i);
+            if (memcmp(z->ombre + off, z->p + off, l)) {
+                memcpy(z->ombre + off, z->p + off, l);
+                delta_push(d, z, i, &cap);
+            }
+        }
+    }
+    /* Rendre l'exces : un delta vit potentiellement tout le run. */
+    d->idx = g_renew(uint32_t, d->idx, d->n);
+    d->data = g_realloc(d->data, d->n * z->bloc);
+}
+
+static void zone_clear_tracking(CkptZone *z)
+{
+    if (z->mr) {
+        g_free(memory_region_snapshot_and_clear_dirty(z->mr, 0, z->len,
+                                                      DIRTY_MEMORY_VGA));
+    } else {
+        memcpy(z->ombre, z->p, z->len);
+    }
+}
+
+static void delta_apply(const CkptZone *z, const CkptDelta *d, uint8_t *dst)
+{
+    for (uint32_t j = 0; j < d->n; j++) {
+        memcpy(dst + d->idx[j] * z->bloc, d->data + j * z->bloc,
+               zone_bloc_len(z, d->idx[j]));
+    }
+}
+
+static void ckpt_free(Ckpt *c)
+{
+    for (int z = 0; z < g_nzones; z++) {
+        g_free(c->d[z].idx);
+        g_free(c->d[z].data);
+    }
+    g_delta_octets -= c->octets;
+    g_free(c);
+}
+
+/* Replie le plus ancien checkpoint : la base avance d'un cran. */
+static void ckpt_fold_oldest(void)
+{
+    Ckpt *old = ckpt_at(0), *next = ckpt_at(1);
+
+    for (int z = 0; z < g_nzones; z++) {
+        delta_apply(&g_zone[z], &next->d[z], g_zone[z].base);
+        g_free(next->d[z].idx);
+        g_free(next->d[z].data);
+        next->d[z] = (CkptDelta) { 0 };
+    }
+    g_delta_octets -= next->octets - sizeof(Ckpt);
+    next->octets = sizeof(Ckpt);
+    ckpt_free(old);
+    g_ring[g_first] = NULL;
+    g_first = (g_first + 1) % g_keep;
+    g_count--;
+}
+
+static void ckpt_arm(void)
+{
+    for (int z = 0; z < g_nzones; z++) {
+        CkptZone *zn = &g_zone[z];
+        if (zn->mr) {
+            memory_region_set_log(zn->mr, true, DIRTY_MEMORY_VGA);
+        } else {
+            zn->ombre = g_malloc(zn->len);
+        }
+        zone_clear_tracking(zn);
+        zn->base = g_memdup2(zn->p, zn->len);
+        g_base_octets += zn->len;
+    }
+    g_ring = g_new0(Ckpt *, g_keep);
+    g_armed = true;
+}
+
+static void ckpt_take(void)
+{
+    CPUARMState *env = cpu_env(g_cpu);
+    Ckpt *c = g_new0(Ckpt, 1);
+
+    pause_all_vcpus();
+    if (!g_armed) {
+        ckpt_arm();             /* 1er checkpoint = la base, pas de delta */
+    } else {
+        for (int z = 0; z < g_nzones; z++) {
+            zone_capture(&g_zone[z], &c->d[z]);
+            c->octets += c->d[z].n * g_zone[z].bloc;
+        }
+    }
+    c->fn = calypso_trx_get_fn();
+    c->vclock_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    memcpy(c->cpu, env, CKPT_CPU_LEN);
+    c->halted = g_cpu->halted;
+    resume_all_vcpus();
+
+    c->octets += sizeof(Ckpt);
+    g_delta_octets += c->octets;
+    if (g_count == g_keep) {
+        ckpt_fold_oldest();
+    }
+    g_ring[(g_first + g_count++) % g_keep] = c;
+    while (g_count > 1 &&
+           (int64_t)(g_base_octets + g_delta_octets) > g_max_octets) {
+        ckpt_fold_oldest();
+    }
+}
+
+/* ---- restauration ---- */
+
+static void ckpt_restore(int k)
+{
+    CPUARMState *env = cpu_env(g_cpu);
+    Ckpt *c = ckpt_at(k);
+
+    pause_all_vcpus();
+    for (int z = 0; z < g_nzones; z++) {
+        CkptZone *zn = &g_zone[z];
+        memcpy(zn->p, zn->base, zn->len);
+        for (int i = 1; i <= k; i++) {
+            delta_apply(zn, &ckpt_at(i)->d[z], zn->p);
+        }
+        zone_clear_tracking(zn);
+    }
+    memcpy(env, c->cpu, CKPT_CPU_LEN);
+    g_cpu->halted = c->halted;
+    arm_rebuild_hflags(env);
+    tb_flush(g_cpu);
+    resume_all_vcpus();
+
+    /* Le futur abandonne n'est plus atteignable : nouvelle branche. */
+    while (g_count > k + 1) {
+        int last = (g_first + --g_count) % g_keep;
+        ckpt_free(g_ring[last]);
+        g_ring[last] = NULL;
+    }
+    g_frames = 0;
+}
+
+/* ---- declencheurs ---- */
+
+static void ckpt_bh(void *opaque)
+{
+    ckpt_take();
+}
+
+void calypso_ckpt_on_frame(uint32_t fn)
+{
+    if (g_period && ++g_frames >= g_period) {
+        g_frames = 0;
+        qemu_bh_schedule(g_bh);
+    }
+}
+
+static void hmp_calypso_ckpt(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_str(qdict, "op");
+    bool has_fn = qdict_haskey(qdict, "fn");
+    uint32_t fn = has_fn ? qdict_get_int(qdict, "fn") : 0;
+    const char *sondes = qdict_get_try_str(qdict, "probes");
+
+    if (!strcmp(op, "take")) {
+        ckpt_take();
+        monitor_printf(mon, "checkpoint fn=%u (%d en memoire)\n",
+                       ckpt_at(g_count - 1)->fn, g_count);
+    } else if (!strcmp(op, "list")) {
+        monitor_printf(mon, "periode %u trames, %d/%d checkpoints, "
+                       "base %zu Ko + deltas %zu Ko\n", g_period, g_count,
+                       g_keep, g_base_octets >> 10, g_delta_octets >> 10);
+        for (int i = 0; i < g_count; i++) {
+            Ckpt *c = ckpt_at(i);
+            monitor_printf(mon, "  #%-3d fn=%-8u t=%.3fs %s%zu Ko\n", i,
+                           c->fn, c->vclock_ns / 1e9,
+                           i ? "delta " : "base  ",
+                           (i ? c->octets : g_base_octets) >> 10);
+        }
+    } else if (!strcmp(op, "restore")) {
+        int k = g_count - 1;
+
+        if (replay_mode != REPLAY_MODE_NONE) {
+            monitor_printf(mon, "refuse en mode record/replay : revenir en "
+                           "arriere desynchroniserait le journal\n");
+            return;
+        }
+        if (!g_count) {
+            monitor_printf(mon, "aucun checkpoint\n");
+            return;
+        }
+        /* Le plus recent dont le FN est <= fn ; les FN croissent sauf au
+         * passage de l'hypertrame, d'ou le parcours depuis la fin. */
+        while (has_fn && k > 0 && ckpt_at(k)->fn > fn) {
+            k--;
+        }
+        ckpt_restore(k);
+        if (sondes) {
+            calypso_debug_set(sondes);
+        }
+        monitor_printf(mon, "restaure #%d fn=%u%s%s\n", k, ckpt_at(k)->fn,
+                       sondes ? ", sondes " : "", sondes ? sondes : "");
+    } else {
+        monitor_printf(mon, "usage: calypso-ckpt list|take|restore "
+                       "[fn] [sondes]\n");
+    }
+}
+
+void calypso_ckpt_init(CPUState *cpu)
+{
+    const char *e;
+
+    g_cpu = cpu;
+    e = getenv("CALYPSO_CKPT");
+    g_period = (e && *e) ? strtoul(e, NULL, 0) : 0;
+    e = getenv("CALYPSO_CKPT_KEEP");
+    if (e && *e) {
+        g_keep = MAX(2, atoi(e));
+    }
+    e = getenv("CALYPSO_CKPT_MAX_MB");
+    g_max_octets = ((e && *e) ? strtoll(e, NULL, 0) : CKPT_MAX_MB_DEF) << 20;
+
+    g_bh = qemu_bh_new(ckpt_bh, NULL);
+    monitor_register_hmp("calypso-ckpt", false, hmp_calypso_ckpt);
+    if (g_period) {
+        fprintf(stderr, "[ckpt] checkpoint toutes les %u trames, anneau %d, "
+                "plafond %lld Mo, %d zones\n", g_period, g_keep,
+                (long long)(g_max_octets >> 20), g_nzones);
+    }
+}
@@ -0,0 +1,57 @@
+/*
+ * calypso_ckpt.h — checkpoints incrementaux en memoire (« voyage dans le temps »)
+ *
+ * [2026-10-18] Pourquoi ce module existe.
+ *
+ *   Diagnostiquer la chaine FB-det native voulait dire relancer depuis le boot,
+ *   plusieurs minutes, a chaque nouvelle combinaison de sondes CALYPSO_DEBUG
+ *   (cf TODO.md : run apres run). Ici la machine garde un anneau de
+ *   checkpoints pris toutes les CALYPSO_CKPT trames TDMA, chacun etiquete par
+ *   son FN ; le moniteur permet de revenir a la trame N et de re-executer avec
+ *   d'autres sondes en quelques secondes :
+ *
+ *       (qemu) calypso-ckpt list
+ *       (qemu) calypso-ckpt restore 1200 FBDET,IMR_W
+ *
+ * CE QUI EST CAPTURE : les zones enregistrees via calypso_ckpt_add_ram()
+ *   (RAM ARM : IRAM, XRAM — pages sales suivies par le dirty-log QEMU) et
+ *   calypso_ckpt_add_blob() (etat « a plat » : C54xState, TRX/TPU/TSP/ULPD,
+ *   shunt, INTH, curseur du rejeu BSP), plus l'etat ARM (CPUARMState jusqu'a
+ *   end_reset_fields). Le checkpoint le plus ancien est une image complete ;
+ *   les suivants ne stockent que les pages/blocs modifies depuis le precedent.
+ *
+ * CE QUI NE L'EST PAS : les horloges QEMU (virtual clock, timers) ne reculent
+ *   pas, l'etat prive des peripheriques non enregistres (UART, timers, statics
+ *   des modules) reste celui du present. Pour une re-execution deterministe,
+ *   nourrir le BSP depuis une capture (CALYPSO_BSP_REPLAY_FILE) : son curseur
+ *   fait partie du checkpoint. Le sous-systeme replay/ (-icount rr=) journalise
+ *   les entrees de TOUT le run : revenir en arriere le desynchronise, la
+ *   restauration est donc refusee en mode record/replay.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#ifndef CALYPSO_CKPT_H
+#define CALYPSO_CKPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct MemoryRegion MemoryRegion;
+typedef struct CPUState CPUState;
+
+/* Enregistrement des zones — a appeler pendant l'init machine, avant
+ * calypso_ckpt_init(). Le nom sert aux messages et a `calypso-ckpt list`. */
+void calypso_ckpt_add_ram(const char *nom, MemoryRegion *mr);
+void calypso_ckpt_add_blob(const char *nom, void *p, size_t len);
+
+/* Fin d'init machine : lit CALYPSO_CKPT / _KEEP / _MAX_MB et enregistre la
+ * commande moniteur. Sans CALYPSO_CKPT aucun checkpoint periodique n'est
+ * pris, mais `calypso-ckpt take` reste disponible. */
+void calypso_ckpt_init(CPUState *cpu);
+
+/* Tick trame TDMA (calypso_frame_irq_lower). Ne capture pas elle-meme : on est
+ * dans un callback de timer VIRTUAL, d'ou la pause des vCPU est interdite —
+ * la capture est deportee dans un bottom-half. */
+void calypso_ckpt_on_frame(uint32_t fn);
+
+#endif /* CALYPSO_CKPT_H */
@@ -0,0 +1,22 @@
+/*
+ * calypso_config-stub.c — commandes QMP Calypso sans CONFIG_CALYPSO
+ *
+ * Le schéma les déclare pour toute cible ARM ; les binaires construits sans
+ * la machine Calypso répondent par une erreur.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc-target.h"
+
+CalypsoConfigEntryList *qmp_query_calypso_config(Error **errp)
+{
+    error_setg(errp, "Calypso support is not compiled in");
+    return NULL;
+}
+
+void qmp_calypso_set(const char *name, int64_t value, Error **errp)
+{
+    error_setg(errp, "Calypso support is not compiled in");
+}
@@ -0,0 +1,244 @@
+/*
+ * calypso_config.c — réglages typés de la machine Calypso (voir calypso_config.h)
+ *
+ * Une table décrit chaque réglage (propriété, variable d'amorce, type, bornes,
+ * modifiable à chaud ou non) ; tout le reste — amorce par l'environnement,
+ * propriétés QOM, query-calypso-config / calypso-set — est dérivé de la table.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "qapi/qapi-commands-misc-target.h"
+#include "hw/qdev-core.h"
+
+#include "hw/arm/calypso/calypso_config.h"
+#include "hw/arm/calypso/calypso_debug.h"
+
+CalypsoConfig calypso_cfg;
+
+typedef struct CfgDesc {
+    const char *nom;             /* propriété QOM / calypso-set */
+    const char *env;             /* variable d'amorce */
+    CalypsoConfigType type;
+    size_t off;
+    int64_t defaut, min, max;
+    bool live;
+    const char *desc;
+} CfgDesc;
+
+#define CFG_BOOL(nom, env, champ, defaut, live, desc)                        \
+    { nom, env, CALYPSO_CONFIG_TYPE_BOOL,                                    \
+      offsetof(CalypsoConfig, champ), defaut, 0, 1, live, desc }
+#define CFG_INT(nom, env, champ, defaut, min, max, live, desc)               \
+    { nom, env, CALYPSO_CONFIG_TYPE_INT,                                     \
+      offsetof(CalypsoConfig, champ), defaut, min, max, live, desc }
+
+static const CfgDesc cfg_table[] = {
+    CFG_INT("dsp-budget", "CALYPSO_DSP_BUDGET", dsp_budget,
+            256000, 1000, 100000000, true,
+            "C54x instructions per c54x_run call (~1 nominal frame = 256000)"),
+    CFG_BOOL("dsp-idle-ff", "CALYPSO_DSP_IDLE_FF", dsp_idle_ff, 1, true,
+             "Fast-forward the DSP dispatcher polling loop when no task is "
+             "pending"),
+    CFG_INT("bsp-drain-ms", "CALYPSO_BSP_DRAIN_MS", bsp_drain_ms,
+            5, 1, 1000, true,
+            "Period of the BSP burst drain timer, in milliseconds"),
+    CFG_BOOL("cpu-idle", "CALYPSO_CPU_IDLE", cpu_idle, 1, true,
+             "Park the ARM vCPU while it spins in the L1 idle loop"),
+    CFG_INT("bsp-iq-decim", "CALYPSO_BSP_IQ_DECIM", bsp_iq_decim,
+            4, 1, 64, true,
+            "Decimation of the passthrough I/Q stream (4 SPS -> 1 SPS)"),
+    CFG_INT("bsp-rx-window", "CALYPSO_BSP_RX_WINDOW", bsp_rx_window,
+            148, 1, 192, true,
+            "Samples delivered per burst; beyond the burst, synthetic guard"),
+    CFG_INT("bsp-iq-shift", "CALYPSO_BSP_IQ_SHIFT", bsp_iq_shift,
+            0, 0, 12, true,
+            "Right shift applied to I/Q samples before the DARAM write"),
+    CFG_BOOL("bsp-dc-remove", "CALYPSO_BSP_DC_REMOVE", bsp_dc_remove, 0, true,
+             "Remove the complex mean of each passthrough burst"),
+    CFG_BOOL("bsp-fingerprint", "CALYPSO_BSP_FINGERPRINT", bsp_fingerprint,
+             0, true, "FEED-FP probe: hash of every incoming TRXD burst"),
+    CFG_BOOL("bsp-fn-probe", "CALYPSO_BSP_FN_PROBE", bsp_fn_probe, 0, true,
+             "FN-PROBE log of burst FN versus dispatcher FN"),
+    CFG_BOOL("fb-iq-owns", "CALYPSO_FB_IQ_OWNS", fb_iq_owns, 0, true,
+             "Leave DARAM to the shunt feed_iq writer (rx_burst skips it)"),
+    CFG_INT("tdma-ns", "CALYPSO_TDMA_NS", tdma_ns,
+            4615384, 4615384, 1000000000, false,
+            "Wall-clock TDMA frame period of the clock master, in ns "
+            "(shared with the osmo-trx device heartbeat: startup only)"),
+};
+
+static bool cfg_ready;
+
+static int64_t cfg_load(const CfgDesc *d)
+{
+    void *p = (char *)&calypso_cfg + d->off;
+
+    if (d->type == CALYPSO_CONFIG_TYPE_BOOL) {
+        return qatomic_read((bool *)p);
+    }
+    return qatomic_read((int32_t *)p);
+}
+
+static void cfg_store_raw(const CfgDesc *d, int64_t v)
+{
+    void *p = (char *)&calypso_cfg + d->off;
+
+    if (d->type == CALYPSO_CONFIG_TYPE_BOOL) {
+        qatomic_set((bool *)p, v != 0);
+    } else {
+        qatomic_set((int32_t *)p, (int32_t)v);
+    }
+}
+
+static bool cfg_store(const CfgDesc *d, int64_t v, Error **errp)
+{
+    if (!d->live && phase_check(PHASE_MACHINE_READY)) {
+        error_setg(errp, "calypso: '%s' is only read at machine creation; "
+                   "use -machine calypso,%s=... or %s", d->nom, d->nom, d->env);
+        return false;
+    }
+    if (v < d->min || v > d->max) {
+        error_setg(errp, "calypso: '%s' must be in [%" PRId64 ", %" PRId64 "]",
+                   d->nom, d->min, d->max);
+        return false;
+    }
+    if (cfg_load(d) != v) {
+        fprintf(stderr, "[cfg] %s = %" PRId64 " (etait %" PRId64 ")\n",
+                d->nom, v, cfg_load(d));
+    }
+    cfg_store_raw(d, v);
+    return true;
+}
+
+static const CfgDesc *cfg_find(const char *nom, Error **errp)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(cfg_table); i++) {
+        if (!strcmp(cfg_table[i].nom, nom)) {
+            return &cfg_table[i];
+        }
+    }
+    error_setg(errp, "calypso: unknown tunable '%s'", nom);
+    return NULL;
+}
+
+void calypso_config_init(void)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(cfg_table); i++) {
+        const CfgDesc *d = &cfg_table[i];
+        const char *e = getenv(d->env);
+        int64_t v = d->defaut;
+
+        if (d->type == CALYPSO_CONFIG_TYPE_BOOL) {
+            v = calypso_gate(d->env, d->defaut);
+        } else if (e && *e) {
+            /* Même lecture que les anciens latches (atoi/strtoul base 0),
+             * mais une valeur hors bornes est ramenée aux bornes et dite. */
+            v = strtoll(e, NULL, 0);
+            if (v < d->min || v > d->max) {
+                int64_t c = v < d->min ? d->min : d->max;
+                fprintf(stderr, "[cfg] %s=%s hors [%" PRId64 ", %" PRId64
+                        "] -> %" PRId64 "\n", d->env, e, d->min, d->max, c);
+                v = c;
+            }
+        }
+        cfg_store_raw(d, v);
+        if (v != d->defaut) {
+            fprintf(stderr, "[cfg] %s = %" PRId64 " (%s)\n",
+                    d->nom, v, d->env);
+        }
+    }
+    cfg_ready = true;
+}
+
+/* ---- propriétés QOM ---- */
+
+static void cfg_prop_get(Object *obj, Visitor *v, const char *name,
+                         void *opaque, Error **errp)
+{
+    const CfgDesc *d = opaque;
+
+    if (d->type == CALYPSO_CONFIG_TYPE_BOOL) {
+        bool b = cfg_load(d);
+        visit_type_bool(v, name, &b, errp);
+    } else {
+        int64_t x = cfg_load(d);
+        visit_type_int(v, name, &x, errp);
+    }
+}
+
+static void cfg_prop_set(Object *obj, Visitor *v, const char *name,
+                         void *opaque, Error **errp)
+{
+    const CfgDesc *d = opaque;
+    int64_t x;
+
+    if (d->type == CALYPSO_CONFIG_TYPE_BOOL) {
+        bool b;
+        if (!visit_type_bool(v, name, &b, errp)) {
+            return;
+        }
+        x = b;
+    } else if (!visit_type_int(v, name, &x, errp)) {
+        return;
+    }
+    cfg_store(d, x, errp);
+}
+
+void calypso_config_class_init(ObjectClass *oc)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(cfg_table); i++) {
+        const CfgDesc *d = &cfg_table[i];
+
+        object_class_property_add(oc, d->nom,
+                                  d->type == CALYPSO_CONFIG_TYPE_BOOL
+                                  ? "bool" : "int",
+                                  cfg_prop_get, cfg_prop_set, NULL,
+                                  (void *)d);
+        object_class_property_set_description(oc, d->nom, d->desc);
+    }
+}
+
+/* ---- QMP ---- */
+
+CalypsoConfigEntryList *qmp_query_calypso_config(Error **errp)
+{
+    CalypsoConfigEntryList *head = NULL, **tail = &head;
+
+    if (!cfg_ready) {
+        error_setg(errp, "calypso: not a Calypso machine");
+        return NULL;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(cfg_table); i++) {
+        const CfgDesc *d = &cfg_table[i];
+        CalypsoConfigEntry *e = g_new0(CalypsoConfigEntry, 1);
+
+        e->name = g_strdup(d->nom);
+        e->env = g_strdup(d->env);
+        e->type = d->type;
+        e->value = cfg_load(d);
+        e->default_value = d->defaut;
+        e->min = d->min;
+        e->max = d->max;
+        e->live = d->live;
+        QAPI_LIST_APPEND(tail, e);
+    }
+    return head;
+}
+
+void qmp_calypso_set(const char *name, int64_t value, Error **errp)
+{
+    const CfgDesc *d;
+
+    if (!cfg_ready) {
+        error_setg(errp, "calypso: not a Calypso machine");
+        return;
+    }
+    d = cfg_find(name, errp);
+    if (d) {
+        cfg_store(d, value, errp);
+    }
+}
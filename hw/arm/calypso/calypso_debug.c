@@ -43,14 +43,8 @@ static void normalize(char *s)
     }
 }
 
-static void parse_env_locked(void)
+static void parse_list_locked(const char *e)
 {
-    if (s_inited) return;
-    s_inited = true;
-
-    const char *e = getenv("CALYPSO_DEBUG");
-    if (!e || !*e) return;
-
     /* Walk comma-separated tokens. */
     const char *p = e;
     while (*p && s_entries_n < MAX_ENTRIES) {
@@ -81,6 +75,16 @@ static void parse_env_locked(void)
     }
 }
 
+static void parse_env_locked(void)
+{
+    if (s_inited) return;
+    s_inited = true;
+
+    const char *e = getenv("CALYPSO_DEBUG");
+    if (!e || !*e) return;
+    parse_list_locked(e);
+}
+
 /* Init unique du master gate : parse l'env et fixe calypso_debug_master.
  * Appelé depuis l'inline calypso_debug_enabled() du header au 1er passage. */
 void calypso_debug_master_init(void)
@@ -91,6 +95,22 @@ void calypso_debug_master_init(void)
     pthread_mutex_unlock(&s_mu);
 }
 
+/* Remplace la liste à chaud (calypso-ckpt restore ... <sondes>). Les sites qui
+ * ont mémorisé leur réponse dans un `static int` gardent l'ancienne : seuls
+ * les appels directs à calypso_debug_enabled() voient le changement. */
+void calypso_debug_set(const char *liste)
+{
+    pthread_mutex_lock(&s_mu);
+    s_inited = true;
+    s_entries_n = 0;
+    s_all = false;
+    if (liste && *liste) {
+        parse_list_locked(liste);
+    }
+    calypso_debug_master = (s_all || s_entries_n > 0) ? 1 : 0;
+    pthread_mutex_unlock(&s_mu);
+}
+
 /* Impl réelle (out-of-line). N'est atteinte que quand master == 1, donc
  * parse_env_locked a déjà tourné — le bloc !s_inited reste par sûreté. */
 bool calypso_debug_enabled_(const char *probe_name)
@@ -47,6 +47,9 @@
 #include "sysemu/dma.h"
 #include "qemu/main-loop.h"
 #include "calypso_dsp_shunt.h"
+#include "calypso_iq_rec.h"
+#include "calypso_ckpt.h"
+#include "hw/arm/calypso/calypso_config.h"
 #include "hw/arm/calypso/calypso_trf6151.h"
 #include "hw/arm/calypso/calypso_twl3025.h"
 #include "calypso_c54x.h"   /* C54xState + c54x_bsp_load/run/interrupt_ex/wake (CALYPSO_DSP=c54x route) */
@@ -1892,14 +1895,10 @@ static void shunt_route_to_c54x_run(void)
     dsp->running = true;
 
     fprintf(stderr, "[c54x-route] c-wake-ok running=%d idle=%d\n", dsp->running, dsp->idle);
-    /* (d) execute le budget (1 trame nominale ~256000 insns ; ajustable env). */
+    /* (d) execute le budget (1 trame nominale ~256000 insns ; dsp-budget,
+     * reglable a chaud — meme reglage que le tick TRX). */
     {
-        static int budget = -1;
-        if (budget < 0) {
-            const char *b = getenv("CALYPSO_DSP_BUDGET");
-            budget = (b && *b) ? atoi(b) : 256000;
-            if (budget <= 0) budget = 256000;
-        }
+        int budget = calypso_cfg.dsp_budget;
         fprintf(stderr, "[c54x-route] d-pre-c54x_run budget=%d\n", budget);
         c54x_run(dsp, budget);
         fprintf(stderr, "[c54x-route] d-c54x_run-RETURNED\n");
@@ -3454,42 +3453,24 @@ static struct dsp_shunt_shm *g_shm;
 static int16_t  g_fbs[FBS_RING];
 static uint32_t g_fbs_wr, g_fbs_rd;
 static uint32_t              g_shm_last_si_seq;
-static FILE                 *g_iq_cfile2;  /* cfile #2 FN-espace (zero-fill) -> test grgsm SACCH */
-
-/* [2026-07-30] PLAFOND du cfile #2. Le zero-fill produit un flux CONTINU : spf
- * (def 2500) floats par trame TDMA = 10 ko/trame, soit ~2,2 Mo/s en temps réel
- * = 7,8 Go/h — pour un /dev/shm de 8 Go, qui est de la RAM. C'était donc le seul
- * dump non plafonné du projet, et il ne pouvait pas être activé par défaut.
- * Plafonné, il peut l'être : à l'atteinte du plafond on ferme proprement (le
- * fichier reste décodable) et on le dit UNE fois.
- *   CALYPSO_IQ_CFILE2_MAX_MB=0 -> illimité (à vos risques).
- * Cf. la règle « toute sonde PLAFONNÉE » (TODO.md §4). */
-static int64_t g_c2_written;    /* octets écrits */
-static int64_t g_c2_max = -1;   /* -1 = non résolu, 0 = illimité */
-
-static void cfile2_wr(const void *buf, size_t nfloats)
-{
-    if (!g_iq_cfile2) return;
-    if (g_c2_max < 0) {
-        const char *e = getenv("CALYPSO_IQ_CFILE2_MAX_MB");
-        int mb = (e && *e) ? atoi(e) : 512;
-        g_c2_max = (mb <= 0) ? 0 : (int64_t)mb * 1024 * 1024;
-    }
-    if (g_c2_max && g_c2_written >= g_c2_max) {
-        SHUNT_ERR("cfile #2 : plafond %lld Mo atteint -> fermeture, le fichier "
-                  "reste decodable (CALYPSO_IQ_CFILE2_MAX_MB=0 pour illimite)",
-                  (long long)(g_c2_max / (1024 * 1024)));
-        fclose(g_iq_cfile2);
-        g_iq_cfile2 = NULL;
-        return;
-    }
-    fwrite(buf, sizeof(float), nfloats, g_iq_cfile2);
-    g_c2_written += (int64_t)nfloats * (int64_t)sizeof(float);
-}
+/* [2026-10-18] Les deux enregistrements disque (record IQ16 rejouable + cfile #2
+ * FN-espace) passent par calypso_iq_rec : ring sans verrou + thread dedie, plus
+ * aucun fwrite sur le thread d'emulation. Le plafond du cfile #2
+ * (CALYPSO_IQ_CFILE2_MAX_MB, def 512, 0 = illimite) est tenu par le recorder :
+ * a l'atteinte on ferme proprement et on le dit UNE fois (TODO.md §4). */
+static CalypsoIqRec         *g_iq_cfile2;  /* cfile #2 FN-espace (zero-fill) -> test grgsm SACCH */
 static int                   g_iq_fd      = -1;   /* fd brut I/Q : fichier ou FIFO live */
 static int                   g_iq_is_fifo = 0;    /* 1 = FIFO -> non bloquant + drop */
 static char                  g_iq_path[256];      /* chemin memorise pour retry FIFO */
-static FILE                 *g_iq_rec;            /* record disque .cfile contigu (rejeu), EN PLUS du live */
+static CalypsoIqRec         *g_iq_rec;            /* record disque IQ16 indexe (rejeu), EN PLUS du live */
+
+/* Plafond en Mo lu dans `var` (absente/vide -> 512, <= 0 -> illimite). */
+static int64_t shunt_iq_cap(const char *var)
+{
+    const char *e = getenv(var);
+    int mb = (e && *e) ? atoi(e) : 512;
+    return (mb <= 0) ? 0 : (int64_t)mb * 1024 * 1024;
+}
 
 static void shunt_shm_init(void)
 {
@@ -3543,28 +3524,50 @@ static void shunt_shm_init(void)
                 SHUNT_ERR("open(%s) cfile: %s", cf, strerror(errno));
         }
     }
-    /* Record disque .cfile contigu (capture brute fc32) EN PLUS de la sortie live :
-     * la FIFO sert au live (FFT) sans rien garder, ce record garde tout pour le
-     * rejeu deterministe (grgsm_cfile_decode.py). Fichier regulier -> fwrite jamais
-     * bloquant. Defaut /dev/shm/dsp_iq.cfile ; CALYPSO_SHUNT_IQ_RECORD= (vide) pour
-     * desactiver. On evite le double-open si le record vise le meme fichier que la
-     * sortie live (cas live=fichier, pas FIFO). */
+    /* Record disque contigu EN PLUS de la sortie live : la FIFO sert au live
+     * (FFT) sans rien garder, ce record garde tout pour le rejeu.
+     * [2026-10-18] Format IQ16 natif (cs16, header fn/tn par burst) + index
+     * <chemin>.idx, ecrit par le thread cal-iqrec : le fichier est directement
+     * rejouable par CALYPSO_BSP_REPLAY_FILE (et CALYPSO_BSP_REPLAY_START_FN
+     * saute via l'index). Compression zstd si CALYPSO_SHUNT_IQ_RECORD_ZSTD > 0
+     * (niveau ; defaut 1 quand QEMU a zstd), plafond
+     * CALYPSO_SHUNT_IQ_RECORD_MAX_MB (def 512). Defaut
+     * /dev/shm/dsp_iq.iq16[.zst] ; CALYPSO_SHUNT_IQ_RECORD= (vide) pour
+     * desactiver. On evite le double-open si le record vise le meme fichier que
+     * la sortie live (cas live=fichier, pas FIFO). */
     const char *rec = getenv("CALYPSO_SHUNT_IQ_RECORD");
+    const char *zl  = getenv("CALYPSO_SHUNT_IQ_RECORD_ZSTD");
+#ifdef CONFIG_ZSTD
+    int zlevel = (zl && *zl) ? atoi(zl) : 1;
+#else
+    int zlevel = (zl && *zl) ? atoi(zl) : 0;
+#endif
     if (!rec)
-        rec = "/dev/shm/dsp_iq.cfile";
+        rec = zlevel > 0 ? "/dev/shm/dsp_iq.iq16.zst" : "/dev/shm/dsp_iq.iq16";
     if (*rec && !(g_iq_fd >= 0 && !g_iq_is_fifo && strcmp(rec, g_iq_path) == 0)) {
-        g_iq_rec = fopen(rec, "wb");
+        CalypsoIqRecOpts o = {
+            .fmt        = CALYPSO_IQREC_IQ16,
+            .max_bytes  = shunt_iq_cap("CALYPSO_SHUNT_IQ_RECORD_MAX_MB"),
+            .zstd_level = zlevel,
+        };
+        g_iq_rec = calypso_iq_rec_open(rec, &o);
         if (g_iq_rec)
-            SHUNT_ERR("record disque I/Q -> %s (cfile fc32 contigu)", rec);
-        else
-            SHUNT_ERR("fopen(%s) record: %s", rec, strerror(errno));
+            SHUNT_ERR("record disque I/Q -> %s (IQ16 indexe%s, thread cal-iqrec)",
+                      rec, zlevel > 0 ? " zstd" : "");
     }
     /* cfile #2 : reconstruction FN-espacee (zero-fill des trames manquantes) pour
      * que grgsm retrouve la 51-mf et decode la SACCH (SI5/SI6). Test offline, ne
-     * touche PAS au cfile live. Active via CALYPSO_SHUNT_IQ_CFILE2=<chemin>. */
+     * touche PAS au cfile live. Active via CALYPSO_SHUNT_IQ_CFILE2=<chemin>.
+     * spf = int16/trame TDMA (def 2500=1x, sweepable via CALYPSO_IQ_CFILE_SPF). */
     const char *cf2 = getenv("CALYPSO_SHUNT_IQ_CFILE2");
     if (cf2 && *cf2) {
-        g_iq_cfile2 = fopen(cf2, "wb");
+        const char *e = getenv("CALYPSO_IQ_CFILE_SPF");
+        CalypsoIqRecOpts o = {
+            .fmt       = CALYPSO_IQREC_FC32_FNSPACED,
+            .max_bytes = shunt_iq_cap("CALYPSO_IQ_CFILE2_MAX_MB"),
+            .spf       = (e && *e) ? atoi(e) : 2500,
+        };
+        g_iq_cfile2 = calypso_iq_rec_open(cf2, &o);
         if (g_iq_cfile2)
             SHUNT_ERR("cfile #2 FN-espace -> %s (gap zero-fill)", cf2);
     }
@@ -3679,11 +3682,10 @@ void calypso_dsp_shunt_feed_iq(uint32_t fn, const int16_t *iq, int n)
          *   retirer : quand la chaine BSP -> BDLENA -> DARAM alimente le buffer seule
          *             (writer 0x12ed non degenere).
          */
-        static int _fid = -1, _decim = 4, _fcch = 0;
+        static int _fid = -1, _fcch = 0;
+        int _decim = calypso_cfg.bsp_iq_decim;
         if (_fid < 0) {
             const char *e = getenv("CALYPSO_FB_IQ_DARAM"); _fid = (e && atoi(e) > 0) ? 1 : 0;
-            const char *d = getenv("CALYPSO_BSP_IQ_DECIM"); if (d && *d) _decim = atoi(d);
-            if (_decim < 1) _decim = 1;
             const char *f = getenv("CALYPSO_FB_IQ_FCCH_ONLY"); _fcch = (f && atoi(f) > 0) ? 1 : 0;
         }
         static uint16_t _iqbase = 0;
@@ -3955,46 +3957,25 @@ void calypso_dsp_shunt_feed_iq(uint32_t fn, const int16_t *iq, int n)
         g_shm->iq_wr++;               /* publie le burst (le lecteur poll iq_wr) */
     }
 
-    /* Sorties fc32 (I,Q normalise) : (a) live -> FIFO (FFT, drop) ou fichier, via
-     * g_iq_fd ; (b) record disque contigu -> g_iq_rec (rejeu deterministe). fbuf
-     * calcule une seule fois et diffuse aux deux. */
+    /* Sortie live fc32 (I,Q normalise) -> FIFO (FFT, drop) ou fichier, via
+     * g_iq_fd. Jamais bloquant (O_NONBLOCK sur FIFO). */
     if (g_iq_is_fifo && g_iq_fd < 0)
         g_iq_fd = open(g_iq_path, O_WRONLY | O_NONBLOCK);     /* retry : le lecteur est-il apparu ? */
-    if (g_iq_fd >= 0 || g_iq_rec) {
+    if (g_iq_fd >= 0) {
         float fbuf[SHM_IQ_LEN];
         for (int i = 0; i < n; i++)
             fbuf[i] = (float)iq[i] / 32768.0f;
-        if (g_iq_fd >= 0) {
-            ssize_t w = write(g_iq_fd, fbuf, (size_t)n * sizeof(float));
-            if (w < 0 && g_iq_is_fifo && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-                /* pipe plein -> drop ce burst (FFT live, perte tolerable) */
-            } else if (w < 0 && g_iq_is_fifo && (errno == EPIPE || errno == ENXIO)) {
-                close(g_iq_fd); g_iq_fd = -1;   /* lecteur parti -> on reessaiera */
-            }
+        ssize_t w = write(g_iq_fd, fbuf, (size_t)n * sizeof(float));
+        if (w < 0 && g_iq_is_fifo && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            /* pipe plein -> drop ce burst (FFT live, perte tolerable) */
+        } else if (w < 0 && g_iq_is_fifo && (errno == EPIPE || errno == ENXIO)) {
+            close(g_iq_fd); g_iq_fd = -1;   /* lecteur parti -> on reessaiera */
         }
-        if (g_iq_rec)                                  /* record disque : jamais bloquant */
-            fwrite(fbuf, sizeof(float), (size_t)n, g_iq_rec);
-    }
-    /* cfile #2 FN-espace : chaque burst TS0 a sa position de trame
-     * ((fn-base)*spf int16), trames manquantes zero-fillees -> grgsm retrouve la
-     * 51-mf -> SACCH (SI5/SI6) decodable. spf = int16/trame TDMA (def 2500=1x,
-     * sweepable via CALYPSO_IQ_CFILE_SPF pour le test offline). */
-    if (g_iq_cfile2) {
-        static int spf = -1; static uint32_t base_fn = 0; static int64_t pos = 0; static int have_base = 0;
-        if (spf < 0) { const char *e = getenv("CALYPSO_IQ_CFILE_SPF"); spf = (e && *e) ? atoi(e) : 2500; }
-        if (!have_base) { base_fn = fn; pos = 0; have_base = 1; }
-        int64_t target = (int64_t)fn - (int64_t)base_fn;
-        if (target < 0) target += 2715648;            /* hyperframe wrap */
-        target *= spf;
-        int64_t gap = target - pos;
-        if (gap < 0 || gap > (int64_t)spf * 300) { base_fn = fn; pos = 0; gap = 0; }  /* rebase si saut anormal */
-        static const float zeros[512] = {0};
-        while (gap > 0 && g_iq_cfile2) { int c = gap > 512 ? 512 : (int)gap; cfile2_wr(zeros, (size_t)c); pos += c; gap -= c; }
-        float fbuf2[SHM_IQ_LEN];
-        for (int i = 0; i < n; i++) fbuf2[i] = (float)iq[i] / 32768.0f;
-        cfile2_wr(fbuf2, (size_t)n);
-        pos += n;
     }
+    /* Records disque : simple copie dans le ring du recorder (le shunt ne voit
+     * que TS0 -> tn=0). Le cfile #2 FN-espace est reconstruit cote thread. */
+    calypso_iq_rec_push(g_iq_rec, fn, 0, iq, n);
+    calypso_iq_rec_push(g_iq_cfile2, fn, 0, iq, n);
     /* [2026-08-12] LE BLOC CI-DESSUS ETAIT ECRIT DEUX FOIS, a la suite, dans
      * cette meme fonction. Consequence : CHAQUE burst etait ecrit DEUX FOIS dans
      * le cfile #2, et — pire — chaque copie avait ses PROPRES `static` (spf,
@@ -4051,6 +4032,7 @@ void calypso_dsp_shunt_init(MemoryRegion *system_memory, AddressSpace *as)
     g_shunt.as     = as;
     g_shunt.pending = false;
     g_shunt.tick_cnt = 0;
+    calypso_ckpt_add_blob("shunt", &g_shunt, sizeof(g_shunt));
 
     /* Overlay the single d_dsp_page word as IO. The rest of the API RAM
      * stays as plain RAM that the firmware reads/writes directly. */
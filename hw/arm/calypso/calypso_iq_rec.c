@@ -0,0 +1,623 @@
+/*
+ * calypso_iq_rec.c — enregistreur I/Q asynchrone + relecteur (format IQ16)
+ *
+ * Voir calypso_iq_rec.h pour le format et la raison d'etre.
+ *
+ * Modele de concurrence : ring SPSC de IQREC_RING slots. Le producteur (thread
+ * d'emulation, sous BQL) n'ecrit que `wr`, le thread recorder n'ecrit que `rd`.
+ * Publication par store-release / load-acquire, reveil par QemuEvent (le set
+ * est un simple test atomique quand l'evenement est deja leve). Toutes les
+ * E/S — fwrite, compression, index, fflush — sont faites par le thread.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+
+#include "calypso_iq_rec.h"
+#include "calypso_tint0.h"  /* GSM_HYPERFRAME */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hw/arm/calypso/calypso_debug.h"
+#define IQREC_LOG(fmt, ...) \
+    do { if (calypso_debug_enabled("IQREC")) \
+        fprintf(stderr, "[iqrec] " fmt "\n", ##__VA_ARGS__); } while (0)
+
+#define IQREC_RING       256    /* slots, pow2 — ~150 ms de bursts 8 TS */
+#define IQREC_CHUNK      64     /* bursts par entree d'index (= par trame zstd) */
+#define IQREC_HDR        12
+#define IQREC_IDX_HDR    8
+#define IQREC_IDX_ENT    16
+#define IQREC_IDX_VER    1
+#define IQREC_MAX_OPEN   4
+#define IQREC_ZSTD_MAGIC 0xFD2FB528u
+
+typedef struct IqRecSlot {
+    uint32_t fn;
+    uint8_t  tn;
+    uint16_t n;
+    int16_t  iq[CALYPSO_IQREC_MAX_I16];
+} IqRecSlot;
+
+struct CalypsoIqRec {
+    CalypsoIqRecOpts o;
+    char        path[256];
+    IqRecSlot  *ring;
+    uint32_t    wr;          /* ecrit par le producteur seul */
+    uint32_t    rd;          /* ecrit par le thread seul */
+    uint64_t    dropped;     /* producteur seul */
+    bool        stop;
+    QemuEvent   ev;
+    QemuThread  thread;
+
+    /* --- etat prive du thread --- */
+    FILE       *f;
+    FILE       *idx;
+    int64_t     written;     /* octets deja dans f */
+    uint64_t    bursts;
+    unsigned    in_chunk;
+    bool        capped;
+    uint32_t    base_fn;     /* FC32_FNSPACED */
+    int64_t     pos;
+    bool        have_base;
+#ifdef CONFIG_ZSTD
+    ZSTD_CCtx  *zc;
+    uint8_t    *zout;
+    size_t      zout_sz;
+#endif
+};
+
+static CalypsoIqRec *iq_rec_open_tab[IQREC_MAX_OPEN];
+
+/* === Cote thread ======================================================== */
+
+static void iq_rec_raw(CalypsoIqRec *r, const void *buf, size_t len)
+{
+    if (fwrite(buf, 1, len, r->f) != len) {
+        error_report("[iqrec] %s : ecriture : %s -> fermeture",
+                     r->path, strerror(errno));
+        fclose(r->f);
+        r->f = NULL;
+        return;
+    }
+    r->written += (int64_t)len;
+}
+
+static void iq_rec_out(CalypsoIqRec *r, const void *buf, size_t len)
+{
+#ifdef CONFIG_ZSTD
+    if (r->zc) {
+        ZSTD_inBuffer in = { buf, len, 0 };
+        while (r->f && in.pos < in.size) {
+            ZSTD_outBuffer out = { r->zout, r->zout_sz, 0 };
+            size_t rc = ZSTD_compressStream2(r->zc, &out, &in, ZSTD_e_continue);
+            if (ZSTD_isError(rc)) {
+                error_report("[iqrec] %s : zstd : %s", r->path,
+                             ZSTD_getErrorName(rc));
+                return;
+            }
+            if (out.pos) {
+                iq_rec_raw(r, r->zout, out.pos);
+            }
+        }
+        return;
+    }
+#endif
+    iq_rec_raw(r, buf, len);
+}
+
+/* Fin de chunk : ferme la trame zstd courante (le chunk suivant est une trame
+ * independante, donc un point d'entree pour l'index) puis pousse sur disque. */
+static void iq_rec_chunk_end(CalypsoIqRec *r)
+{
+#ifdef CONFIG_ZSTD
+    if (r->zc && r->f) {
+        ZSTD_inBuffer in = { NULL, 0, 0 };
+        size_t left;
+        do {
+            ZSTD_outBuffer out = { r->zout, r->zout_sz, 0 };
+            left = ZSTD_compressStream2(r->zc, &out, &in, ZSTD_e_end);
+            if (ZSTD_isError(left)) {
+                error_report("[iqrec] %s : zstd : %s", r->path,
+                             ZSTD_getErrorName(left));
+                break;
+            }
+            if (out.pos) {
+                iq_rec_raw(r, r->zout, out.pos);
+            }
+        } while (left && r->f);
+    }
+#endif
+    if (r->f) {
+        fflush(r->f);
+    }
+    if (r->idx) {
+        fflush(r->idx);
+    }
+    r->in_chunk = 0;
+}
+
+static void iq_rec_index(CalypsoIqRec *r, const IqRecSlot *s)
+{
+    uint8_t e[IQREC_IDX_ENT] = { 0 };
+
+    if (!r->idx) {
+        return;
+    }
+    stl_le_p(e, s->fn);
+    e[4] = s->tn;
+    stq_le_p(e + 8, (uint64_t)r->written);
+    fwrite(e, 1, sizeof(e), r->idx);
+}
+
+static void iq_rec_put_iq16(CalypsoIqRec *r, const IqRecSlot *s)
+{
+    uint8_t hdr[IQREC_HDR] = { 'I', 'Q', '1', '6' };
+    int16_t le[CALYPSO_IQREC_MAX_I16];
+
+    if (r->in_chunk == IQREC_CHUNK) {
+        iq_rec_chunk_end(r);
+    }
+    if (r->in_chunk == 0) {
+        iq_rec_index(r, s);
+    }
+    stl_le_p(hdr + 4, s->fn);
+    hdr[8] = s->tn;
+    stw_le_p(hdr + 9, s->n);
+    for (int i = 0; i < s->n; i++) {
+        le[i] = (int16_t)cpu_to_le16((uint16_t)s->iq[i]);
+    }
+    iq_rec_out(r, hdr, sizeof(hdr));
+    iq_rec_out(r, le, (size_t)s->n * sizeof(int16_t));
+    r->in_chunk++;
+}
+
+/* cfile #2 FN-espace : chaque burst a sa position de trame ((fn-base)*spf
+ * int16), trames manquantes zero-fillees -> grgsm retrouve la 51-mf et decode
+ * la SACCH (SI5/SI6). Reprend a l'identique la logique de feed_iq, hors du
+ * thread d'emulation. */
+static void iq_rec_put_fc32(CalypsoIqRec *r, const IqRecSlot *s)
+{
+    static const float zeros[512];
+    float fbuf[CALYPSO_IQREC_MAX_I16];
+    int64_t spf = r->o.spf > 0 ? r->o.spf : 2500;
+
+    if (!r->have_base) {
+        r->base_fn = s->fn;
+        r->pos = 0;
+        r->have_base = true;
+    }
+    int64_t target = (int64_t)s->fn - (int64_t)r->base_fn;
+    if (target < 0) {
+        target += GSM_HYPERFRAME;
+    }
+    target *= spf;
+    int64_t gap = target - r->pos;
+    if (gap < 0 || gap > spf * 300) {          /* rebase si saut anormal */
+        r->base_fn = s->fn;
+        r->pos = 0;
+        gap = 0;
+    }
+    while (gap > 0 && r->f) {
+        int c = gap > 512 ? 512 : (int)gap;
+        iq_rec_raw(r, zeros, (size_t)c * sizeof(float));
+        r->pos += c;
+        gap -= c;
+    }
+    for (int i = 0; i < s->n; i++) {
+        fbuf[i] = (float)s->iq[i] / 32768.0f;
+    }
+    if (r->f) {
+        iq_rec_raw(r, fbuf, (size_t)s->n * sizeof(float));
+    }
+    r->pos += s->n;
+}
+
+static void iq_rec_close_files(CalypsoIqRec *r)
+{
+    if (r->o.fmt == CALYPSO_IQREC_IQ16 && r->in_chunk) {
+        iq_rec_chunk_end(r);
+    }
+    if (r->f) {
+        fclose(r->f);
+        r->f = NULL;
+    }
+    if (r->idx) {
+        fclose(r->idx);
+        r->idx = NULL;
+    }
+}
+
+static void iq_rec_write(CalypsoIqRec *r, const IqRecSlot *s)
+{
+    if (!r->f) {
+        return;                               /* plafonne ou en erreur : on vide */
+    }
+    if (r->o.max_bytes && r->written >= r->o.max_bytes) {
+        /* Meme regle que l'ancien cfile #2 : a l'atteinte du plafond on ferme
+         * proprement (le fichier reste decodable) et on le dit UNE fois. */
+        iq_rec_close_files(r);
+        r->capped = true;
+        error_report("[iqrec] %s : plafond %lld Mo atteint -> fermeture, le "
+                     "fichier reste decodable", r->path,
+                     (long long)(r->o.max_bytes / (1024 * 1024)));
+        return;
+    }
+    if (r->o.fmt == CALYPSO_IQREC_IQ16) {
+        iq_rec_put_iq16(r, s);
+    } else {
+        iq_rec_put_fc32(r, s);
+    }
+    r->bursts++;
+}
+
+static void *iq_rec_thread(void *opaque)
+{
+    CalypsoIqRec *r = opaque;
+
+    for (;;) {
+        qemu_event_reset(&r->ev);
+        uint32_t wr = qatomic_load_acquire(&r->wr);
+        while (r->rd != wr) {
+            iq_rec_write(r, &r->ring[r->rd % IQREC_RING]);
+            qatomic_store_release(&r->rd, r->rd + 1);
+        }
+        if (qatomic_load_acquire(&r->wr) != r->rd) {
+            continue;
+        }
+        if (qatomic_read(&r->stop)) {
+            break;
+        }
+        qemu_event_wait(&r->ev);
+    }
+    iq_rec_close_files(r);
+    return NULL;
+}
+
+/* === Cote emulation ===================================================== */
+
+static void iq_rec_atexit(void)
+{
+    for (int i = 0; i < IQREC_MAX_OPEN; i++) {
+        if (iq_rec_open_tab[i]) {
+            calypso_iq_rec_close(iq_rec_open_tab[i]);
+        }
+    }
+}
+
+CalypsoIqRec *calypso_iq_rec_open(const char *path, const CalypsoIqRecOpts *o)
+{
+    static bool atexit_armed;
+    int slot = -1;
+
+    for (int i = 0; i < IQREC_MAX_OPEN; i++) {
+        if (!iq_rec_open_tab[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        error_report("[iqrec] %s : trop de recorders ouverts (max %d)",
+                     path, IQREC_MAX_OPEN);
+        return NULL;
+    }
+
+    CalypsoIqRec *r = g_new0(CalypsoIqRec, 1);
+    r->o = *o;
+    snprintf(r->path, sizeof(r->path), "%s", path);
+    r->f = fopen(path, "wb");
+    if (!r->f) {
+        error_report("[iqrec] fopen(%s) : %s", path, strerror(errno));
+        g_free(r);
+        return NULL;
+    }
+    setvbuf(r->f, NULL, _IOFBF, 1 << 20);
+
+    if (r->o.fmt == CALYPSO_IQREC_IQ16) {
+        char ipath[272];
+        uint8_t ih[IQREC_IDX_HDR] = { 'I', 'Q', 'I', 'X' };
+
+        snprintf(ipath, sizeof(ipath), "%s.idx", path);
+        r->idx = fopen(ipath, "wb");
+        if (r->idx) {
+            stl_le_p(ih + 4, IQREC_IDX_VER);
+            fwrite(ih, 1, sizeof(ih), r->idx);
+        } else {
+            error_report("[iqrec] fopen(%s) : %s (capture non indexee)",
+                         ipath, strerror(errno));
+        }
+        if (r->o.zstd_level > 0) {
+#ifdef CONFIG_ZSTD
+            r->zc = ZSTD_createCCtx();
+            r->zout_sz = ZSTD_CStreamOutSize();
+            r->zout = g_malloc(r->zout_sz);
+            ZSTD_CCtx_setParameter(r->zc, ZSTD_c_compressionLevel,
+                                   r->o.zstd_level);
+#else
+            warn_report("[iqrec] %s : QEMU construit sans zstd -> capture "
+                        "non compressee", path);
+            r->o.zstd_level = 0;
+#endif
+        }
+    }
+
+    r->ring = g_new(IqRecSlot, IQREC_RING);
+    qemu_event_init(&r->ev, false);
+    qemu_thread_create(&r->thread, "cal-iqrec", iq_rec_thread, r,
+                       QEMU_THREAD_JOINABLE);
+    iq_rec_open_tab[slot] = r;
+    if (!atexit_armed) {
+        atexit_armed = true;
+        atexit(iq_rec_atexit);
+    }
+    IQREC_LOG("%s ouvert (fmt=%s zstd=%d plafond=%lld Mo)", path,
+              r->o.fmt == CALYPSO_IQREC_IQ16 ? "iq16" : "fc32-fn",
+              r->o.zstd_level, (long long)(r->o.max_bytes / (1024 * 1024)));
+    return r;
+}
+
+bool calypso_iq_rec_push(CalypsoIqRec *r, uint32_t fn, uint8_t tn,
+                         const int16_t *iq, int n)
+{
+    if (!r || n <= 0) {
+        return false;
+    }
+    uint32_t wr = r->wr;
+    if (wr - qatomic_load_acquire(&r->rd) >= IQREC_RING) {
+        r->dropped++;
+        return false;
+    }
+    IqRecSlot *s = &r->ring[wr % IQREC_RING];
+    if (n > CALYPSO_IQREC_MAX_I16) {
+        n = CALYPSO_IQREC_MAX_I16;
+    }
+    s->fn = fn;
+    s->tn = tn;
+    s->n  = (uint16_t)n;
+    memcpy(s->iq, iq, (size_t)n * sizeof(int16_t));
+    qatomic_store_release(&r->wr, wr + 1);
+    qemu_event_set(&r->ev);
+    return true;
+}
+
+void calypso_iq_rec_close(CalypsoIqRec *r)
+{
+    if (!r) {
+        return;
+    }
+    for (int i = 0; i < IQREC_MAX_OPEN; i++) {
+        if (iq_rec_open_tab[i] == r) {
+            iq_rec_open_tab[i] = NULL;
+        }
+    }
+    qatomic_set(&r->stop, true);
+    qemu_event_set(&r->ev);
+    qemu_thread_join(&r->thread);
+    if (r->dropped || calypso_debug_enabled("IQREC")) {
+        fprintf(stderr, "[iqrec] %s : %llu bursts ecrits, %llu perdus (ring "
+                "plein), %lld o%s\n", r->path,
+                (unsigned long long)r->bursts,
+                (unsigned long long)r->dropped, (long long)r->written,
+                r->capped ? " (plafonne)" : "");
+    }
+#ifdef CONFIG_ZSTD
+    ZSTD_freeCCtx(r->zc);
+    g_free(r->zout);
+#endif
+    qemu_event_destroy(&r->ev);
+    g_free(r->ring);
+    g_free(r);
+}
+
+/* === Relecteur ========================================================== */
+
+struct CalypsoIqReader {
+    FILE       *f;
+    bool        zst;
+    uint32_t    skip_until;   /* UINT32_MAX = rien a sauter */
+    const char *err;
+    uint8_t    *buf;          /* flux decompresse (zstd) */
+    size_t      buf_sz, buf_pos, buf_len;
+#ifdef CONFIG_ZSTD
+    ZSTD_DCtx  *dz;
+    uint8_t    *zin;
+    size_t      zin_sz;
+    ZSTD_inBuffer in;
+#endif
+};
+
+#ifdef CONFIG_ZSTD
+static bool iq_reader_refill(CalypsoIqReader *rd)
+{
+    for (;;) {
+        if (rd->in.pos == rd->in.size) {
+            rd->in.size = fread(rd->zin, 1, rd->zin_sz, rd->f);
+            rd->in.pos = 0;
+            if (rd->in.size == 0) {
+                return false;
+            }
+        }
+        ZSTD_outBuffer out = { rd->buf, rd->buf_sz, 0 };
+        size_t rc = ZSTD_decompressStream(rd->dz, &out, &rd->in);
+        if (ZSTD_isError(rc)) {
+            rd->err = ZSTD_getErrorName(rc);
+            return false;
+        }
+        if (out.pos) {
+            rd->buf_pos = 0;
+            rd->buf_len = out.pos;
+            return true;
+        }
+    }
+}
+#endif
+
+/* Lit exactement len octets du flux IQ16 (decompresse si besoin). */
+static size_t iq_reader_read(CalypsoIqReader *rd, void *dst, size_t len)
+{
+    if (!rd->zst) {
+        return fread(dst, 1, len, rd->f);
+    }
+#ifdef CONFIG_ZSTD
+    size_t got = 0;
+    while (got < len) {
+        if (rd->buf_pos == rd->buf_len && !iq_reader_refill(rd)) {
+            break;
+        }
+        size_t c = MIN(len - got, rd->buf_len - rd->buf_pos);
+        memcpy((uint8_t *)dst + got, rd->buf + rd->buf_pos, c);
+        rd->buf_pos += c;
+        got += c;
+    }
+    return got;
+#else
+    return 0;
+#endif
+}
+
+/* Cherche dans <path>.idx le dernier chunk qui commence a fn <= start_fn. */
+static int64_t iq_reader_seek_off(const char *path, uint32_t start_fn)
+{
+    char ipath[272];
+    uint8_t e[IQREC_IDX_ENT];
+    int64_t off = -1;
+
+    snprintf(ipath, sizeof(ipath), "%s.idx", path);
+    FILE *f = fopen(ipath, "rb");
+    if (!f) {
+        return -1;
+    }
+    if (fread(e, 1, IQREC_IDX_HDR, f) != IQREC_IDX_HDR ||
+        memcmp(e, "IQIX", 4) != 0 || ldl_le_p(e + 4) != IQREC_IDX_VER) {
+        fclose(f);
+        return -1;
+    }
+    while (fread(e, 1, sizeof(e), f) == sizeof(e)) {
+        if ((uint32_t)ldl_le_p(e) > start_fn) {
+            break;
+        }
+        off = (int64_t)ldq_le_p(e + 8);
+    }
+    fclose(f);
+    return off;
+}
+
+CalypsoIqReader *calypso_iq_reader_open(const char *path, uint32_t start_fn)
+{
+    uint8_t magic[4];
+    FILE *f = fopen(path, "rb");
+
+    if (!f) {
+        error_report("[iqrec] fopen(%s) : %s", path, strerror(errno));
+        return NULL;
+    }
+    CalypsoIqReader *rd = g_new0(CalypsoIqReader, 1);
+    rd->f = f;
+    rd->skip_until = start_fn;
+    rd->zst = fread(magic, 1, 4, f) == 4 &&
+              (uint32_t)ldl_le_p(magic) == IQREC_ZSTD_MAGIC;
+    if (rd->zst) {
+#ifdef CONFIG_ZSTD
+        rd->dz = ZSTD_createDCtx();
+        rd->zin_sz = ZSTD_DStreamInSize();
+        rd->zin = g_malloc(rd->zin_sz);
+        rd->buf_sz = ZSTD_DStreamOutSize();
+        rd->buf = g_malloc(rd->buf_sz);
+#else
+        error_report("[iqrec] %s : capture zstd, QEMU construit sans zstd",
+                     path);
+        calypso_iq_reader_close(rd);
+        return NULL;
+#endif
+    }
+
+    int64_t off = start_fn != UINT32_MAX ? iq_reader_seek_off(path, start_fn)
+                                         : -1;
+    if (fseeko(f, off > 0 ? off : 0, SEEK_SET) != 0) {
+        error_report("[iqrec] %s : seek %lld : %s", path, (long long)off,
+                     strerror(errno));
+        calypso_iq_reader_close(rd);
+        return NULL;
+    }
+    if (start_fn != UINT32_MAX) {
+        IQREC_LOG("%s : depart fn=%u -> offset %lld%s", path, start_fn,
+                  (long long)(off > 0 ? off : 0),
+                  off < 0 ? " (pas d'index, parcours depuis le debut)" : "");
+    }
+    return rd;
+}
+
+int calypso_iq_reader_next(CalypsoIqReader *rd, uint32_t *fn, uint8_t *tn,
+                           int16_t *iq, int max)
+{
+    uint8_t hdr[IQREC_HDR];
+
+    for (;;) {
+        size_t got = iq_reader_read(rd, hdr, sizeof(hdr));
+        if (got == 0 && !rd->err) {
+            return 0;
+        }
+        if (got != sizeof(hdr)) {
+            rd->err = rd->err ? rd->err : "header tronque";
+            return -1;
+        }
+        if (memcmp(hdr, "IQ16", 4) != 0) {
+            rd->err = "bad magic";
+            return -1;
+        }
+        uint16_t n = lduw_le_p(hdr + 9);
+        if (n == 0 || n > max) {
+            rd->err = "n hors limites";
+            return -1;
+        }
+        if (iq_reader_read(rd, iq, (size_t)n * sizeof(int16_t)) !=
+            (size_t)n * sizeof(int16_t)) {
+            rd->err = rd->err ? rd->err : "burst tronque";
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            iq[i] = (int16_t)le16_to_cpu((uint16_t)iq[i]);
+        }
+        *fn = ldl_le_p(hdr + 4);
+        *tn = hdr[8];
+        if (rd->skip_until != UINT32_MAX) {
+            if (*fn < rd->skip_until) {
+                continue;
+            }
+            rd->skip_until = UINT32_MAX;
+        }
+        return n;
+    }
+}
+
+const char *calypso_iq_reader_error(CalypsoIqReader *rd)
+{
+    return rd->err ? rd->err : "ok";
+}
+
+void calypso_iq_reader_close(CalypsoIqReader *rd)
+{
+    if (!rd) {
+        return;
+    }
+    if (rd->f) {
+        fclose(rd->f);
+    }
+#ifdef CONFIG_ZSTD
+    ZSTD_freeDCtx(rd->dz);
+    g_free(rd->zin);
+#endif
+    g_free(rd->buf);
+    g_free(rd);
+}
@@ -0,0 +1,78 @@
+/*
+ * calypso_iq_rec.h — enregistreur I/Q asynchrone + relecteur (format IQ16)
+ *
+ * [2026-10-18] Pourquoi ce module existe.
+ *
+ *   Le shunt enregistrait l'I/Q d'entree du DSP par fwrite() de float32 SUR LE
+ *   THREAD D'EMULATION (record /dev/shm/dsp_iq.cfile, cfile #2 FN-espace).
+ *   Deux fois le volume utile (cs16 -> fc32), une conversion par echantillon,
+ *   et une ecriture disque bloquante a chaque burst : d'ou le plafond de 512 Mo
+ *   et un record coupe par defaut — on ne pouvait pas le laisser allume.
+ *
+ *   Ici le thread d'emulation ne fait plus qu'un memcpy dans un ring SPSC sans
+ *   verrou ; un thread dedie (« cal-iqrec ») ecrit, compresse et indexe. Ring
+ *   plein -> le burst est PERDU et compte (jamais de blocage de l'emulation).
+ *
+ * FORMAT IQ16 (celui de BSP_DUMP_RX_FILE, donc rejouable tel quel par
+ * CALYPSO_BSP_REPLAY_FILE) : par burst un header 12 o
+ *     magic 'IQ16' | fn LE 4o | tn 1o | n_int16 LE 2o | pad 1o
+ * puis n x int16 LE (I/Q entrelaces, cs16 natif — plus de conversion float).
+ *
+ * COMPRESSION (optionnelle, si QEMU est construit avec zstd) : le fichier est
+ * une suite de trames zstd INDEPENDANTES de IQREC_CHUNK bursts chacune ;
+ * `zstd -dc capture.iq16.zst` rend le flux IQ16 brut.
+ *
+ * INDEX « <chemin>.idx » : header 'IQIX' | version LE 4o, puis une entree de
+ * 16 o par chunk : fn LE 4o | tn 1o | pad 3o | offset fichier LE 8o. L'offset
+ * designe le debut d'un chunk (= d'une trame zstd si compresse) : le relecteur
+ * y saute directement (CALYPSO_BSP_REPLAY_START_FN).
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#ifndef CALYPSO_IQ_REC_H
+#define CALYPSO_IQ_REC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CALYPSO_IQREC_MAX_I16  384   /* = BSP_IQ_MAX_I16 (192 echantillons I/Q) */
+
+typedef enum CalypsoIqRecFmt {
+    CALYPSO_IQREC_IQ16,             /* records IQ16 natifs + index (+ zstd) */
+    CALYPSO_IQREC_FC32_FNSPACED,    /* fc32 FN-espace zero-fill (cfile #2 grgsm) */
+} CalypsoIqRecFmt;
+
+typedef struct CalypsoIqRecOpts {
+    CalypsoIqRecFmt fmt;
+    int64_t max_bytes;    /* plafond du fichier de sortie, 0 = illimite */
+    int     zstd_level;   /* IQ16 seulement : 0 = brut */
+    int     spf;          /* FC32_FNSPACED : int16 par trame TDMA (def 2500) */
+} CalypsoIqRecOpts;
+
+typedef struct CalypsoIqRec CalypsoIqRec;
+
+/* Ouvre le fichier et demarre le thread. NULL si l'ouverture echoue (deja
+ * signale). Les recorders ouverts sont vidanges et fermes a la sortie. */
+CalypsoIqRec *calypso_iq_rec_open(const char *path, const CalypsoIqRecOpts *o);
+
+/* Producteur UNIQUE (thread d'emulation). Jamais bloquant : retourne false si
+ * le ring est plein (burst perdu, compte dans le bilan de fermeture). */
+bool calypso_iq_rec_push(CalypsoIqRec *r, uint32_t fn, uint8_t tn,
+                         const int16_t *iq, int n);
+
+void calypso_iq_rec_close(CalypsoIqRec *r);
+
+/* Relecteur IQ16, brut ou zstd (detecte au magic). start_fn != UINT32_MAX :
+ * saute via l'index au chunk qui contient start_fn et ignore les bursts qui
+ * le precedent. */
+typedef struct CalypsoIqReader CalypsoIqReader;
+
+CalypsoIqReader *calypso_iq_reader_open(const char *path, uint32_t start_fn);
+/* Retourne n (int16 lus dans iq), 0 en fin de fichier, -1 sur erreur
+ * (motif : calypso_iq_reader_error). */
+int  calypso_iq_reader_next(CalypsoIqReader *rd, uint32_t *fn, uint8_t *tn,
+                            int16_t *iq, int max);
+const char *calypso_iq_reader_error(CalypsoIqReader *rd);
+void calypso_iq_reader_close(CalypsoIqReader *rd);
+
+#endif /* CALYPSO_IQ_REC_H */
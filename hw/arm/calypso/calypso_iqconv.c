@@ -0,0 +1,354 @@
+/*
+ * calypso_iqconv.c — etage de conversion I/Q du BSP (voir calypso_iqconv.h)
+ *
+ * [2026-10-18] Pourquoi ce module existe.
+ *
+ *   La rotation AFC (calypso_twl3025_apply_phase) faisait un cos() et un sin()
+ *   double PAR ECHANTILLON : ~190 x 2 appels libm par burst, 8 bursts par
+ *   trame, autant de fois qu'on nourrit d'ARFCN. C'etait de loin le poste le
+ *   plus cher du front-end, devant tout le reste reuni. Ici le phaseur avance
+ *   par recurrence complexe (une multiplication par echantillon), 8 voies a la
+ *   fois, et les autres passes (DC, mise en mots DSP) sont vectorisees aussi.
+ *
+ * BITS IDENTIQUES ENTRE VERSIONS. Les 8 voies sont un contrat, pas un detail
+ * de SIMD : la voie k porte le phaseur exp(j(ph0 + k step)) et chaque bloc de 8
+ * echantillons le multiplie par exp(j 8 step), dans le meme ordre d'operations
+ * float en scalaire, SSE2 (4 vecteurs de 2 complexes) et AVX2 (2 vecteurs de
+ * 4). Pas de FMA : l'AVX2 est compile sans la cible « fma » et la version
+ * scalaire suppose un hote x86 sans -mfma (sur d'autres hotes le compilateur
+ * peut fusionner, ecart possible de 1 LSB).
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include <math.h>
+#include "hw/arm/calypso/calypso_iqconv.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define IQ_LANES  8     /* phaseurs par bloc : commun a TOUTES les versions */
+
+typedef struct IqRot {
+    float p[2 * IQ_LANES];   /* phaseurs des voies, re/im entrelaces */
+    float r[2];              /* exp(j IQ_LANES step) */
+} IqRot;
+
+typedef struct IqAccel {
+    const char *nom;
+    void (*rotate)(int16_t *iq, int n_cplx, IqRot *t);
+    void (*dc_remove)(int16_t *iq, int n_cplx);
+    void (*pack)(uint16_t *dst, const int16_t *src, int n, int shift);
+} IqAccel;
+
+/* ---- synthese GMSK (recurrence de phase : reste scalaire) ---- */
+
+void calypso_iq_gmsk(int16_t *iq, const uint8_t *bits, int n, unsigned *phase)
+{
+    /* Q15 pleine echelle, un bit de marge sous INT16_MIN. */
+    static const int16_t tab[4][2] = {
+        { 0x7FFE, 0 }, { 0, 0x7FFE }, { -0x7FFE, 0 }, { 0, -0x7FFE },
+    };
+    unsigned ph = *phase & 3;
+
+    for (int i = 0; i < n; i++) {
+        iq[2 * i]     = tab[ph][0];
+        iq[2 * i + 1] = tab[ph][1];
+        ph = (ph + ((!bits || bits[i]) ? 3 : 1)) & 3;
+    }
+    *phase = ph;
+}
+
+/* ---- versions scalaires (reference) ---- */
+
+static inline int16_t iq_sat(float a)
+{
+    if (a > 32767.0f) {
+        return 32767;
+    }
+    if (a < -32768.0f) {
+        return -32768;
+    }
+    return (int16_t)a;
+}
+
+static void iq_rotate_scalar(int16_t *iq, int n, IqRot *t)
+{
+    for (int i = 0; i < n; i++) {
+        int k = i % IQ_LANES;
+        float I = iq[2 * i], Q = iq[2 * i + 1];
+        float c = t->p[2 * k], s = t->p[2 * k + 1];
+
+        iq[2 * i]     = iq_sat(I * c - Q * s);
+        iq[2 * i + 1] = iq_sat(Q * c + I * s);
+        t->p[2 * k]     = c * t->r[0] - s * t->r[1];
+        t->p[2 * k + 1] = s * t->r[0] + c * t->r[1];
+    }
+}
+
+static void iq_dc_scalar(int16_t *iq, int n)
+{
+    int32_t si = 0, sq = 0;
+
+    for (int i = 0; i < n; i++) {
+        si += iq[2 * i];
+        sq += iq[2 * i + 1];
+    }
+    int dc[2] = { si / n, sq / n };
+    for (int i = 0; i < 2 * n; i++) {
+        int v = iq[i] - dc[i & 1];
+        iq[i] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+    }
+}
+
+static void iq_pack_scalar(uint16_t *dst, const int16_t *src, int n, int shift)
+{
+    for (int i = 0; i < n; i++) {
+        dst[i] = (uint16_t)(src[i] >> shift);
+    }
+}
+
+#if defined(CONFIG_AVX2_OPT) || defined(__SSE2__)
+#include <immintrin.h>
+#include "host/cpuinfo.h"
+
+/* Bloc partiel en fin de burst : on le passe par un tampon de 8 complexes
+ * mis a zero, meme calcul que les blocs pleins. */
+#define IQ_BLOCK_BEGIN(iq, i, n, tail)                                       \
+    int16_t *b = (iq) + 2 * (i);                                             \
+    int m = MIN(IQ_LANES, (n) - (i));                                        \
+    if (m < IQ_LANES) {                                                      \
+        memset(tail, 0, sizeof(tail));                                       \
+        memcpy(tail, b, m * 2 * sizeof(int16_t));                            \
+        b = tail;                                                            \
+    }
+#define IQ_BLOCK_END(iq, i, tail)                                            \
+    if (b == tail) {                                                         \
+        memcpy((iq) + 2 * (i), tail, m * 2 * sizeof(int16_t));               \
+    }
+
+static void __attribute__((target("sse2")))
+iq_rotate_sse2(int16_t *iq, int n, IqRot *t)
+{
+    const __m128 sgn = _mm_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+    const __m128 rc = _mm_set1_ps(t->r[0]);
+    const __m128 rs = _mm_xor_ps(_mm_set1_ps(t->r[1]), sgn);
+    int16_t tail[2 * IQ_LANES];
+    __m128 P[4];
+
+    for (int k = 0; k < 4; k++) {
+        P[k] = _mm_loadu_ps(t->p + 4 * k);
+    }
+    for (int i = 0; i < n; i += IQ_LANES) {
+        IQ_BLOCK_BEGIN(iq, i, n, tail);
+        __m128i v0 = _mm_loadu_si128((const __m128i *)b);
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(b + 8));
+        __m128i w[4] = {
+            _mm_unpacklo_epi16(v0, v0), _mm_unpackhi_epi16(v0, v0),
+            _mm_unpacklo_epi16(v1, v1), _mm_unpackhi_epi16(v1, v1),
+        };
+        __m128i o[4];
+
+        for (int k = 0; k < 4; k++) {
+            __m128 x = _mm_cvtepi32_ps(_mm_srai_epi32(w[k], 16));
+            __m128 xs = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1));
+            __m128 c = _mm_shuffle_ps(P[k], P[k], _MM_SHUFFLE(2, 2, 0, 0));
+            __m128 s = _mm_xor_ps(_mm_shuffle_ps(P[k], P[k],
+                                                 _MM_SHUFFLE(3, 3, 1, 1)), sgn);
+            __m128 ps = _mm_shuffle_ps(P[k], P[k], _MM_SHUFFLE(2, 3, 0, 1));
+
+            o[k] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(x, c),
+                                               _mm_mul_ps(xs, s)));
+            P[k] = _mm_add_ps(_mm_mul_ps(P[k], rc), _mm_mul_ps(ps, rs));
+        }
+        _mm_storeu_si128((__m128i *)b, _mm_packs_epi32(o[0], o[1]));
+        _mm_storeu_si128((__m128i *)(b + 8), _mm_packs_epi32(o[2], o[3]));
+        IQ_BLOCK_END(iq, i, tail);
+    }
+}
+
+static void __attribute__((target("sse2")))
+iq_dc_sse2(int16_t *iq, int n)
+{
+    __m128i acc = _mm_setzero_si128();
+    int32_t s[4];
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(iq + 2 * i));
+        acc = _mm_add_epi32(acc, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        acc = _mm_add_epi32(acc, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+    }
+    _mm_storeu_si128((__m128i *)s, acc);
+    s[0] += s[2];
+    s[1] += s[3];
+    for (; i < n; i++) {
+        s[0] += iq[2 * i];
+        s[1] += iq[2 * i + 1];
+    }
+
+    int16_t di = s[0] / n, dq = s[1] / n;
+    __m128i dc = _mm_setr_epi16(di, dq, di, dq, di, dq, di, dq);
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i *p = (__m128i *)(iq + 2 * i);
+        _mm_storeu_si128(p, _mm_subs_epi16(_mm_loadu_si128(p), dc));
+    }
+    for (i *= 2; i < 2 * n; i++) {
+        int v = iq[i] - ((i & 1) ? dq : di);
+        iq[i] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+    }
+}
+
+static void __attribute__((target("sse2")))
+iq_pack_sse2(uint16_t *dst, const int16_t *src, int n, int shift)
+{
+    __m128i sh = _mm_cvtsi32_si128(shift);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_sra_epi16(v, sh));
+    }
+    iq_pack_scalar(dst + i, src + i, n - i, shift);
+}
+
+#ifdef CONFIG_AVX2_OPT
+static void __attribute__((target("avx2")))
+iq_rotate_avx2(int16_t *iq, int n, IqRot *t)
+{
+    const __m256 sgn = _mm256_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f,
+                                      -0.0f, 0.0f, -0.0f, 0.0f);
+    const __m256 rc = _mm256_set1_ps(t->r[0]);
+    const __m256 rs = _mm256_xor_ps(_mm256_set1_ps(t->r[1]), sgn);
+    int16_t tail[2 * IQ_LANES];
+    __m256 P[2] = { _mm256_loadu_ps(t->p), _mm256_loadu_ps(t->p + 8) };
+
+    for (int i = 0; i < n; i += IQ_LANES) {
+        IQ_BLOCK_BEGIN(iq, i, n, tail);
+        for (int k = 0; k < 2; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(b + 8 * k));
+            __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v));
+            __m256 xs = _mm256_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1));
+            __m256 c = _mm256_moveldup_ps(P[k]);
+            __m256 s = _mm256_xor_ps(_mm256_movehdup_ps(P[k]), sgn);
+            __m256 ps = _mm256_permute_ps(P[k], _MM_SHUFFLE(2, 3, 0, 1));
+            __m256i o = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(x, c),
+                                                          _mm256_mul_ps(xs, s)));
+
+            _mm_storeu_si128((__m128i *)(b + 8 * k),
+                             _mm_packs_epi32(_mm256_castsi256_si128(o),
+                                             _mm256_extracti128_si256(o, 1)));
+            P[k] = _mm256_add_ps(_mm256_mul_ps(P[k], rc), _mm256_mul_ps(ps, rs));
+        }
+        IQ_BLOCK_END(iq, i, tail);
+    }
+}
+
+static void __attribute__((target("avx2")))
+iq_pack_avx2(uint16_t *dst, const int16_t *src, int n, int shift)
+{
+    __m128i sh = _mm_cvtsi32_si128(shift);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_sra_epi16(v, sh));
+    }
+    /* Reste en ligne : un appel terminal vers la version SSE2 sortirait sans
+     * vzeroupper et ferait payer la transition AVX/SSE a tout le code suivant. */
+    for (; i < n; i++) {
+        dst[i] = (uint16_t)(src[i] >> shift);
+    }
+}
+#endif /* CONFIG_AVX2_OPT */
+
+static const IqAccel accel_table[] = {
+    { "scalaire", iq_rotate_scalar, iq_dc_scalar, iq_pack_scalar },
+    { "sse2", iq_rotate_sse2, iq_dc_sse2, iq_pack_sse2 },
+#ifdef CONFIG_AVX2_OPT
+    /* Le DC est une somme sur ~190 complexes : la SSE2 suffit. */
+    { "avx2", iq_rotate_avx2, iq_dc_sse2, iq_pack_avx2 },
+#endif
+};
+
+static unsigned best_accel(void)
+{
+    unsigned info = cpuinfo_init();
+
+#ifdef CONFIG_AVX2_OPT
+    if (info & CPUINFO_AVX2) {
+        return 2;
+    }
+#endif
+    return info & CPUINFO_SSE2 ? 1 : 0;
+}
+
+#else
+static const IqAccel accel_table[] = {
+    { "scalaire", iq_rotate_scalar, iq_dc_scalar, iq_pack_scalar },
+};
+
+static unsigned best_accel(void)
+{
+    return 0;
+}
+#endif
+
+static const IqAccel *iq_accel;
+static unsigned accel_index;
+
+static void __attribute__((constructor)) init_accel(void)
+{
+    accel_index = best_accel();
+    iq_accel = &accel_table[accel_index];
+}
+
+bool test_calypso_iqconv_next_accel(void)
+{
+    if (accel_index != 0) {
+        iq_accel = &accel_table[--accel_index];
+        return true;
+    }
+    return false;
+}
+
+const char *calypso_iqconv_accel_name(void)
+{
+    return iq_accel->nom;
+}
+
+/* ---- points d'entree ---- */
+
+void calypso_iq_rotate(int16_t *iq, int n_cplx, double ph0, double step)
+{
+    IqRot t;
+
+    if (n_cplx <= 0) {
+        return;
+    }
+    /* ph0 peut valoir step x (fn x 1250) : on le ramene dans [0, 2pi) avant
+     * d'ajouter les k step, pour que les voies gardent toute la precision. */
+    ph0 = fmod(ph0, 2.0 * M_PI);
+    for (int k = 0; k < IQ_LANES; k++) {
+        t.p[2 * k]     = cos(ph0 + k * step);
+        t.p[2 * k + 1] = sin(ph0 + k * step);
+    }
+    t.r[0] = cos(IQ_LANES * step);
+    t.r[1] = sin(IQ_LANES * step);
+    iq_accel->rotate(iq, n_cplx, &t);
+}
+
+void calypso_iq_dc_remove(int16_t *iq, int n_cplx)
+{
+    if (n_cplx > 0) {
+        iq_accel->dc_remove(iq, n_cplx);
+    }
+}
+
+void calypso_iq_pack(uint16_t *dst, const int16_t *src, int n, int shift)
+{
+    if (n > 0) {
+        iq_accel->pack(dst, src, n, shift);
+    }
+}
@@ -10,16 +10,46 @@
  *                             (reprend l'idée de CALYPSO_WATCH_WR_ADDR, qu'il
  *                             remplace : ici les deux sens et les deux côtés)
  *   CALYPSO_MAILBOX_ONLY=1    ne trace QUE les cellules de _CELLS
- *   CALYPSO_MAILBOX_FILE=...  défaut $CALYPSO_LOG_DIR/mailbox.log, sinon
- *                             /tmp/calypso/logs/mailbox.log
- *   CALYPSO_MAILBOX_MAX=N     garde-fou (défaut 5 000 000 lignes, 0 = illimité)
+ *   CALYPSO_MAILBOX_FMT=bin   (défaut) enregistrements binaires de taille fixe
+ *                             dans un anneau mmap'é — voir « FORMAT BINAIRE »
+ *   CALYPSO_MAILBOX_FMT=texte l'ancien journal texte, une ligne par événement
+ *   CALYPSO_MAILBOX_FILE=...  défaut $LOG_DIR/mailbox.mbx (bin) ou mailbox.log
+ *                             (texte), sinon sous /tmp/calypso/logs
+ *   CALYPSO_MAILBOX_RING_MB=N taille de l'anneau binaire (défaut 256 Mo, soit
+ *                             ~11 M d'événements ; les plus anciens sont écrasés)
+ *   CALYPSO_MAILBOX_MAX=N     garde-fou du mode texte (défaut 5 000 000 lignes,
+ *                             0 = illimité)
+ *
+ * FORMAT BINAIRE [2026-10-18]. Le texte coûtait un fprintf par événement et
+ * plafonnait à 5 M lignes (291 Mo en quelques minutes, QEMU tué). En binaire un
+ * événement est une copie de 24 octets dans une page mappée — pas d'appel
+ * système, le noyau écrit en tâche de fond — et l'anneau borne le disque sans
+ * jamais couper la trace : on garde toujours les N DERNIERS événements, ce qui
+ * est ce qu'on veut après des heures de run. Tout est petit-boutiste, quel que
+ * soit l'hôte (cpu_to_le* à l'écriture) :
+ *
+ *   en-tête 64 o : 'MBXB' | version 4o | taille_rec 4o | taille_hdr 4o
+ *                  | capacite 8o | total 8o | réservé 32o
+ *   record  24 o : insn 4o | fn 4o | ctx 4o | rep 4o | mot 2o | val 2o
+ *                  | avant 2o | sens 1o | pad 1o
+ *
+ * `total` compte les records écrits depuis le début ; le plus ancien encore
+ * présent est à l'indice total % capacite dès que total > capacite. `rep` != 0
+ * résume une série repliée (rep + 1 accès identiques). Le décodeur hors ligne
+ * tools/mailbox-decode.py rend le même texte que l'ancien mailbox.log (donc
+ * mailbox-annote.py marche dessus) et filtre par cellule, FN ou insn.
  *
  * SPDX-License-Identifier: GPL-2.0-or-later
  */
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
 #include "calypso_mailbox.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 int calypso_mbx_actif = -1;   /* -1 = à initialiser au premier accès */
 
@@ -31,6 +61,39 @@ static uint16_t g_cells[32];
 static int      g_ncells;
 static unsigned long g_n, g_max = 5000000UL;
 
+/* Mode binaire : anneau mmap'é (voir l'en-tête du fichier). */
+#define MBX_BIN_VERSION 1
+typedef struct MbxBinHdr {
+    char     magic[4];
+    uint32_t version;
+    uint32_t taille_rec;
+    uint32_t taille_hdr;
+    uint64_t capacite;
+    uint64_t total;
+    uint8_t  reserve[32];
+} MbxBinHdr;
+
+typedef struct MbxBinRec {
+    uint32_t insn;
+    uint32_t fn;
+    uint32_t ctx;
+    uint32_t rep;
+    uint16_t mot;
+    uint16_t val;
+    uint16_t avant;
+    uint8_t  sens;
+    uint8_t  pad;
+} MbxBinRec;
+
+_Static_assert(sizeof(MbxBinHdr) == 64, "en-tete mailbox binaire");
+_Static_assert(sizeof(MbxBinRec) == 24, "record mailbox binaire");
+
+static int        g_bin = 1;
+static MbxBinHdr *g_bhdr;
+static MbxBinRec *g_brec;
+static uint64_t   g_bcap;
+static uint64_t   g_btotal;     /* = total, en ordre hôte */
+
 /* Repliement PAR CELLULE — journaliser au CHANGEMENT, pas au non-consécutif.
  *
  * [2026-07-29, seconde version] La première repliait les événements CONSÉCUTIFS
@@ -46,11 +109,18 @@ static unsigned long g_n, g_max = 5000000UL;
  * Les écritures sont toujours journalisées : elles sont rares et chacune est un
  * événement.  CALYPSO_MAILBOX_BRUT=1 désactive tout le repliement. */
 static int       g_brut;
-static uint16_t *g_dval;      /* dernière valeur journalisée, par mot */
-static uint32_t *g_dctx;      /* dernier contexte journalisé, par mot */
-static uint32_t *g_drep;      /* longueur de la série en cours, par mot */
-static uint8_t  *g_dvu;       /* ce mot a-t-il déjà été journalisé ? */
-static uint8_t  *g_dsens;     /* sens du dernier événement journalisé */
+
+/* [2026-10-18] Une seule table de structures au lieu de cinq tableaux
+ * parallèles (g_dval, g_dctx, g_drep, g_dvu, g_dsens) : un accès touche une
+ * ligne de cache au lieu de cinq, et une seule allocation de 768 Ko. */
+typedef struct MbxCellule {
+    uint32_t ctx;     /* dernier contexte journalisé */
+    uint32_t rep;     /* longueur de la série en cours */
+    uint16_t val;     /* dernière valeur journalisée */
+    uint8_t  vu;      /* ce mot a-t-il déjà été journalisé ? */
+    uint8_t  sens;    /* sens du dernier événement journalisé */
+} MbxCellule;
+static MbxCellule *g_cel;
 
 /* Noms des cellules qui reviennent sans cesse dans le diagnostic. Une trace
  * lisible évite de re-chercher « 0x08fa c'était quoi déjà » à chaque lecture. */
@@ -91,6 +161,75 @@ static void mbx_ecrire(CalypsoMbxSens sens, uint16_t mot, uint16_t val,
                        uint16_t avant, uint32_t ctx, uint32_t fn, uint32_t insn,
                        unsigned long rep);
 
+static int mbx_cellules_alloc(void)
+{
+    g_cel = calloc(0x10000, sizeof(*g_cel));
+    if (!g_cel) {
+        fprintf(stderr, "[mbx] allocation impossible — moniteur INACTIF\n");
+        calypso_mbx_actif = 0;
+        return 0;
+    }
+    return 1;
+}
+
+/* Crée le fichier anneau à sa taille finale et le mappe. Rien n'est écrit par
+ * write() ensuite : les records vont directement dans les pages partagées, et
+ * un arrêt brutal de QEMU ne perd rien de ce qui y est déjà. */
+static void mbx_bin_ouvrir(const char *chemin)
+{
+    const char *e = getenv("CALYPSO_MAILBOX_RING_MB");
+    long mo = (e && *e) ? strtol(e, NULL, 0) : 256;
+    size_t taille;
+    void *m;
+    int fd;
+
+    if (mo <= 0) {
+        mo = 256;
+    }
+    g_bcap = ((uint64_t)mo << 20) / sizeof(MbxBinRec);
+    taille = sizeof(MbxBinHdr) + g_bcap * sizeof(MbxBinRec);
+
+    fd = open(chemin, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)taille) != 0) {
+        fprintf(stderr, "[mbx] ouverture impossible : %s — moniteur INACTIF\n",
+                chemin);
+        if (fd >= 0) {
+            close(fd);
+        }
+        calypso_mbx_actif = 0;
+        return;
+    }
+    m = mmap(NULL, taille, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        fprintf(stderr, "[mbx] mmap impossible : %s — moniteur INACTIF\n",
+                chemin);
+        calypso_mbx_actif = 0;
+        return;
+    }
+    if (!mbx_cellules_alloc()) {
+        munmap(m, taille);
+        return;
+    }
+    g_bhdr = m;
+    g_brec = (MbxBinRec *)(g_bhdr + 1);
+    memcpy(g_bhdr->magic, "MBXB", 4);
+    g_bhdr->version    = cpu_to_le32(MBX_BIN_VERSION);
+    g_bhdr->taille_rec = cpu_to_le32(sizeof(MbxBinRec));
+    g_bhdr->taille_hdr = cpu_to_le32(sizeof(MbxBinHdr));
+    g_bhdr->capacite   = cpu_to_le64(g_bcap);
+    g_bhdr->total      = 0;
+    g_btotal           = 0;
+
+    fprintf(stderr, "[mbx] moniteur mailbox ACTIF -> %s (binaire, anneau %ld Mo "
+            "= %llu evenements ; ecr=%d lec=%d cellules_sup=%d only=%d) — "
+            "lire avec tools/mailbox-decode.py\n",
+            chemin, mo, (unsigned long long)g_bcap, g_ecr, g_lec, g_ncells,
+            g_only);
+
+    calypso_mbx_actif = 1;
+}
+
 void calypso_mbx_init(void)
 {
     const char *e;
@@ -142,6 +281,11 @@ void calypso_mbx_init(void)
         g_max = strtoul(e, NULL, 0);
     }
 
+    e = getenv("CALYPSO_MAILBOX_FMT");
+    if (e && *e) {
+        g_bin = strcmp(e, "texte") && strcmp(e, "text") && strcmp(e, "txt");
+    }
+
     e = getenv("CALYPSO_MAILBOX_FILE");
     if (!e || !*e) {
         static char def[512];
@@ -150,10 +294,15 @@ void calypso_mbx_init(void)
          * tombé dans le repli. On accepte les deux, LOG_DIR fait foi. */
         const char *d = getenv("LOG_DIR");
         if (!d || !*d) d = getenv("CALYPSO_LOG_DIR");
-        snprintf(def, sizeof(def), "%s/mailbox.log",
-                 (d && *d) ? d : "/tmp/calypso/logs");
+        snprintf(def, sizeof(def), "%s/%s",
+                 (d && *d) ? d : "/tmp/calypso/logs",
+                 g_bin ? "mailbox.mbx" : "mailbox.log");
         e = def;
     }
+    if (g_bin) {
+        mbx_bin_ouvrir(e);
+        return;
+    }
     g_f = fopen(e, "w");
     if (!g_f) {
         fprintf(stderr, "[mbx] ouverture impossible : %s — moniteur INACTIF\n", e);
@@ -165,14 +314,7 @@ void calypso_mbx_init(void)
      * (voir mbx_ecrire) pour qu'un arrêt brutal ne perde qu'une fenêtre. */
     setvbuf(g_f, NULL, _IOFBF, 1 << 20);
 
-    g_dval = calloc(0x10000, sizeof(*g_dval));
-    g_dctx = calloc(0x10000, sizeof(*g_dctx));
-    g_drep = calloc(0x10000, sizeof(*g_drep));
-    g_dvu  = calloc(0x10000, sizeof(*g_dvu));
-    g_dsens = calloc(0x10000, sizeof(*g_dsens));
-    if (!g_dval || !g_dctx || !g_drep || !g_dvu || !g_dsens) {
-        fprintf(stderr, "[mbx] allocation impossible — moniteur INACTIF\n");
-        calypso_mbx_actif = 0;
+    if (!mbx_cellules_alloc()) {
         return;
     }
 
@@ -214,7 +356,7 @@ void calypso_mbx_evt(CalypsoMbxSens sens, uint16_t mot, uint16_t val,
     if (!g_init) {
         calypso_mbx_init();
     }
-    if (!g_f) {
+    if (!g_f && !g_bhdr) {
         return;
     }
 
@@ -226,7 +368,7 @@ void calypso_mbx_evt(CalypsoMbxSens sens, uint16_t mot, uint16_t val,
         return;
     }
 
-    if (g_max && g_n >= g_max) {
+    if (!g_bhdr && g_max && g_n >= g_max) {
         if (g_n == g_max) {
             g_n++;
             fprintf(g_f, "# PLAFOND %lu lignes atteint — trace interrompue. "
@@ -250,38 +392,39 @@ void calypso_mbx_evt(CalypsoMbxSens sens, uint16_t mot, uint16_t val,
      * « 0x0000 -> 0x0000 » depuis le même PC (@0xb446), une fois par trame. Une
      * écriture qui ne change rien, depuis le même PC, ne porte pas plus
      * d'information qu'une lecture — même règle pour les deux. */
+    MbxCellule *c = &g_cel[mot];
+
     if (est_ecr && avant != val) {
-        if (g_drep[mot] > 1) {
-            mbx_ecrire(g_dsens[mot], mot, g_dval[mot], g_dval[mot], g_dctx[mot],
-                       fn, insn, g_drep[mot] - 1);
+        if (c->rep > 1) {
+            mbx_ecrire(c->sens, mot, c->val, c->val, c->ctx, fn, insn,
+                       c->rep - 1);
         }
-        g_drep[mot] = 0;
+        c->rep = 0;
         mbx_ecrire(sens, mot, val, avant, ctx, fn, insn, 0);
-        g_dval[mot]  = val;
-        g_dctx[mot]  = ctx;
-        g_dsens[mot] = sens;
-        g_dvu[mot]   = 1;
+        c->val  = val;
+        c->ctx  = ctx;
+        c->sens = sens;
+        c->vu   = 1;
         return;
     }
 
     /* Sinon — lecture, ou écriture sans effet : rien de neuf si même valeur ET
      * même contexte. On compte. */
-    if (g_dvu[mot] && g_dval[mot] == val && g_dctx[mot] == ctx) {
-        g_drep[mot]++;
+    if (c->vu && c->val == val && c->ctx == ctx) {
+        c->rep++;
         g_n--;                        /* ne consomme pas le plafond */
         return;
     }
 
     /* Changement : on résume la série précédente, puis on journalise. */
-    if (g_drep[mot] > 1) {
-        mbx_ecrire(g_dsens[mot], mot, g_dval[mot], g_dval[mot], g_dctx[mot],
-                   fn, insn, g_drep[mot] - 1);
+    if (c->rep > 1) {
+        mbx_ecrire(c->sens, mot, c->val, c->val, c->ctx, fn, insn, c->rep - 1);
     }
-    g_drep[mot]  = 1;
-    g_dval[mot]  = val;
-    g_dctx[mot]  = ctx;
-    g_dsens[mot] = sens;
-    g_dvu[mot]   = 1;
+    c->rep  = 1;
+    c->val  = val;
+    c->ctx  = ctx;
+    c->sens = sens;
+    c->vu   = 1;
     mbx_ecrire(sens, mot, val, avant, ctx, fn, insn, 0);
 }
 
@@ -292,6 +435,26 @@ static void mbx_ecrire(CalypsoMbxSens sens, uint16_t mot, uint16_t val,
     static const char *nom_sens[] = { "ARM>WR", "ARM<RD", "DSP>WR", "DSP<RD" };
     char suffixe[32] = "";
 
+    if (g_bhdr) {
+        /* Pas de nom ni de mise en forme ici : c'est le décodeur qui les
+         * ajoute. `total` est publié APRÈS le record, un lecteur concurrent
+         * (mailbox-decode.py --suivre) ne voit donc jamais un record à moitié
+         * écrit. */
+        uint64_t t = g_btotal++;
+        MbxBinRec *r = &g_brec[t % g_bcap];
+        r->insn  = cpu_to_le32(insn);
+        r->fn    = cpu_to_le32(fn);
+        r->ctx   = cpu_to_le32(ctx);
+        r->rep   = cpu_to_le32((uint32_t)rep);
+        r->mot   = cpu_to_le16(mot);
+        r->val   = cpu_to_le16(val);
+        r->avant = cpu_to_le16(avant);
+        r->sens  = (uint8_t)sens;
+        r->pad   = 0;
+        __atomic_store_n(&g_bhdr->total, cpu_to_le64(g_btotal),
+                         __ATOMIC_RELEASE);
+        return;
+    }
     if (rep) {
         snprintf(suffixe, sizeof(suffixe), "  x%lu", rep + 1);
     }
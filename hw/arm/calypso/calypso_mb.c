@@ -28,6 +28,8 @@
 #include "hw/arm/calypso/calypso_trx.h"   /* C54xState + calypso_trx_get_dsp()
                                              + calypso_trx_set_section_paths() */
 #include "calypso_dsp_shunt.h"
+#include "calypso_ckpt.h"
+#include "hw/arm/calypso/calypso_config.h"
 
 #define CALYPSO_XRAM_BASE     0x01000000
 #define CALYPSO_XRAM_SIZE     (8 * 1024 * 1024)
@@ -259,6 +261,16 @@ static void calypso_machine_init(MachineState *machine)
      * (sinon g_shunt.c54x reste NULL et la branche route_c54x est morte). */
     calypso_dsp_shunt_set_c54x(calypso_trx_get_dsp());
 
+    /* ---- Checkpoints (CALYPSO_CKPT, calypso-ckpt au moniteur) ----
+     * Le TRX, le C54x, le shunt et le BSP ont enregistré leur état à leur
+     * init ; restent la RAM ARM et l'INTH (registres après l'iomem). */
+    calypso_ckpt_add_ram("xram", &s->xram);
+    calypso_ckpt_add_ram("iram", &s->soc.iram);
+    calypso_ckpt_add_blob("inth", &s->soc.inth.ilr,
+                          sizeof(s->soc.inth) -
+                          offsetof(CalypsoINTHState, ilr));
+    calypso_ckpt_init(CPU(s->cpu));
+
     fprintf(stderr, "[MB] === Machine ready ===\n");
     fprintf(stderr, "[MB]   Flash:  0x%08x–0x%08x (%d MiB pflash_cfi01)\n",
             CALYPSO_FLASH_BASE,
@@ -336,12 +348,24 @@ static void calypso_machine_class_init(ObjectClass *oc, void *data)
         "Path to Registers .bin (MMR snapshot, words 0x00..0x1F) → applied as "
         "the DSP reset state (IMR/IFR/ST0/ST1/T/TRN/AR0-7/SP/BK/BRC/RSA/REA/PMST)");
 #undef REG_DSP_SECTION
+
+    /* Réglages typés (dsp-budget, bsp-drain-ms, ...) : propriétés de la
+     * machine, aussi pilotés par query-calypso-config / calypso-set. */
+    calypso_config_class_init(oc);
+}
+
+/* Les variables CALYPSO_* amorcent calypso_cfg ici, avant que les propriétés
+ * de -M calypso,... ne s'appliquent : la ligne de commande l'emporte. */
+static void calypso_machine_instance_init(Object *obj)
+{
+    calypso_config_init();
 }
 
 static const TypeInfo calypso_machine_info = {
     .name          = TYPE_CALYPSO_MACHINE,
     .parent        = TYPE_MACHINE,
     .instance_size = sizeof(CalypsoMachineState),
+    .instance_init = calypso_machine_instance_init,
     .class_init    = calypso_machine_class_init,
 };
 
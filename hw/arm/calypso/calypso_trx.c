@@ -104,6 +104,8 @@ static CalypsoTRX *g_trx;
 
 #include "qemu/atomic.h"
 #include "calypso_dsp_shunt.h"
+#include "calypso_ckpt.h"
+#include "hw/arm/calypso/calypso_config.h"
 #include "calypso_layer1.h"   /* CALYPSO_L1=c : HLE L1 scaffold (FB via corrélation host) */
 
 /* FBSB host-side orchestration. Reintroduced after preNoCell refactor
@@ -1405,13 +1407,13 @@ static void *clk_master_loop(void *arg)
      * wall réel (→ osmocon LOST), ralentir UNIFORMÉMENT toute la timeline via
      * CALYPSO_TDMA_NS (le device heartbeat lit la MÊME var → osmo-trx/BTS
      * suivent → cohérent à vitesse réduite). Défaut = sample-exact réel. */
-    long long wall_ns = WALL_TDMA_NS;
-    const char *e = getenv("CALYPSO_TDMA_NS");
-    if (e && *e) { long long v = atoll(e); if (v >= WALL_TDMA_NS) wall_ns = v; }
+    /* tdma-ns (calypso_config.c) : borné à >= WALL_TDMA_NS, figé au démarrage
+     * puisque le heartbeat du device lit la même variable une seule fois. */
+    long long wall_ns = calypso_cfg.tdma_ns;
 
     fprintf(stderr,
             "[clk-master] pthread armed (CLOCK_MONOTONIC ABSTIME, %lld ns/frame%s)\n",
-            wall_ns, (wall_ns != WALL_TDMA_NS) ? " [SLOWED via CALYPSO_TDMA_NS]" : "");
+            wall_ns, (wall_ns != WALL_TDMA_NS) ? " [SLOWED via tdma-ns / CALYPSO_TDMA_NS]" : "");
 
     while (g_clk_master_running) {
         next.tv_nsec += wall_ns;
@@ -1588,20 +1590,20 @@ static const MemoryRegionOps calypso_sim_ops = {
  */
 static void calypso_cpu_idle_park(void)
 {
-    static int      enabled = -1;
+    static int      init = 0;
     static uint64_t lo, hi, parked_n;
-    if (enabled < 0) {
-        const char *e = getenv("CALYPSO_CPU_IDLE");
+    if (!init) {
         const char *l = getenv("CALYPSO_IDLE_PC_LO");
         const char *h = getenv("CALYPSO_IDLE_PC_HI");
-        enabled = (e && *e == '0') ? 0 : 1;
+        init = 1;
         lo = l ? strtoull(l, NULL, 0) : 0x00823000ULL; /* l1a_l23_handler .. */
         hi = h ? strtoull(h, NULL, 0) : 0x00826000ULL; /* .. l1a_compl_execute */
         fprintf(stderr, "[cpu-idle] governor %s window=[0x%llx,0x%llx]\n",
-                enabled ? "ON (opt-out CALYPSO_CPU_IDLE=0)" : "OFF",
+                calypso_cfg.cpu_idle ? "ON (opt-out cpu-idle=off)" : "OFF",
                 (unsigned long long)lo, (unsigned long long)hi);
     }
-    if (!enabled) return;
+    /* calypso_cfg.cpu_idle : réglable à chaud (qom-set /machine cpu-idle). */
+    if (!calypso_cfg.cpu_idle) return;
 
     CPUState *cs = first_cpu;
     if (!cs) return;
@@ -1634,6 +1636,10 @@ static void calypso_frame_irq_lower(void *o){
      * pour que le mock écrive ses résultats entre deux ticks ARM. */
     calypso_dsp_shunt_on_frame_tick();
 
+    /* Checkpoint périodique (CALYPSO_CKPT) : frontière de trame = état le plus
+     * lisible pour y revenir ; la capture elle-même part en bottom-half. */
+    calypso_ckpt_on_frame(((CalypsoTRX *)o)->fn);
+
     /* Per-frame work for this tick is done — park the vCPU if the guest is
      * back in its idle super-loop, so the host core sleeps until the next
      * interrupt instead of spinning at 100%. See calypso_cpu_idle_park(). */
@@ -1760,15 +1766,9 @@ static void calypso_tdma_tick(void *opaque) {
      * Sous DSP-overload (fb-det compute), 2× ce budget = ~18.6 ms wall sur le
      * tdma_tick alors que la frame GSM dure 4.615 ms → drift wall/qfn 3.6×.
      * Override via CALYPSO_DSP_BUDGET pour mesurer A/B sans recompiler. Voir
-     * REPORT_CLAUDE_WEB_20260516_DSP_OVERRUN.md. */
-    static int dsp_budget = -1;
-    if (dsp_budget < 0) {
-        const char *e = getenv("CALYPSO_DSP_BUDGET");
-        dsp_budget = (e && *e) ? atoi(e) : 256000;
-        if (dsp_budget < 1000) dsp_budget = 1000;
-        TRX_LOG("CALYPSO_DSP_BUDGET = %d insn/c54x_run (default 256000)",
-                dsp_budget);
-    }
+     * REPORT_CLAUDE_WEB_20260516_DSP_OVERRUN.md.
+     * [2026-10-18] Réglable à chaud : calypso-set dsp-budget (calypso_config.c). */
+    int dsp_budget = calypso_cfg.dsp_budget;
     /* GATE DSP_SHUNT : si le shunt est actif, le mock cote ARM remplace
      * la DSP. Skip TOUS les c54x_run -> le c54x emule n'execute aucune
      * instruction, ne touche pas a la DARAM, ne fabrique pas de d_dsp_page
@@ -2416,8 +2416,22 @@ void calypso_trx_init(MemoryRegion *sysmem, qemu_irq *irqs)
                 c54x_load_registers(s->dsp, g_section_registers);
             c54x_reset(s->dsp);
             calypso_bsp_init(s->dsp);
-        }
-    }
+            calypso_ckpt_add_blob("c54x", s->dsp, sizeof(*s->dsp));
+        }
+    }
+
+    /* Checkpoints : l'état « à plat » du TRX, par plages de champs contigus —
+     * surtout pas les MemoryRegion ni les QEMUTimer intercalés. */
+#define TRX_CKPT(nom, premier, dernier)                                       \
+    calypso_ckpt_add_blob(nom, &s->premier,                                   \
+                          offsetof(CalypsoTRX, dernier) + sizeof(s->dernier) \
+                          - offsetof(CalypsoTRX, premier))
+    TRX_CKPT("trx.api", dsp_ram, boot_frame);
+    TRX_CKPT("trx.tpu", tpu_regs, tpu_ram);
+    TRX_CKPT("trx.tsp", tsp_regs, tsp_regs);
+    TRX_CKPT("trx.ulpd", ulpd_regs, ulpd_counter);
+    TRX_CKPT("trx.fn", fn, dsp_init_done);
+#undef TRX_CKPT
 
     TRX_LOG("=== Hardware ready ===");
 
@@ -30,6 +30,7 @@
 
 #include "hw/arm/calypso/calypso_twl3025.h"
 #include "hw/arm/calypso/calypso_debug.h"
+#include "hw/arm/calypso/calypso_iqconv.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -207,20 +208,11 @@ void calypso_twl3025_apply_phase(int16_t *iq_samples, int n_samples,
     uint64_t sample_offset = (uint64_t)fn * SAMPLES_PER_FRAME
                            + (uint64_t)tn * SAMPLES_PER_SLOT;
 
-    for (int i = 0; i < n_samples; i++) {
-        double ph = step * (double)(sample_offset + (uint64_t)i);
-        double c = cos(ph), s = sin(ph);
-        int16_t I = iq_samples[2 * i];
-        int16_t Q = iq_samples[2 * i + 1];
-        double new_I = I * c - Q * s;
-        double new_Q = I * s + Q * c;
-        if (new_I >  32767.0) new_I =  32767.0;
-        if (new_I < -32768.0) new_I = -32768.0;
-        if (new_Q >  32767.0) new_Q =  32767.0;
-        if (new_Q < -32768.0) new_Q = -32768.0;
-        iq_samples[2 * i]     = (int16_t)new_I;
-        iq_samples[2 * i + 1] = (int16_t)new_Q;
-    }
+    /* Rotation par récurrence de phaseur (calypso_iqconv.c, SSE2/AVX2) : les
+     * cos/sin double par échantillon coûtaient plus que tout le reste du
+     * front-end BSP. Écart <= 1 LSB avec l'ancien calcul direct. */
+    calypso_iq_rotate(iq_samples, n_samples,
+                      step * (double)sample_offset, step);
 }
 
 void calypso_twl3025_reset(void)
@@ -236,6 +236,7 @@ struct AioContext {
 
     /* AIO engine parameters */
     int64_t aio_max_batch;  /* maximum number of requests in a batch */
+    bool io_uring_sqpoll;   /* io_uring ring polled by a kernel thread */
 
     /*
      * List of handlers participating in userspace polling.  Protected by
@@ -710,8 +711,11 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
  * @ctx: the aio context
  * @max_batch: maximum number of requests in a batch, 0 means that the
  *             engine will use its default
+ * @io_uring_sqpoll: let a kernel thread poll the io_uring submission queue;
+ *                   takes effect when the context first uses io_uring
  */
-void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch);
+void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
+                                bool io_uring_sqpoll);
 
 /**
  * aio_context_set_thread_pool_params:
@@ -30,6 +30,7 @@
 #include "block/snapshot.h"
 #include "qemu/iov.h"
 #include "qemu/rcu.h"
+#include "qemu/seqlock.h"
 #include "qemu/stats64.h"
 
 #define BLOCK_FLAG_LAZY_REFCOUNTS   8
@@ -56,6 +57,7 @@
 #define BLOCK_OPT_DATA_FILE         "data_file"
 #define BLOCK_OPT_DATA_FILE_RAW     "data_file_raw"
 #define BLOCK_OPT_COMPRESSION_TYPE  "compression_type"
+#define BLOCK_OPT_COMPRESSION_DICT  "compression_dict"
 #define BLOCK_OPT_EXTL2             "extended_l2"
 
 #define BLOCK_PROBE_BUF_SIZE        512
@@ -1210,6 +1212,15 @@ struct BlockDriverState {
     QemuMutex dirty_bitmap_mutex;
     QLIST_HEAD(, BdrvDirtyBitmap) dirty_bitmaps;
 
+    /*
+     * A byte range that is known to be dirty in all enabled bitmaps, so
+     * that bdrv_set_dirty() need not take dirty_bitmap_mutex for writes
+     * inside it.  Written under dirty_bitmap_mutex, read with the seqlock.
+     */
+    QemuSeqLock dirty_known_seqlock;
+    int64_t dirty_known_start;
+    int64_t dirty_known_end;
+
     /* Offset after the highest byte written to */
     Stat64 wr_highest_offset;
 
@@ -147,6 +147,10 @@ BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
  * driver that the mirror job inserts into the graph above @bs. NULL means that
  * a node name should be autogenerated.
  * @copy_mode: When to trigger writes to the target.
+ * @max_in_flight: Maximum number of background requests in flight, or 0 for
+ *                 the default.
+ * @adaptive: Whether to tune the number and size of requests in flight while
+ *            the job runs.
  * @errp: Error object.
  *
  * Start a mirroring operation on @bs.  Clusters that are allocated
@@ -163,7 +167,8 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                   BlockdevOnError on_source_error,
                   BlockdevOnError on_target_error,
                   bool unmap, const char *filter_node_name,
-                  MirrorCopyMode copy_mode, Error **errp);
+                  MirrorCopyMode copy_mode, int max_in_flight,
+                  bool adaptive, Error **errp);
 
 /*
  * backup_job_create:
@@ -66,9 +66,23 @@ void laio_attach_aio_context(LinuxAioState *s, AioContext *new_context);
 #endif
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
-LuringState *luring_init(Error **errp);
+LuringState *luring_init(bool sqpoll, Error **errp);
 void luring_cleanup(LuringState *s);
 
+/*
+ * Memory that is registered with every ring as fixed buffers, so that
+ * requests into it need no page pinning by the kernel.
+ */
+void luring_register_buf(void *host, size_t size);
+void luring_unregister_buf(void *host, size_t size);
+
+/*
+ * Must be called from the main loop thread before closing an fd that was
+ * used with io_uring.  Removes it from the registered files of every ring,
+ * so that closing it releases the file, and its locks, right away.
+ */
+void luring_close_fd(int fd);
+
 /* luring_co_submit: submit I/O requests in the thread's current AioContext. */
 int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
                                   QEMUIOVector *qiov, int type);
@@ -78,17 +78,25 @@ struct TranslationBlock {
 #define CF_NOIRQ         0x00010000 /* Generate an uninterruptible TB */
 #define CF_PCREL         0x00020000 /* Opcodes in TB are PC-relative */
 #define CF_BP_PAGE       0x00040000 /* Breakpoint present in code page */
+#define CF_TIER2         0x00080000 /* Hot retranslation (superblock) */
 #define CF_CLUSTER_MASK  0xff000000 /* Top 8 bits are cluster ID */
 #define CF_CLUSTER_SHIFT 24
 
     /*
-     * Above fields used for comparing
+     * Above fields used for comparing, except for CF_TIER2: a tier-2 TB
+     * replaces its tier-1 original under the same lookup key.
      */
 
     /* size of target code for this block (1 <= size <= TARGET_PAGE_SIZE) */
     uint16_t size;
     uint16_t icount;
 
+    /*
+     * execution counter in each CPU's tier_counts[], 0 if not counted; read
+     * by the generated code, see tb_tier_assign()
+     */
+    uint32_t tier_slot;
+
     struct tb_tc tc;
 
     /*
@@ -121,6 +129,12 @@ struct TranslationBlock {
     uint16_t jmp_insn_offset[2];  /* offset of direct jump insn */
     uintptr_t jmp_target_addr[2]; /* target address */
 
+    /*
+     * Entry point for chained jumps and goto_ptr, past the loads of the
+     * globals pinned in host registers: the jumping TB already holds them.
+     */
+    uint16_t warm_offset;
+
     /*
      * Each TB has a NULL-terminated list (jmp_list_head) of incoming jumps.
      * Each TB can have two outgoing jumps, and therefore can participate
@@ -152,4 +166,15 @@ static inline uint32_t tb_cflags(const TranslationBlock *tb)
     return qatomic_read(&tb->cflags);
 }
 
+static inline const void *tb_warm_ptr(const TranslationBlock *tb)
+{
+    return tb->tc.ptr + tb->warm_offset;
+}
+
+/* The cflags that TB lookup compares and hashes. */
+static inline uint32_t tb_lookup_cflags(const TranslationBlock *tb)
+{
+    return tb_cflags(tb) & ~CF_TIER2;
+}
+
 #endif /* EXEC_TRANSLATION_BLOCK_H */
@@ -172,6 +172,19 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
  */
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest);
 
+/**
+ * translator_trace_jump
+ * @db: Disassembly context
+ * @dest: target pc of an unconditional direct branch
+ *
+ * In a tier-2 (CF_TIER2) TB, decide whether the branch to @dest can be
+ * folded into the TB instead of ending it.  If so, db->pc_next is moved
+ * to @dest and true is returned: the caller must emit nothing for the
+ * branch beyond its side effects (e.g. the link register) and let
+ * translation continue at @dest.
+ */
+bool translator_trace_jump(DisasContextBase *db, vaddr dest);
+
 /**
  * translator_io_start
  * @db: Disassembly context
@@ -0,0 +1,65 @@
+/*
+ * calypso_config.h — réglages typés de la machine Calypso (QOM + QMP)
+ *
+ * [2026-10-18] Pourquoi ce module existe.
+ *
+ *   Le comportement du modèle se règle par des centaines de getenv() /
+ *   calypso_gate() épars. Sur les chemins chauds ils sont figés dans des
+ *   `static int x = -1` : impossible de les changer sans relancer le
+ *   téléphone, donc impossible de régler le débit (budget DSP, idle FF,
+ *   période de drain BSP) pendant qu'il tourne.
+ *
+ *   Les réglages migrés ici vivent dans UNE structure, calypso_cfg, que les
+ *   chemins chauds lisent directement (un champ, pas de latch ni de getenv).
+ *   Chaque réglage est :
+ *     - amorcé au démarrage par sa variable CALYPSO_* (les .env restent
+ *       valables, même sémantique que calypso_gate() pour les booléens) ;
+ *     - une propriété QOM de la machine : -M calypso,dsp-budget=300000, ou
+ *       qom-get / qom-set /machine dsp-budget ;
+ *     - listé par query-calypso-config et modifiable par calypso-set (QMP).
+ *   Ceux marqués « live » se changent à chaud ; les autres ne sont lus qu'à
+ *   la création de la machine et refusent qom-set ensuite.
+ *
+ * AJOUTER UN RÉGLAGE : un champ ici, une ligne dans cfg_table[]
+ * (calypso_config.c), puis remplacer le latch par calypso_cfg.<champ>.
+ * Les variables à VALEUR chaîne (chemins, listes de plages) restent en getenv.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#ifndef HW_ARM_CALYPSO_CONFIG_H
+#define HW_ARM_CALYPSO_CONFIG_H
+
+#include "qom/object.h"
+
+typedef struct CalypsoConfig {
+    /* Débit (live) */
+    int32_t dsp_budget;          /* dsp-budget : insn par c54x_run */
+    bool    dsp_idle_ff;         /* dsp-idle-ff : saut de la boucle dispatcher */
+    int32_t bsp_drain_ms;        /* bsp-drain-ms : période du drain BSP */
+    bool    cpu_idle;            /* cpu-idle : parking ARM dans la boucle L1 */
+
+    /* Front-end BSP, lus par burst (live) */
+    int32_t bsp_iq_decim;        /* bsp-iq-decim : 4 SPS -> 1 SPS */
+    int32_t bsp_rx_window;       /* bsp-rx-window : échantillons livrés */
+    int32_t bsp_iq_shift;        /* bsp-iq-shift : >>n avant DARAM */
+    bool    bsp_dc_remove;       /* bsp-dc-remove */
+    bool    bsp_fingerprint;     /* bsp-fingerprint : sonde FEED-FP */
+    bool    bsp_fn_probe;        /* bsp-fn-probe : sonde FN-PROBE */
+    bool    fb_iq_owns;          /* fb-iq-owns : feed_iq seul writer DARAM */
+
+    /* Démarrage seulement */
+    int32_t tdma_ns;             /* tdma-ns : période de l'horloge maître */
+} CalypsoConfig;
+
+/* Lu sans verrou par les chemins chauds (vCPU, thread DSP, timers) ; écrit
+ * sous BQL par les setters de propriétés, avec qatomic_set(). */
+extern CalypsoConfig calypso_cfg;
+
+/* instance_init de la machine : valeurs par défaut puis variables CALYPSO_*,
+ * AVANT que -M calypso,... n'applique ses propriétés. */
+void calypso_config_init(void);
+
+/* class_init de la machine : une propriété QOM par réglage. */
+void calypso_config_class_init(ObjectClass *oc);
+
+#endif /* HW_ARM_CALYPSO_CONFIG_H */
@@ -30,6 +30,7 @@
 extern int  calypso_debug_master;
 void        calypso_debug_master_init(void);
 bool        calypso_debug_enabled_(const char *probe_name);   /* impl réelle */
+void        calypso_debug_set(const char *liste);             /* à chaud */
 
 static inline bool calypso_debug_enabled(const char *probe_name)
 {
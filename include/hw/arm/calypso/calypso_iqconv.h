@@ -0,0 +1,47 @@
+/*
+ * calypso_iqconv.h — etage de conversion I/Q du BSP (vectorise)
+ *
+ * Les primitives par echantillon du front-end BSP, sorties des boucles
+ * scalaires de calypso_bsp.c / calypso_twl3025.c : synthese GMSK des soft-bits,
+ * suppression du DC, rotation AFC, mise en mots DSP. Chacune a une version
+ * SSE2 / AVX2 / scalaire choisie au demarrage via host/cpuinfo.h, comme
+ * util/bufferiszero.c.
+ *
+ * Les trois versions rendent les MEMES BITS (meme sequence d'operations
+ * float par voie, pas de FMA) : un rejeu CALYPSO_BSP_REPLAY_FILE donne la meme
+ * DARAM quelle que soit la machine. Banc : tests/bench/calypso-iqconv-bench.c.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#ifndef HW_ARM_CALYPSO_IQCONV_H
+#define HW_ARM_CALYPSO_IQCONV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Modulation ±pi/2 par bit (h=0.5) des soft-bits TRXD : bit 0 -> +pi/2,
+ * bit 1 -> -pi/2, amplitude Q15 0x7FFE, echantillon emis AVANT l'avance de
+ * phase. bits == NULL : n bits de garde (= 1). *phase (0..3) est poursuivi.
+ * Ecrit 2n int16. */
+void calypso_iq_gmsk(int16_t *iq, const uint8_t *bits, int n, unsigned *phase);
+
+/* Retire la moyenne complexe (entiere, tronquee) du burst, en saturant. */
+void calypso_iq_dc_remove(int16_t *iq, int n_cplx);
+
+/* iq[k] *= exp(j (ph0 + k step)), k = 0..n_cplx-1, sature sur int16 (troncature
+ * vers zero comme l'ancien cast). Phaseur calcule par recurrence en float par
+ * blocs de 8, recale en double a chaque appel : ecart <= 1 LSB avec cos/sin
+ * double par echantillon sur une longueur de burst. */
+void calypso_iq_rotate(int16_t *iq, int n_cplx, double ph0, double step);
+
+/* dst[i] = (uint16_t)(src[i] >> shift) : I/Q -> mots DSP. */
+void calypso_iq_pack(uint16_t *dst, const int16_t *src, int n, int shift);
+
+/* Nom de l'implementation active ("avx2", "sse2", "scalaire"). */
+const char *calypso_iqconv_accel_name(void);
+
+/* Banc / tests : passe a l'implementation suivante (moins rapide) ; false
+ * quand la scalaire est deja active. */
+bool test_calypso_iqconv_next_accel(void);
+
+#endif /* HW_ARM_CALYPSO_IQCONV_H */
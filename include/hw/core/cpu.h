@@ -201,6 +201,7 @@ struct CPUClass {
 
 /* Use a fully associative victim tlb of 8 entries. */
 #define CPU_VTLB_SIZE 8
+#define CPU_TLB_LARGE_PAGES 8
 
 /*
  * The full TLB entry, which is not accessed by generated TCG code,
@@ -271,10 +272,21 @@ struct CPUTLBEntryFull {
  */
 typedef struct CPUTLBDesc {
     /*
-     * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * The large pages allocated into the tlb, which holds them as
+     * TARGET_PAGE_SIZE entries: when any page within one is flushed,
+     * all of its entries must go.  Entry i is matched if
+     * (addr & large_page[i].mask) == large_page[i].addr.
+     */
+    struct {
+        vaddr addr;
+        vaddr mask;
+    } large_page[CPU_TLB_LARGE_PAGES];
+    unsigned n_large_pages;
+    /*
+     * Once large_page[] is full, describe a region covering all of the
+     * other large pages allocated into the tlb.  When any page within
+     * this region is flushed, we must flush the entire tlb.  The region
+     * is matched if (addr & large_page_mask) == large_page_addr.
      */
     vaddr large_page_addr;
     vaddr large_page_mask;
@@ -311,6 +323,10 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /* page flushes that evicted one tracked large page */
+    size_t large_flush_count;
+    /* page or range flushes that had to flush a whole mmu_idx */
+    size_t escalate_flush_count;
 } CPUTLBCommon;
 
 /*
@@ -419,6 +435,8 @@ struct qemu_work_item;
  * @created: Indicates whether the CPU thread has been successfully created.
  * @halt_cond: condition variable sleeping threads can wait on.
  * @interrupt_request: Indicates a pending interrupt request.
+ * @tb_profile_request: TCG: count the next translation block in the
+ *   JIT profile (see x-jit-profile).
  * @halted: Nonzero if the CPU is in suspended state.
  * @stop: Indicates a pending stop request.
  * @stopped: Indicates the CPU has been artificially stopped.
@@ -488,6 +506,7 @@ struct CPUState {
     bool unplug;
     bool crash_occurred;
     bool exit_request;
+    bool tb_profile_request;
     int exclusive_context_count;
     uint32_t cflags_next_tb;
     /* updates protected by BQL */
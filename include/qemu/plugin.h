@@ -72,6 +72,7 @@ enum plugin_dyn_cb_type {
     PLUGIN_CB_MEM_REGULAR,
     PLUGIN_CB_INLINE_ADD_U64,
     PLUGIN_CB_INLINE_STORE_U64,
+    PLUGIN_CB_MEM_BUF,
 };
 
 struct qemu_plugin_regular_cb {
@@ -96,6 +97,19 @@ struct qemu_plugin_conditional_cb {
     uint64_t imm;
 };
 
+/*
+ * Appends a record to a memory trace buffer. @f is the core helper
+ * delivering the buffer once full, not a plugin function.
+ */
+struct qemu_plugin_mem_buf_cb {
+    union qemu_plugin_cb_sig f;
+    TCGHelperInfo *info;
+    struct qemu_plugin_mem_buf *buf;
+    uint64_t pc;
+    void *userp;
+    enum qemu_plugin_mem_rw rw;
+};
+
 /*
  * A dynamic callback has an insertion point that is determined at run-time.
  * Usually the insertion point is somewhere in the code cache; think for
@@ -107,6 +121,7 @@ struct qemu_plugin_dyn_cb {
         struct qemu_plugin_regular_cb regular;
         struct qemu_plugin_conditional_cb cond;
         struct qemu_plugin_inline_cb inline_insn;
+        struct qemu_plugin_mem_buf_cb mem_buf;
     };
 };
 
@@ -128,6 +143,26 @@ struct qemu_plugin_scoreboard {
     QLIST_ENTRY(qemu_plugin_scoreboard) entry;
 };
 
+/*
+ * Per-vCPU state of a memory trace buffer, kept in a scoreboard so that
+ * generated code can find it like any inline op entry. @cur always
+ * points to a free record.
+ */
+struct qemu_plugin_mem_buf_vcpu {
+    qemu_plugin_mem_record *cur;
+    qemu_plugin_mem_record *end;
+    qemu_plugin_mem_record *start;
+};
+
+/* A memory trace buffer: @n_records records per vcpu_index */
+struct qemu_plugin_mem_buf {
+    struct qemu_plugin_scoreboard *vcpus;
+    size_t n_records;
+    qemu_plugin_vcpu_mem_buf_cb_t cb;
+    void *userp;
+    QLIST_ENTRY(qemu_plugin_mem_buf) entry;
+};
+
 /* Internal context for this TranslationBlock */
 struct qemu_plugin_tb {
     GPtrArray *insns;
@@ -65,11 +65,16 @@ typedef uint64_t qemu_plugin_id_t;
  *
  * version 4:
  * - added qemu_plugin_read_memory_vaddr
+ *
+ * version 5:
+ * - added memory trace buffers: qemu_plugin_mem_buf_new,
+ *   qemu_plugin_mem_buf_flush, qemu_plugin_mem_buf_free and
+ *   qemu_plugin_register_vcpu_mem_buf
  */
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 4
+#define QEMU_PLUGIN_VERSION 5
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -701,6 +706,103 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     qemu_plugin_u64 entry,
     uint64_t imm);
 
+/** struct qemu_plugin_mem_buf - Opaque handle for a memory trace buffer */
+struct qemu_plugin_mem_buf;
+
+/**
+ * typedef qemu_plugin_mem_record - one memory access of a trace buffer
+ * @vaddr: the virtual address of the access
+ * @pc: the virtual address of the instruction doing the access
+ * @userdata: userdata given when instrumenting the instruction
+ * @info: opaque handle for the qemu_plugin_mem_* queries
+ */
+typedef struct {
+    uint64_t vaddr;
+    uint64_t pc;
+    void *userdata;
+    qemu_plugin_meminfo_t info;
+} qemu_plugin_mem_record;
+
+/**
+ * typedef qemu_plugin_vcpu_mem_buf_cb_t - trace buffer callback function type
+ * @vcpu_index: the vCPU that did the accesses
+ * @records: the accesses, oldest first
+ * @n_records: number of entries in @records
+ * @userdata: userdata given to qemu_plugin_mem_buf_new()
+ */
+typedef void (*qemu_plugin_vcpu_mem_buf_cb_t)(
+    unsigned int vcpu_index,
+    const qemu_plugin_mem_record *records,
+    size_t n_records,
+    void *userdata);
+
+/**
+ * qemu_plugin_mem_buf_new() - alloc a new memory trace buffer
+ * @n_records: capacity of the buffer of each vCPU, in records
+ * @cb: callback receiving the records
+ * @userdata: opaque pointer for @cb
+ *
+ * Each vCPU appends the accesses instrumented with
+ * qemu_plugin_register_vcpu_mem_buf() to its own buffer, from generated
+ * code, and @cb is called from the vCPU thread with the whole buffer
+ * once it is full. Pending records are also delivered when the vCPU
+ * goes idle or exits, and by qemu_plugin_mem_buf_flush() and
+ * qemu_plugin_mem_buf_free().
+ *
+ * @cb runs without access to registers and may not use
+ * qemu_plugin_get_hwaddr(): the translation that was used by an access
+ * is gone by the time it is delivered.
+ *
+ * Returns a pointer to a new buffer. It must be freed using
+ * qemu_plugin_mem_buf_free.
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_mem_buf *
+qemu_plugin_mem_buf_new(size_t n_records, qemu_plugin_vcpu_mem_buf_cb_t cb,
+                        void *userdata);
+
+/**
+ * qemu_plugin_mem_buf_flush() - deliver the pending records of a vCPU
+ * @buf: buffer to flush
+ * @vcpu_index: vCPU whose records are delivered
+ *
+ * Must be called from the thread of @vcpu_index, e.g. from one of its
+ * callbacks, or while no vCPU is running.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_buf_flush(struct qemu_plugin_mem_buf *buf,
+                               unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_mem_buf_free() - flush and free a memory trace buffer
+ * @buf: buffer to free
+ *
+ * Delivers the records still pending on all vCPUs before freeing @buf.
+ * As with scoreboards, only free a buffer at exit, once no instrumented
+ * code can run anymore.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_buf_free(struct qemu_plugin_mem_buf *buf);
+
+/**
+ * qemu_plugin_register_vcpu_mem_buf() - record accesses to a trace buffer
+ * @insn: handle for instruction to instrument
+ * @rw: record reads, writes or both
+ * @buf: buffer to append the accesses to
+ * @userdata: opaque pointer stored in each record
+ *
+ * This appends a qemu_plugin_mem_record to @buf for every memory access
+ * generated by the instruction. The record is written inline, without
+ * calling into the plugin, which makes this much cheaper than
+ * qemu_plugin_register_vcpu_mem_cb() for plugins that can process the
+ * accesses in bulk.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_buf(struct qemu_plugin_insn *insn,
+                                       enum qemu_plugin_mem_rw rw,
+                                       struct qemu_plugin_mem_buf *buf,
+                                       void *userdata);
+
 /**
  * qemu_plugin_request_time_control() - request the ability to control time
  *
@@ -25,16 +25,33 @@
 #ifndef TCG_STARTUP_H
 #define TCG_STARTUP_H
 
+/* Bound on the contexts of user mode, see tcg_ctx_borrow(). */
+#define TCG_USER_MAX_CTXS 16
+
 /**
  * tcg_init: Initialize the TCG runtime
  * @tb_size: translation buffer size
  * @splitwx: use separate rw and rx mappings
- * @max_cpus: number of vcpus in system mode
+ * @max_cpus: number of vcpus in system mode; in user mode, number of
+ *            threads that may translate at the same time, at most
+ *            TCG_USER_MAX_CTXS
+ * @evict: recycle cold regions of the JIT buffer when it fills up,
+ *         instead of flushing all translations
  *
  * Allocate and initialize TCG resources, especially the JIT buffer.
- * In user-only mode, @max_cpus is unused.
  */
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus);
+void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus, bool evict);
+
+/**
+ * tcg_pin_init: Configure the globals kept in host registers across TBs
+ * @max: maximum number of pinned globals, 0 to disable
+ *
+ * Profile the use of globals during the first translations, then keep
+ * the most used ones in callee-saved host registers: chained TBs pass
+ * them along instead of reloading them from env.  Silently disabled if
+ * the host backend does not support it.
+ */
+void tcg_pin_init(unsigned max);
 
 /**
  * tcg_register_thread: Register this thread with the TCG runtime
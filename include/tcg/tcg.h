@@ -233,6 +233,7 @@ typedef struct TCGPool {
 
 #define TCG_MAX_TEMPS 512
 #define TCG_MAX_INSNS 512
+#define TCG_MAX_PINNED 8
 
 /* when the size of the arguments of a called function is smaller than
    this value, they are statically allocated in the TB stack frame */
@@ -387,6 +388,9 @@ typedef struct TCGTemp {
     unsigned int mem_allocated:1;
     unsigned int temp_allocated:1;
     unsigned int temp_subindex:2;
+    /* Global kept in pin_reg across TBs, see tcg_pin_select(). */
+    unsigned int pinned:1;
+    TCGReg pin_reg:8;
 
     int64_t val;
     struct TCGTemp *mem_base;
@@ -467,6 +471,10 @@ struct TCGContext {
     TCGBar guest_mo;
 
     TCGRegSet reserved_regs;
+    TCGRegSet pin_regs;           /* part of reserved_regs */
+    unsigned pin_generation;
+    uint8_t nb_pinned;
+    uint16_t pin_temps[TCG_MAX_PINNED];
     intptr_t current_frame_offset;
     intptr_t frame_start;
     intptr_t frame_end;
@@ -544,6 +552,9 @@ struct TCGContext {
        It does not take into account fixed registers */
     TCGTemp *reg_to_temp[TCG_TARGET_NB_REGS];
 
+    /* Uses of each global while profiling for tcg_pin_select(). */
+    uint32_t pin_uses[TCG_MAX_TEMPS];
+
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     uint64_t *gen_insn_data;
 
@@ -736,16 +747,39 @@ static inline bool tcg_op_buf_full(void)
 
 /* pool based memory allocation */
 
-/* user-mode: mmap_lock must be held for tcg_malloc_internal. */
+/*
+ * user-mode: mmap_lock must be held for tcg_malloc_internal, unless @s
+ * is a spare context borrowed by this thread.
+ */
 void *tcg_malloc_internal(TCGContext *s, int size);
 void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+#ifdef CONFIG_USER_ONLY
+bool tcg_ctx_borrow(void);
+void tcg_ctx_return(void);
+#else
+/* System-mode threads own their context. */
+static inline bool tcg_ctx_borrow(void)
+{
+    return false;
+}
+static inline void tcg_ctx_return(void)
+{
+}
+#endif
+void tcg_region_sample(const void *tc_ptr);
+bool tcg_region_available(void);
+size_t tcg_region_evict(GTraverseFunc func, gpointer user_data);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
 
+bool tcg_pin_due(void);
+void tcg_pin_select(void);
+void tcg_pin_dump_info(GString *buf);
+
 void tcg_tb_insert(TranslationBlock *tb);
 void tcg_tb_remove(TranslationBlock *tb);
 TranslationBlock *tcg_tb_lookup(uintptr_t tc_ptr);
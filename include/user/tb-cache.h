@@ -0,0 +1,70 @@
+/*
+ * Persistent translation cache for user-mode emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef USER_TB_CACHE_H
+#define USER_TB_CACHE_H
+
+#include "exec/vaddr.h"
+
+/**
+ * tb_cache_enable:
+ * @dir: directory holding the cache files
+ *
+ * Remember, per executable file, which TBs were translated from it and
+ * translate them ahead of the vCPU the next time the file is mapped.
+ * Must be called before the guest binary is loaded.
+ */
+void tb_cache_enable(const char *dir);
+
+/**
+ * tb_cache_map:
+ * @start: first guest address of the mapping
+ * @last: last guest address of the mapping
+ * @fd: host file descriptor of the mapped file
+ * @offset: file offset mapped at @start
+ *
+ * Note a new executable file mapping.  Called with mmap_lock held.
+ */
+void tb_cache_map(vaddr start, vaddr last, int fd, uint64_t offset);
+
+/**
+ * tb_cache_unmap:
+ * @start: first guest address
+ * @last: last guest address
+ *
+ * Forget the mappings overlapping [@start, @last].
+ * Called with mmap_lock held.
+ */
+void tb_cache_unmap(vaddr start, vaddr last);
+
+/**
+ * tb_cache_start:
+ * @cpu: the vCPU to translate for
+ *
+ * Start translating the cached TBs of the mapped files, in the background.
+ * Call once the prologue is generated; without this, the cache is only
+ * recorded.  The helper thread translates with a copy of @cpu, never
+ * with @cpu itself.
+ */
+void tb_cache_start(CPUState *cpu);
+
+/**
+ * tb_cache_fork_end:
+ * @cpu: the vCPU that called fork()
+ * @child: true in the child process
+ *
+ * Restart the background translation in a forked child.
+ */
+void tb_cache_fork_end(CPUState *cpu, bool child);
+
+/**
+ * tb_cache_save:
+ *
+ * Merge the TBs translated by this process into the cache files.
+ */
+void tb_cache_save(void);
+
+#endif /* USER_TB_CACHE_H */
@@ -57,6 +57,7 @@
 #include "user-mmap.h"
 #include "tcg/perf.h"
 #include "exec/page-vary.h"
+#include "user/tb-cache.h"
 
 #ifdef CONFIG_SEMIHOSTING
 #include "semihosting/semihost.h"
@@ -71,6 +72,9 @@ char *exec_path;
 char real_exec_path[PATH_MAX];
 
 static bool opt_one_insn_per_tb;
+static uint32_t opt_pin_regs;
+static uint32_t opt_translate_threads = 4;
+static uint32_t opt_tier_threshold;
 static const char *argv0;
 static const char *gdbstub;
 static envlist_t *envlist;
@@ -155,6 +159,7 @@ void fork_end(pid_t pid)
 
     qemu_plugin_user_postfork(child);
     mmap_fork_end(child);
+    tb_cache_fork_end(thread_cpu, child);
     if (child) {
         CPUState *cpu, *next_cpu;
         /* Child processes created by fork() only have a single thread.
@@ -424,6 +429,33 @@ static void handle_arg_one_insn_per_tb(const char *arg)
     opt_one_insn_per_tb = true;
 }
 
+static void handle_arg_pin_regs(const char *arg)
+{
+    if (qemu_strtoui(arg, NULL, 0, &opt_pin_regs)) {
+        fprintf(stderr, "Invalid number of pinned registers: %s\n", arg);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void handle_arg_tier_threshold(const char *arg)
+{
+    if (qemu_strtoui(arg, NULL, 0, &opt_tier_threshold)) {
+        fprintf(stderr, "Invalid tiering threshold: %s\n", arg);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void handle_arg_translate_threads(const char *arg)
+{
+    if (qemu_strtoui(arg, NULL, 0, &opt_translate_threads) ||
+        opt_translate_threads == 0 ||
+        opt_translate_threads > TCG_USER_MAX_CTXS) {
+        fprintf(stderr, "Invalid number of translation threads: %s "
+                "(between 1 and %d)\n", arg, TCG_USER_MAX_CTXS);
+        exit(EXIT_FAILURE);
+    }
+}
+
 static void handle_arg_strace(const char *arg)
 {
     enable_strace = true;
@@ -448,6 +480,11 @@ static void handle_arg_abi_call0(const char *arg)
 }
 #endif
 
+static void handle_arg_tb_cache(const char *arg)
+{
+    tb_cache_enable(arg);
+}
+
 static void handle_arg_perfmap(const char *arg)
 {
     perf_enable_perfmap();
@@ -516,6 +553,14 @@ static const struct qemu_argument arg_table[] = {
     {"one-insn-per-tb",
                    "QEMU_ONE_INSN_PER_TB",  false, handle_arg_one_insn_per_tb,
      "",           "run with one guest instruction per emulated TB"},
+    {"pin-regs",   "QEMU_PIN_REGS",    true,  handle_arg_pin_regs,
+     "n",          "keep n guest registers in host registers across TBs"},
+    {"translate-threads",
+                   "QEMU_TRANSLATE_THREADS", true, handle_arg_translate_threads,
+     "n",          "let up to n threads translate code at the same time"},
+    {"tier-threshold",
+                   "QEMU_TIER_THRESHOLD", true, handle_arg_tier_threshold,
+     "n",          "retranslate blocks run n times as superblocks"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
@@ -536,6 +581,8 @@ static const struct qemu_argument arg_table[] = {
      "",           "Generate a /tmp/perf-${pid}.map file for perf"},
     {"jitdump",    "QEMU_JITDUMP",     false, handle_arg_jitdump,
      "",           "Generate a jit-${pid}.dump file for perf"},
+    {"tb-cache",   "QEMU_TB_CACHE",    true,  handle_arg_tb_cache,
+     "dir",        "keep a persistent translation cache in 'dir'"},
     {NULL, NULL, false, NULL, NULL, NULL}
 };
 
@@ -699,6 +746,7 @@ int main(int argc, char **argv, char **envp)
     int host_page_size;
     unsigned long max_reserved_va;
     bool preserve_argv0;
+    bool have_plugins;
 
     error_init(argv[0]);
     module_call_init(MODULE_INIT_TRACE);
@@ -747,6 +795,7 @@ int main(int argc, char **argv, char **envp)
         exit(1);
     }
     trace_init_file();
+    have_plugins = !QTAILQ_EMPTY(&plugins);
     qemu_plugin_load_list(&plugins, &error_fatal);
 
     /* Zero out regs */
@@ -807,6 +856,12 @@ int main(int argc, char **argv, char **envp)
         accel_init_interfaces(ac);
         object_property_set_bool(OBJECT(accel), "one-insn-per-tb",
                                  opt_one_insn_per_tb, &error_abort);
+        object_property_set_uint(OBJECT(accel), "pin-regs",
+                                 opt_pin_regs, &error_abort);
+        object_property_set_uint(OBJECT(accel), "translate-threads",
+                                 opt_translate_threads, &error_abort);
+        object_property_set_uint(OBJECT(accel), "tier-threshold",
+                                 opt_tier_threshold, &error_abort);
         ac->init_machine(NULL);
     }
 
@@ -1021,6 +1076,11 @@ int main(int argc, char **argv, char **envp)
 
     target_cpu_copy_regs(env, regs);
 
+    /* Plugins see every translation; keep them on the vCPU thread. */
+    if (!have_plugins) {
+        tb_cache_start(cpu);
+    }
+
     if (gdbstub) {
         if (gdbserver_start(gdbstub) < 0) {
             fprintf(stderr, "qemu: could not open gdbserver on %s\n",
@@ -26,6 +26,7 @@
 #include "user-mmap.h"
 #include "target_mman.h"
 #include "qemu/interval-tree.h"
+#include "user/tb-cache.h"
 
 #ifdef TARGET_ARM
 #include "target/arm/cpu-features.h"
@@ -993,6 +994,12 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
 
     ret = target_mmap__locked(start, len, target_prot, flags,
                               page_flags, fd, offset);
+    if (ret != -1) {
+        tb_cache_unmap(ret, ret + len - 1);
+        if (!(flags & MAP_ANONYMOUS) && (target_prot & PROT_EXEC)) {
+            tb_cache_map(ret, ret + len - 1, fd, offset);
+        }
+    }
 
     mmap_unlock();
 
@@ -1092,6 +1099,7 @@ int target_munmap(abi_ulong start, abi_ulong len)
     if (likely(ret == 0)) {
         page_set_flags(start, start + len - 1, 0);
         shm_region_rm_complete(start, start + len - 1);
+        tb_cache_unmap(start, start + len - 1);
     }
     mmap_unlock();
 
@@ -1183,9 +1191,11 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
         prot = page_get_flags(old_addr);
         page_set_flags(old_addr, old_addr + old_size - 1, 0);
         shm_region_rm_complete(old_addr, old_addr + old_size - 1);
+        tb_cache_unmap(old_addr, old_addr + old_size - 1);
         page_set_flags(new_addr, new_addr + new_size - 1,
                        prot | PAGE_VALID | PAGE_RESET);
         shm_region_rm_complete(new_addr, new_addr + new_size - 1);
+        tb_cache_unmap(new_addr, new_addr + new_size - 1);
     }
     mmap_unlock();
     return new_addr;
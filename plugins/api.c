@@ -200,6 +200,14 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     plugin_register_inline_op_on_entry(&insn->mem_cbs, rw, op, entry, imm);
 }
 
+void qemu_plugin_register_vcpu_mem_buf(struct qemu_plugin_insn *insn,
+                                       enum qemu_plugin_mem_rw rw,
+                                       struct qemu_plugin_mem_buf *buf,
+                                       void *udata)
+{
+    plugin_register_vcpu_mem_buf(&insn->mem_cbs, rw, buf, insn->vaddr, udata);
+}
+
 void qemu_plugin_register_vcpu_tb_trans_cb(qemu_plugin_id_t id,
                                            qemu_plugin_vcpu_tb_trans_cb_t cb)
 {
@@ -597,6 +605,25 @@ void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
     plugin_scoreboard_free(score);
 }
 
+struct qemu_plugin_mem_buf *
+qemu_plugin_mem_buf_new(size_t n_records, qemu_plugin_vcpu_mem_buf_cb_t cb,
+                        void *userdata)
+{
+    return plugin_mem_buf_new(n_records, cb, userdata);
+}
+
+void qemu_plugin_mem_buf_flush(struct qemu_plugin_mem_buf *buf,
+                               unsigned int vcpu_index)
+{
+    g_assert(vcpu_index < qemu_plugin_num_vcpus());
+    plugin_mem_buf_flush(buf, vcpu_index);
+}
+
+void qemu_plugin_mem_buf_free(struct qemu_plugin_mem_buf *buf)
+{
+    plugin_mem_buf_free(buf);
+}
+
 void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
                                   unsigned int vcpu_index)
 {
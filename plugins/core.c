@@ -260,8 +260,44 @@ static void plugin_grow_scoreboards__locked(CPUState *cpu)
     end_exclusive();
 }
 
+static void plugin_mem_buf_init_vcpu__locked(struct qemu_plugin_mem_buf *buf,
+                                             unsigned int vcpu_index)
+{
+    struct qemu_plugin_mem_buf_vcpu *v =
+        &g_array_index(buf->vcpus->data, struct qemu_plugin_mem_buf_vcpu,
+                       vcpu_index);
+
+    /* generated code stores before checking, so there must be room */
+    if (!v->start) {
+        v->start = g_new(qemu_plugin_mem_record, buf->n_records);
+        v->cur = v->start;
+        v->end = v->start + buf->n_records;
+    }
+}
+
+static void plugin_mem_buf_init__locked(gpointer k, gpointer v, gpointer udata)
+{
+    plugin_mem_buf_init_vcpu__locked(udata, *(int *)k);
+}
+
+/* deliver the pending records of all buffers; called from @cpu's thread */
+static void plugin_mem_buf_flush_vcpu(CPUState *cpu)
+{
+    struct qemu_plugin_mem_buf *buf;
+
+    if (QLIST_EMPTY(&plugin.mem_bufs)) {
+        return;
+    }
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_FOREACH(buf, &plugin.mem_bufs, entry) {
+        plugin_mem_buf_flush(buf, cpu->cpu_index);
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+}
+
 static void qemu_plugin_vcpu_init__async(CPUState *cpu, run_on_cpu_data unused)
 {
+    struct qemu_plugin_mem_buf *buf;
     bool success;
 
     assert(cpu->cpu_index != UNASSIGNED_CPU_INDEX);
@@ -272,6 +308,9 @@ static void qemu_plugin_vcpu_init__async(CPUState *cpu, run_on_cpu_data unused)
                                   &cpu->cpu_index);
     g_assert(success);
     plugin_grow_scoreboards__locked(cpu);
+    QLIST_FOREACH(buf, &plugin.mem_bufs, entry) {
+        plugin_mem_buf_init_vcpu__locked(buf, cpu->cpu_index);
+    }
     qemu_rec_mutex_unlock(&plugin.lock);
 
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_INIT);
@@ -287,6 +326,9 @@ void qemu_plugin_vcpu_exit_hook(CPUState *cpu)
 {
     bool success;
 
+    if (cpu->cpu_index < plugin.num_vcpus) {
+        plugin_mem_buf_flush_vcpu(cpu);
+    }
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_EXIT);
 
     assert(cpu->cpu_index != UNASSIGNED_CPU_INDEX);
@@ -465,6 +507,43 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
     dyn_cb->regular = regular_cb;
 }
 
+/* called from generated code when an append filled the buffer */
+static void plugin_mem_buf_full(unsigned int vcpu_index, void *udata)
+{
+    plugin_mem_buf_flush(udata, vcpu_index);
+}
+
+void plugin_register_vcpu_mem_buf(GArray **arr,
+                                  enum qemu_plugin_mem_rw rw,
+                                  struct qemu_plugin_mem_buf *buf,
+                                  uint64_t pc,
+                                  void *udata)
+{
+    static TCGHelperInfo info = {
+        /* the plugin callback gets no registers */
+        .flags = TCG_CALL_NO_RWG,
+        /*
+         * Match plugin_mem_buf_full:
+         *   void (*)(uint32_t, void *)
+         */
+        .typemask = (dh_typemask(void, 0) |
+                     dh_typemask(i32, 1) |
+                     dh_typemask(ptr, 2))
+    };
+
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+    struct qemu_plugin_mem_buf_cb mem_buf_cb = {
+        .f.vcpu_udata = plugin_mem_buf_full,
+        .info = &info,
+        .buf = buf,
+        .pc = pc,
+        .userp = udata,
+        .rw = rw
+    };
+    dyn_cb->type = PLUGIN_CB_MEM_BUF;
+    dyn_cb->mem_buf = mem_buf_cb;
+}
+
 /*
  * Disable CFI checks.
  * The callback function has been loaded from an external library so we do not
@@ -536,6 +615,7 @@ void qemu_plugin_vcpu_idle_cb(CPUState *cpu)
 {
     /* idle and resume cb may be called before init, ignore in this case */
     if (cpu->cpu_index < plugin.num_vcpus) {
+        plugin_mem_buf_flush_vcpu(cpu);
         plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_IDLE);
     }
 }
@@ -601,6 +681,26 @@ void exec_inline_op(enum plugin_dyn_cb_type type,
     }
 }
 
+/* the C counterpart of gen_mem_buf_cb, for accesses done by helpers */
+static void plugin_mem_buf_append(struct qemu_plugin_mem_buf_cb *cb,
+                                  unsigned int vcpu_index, uint64_t vaddr,
+                                  qemu_plugin_meminfo_t info)
+{
+    struct qemu_plugin_mem_buf_vcpu *v =
+        &g_array_index(cb->buf->vcpus->data, struct qemu_plugin_mem_buf_vcpu,
+                       vcpu_index);
+
+    *v->cur = (qemu_plugin_mem_record) {
+        .vaddr = vaddr,
+        .pc = cb->pc,
+        .userdata = cb->userp,
+        .info = info,
+    };
+    if (++v->cur >= v->end) {
+        plugin_mem_buf_flush(cb->buf, vcpu_index);
+    }
+}
+
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                              uint64_t value_low,
                              uint64_t value_high,
@@ -634,6 +734,12 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                 exec_inline_op(cb->type, &cb->inline_insn, cpu->cpu_index);
             }
             break;
+        case PLUGIN_CB_MEM_BUF:
+            if (rw & cb->mem_buf.rw) {
+                plugin_mem_buf_append(&cb->mem_buf, cpu->cpu_index, vaddr,
+                                      make_plugin_meminfo(oi, rw));
+            }
+            break;
         default:
             g_assert_not_reached();
         }
@@ -733,6 +839,7 @@ static void __attribute__((__constructor__)) plugin_init(void)
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
     QLIST_INIT(&plugin.scoreboards);
+    QLIST_INIT(&plugin.mem_bufs);
     plugin.scoreboard_alloc_size = 16; /* avoid frequent reallocation */
     QTAILQ_INIT(&plugin.ctxs);
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
@@ -768,3 +875,59 @@ void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
     g_array_free(score->data, TRUE);
     g_free(score);
 }
+
+struct qemu_plugin_mem_buf *
+plugin_mem_buf_new(size_t n_records, qemu_plugin_vcpu_mem_buf_cb_t cb,
+                   void *udata)
+{
+    struct qemu_plugin_mem_buf *buf = g_new0(struct qemu_plugin_mem_buf, 1);
+
+    buf->vcpus = plugin_scoreboard_new(sizeof(struct qemu_plugin_mem_buf_vcpu));
+    buf->n_records = MAX(n_records, 1);
+    buf->cb = cb;
+    buf->userp = udata;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_INSERT_HEAD(&plugin.mem_bufs, buf, entry);
+    g_hash_table_foreach(plugin.cpu_ht, plugin_mem_buf_init__locked, buf);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return buf;
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+void plugin_mem_buf_flush(struct qemu_plugin_mem_buf *buf,
+                          unsigned int vcpu_index)
+{
+    struct qemu_plugin_mem_buf_vcpu *v =
+        &g_array_index(buf->vcpus->data, struct qemu_plugin_mem_buf_vcpu,
+                       vcpu_index);
+    size_t n = v->cur - v->start;
+
+    if (n) {
+        buf->cb(vcpu_index, v->start, n, buf->userp);
+        v->cur = v->start;
+    }
+}
+
+void plugin_mem_buf_free(struct qemu_plugin_mem_buf *buf)
+{
+    unsigned int i;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(buf, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    for (i = 0; i < buf->vcpus->data->len; i++) {
+        plugin_mem_buf_flush(buf, i);
+        g_free(g_array_index(buf->vcpus->data,
+                             struct qemu_plugin_mem_buf_vcpu, i).start);
+    }
+    plugin_scoreboard_free(buf->vcpus);
+    g_free(buf);
+}
@@ -32,6 +32,7 @@ struct qemu_plugin_state {
      */
     GHashTable *cpu_ht;
     QLIST_HEAD(, qemu_plugin_scoreboard) scoreboards;
+    QLIST_HEAD(, qemu_plugin_mem_buf) mem_bufs;
     size_t scoreboard_alloc_size;
     DECLARE_BITMAP(mask, QEMU_PLUGIN_EV_MAX);
     /*
@@ -108,6 +109,12 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
+void plugin_register_vcpu_mem_buf(GArray **arr,
+                                  enum qemu_plugin_mem_rw rw,
+                                  struct qemu_plugin_mem_buf *buf,
+                                  uint64_t pc,
+                                  void *udata);
+
 void exec_inline_op(enum plugin_dyn_cb_type type,
                     struct qemu_plugin_inline_cb *cb,
                     int cpu_index);
@@ -118,4 +125,13 @@ struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size);
 
 void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
 
+struct qemu_plugin_mem_buf *
+plugin_mem_buf_new(size_t n_records, qemu_plugin_vcpu_mem_buf_cb_t cb,
+                   void *udata);
+
+void plugin_mem_buf_flush(struct qemu_plugin_mem_buf *buf,
+                          unsigned int vcpu_index);
+
+void plugin_mem_buf_free(struct qemu_plugin_mem_buf *buf);
+
 #endif /* PLUGIN_H */
@@ -86,6 +86,7 @@ enum {
     OPTION_BITMAPS = 275,
     OPTION_FORCE = 276,
     OPTION_SKIP_BROKEN = 277,
+    OPTION_DEDUP = 278,
 };
 
 typedef enum OutputFormat {
@@ -730,6 +731,7 @@ static int img_check(int argc, char **argv)
     bool quiet = false;
     bool image_opts = false;
     bool force_share = false;
+    bool progress = false;
 
     fmt = NULL;
     output = NULL;
@@ -747,7 +749,7 @@ static int img_check(int argc, char **argv)
             {"force-share", no_argument, 0, 'U'},
             {0, 0, 0, 0}
         };
-        c = getopt_long(argc, argv, ":hf:r:T:qU",
+        c = getopt_long(argc, argv, ":hf:r:T:pqU",
                         long_options, &option_index);
         if (c == -1) {
             break;
@@ -783,6 +785,9 @@ static int img_check(int argc, char **argv)
         case 'T':
             cache = optarg;
             break;
+        case 'p':
+            progress = true;
+            break;
         case 'q':
             quiet = true;
             break;
@@ -811,6 +816,11 @@ static int img_check(int argc, char **argv)
         return 1;
     }
 
+    /* Progress would be mixed into the JSON document on stdout */
+    if (quiet || output_format == OFORMAT_JSON) {
+        progress = false;
+    }
+
     ret = bdrv_parse_cache_mode(cache, &flags, &writethrough);
     if (ret < 0) {
         error_report("Invalid source cache option: %s", cache);
@@ -824,8 +834,11 @@ static int img_check(int argc, char **argv)
     }
     bs = blk_bs(blk);
 
+    qemu_progress_init(progress, 1.f);
+
     check = g_new0(ImageCheck, 1);
     ret = collect_image_check(bs, check, filename, fmt, fix);
+    qemu_progress_end();
 
     if (ret == -ENOTSUP) {
         error_report("This image format does not support checks");
@@ -854,6 +867,8 @@ static int img_check(int argc, char **argv)
 
         qapi_free_ImageCheck(check);
         check = g_new0(ImageCheck, 1);
+        /* The repeated check is not shown, except on SIGUSR1 */
+        qemu_progress_init(false, 1.f);
         ret = collect_image_check(bs, check, filename, fmt, 0);
 
         check->leaks_fixed          = leaks_fixed;
@@ -2253,7 +2268,10 @@ static int img_convert(int argc, char **argv)
     bool explict_min_sparse = false;
     bool bitmaps = false;
     bool skip_broken = false;
+    bool dedup = false;
     int64_t rate_limit = 0;
+    int64_t start_time;
+    g_autofree char *report = NULL;
 
     ImgConvertState s = (ImgConvertState) {
         /* Need at least 4k of zeros for sparse detection */
@@ -2275,6 +2293,7 @@ static int img_convert(int argc, char **argv)
             {"target-is-zero", no_argument, 0, OPTION_TARGET_IS_ZERO},
             {"bitmaps", no_argument, 0, OPTION_BITMAPS},
             {"skip-broken-bitmaps", no_argument, 0, OPTION_SKIP_BROKEN},
+            {"dedup", no_argument, 0, OPTION_DEDUP},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hf:O:B:CcF:o:l:S:pt:T:qnm:WUr:",
@@ -2409,6 +2428,9 @@ static int img_convert(int argc, char **argv)
         case OPTION_SKIP_BROKEN:
             skip_broken = true;
             break;
+        case OPTION_DEDUP:
+            dedup = true;
+            break;
         }
     }
 
@@ -2451,6 +2473,22 @@ static int img_convert(int argc, char **argv)
         goto fail_getopt;
     }
 
+    if (dedup && (!out_fmt || strcmp(out_fmt, "qcow2"))) {
+        error_report("--dedup requires the qcow2 output format");
+        goto fail_getopt;
+    }
+
+    if (dedup && skip_create) {
+        error_report("--dedup cannot be used with -n; use "
+                     "--target-image-opts with dedup=on instead");
+        goto fail_getopt;
+    }
+
+    if (dedup && s.compressed) {
+        error_report("Cannot use --dedup when -c is used");
+        goto fail_getopt;
+    }
+
     s.src_num = argc - optind - 1;
     out_filename = s.src_num >= 1 ? argv[argc - 1] : NULL;
 
@@ -2666,6 +2704,18 @@ static int img_convert(int argc, char **argv)
     if (!skip_create) {
         open_opts = qdict_new();
         qemu_opt_foreach(opts, img_add_key_secrets, open_opts, &error_abort);
+        if (dedup) {
+            qdict_put_bool(open_opts, "dedup", true);
+        }
+        if (s.compressed && !s.wr_in_order &&
+            out_fmt && !strcmp(out_fmt, "qcow2")) {
+            /*
+             * Out-of-order writes compress one cluster per coroutine at a
+             * time; in-order writes are serialized and gain nothing.
+             */
+            qdict_put_int(open_opts, "worker-threads",
+                          MIN(g_get_num_processors(), s.num_coroutines));
+        }
 
         /* Create the new image */
         ret = bdrv_create(drv, out_filename, opts, &local_err);
@@ -2783,8 +2833,33 @@ static int img_convert(int argc, char **argv)
         set_rate_limit(s.target, rate_limit);
     }
 
+    start_time = get_clock();
     ret = convert_do_copy(&s);
 
+    if (dedup && ret == 0) {
+        ret = blk_flush(s.target);
+        if (ret < 0) {
+            error_report("error while flushing the target: %s",
+                         strerror(-ret));
+        } else if (!s.quiet) {
+            double secs = (double)(get_clock() - start_time) /
+                          NANOSECONDS_PER_SECOND;
+            uint64_t virtual_size = s.total_sectors * BDRV_SECTOR_SIZE;
+            int64_t image_size;
+            g_autofree char *image_str = NULL;
+            g_autofree char *virtual_str = size_to_str(virtual_size);
+
+            image_size = bdrv_get_allocated_file_size(out_bs);
+            image_str = image_size < 0 ? g_strdup("unavailable")
+                                       : size_to_str(image_size);
+
+            report = g_strdup_printf("Converted %s in %.1f s (%.1f MiB/s), "
+                                     "image size %s", virtual_str, secs,
+                                     secs > 0 ? virtual_size / secs / MiB : 0,
+                                     image_str);
+        }
+    }
+
     /* Now copy the bitmaps */
     if (bitmaps && ret == 0) {
         ret = convert_copy_bitmaps(blk_bs(s.src[0]), out_bs, skip_broken);
@@ -2795,6 +2870,9 @@ out:
         qemu_progress_print(100, 0);
     }
     qemu_progress_end();
+    if (report && !ret) {
+        printf("%s\n", report);
+    }
     qemu_opts_del(opts);
     qemu_opts_free(create_opts);
     qobject_unref(open_opts);
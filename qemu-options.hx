@@ -187,6 +187,9 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-evict=on|off (recycle cold TB cache regions instead of flushing, default=on)\n"
+    "                tier-threshold=n (retranslate TBs run n times as superblocks, default 0 = off)\n"
+    "                pin-regs=n (keep n guest registers in host registers across TBs, default 0 = off)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
@@ -230,6 +233,36 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-evict=on|off``
+        When the TCG translation block cache is full, recycle the parts of
+        it holding the least recently executed code instead of discarding
+        every translation at once. This avoids the retranslation stall of
+        a full flush for guests with a large working set. The default is
+        on; explicit flushes (debugger, plugins, ...) are not affected.
+
+    ``tier-threshold=n``
+        Retranslate a translation block once it has been executed ``n``
+        times by one vCPU. The second translation may continue across
+        forward unconditional direct branches that stay within the same
+        guest page, so that a hot path is optimized as a single block.
+        Only Arm guests fold branches so far; for other targets the
+        retranslation is identical to the first one, and no target forms
+        loop traces. The default, 0, disables tiering; counting costs a
+        memory increment and a compare per execution of a first-tier
+        block, and 256 KiB of counters per vCPU. Tiering is not used with
+        ``-icount``.
+
+    ``pin-regs=n``
+        Count how often the translated code uses each guest register
+        (each TCG global) over the first translations, then keep up to
+        ``n`` of the most used ones in callee-saved host registers. Chained
+        translation blocks pass them along instead of reloading them from
+        the CPU state; writes still reach the CPU state at the end of each
+        basic block. All translations are flushed once, when the selection
+        is made, and ``info jit`` shows it. Only x86-64 and AArch64 hosts
+        support this, and the number of registers is capped by what the
+        host can spare. The default, 0, disables pinning.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -1385,6 +1418,13 @@ SRST
             Specifies the AIO backend (threads/native/io_uring,
             default: threads)
 
+        ``aio-fixed-buffers``
+            With ``aio=io_uring``, registers guest RAM with the io_uring
+            rings so that requests into it skip page pinning in the
+            kernel. The memory lock limit of QEMU (``ulimit -l``) must
+            cover guest RAM, otherwise normal requests are used.
+            (on/off, default: off)
+
         ``locking``
             Specifies whether the image file is protected with Linux OFD
             / POSIX locks. The default is to use the Linux Open File
@@ -5991,7 +6031,7 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
-    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch``
+    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch,io-uring-sqpoll=on|off``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
         emulation happens in vCPU threads or the main event loop thread.
@@ -6031,6 +6071,17 @@ SRST
         in a batch for the AIO engine, 0 means that the engine will use
         its default.
 
+        The ``io-uring-sqpoll`` parameter makes a kernel thread poll
+        the submission queue of the io_uring AIO engine, saving a
+        system call per batch of requests at the cost of a host CPU
+        while requests are submitted. It takes effect when the IOThread
+        first uses io_uring. Older kernels only accept requests on
+        registered files from such a ring, which QEMU cannot guarantee,
+        so without ``IORING_FEAT_SQPOLL_NONFIXED`` (Linux 5.11) or
+        without the privileges to create it, a normal ring is used
+        instead, silently; the ``luring_init_sqpoll`` trace event shows
+        which one was set up.
+
         The IOThread parameters can be modified at run-time using the
         ``qom-set`` command (where ``iothread1`` is the IOThread's
         ``id``):
@@ -51,7 +51,10 @@ mod_mailbox_dissam_status() {
 }
 
 mod_mailbox_dissam_start() {
-    local src="${LOG_DIR:-/root/calypso/logs}/mailbox.log"
+    # [2026-10-18] Trace binaire par défaut (CALYPSO_MAILBOX_FMT=bin) ; l'outil
+    # lit les deux formats, on suit celui que le moniteur produit.
+    local src="${LOG_DIR:-/root/calypso/logs}/mailbox.mbx"
+    [ "${CALYPSO_MAILBOX_FMT:-bin}" = texte ] && src="${LOG_DIR:-/root/calypso/logs}/mailbox.log"
     local out="$CALYPSO_MAILBOX_DISSAM_OUT"
     local log="${LOG_DIR:-/root/calypso/logs}/mod/mailbox-dissam.log"
     local boucle="${RUN_DIR:-/tmp/calypso}/mailbox-dissam-boucle.sh"
@@ -69,7 +72,7 @@ mod_mailbox_dissam_start() {
             > "$out.tmp" 2>>"$log" && mv -f "$out.tmp" "$out" \
             || mod_say "ATTENTION : premier passage en échec, voir $log"
     else
-        mod_say "mailbox.log encore vide — la boucle rattrapera"
+        mod_say "$(basename "$src") encore vide — la boucle rattrapera"
     fi
 
     # La boucle vit dans un SCRIPT, pas dans un `bash -c` en ligne : on peut la
@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+
+#  Compare the wall-clock time of a linux-user command run under a memory
+#  access plugin called on every access (batch=off) and fed from trace
+#  buffers (batch=on).
+#
+#  Syntax:
+#  plugin-mem-bench.py [-h] -p <plugin> [-a <args>] [-n <runs>] -- \
+#                      <qemu executable> [<qemu executable options>] \
+#                      <target executable> [<target executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  -p   - Plugin supporting the batch argument (libhotpages.so, libcache.so).
+#  [-a] - Extra plugin arguments, comma separated.
+#  [-n] - Number of runs of each mode (default 5).
+#
+#  Example of usage:
+#  plugin-mem-bench.py -p build/contrib/plugins/libcache.so -a l2=on -- \
+#      build/qemu-aarch64 ./tests/tcg/aarch64-linux-user/sha1
+#
+#  The plugin reports of both modes are compared; for single-threaded
+#  guests they match.
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import statistics
+import subprocess
+import sys
+import time
+
+
+def run(command, plugin):
+    """
+    Run the command once with the given -plugin argument.
+
+    Returns:
+    (float, str): Wall-clock time in seconds and plugin report
+    """
+    qemu_command = [command[0], "-plugin", plugin, "-d", "plugin"] + \
+        command[1:]
+    start = time.perf_counter()
+    proc = subprocess.run(qemu_command,
+                          stdout=subprocess.DEVNULL,
+                          stderr=subprocess.PIPE)
+    elapsed = time.perf_counter() - start
+    if proc.returncode:
+        sys.exit(proc.stderr.decode("utf-8"))
+    return elapsed, proc.stderr.decode("utf-8")
+
+
+def report(name, times):
+    print('{:<13}{:>10.3f}s{:>10.3f}s{:>10.3f}s'.
+          format(name, statistics.mean(times), min(times), max(times)))
+
+
+def main():
+    # Parse the command line arguments
+    parser = argparse.ArgumentParser(
+        usage='plugin-mem-bench.py [-h] -p <plugin> [-a <args>] '
+        '[-n <runs>] -- <qemu executable> [<qemu executable options>] '
+        '<target executable> [<target executable options>]')
+
+    parser.add_argument('-p', dest='plugin', type=str, required=True,
+                        help='plugin supporting the batch argument')
+    parser.add_argument('-a', dest='args', type=str, default='',
+                        help='extra plugin arguments, comma separated')
+    parser.add_argument('-n', dest='runs', type=int, default=5,
+                        help='number of runs of each mode')
+    parser.add_argument('command', type=str, nargs='+', help=argparse.SUPPRESS)
+
+    args = parser.parse_args()
+
+    results = {}
+    for batch in ("off", "on"):
+        plugin = "{},batch={}".format(args.plugin, batch)
+        if args.args:
+            plugin += "," + args.args
+        times = []
+        for _ in range(args.runs):
+            elapsed, output = run(args.command, plugin)
+            times.append(elapsed)
+        results[batch] = (times, output)
+
+    print('{:<13}{:>11}{:>11}{:>11}'.format("", "mean", "min", "max"))
+    report("per-access:", results["off"][0])
+    report("batched:", results["on"][0])
+    print('\nspeedup: {:.2f}x, reports {}'.
+          format(statistics.mean(results["off"][0]) /
+                 statistics.mean(results["on"][0]),
+                 "match" if results["off"][1] == results["on"][1]
+                 else "differ"))
+
+
+if __name__ == "__main__":
+    main()
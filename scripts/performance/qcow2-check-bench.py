@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+
+#  Compare the wall-clock time and peak memory of "qemu-img check" on a
+#  large qcow2 image, for one or more qemu-img executables.
+#
+#  Syntax:
+#  qcow2-check-bench.py [-h] [-s <size>] [-d <percent>] [-n <runs>] \
+#                       [-f <image>] -- <qemu-img executable> \
+#                       [<qemu-img executable> ...]
+#
+#  [-h] - Print the script arguments help message.
+#  [-s] - Virtual size of the image (default 1T).
+#  [-d] - Share of the image that is discarded after preallocating its
+#         metadata, in percent (default 90).
+#  [-n] - Number of runs of each executable (default 3).
+#  [-f] - Image file to create (default qcow2-check-bench.qcow2).
+#
+#  Example of usage, comparing two builds:
+#  qcow2-check-bench.py -- old/build/qemu-img build/qemu-img
+#
+#  The image is created with preallocation=metadata, so that every
+#  cluster is referenced, and then most of it is discarded with qemu-io
+#  from the directory of the first executable.  The image file keeps its
+#  length, so the check covers a file much larger than the clusters that
+#  are still in use, as for a guest disk that has been trimmed.
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import time
+
+
+def create(qemu_img, image, size, discard):
+    """
+    Create the image and discard the given share of it.
+    """
+    subprocess.run([qemu_img, "create", "-q", "-f", "qcow2",
+                    "-o", "preallocation=metadata", image, size],
+                   check=True)
+    qemu_io = os.path.join(os.path.dirname(qemu_img), "qemu-io")
+    info = json.loads(subprocess.run([qemu_img, "info", "--output=json",
+                                      image],
+                                     check=True, stdout=subprocess.PIPE).stdout)
+    length = info["virtual-size"] * discard // 100
+    length -= length % info["cluster-size"]
+    if length:
+        subprocess.run([qemu_io, "-f", "qcow2", "-c",
+                        "discard 0 {}".format(length), image],
+                       check=True, stdout=subprocess.DEVNULL)
+
+
+def run(qemu_img, image):
+    """
+    Run "qemu-img check" once.
+
+    Returns:
+    (float, int): Wall-clock time in seconds and peak RSS in KiB
+    """
+    start = time.perf_counter()
+    proc = subprocess.Popen([qemu_img, "check", "-f", "qcow2", image],
+                            stdout=subprocess.DEVNULL,
+                            stderr=subprocess.PIPE)
+    _, status, rusage = os.wait4(proc.pid, 0)
+    elapsed = time.perf_counter() - start
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    if proc.returncode:
+        sys.exit(proc.stderr.read().decode("utf-8"))
+    proc.stderr.close()
+    return elapsed, rusage.ru_maxrss
+
+
+def main():
+    # Parse the command line arguments
+    parser = argparse.ArgumentParser(
+        usage='qcow2-check-bench.py [-h] [-s <size>] [-d <percent>] '
+        '[-n <runs>] [-f <image>] -- <qemu-img executable> '
+        '[<qemu-img executable> ...]')
+
+    parser.add_argument('-s', dest='size', type=str, default='1T',
+                        help='virtual size of the image')
+    parser.add_argument('-d', dest='discard', type=int, default=90,
+                        help='share of the image that is discarded, '
+                        'in percent')
+    parser.add_argument('-n', dest='runs', type=int, default=3,
+                        help='number of runs of each executable')
+    parser.add_argument('-f', dest='image', type=str,
+                        default='qcow2-check-bench.qcow2',
+                        help='image file to create')
+    parser.add_argument('qemu_img', type=str, nargs='+',
+                        help=argparse.SUPPRESS)
+
+    args = parser.parse_args()
+
+    create(args.qemu_img[0], args.image, args.size, args.discard)
+    try:
+        print('{:<40}{:>11}{:>11}{:>14}'.format("", "mean", "min",
+                                                "peak RSS"))
+        for qemu_img in args.qemu_img:
+            times = []
+            rss = 0
+            for _ in range(args.runs):
+                elapsed, maxrss = run(qemu_img, args.image)
+                times.append(elapsed)
+                rss = max(rss, maxrss)
+            print('{:<40}{:>10.3f}s{:>10.3f}s{:>10} KiB'.
+                  format(qemu_img[-40:], statistics.mean(times), min(times),
+                         rss))
+    finally:
+        os.unlink(args.image)
+
+
+if __name__ == "__main__":
+    main()
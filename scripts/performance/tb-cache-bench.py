@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+
+#  Compare the wall-clock time of a linux-user command run with an empty
+#  (cold) and a populated (warm) persistent translation cache.
+#
+#  Syntax:
+#  tb-cache-bench.py [-h] [-n <runs>] -- <qemu executable> \
+#                    [<qemu executable options>] \
+#                    <target executable> [<target executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-n] - Number of cold and of warm runs (default 5).
+#
+#  Example of usage, compiling a file with a cross compiler:
+#  tb-cache-bench.py -- qemu-aarch64 -L /usr/aarch64-linux-gnu \
+#      /usr/aarch64-linux-gnu/bin/gcc -O2 -c hello.c -o /dev/null
+#
+#  Each cold run gets a fresh cache directory; the warm runs share one
+#  that was filled by a first, untimed run.  Compiler drivers execute
+#  several programs (cc1, as...): run qemu through binfmt_misc with
+#  QEMU_TB_CACHE exported for those to use the cache too.
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def run(command, cache_dir):
+    """
+    Run the command once with QEMU_TB_CACHE set to cache_dir.
+
+    Returns:
+    (float): Wall-clock time in seconds
+    """
+    env = dict(os.environ, QEMU_TB_CACHE=cache_dir)
+    start = time.perf_counter()
+    proc = subprocess.run(command, env=env,
+                          stdout=subprocess.DEVNULL,
+                          stderr=subprocess.PIPE)
+    elapsed = time.perf_counter() - start
+    if proc.returncode:
+        sys.exit(proc.stderr.decode("utf-8"))
+    return elapsed
+
+
+def report(name, times):
+    print('{:<8}{:>10.3f}s{:>10.3f}s{:>10.3f}s'.
+          format(name, statistics.mean(times), min(times), max(times)))
+
+
+def main():
+    # Parse the command line arguments
+    parser = argparse.ArgumentParser(
+        usage='tb-cache-bench.py [-h] [-n <runs>] -- '
+        '<qemu executable> [<qemu executable options>] '
+        '<target executable> [<target executable options>]')
+
+    parser.add_argument('-n', dest='runs', type=int, default=5,
+                        help='number of cold and of warm runs')
+    parser.add_argument('command', type=str, nargs='+', help=argparse.SUPPRESS)
+
+    args = parser.parse_args()
+
+    cold = []
+    for _ in range(args.runs):
+        with tempfile.TemporaryDirectory() as cache_dir:
+            cold.append(run(args.command, cache_dir))
+
+    warm = []
+    with tempfile.TemporaryDirectory() as cache_dir:
+        run(args.command, cache_dir)
+        for _ in range(args.runs):
+            warm.append(run(args.command, cache_dir))
+        cache_size = sum(os.path.getsize(os.path.join(cache_dir, f))
+                         for f in os.listdir(cache_dir))
+
+    print('{:<8}{:>11}{:>11}{:>11}'.format("", "mean", "min", "max"))
+    report("cold:", cold)
+    report("warm:", warm)
+    print('\nspeedup: {:.2f}x, cache size: {:,} bytes'.
+          format(statistics.mean(cold) / statistics.mean(warm), cache_size))
+
+
+if __name__ == "__main__":
+    main()
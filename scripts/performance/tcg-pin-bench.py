@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+
+#  Compare the wall-clock time of a linux-user command run without and
+#  with guest registers pinned in host registers across TBs.
+#
+#  Syntax:
+#  tcg-pin-bench.py [-h] [-r <regs>] [-n <runs>] -- <qemu executable> \
+#                   [<qemu executable options>] \
+#                   <target executable> [<target executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-r] - Number of pinned registers (default 4).
+#  [-n] - Number of runs of each mode (default 5).
+#
+#  Example of usage, on an Arm and on an x86 guest:
+#  tcg-pin-bench.py -- build/qemu-aarch64 ./tests/tcg/aarch64-linux-user/sha512
+#  tcg-pin-bench.py -- build/qemu-x86_64 ./tests/tcg/x86_64-linux-user/sha512
+#
+#  The guest output of both modes is compared as well.  Pinning only pays
+#  off once the selection is made, after the first few thousand
+#  translations: benchmark programs that run for a while.
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import statistics
+import subprocess
+import sys
+import time
+
+
+def run(command, regs):
+    """
+    Run the command once with the given number of pinned registers.
+
+    Returns:
+    (float, bytes): Wall-clock time in seconds and guest output
+    """
+    qemu_command = [command[0], "-pin-regs", str(regs)] + command[1:]
+    start = time.perf_counter()
+    proc = subprocess.run(qemu_command,
+                          stdout=subprocess.PIPE,
+                          stderr=subprocess.PIPE)
+    elapsed = time.perf_counter() - start
+    if proc.returncode:
+        sys.exit(proc.stderr.decode("utf-8"))
+    return elapsed, proc.stdout
+
+
+def report(name, times):
+    print('{:<13}{:>10.3f}s{:>10.3f}s{:>10.3f}s'.
+          format(name, statistics.mean(times), min(times), max(times)))
+
+
+def main():
+    # Parse the command line arguments
+    parser = argparse.ArgumentParser(
+        usage='tcg-pin-bench.py [-h] [-r <regs>] [-n <runs>] -- '
+        '<qemu executable> [<qemu executable options>] '
+        '<target executable> [<target executable options>]')
+
+    parser.add_argument('-r', dest='regs', type=int, default=4,
+                        help='number of pinned registers')
+    parser.add_argument('-n', dest='runs', type=int, default=5,
+                        help='number of runs of each mode')
+    parser.add_argument('command', type=str, nargs='+', help=argparse.SUPPRESS)
+
+    args = parser.parse_args()
+
+    results = {}
+    for regs in (0, args.regs):
+        times = []
+        for _ in range(args.runs):
+            elapsed, output = run(args.command, regs)
+            times.append(elapsed)
+        results[regs] = (times, output)
+
+    print('{:<13}{:>11}{:>11}{:>11}'.format("", "mean", "min", "max"))
+    report("unpinned:", results[0][0])
+    report("pinned:", results[args.regs][0])
+    print('\nspeedup: {:.2f}x, outputs {}'.
+          format(statistics.mean(results[0][0]) /
+                 statistics.mean(results[args.regs][0]),
+                 "match" if results[0][1] == results[args.regs][1]
+                 else "differ"))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+
+#  Compare the wall-clock time of a linux-user command run without and
+#  with tiered translation of hot translation blocks.
+#
+#  Syntax:
+#  tcg-tier-bench.py [-h] [-t <threshold>] [-n <runs>] -- \
+#                    <qemu executable> [<qemu executable options>] \
+#                    <target executable> [<target executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-t] - Executions after which a block is retranslated (default 1000).
+#  [-n] - Number of runs of each mode (default 5).
+#
+#  Example of usage, on an Arm guest:
+#  tcg-tier-bench.py -- build/qemu-arm ./tests/tcg/arm-linux-user/sha512
+#
+#  The guest output of both modes is compared as well.  Only Arm guests
+#  translate the second tier differently from the first; elsewhere the
+#  script measures the cost of counting and retranslating alone.
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import statistics
+import subprocess
+import sys
+import time
+
+
+def run(command, threshold):
+    """
+    Run the command once with the given tiering threshold (0 for none).
+
+    Returns:
+    (float, bytes): Wall-clock time in seconds and guest output
+    """
+    qemu_command = [command[0], "-tier-threshold", str(threshold)] + \
+        command[1:]
+    start = time.perf_counter()
+    proc = subprocess.run(qemu_command,
+                          stdout=subprocess.PIPE,
+                          stderr=subprocess.PIPE)
+    elapsed = time.perf_counter() - start
+    if proc.returncode:
+        sys.exit(proc.stderr.decode("utf-8"))
+    return elapsed, proc.stdout
+
+
+def report(name, times):
+    print('{:<13}{:>10.3f}s{:>10.3f}s{:>10.3f}s'.
+          format(name, statistics.mean(times), min(times), max(times)))
+
+
+def main():
+    # Parse the command line arguments
+    parser = argparse.ArgumentParser(
+        usage='tcg-tier-bench.py [-h] [-t <threshold>] [-n <runs>] -- '
+        '<qemu executable> [<qemu executable options>] '
+        '<target executable> [<target executable options>]')
+
+    parser.add_argument('-t', dest='threshold', type=int, default=1000,
+                        help='executions after which a block is '
+                        'retranslated')
+    parser.add_argument('-n', dest='runs', type=int, default=5,
+                        help='number of runs of each mode')
+    parser.add_argument('command', type=str, nargs='+', help=argparse.SUPPRESS)
+
+    args = parser.parse_args()
+
+    results = {}
+    for threshold in (0, args.threshold):
+        times = []
+        for _ in range(args.runs):
+            elapsed, output = run(args.command, threshold)
+            times.append(elapsed)
+        results[threshold] = (times, output)
+
+    print('{:<13}{:>11}{:>11}{:>11}'.format("", "mean", "min", "max"))
+    report("one tier:", results[0][0])
+    report("tiered:", results[args.threshold][0])
+    print('\nspeedup: {:.2f}x, outputs {}'.
+          format(statistics.mean(results[0][0]) /
+                 statistics.mean(results[args.threshold][0]),
+                 "match" if results[0][1] == results[args.threshold][1]
+                 else "differ"))
+
+
+if __name__ == "__main__":
+    main()
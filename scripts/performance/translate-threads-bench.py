@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+
+#  Compare the wall-clock time of a linux-user command run with a single
+#  translating thread and with several vCPU threads translating in parallel.
+#
+#  Syntax:
+#  translate-threads-bench.py [-h] [-t <threads>] [-n <runs>] -- \
+#                             <qemu executable> [<qemu executable options>] \
+#                             <target executable> [<target executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-t] - Number of translating threads of the parallel mode (default 4).
+#  [-n] - Number of runs of each mode (default 5).
+#
+#  Example of usage:
+#  translate-threads-bench.py -t 8 -- build/qemu-aarch64 \
+#      ./tests/tcg/aarch64-linux-user/thread-cold-start
+#
+#  The guest output of both modes is compared as well.  Only the start-up
+#  of multi-threaded guests, while their threads run code that was never
+#  translated before, can get faster: benchmark programs of that kind.
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import statistics
+import subprocess
+import sys
+import time
+
+
+def run(command, threads):
+    """
+    Run the command once with the given number of translating threads.
+
+    Returns:
+    (float, bytes): Wall-clock time in seconds and guest output
+    """
+    qemu_command = [command[0], "-translate-threads", str(threads)] + \
+        command[1:]
+    start = time.perf_counter()
+    proc = subprocess.run(qemu_command,
+                          stdout=subprocess.PIPE,
+                          stderr=subprocess.PIPE)
+    elapsed = time.perf_counter() - start
+    if proc.returncode:
+        sys.exit(proc.stderr.decode("utf-8"))
+    return elapsed, proc.stdout
+
+
+def report(name, times):
+    print('{:<13}{:>10.3f}s{:>10.3f}s{:>10.3f}s'.
+          format(name, statistics.mean(times), min(times), max(times)))
+
+
+def main():
+    # Parse the command line arguments
+    parser = argparse.ArgumentParser(
+        usage='translate-threads-bench.py [-h] [-t <threads>] [-n <runs>] '
+        '-- <qemu executable> [<qemu executable options>] '
+        '<target executable> [<target executable options>]')
+
+    parser.add_argument('-t', dest='threads', type=int, default=4,
+                        help='number of translating threads')
+    parser.add_argument('-n', dest='runs', type=int, default=5,
+                        help='number of runs of each mode')
+    parser.add_argument('command', type=str, nargs='+', help=argparse.SUPPRESS)
+
+    args = parser.parse_args()
+
+    results = {}
+    for threads in (1, args.threads):
+        times = []
+        for _ in range(args.runs):
+            elapsed, output = run(args.command, threads)
+            times.append(elapsed)
+        results[threads] = (times, output)
+
+    print('{:<13}{:>11}{:>11}{:>11}'.format("", "mean", "min", "max"))
+    report("serial:", results[1][0])
+    report("parallel:", results[args.threads][0])
+    print('\nspeedup: {:.2f}x, outputs {}'.
+          format(statistics.mean(results[1][0]) /
+                 statistics.mean(results[args.threads][0]),
+                 "match" if results[1][1] == results[args.threads][1]
+                 else "differ"))
+
+
+if __name__ == "__main__":
+    main()
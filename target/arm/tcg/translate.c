@@ -6575,9 +6575,33 @@ static bool trans_CLRM(DisasContext *s, arg_CLRM *a)
  * Branch, branch with link
  */
 
+/*
+ * In a tier-2 TB, fold an unconditional branch forward within the page
+ * into the TB rather than ending it with gen_jmp().
+ */
+static bool arm_trace_jump(DisasContext *s, target_long diff)
+{
+    if (s->condjmp || s->condexec_mask || s->eci || s->ss_active ||
+        s->base.is_jmp != DISAS_NEXT ||
+        !translator_trace_jump(&s->base, s->pc_curr + diff)) {
+        return false;
+    }
+    if (!s->thumb) {
+        /* Redo the end-of-page bound of arm_tr_init_disas_context. */
+        int bound = -(s->base.pc_next | TARGET_PAGE_MASK) / 4;
+
+        s->base.max_insns = MIN(s->base.max_insns, s->base.num_insns + bound);
+    }
+    return true;
+}
+
 static bool trans_B(DisasContext *s, arg_i *a)
 {
-    gen_jmp(s, jmp_diff(s, a->imm));
+    target_long diff = jmp_diff(s, a->imm);
+
+    if (!arm_trace_jump(s, diff)) {
+        gen_jmp(s, diff);
+    }
     return true;
 }
 
@@ -6598,8 +6622,12 @@ static bool trans_B_cond_thumb(DisasContext *s, arg_ci *a)
 
 static bool trans_BL(DisasContext *s, arg_i *a)
 {
+    target_long diff = jmp_diff(s, a->imm);
+
     gen_pc_plus_diff(s, cpu_R[14], curr_insn_len(s) | s->thumb);
-    gen_jmp(s, jmp_diff(s, a->imm));
+    if (!arm_trace_jump(s, diff)) {
+        gen_jmp(s, diff);
+    }
     return true;
 }
 
@@ -172,5 +172,7 @@ typedef enum {
 #define TCG_TARGET_DEFAULT_MO (0)
 #define TCG_TARGET_NEED_LDST_LABELS
 #define TCG_TARGET_NEED_POOL_LABELS
+/* Callee-saved registers may hold globals across TBs. */
+#define TCG_TARGET_PIN_GLOBALS 1
 
 #endif /* AARCH64_TCG_TARGET_H */
@@ -249,5 +249,7 @@ typedef enum {
 #define TCG_TARGET_DEFAULT_MO (TCG_MO_ALL & ~TCG_MO_ST_LD)
 #define TCG_TARGET_NEED_LDST_LABELS
 #define TCG_TARGET_NEED_POOL_LABELS
+/* Callee-saved registers may hold globals across TBs. */
+#define TCG_TARGET_PIN_GLOBALS (TCG_TARGET_REG_BITS == 64)
 
 #endif
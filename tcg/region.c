@@ -29,6 +29,7 @@
 #include "qemu/memalign.h"
 #include "qemu/cacheinfo.h"
 #include "qemu/qtree.h"
+#include "qemu/bitmap.h"
 #include "qapi/error.h"
 #include "tcg/tcg.h"
 #include "exec/translation-block.h"
@@ -69,9 +70,20 @@ struct tcg_region_state {
     size_t stride; /* .size + guard size */
     size_t total_size; /* size of entire buffer, >= n * stride */
 
+    bool evict; /* recycle cold regions instead of flushing everything */
+
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+
+    /* eviction state, see tcg_region_evict(); arrays of .n entries */
+    unsigned long *free_map; /* evicted regions available for reuse */
+    size_t n_free;
+    uint64_t next_gen;
+    uint64_t *gen; /* allocation stamp, for age tie-breaks */
+    uint32_t *heat; /* decayed count of sampled hot TBs */
+    uint32_t *hits; /* samples since the last eviction pass */
+    size_t *used; /* contribution of each full region to agg_size_full */
 };
 
 static struct tcg_region_state region;
@@ -191,10 +203,9 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Return the index of the region containing @p, or -1 if none. */
+static ssize_t tc_ptr_to_region_idx(const void *p)
 {
-    size_t region_idx;
-
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -202,20 +213,28 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
     if (!in_code_gen_buffer(p)) {
         p -= tcg_splitwx_diff;
         if (!in_code_gen_buffer(p)) {
-            return NULL;
+            return -1;
         }
     }
 
     if (p < region.start_aligned) {
-        region_idx = 0;
+        return 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
+            return region.n - 1;
         }
+        return offset / region.stride;
+    }
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
+    ssize_t region_idx = tc_ptr_to_region_idx(p);
+
+    if (region_idx < 0) {
+        return NULL;
     }
     return region_trees + region_idx * tree_size;
 }
@@ -311,6 +330,13 @@ size_t tcg_nb_tbs(void)
     return nb_tbs;
 }
 
+static void tcg_region_tree_reset__locked(struct tcg_region_tree *rt)
+{
+    /* Increment the refcount first so that destroy acts as a reset */
+    q_tree_ref(rt->tree);
+    q_tree_destroy(rt->tree);
+}
+
 static void tcg_region_tree_reset_all(void)
 {
     size_t i;
@@ -319,9 +345,7 @@ static void tcg_region_tree_reset_all(void)
     for (i = 0; i < region.n; i++) {
         struct tcg_region_tree *rt = region_trees + i * tree_size;
 
-        /* Increment the refcount first so that destroy acts as a reset */
-        q_tree_ref(rt->tree);
-        q_tree_destroy(rt->tree);
+        tcg_region_tree_reset__locked(rt);
     }
     tcg_region_tree_unlock_all();
 }
@@ -359,11 +383,21 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t i;
+
+    if (region.current < region.n) {
+        i = region.current++;
+    } else if (region.n_free) {
+        /* recycle a region emptied by tcg_region_evict() */
+        i = find_first_bit(region.free_map, region.n);
+        clear_bit(i, region.free_map);
+        region.n_free--;
+    } else {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, i);
+    region.gen[i] = region.next_gen++;
+    region.heat[i] = 0;
     return false;
 }
 
@@ -377,10 +411,14 @@ bool tcg_region_alloc(TCGContext *s)
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
 
+    /* and which region is being retired, for tcg_region_evict() */
+    ssize_t full = tc_ptr_to_region_idx(s->code_gen_buffer);
+
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        region.used[full] = size_full - TCG_HIGHWATER;
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -403,6 +441,21 @@ void tcg_region_initial_alloc(TCGContext *s)
     qemu_mutex_unlock(&region.lock);
 }
 
+/*
+ * First region allocation of a context created after translation began
+ * (user-mode spare contexts): regions may have run out by then.
+ * Returns true on error.
+ */
+bool tcg_region_late_alloc(TCGContext *s)
+{
+    bool err;
+
+    qemu_mutex_lock(&region.lock);
+    err = tcg_region_alloc__locked(s);
+    qemu_mutex_unlock(&region.lock);
+    return err;
+}
+
 /* Call from a safe-work context */
 void tcg_region_reset_all(void)
 {
@@ -412,6 +465,10 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    bitmap_zero(region.free_map, region.n);
+    region.n_free = 0;
+    memset(region.used, 0, region.n * sizeof(*region.used));
+    memset(region.hits, 0, region.n * sizeof(*region.hits));
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -422,11 +479,137 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/*
+ * Incremental eviction.
+ *
+ * Once every region has been handed out, running out of space used to mean
+ * a full tb_flush: all translations are dropped and the working set is
+ * retranslated at once.  Instead, the TB maintenance code can recycle a
+ * few whole regions that no context is translating into.  Victims are the
+ * regions holding the fewest hot TBs, where "hot" is sampled from the vCPU
+ * jump caches before each pass and decays by half on every pass; among
+ * equally cold regions the oldest allocation goes first.  TBs are unlinked
+ * one by one by the caller, so the surviving regions keep their code and
+ * their chained jumps.
+ *
+ * Each pass recycles 1/TCG_REGION_EVICT_DIV of the regions.  Eviction needs
+ * spare regions beyond the contexts' current ones, so when it is enabled
+ * the buffer is split into at least TCG_REGION_EVICT_MIN regions (or twice
+ * the number of contexts), each no smaller than TCG_REGION_EVICT_MIN_SIZE.
+ */
+#define TCG_REGION_EVICT_DIV        8
+#define TCG_REGION_EVICT_MIN        8
+#define TCG_REGION_EVICT_MIN_SIZE   (256 * KiB)
+
+/* Call from a safe-work context */
+void tcg_region_sample(const void *tc_ptr)
+{
+    ssize_t i = tc_ptr_to_region_idx(tc_ptr);
+
+    if (i >= 0) {
+        region.hits[i]++;
+    }
+}
+
+/*
+ * Return true if a region can be allocated without evicting or flushing,
+ * e.g. because another vCPU already made room.
+ */
+bool tcg_region_available(void)
+{
+    bool ret;
+
+    qemu_mutex_lock(&region.lock);
+    ret = region.current < region.n || region.n_free;
+    qemu_mutex_unlock(&region.lock);
+    return ret;
+}
+
+/*
+ * Call from a safe-work context.
+ * @func is called on every TB of each victim region, with that region's
+ * tree locked; it must unlink the TB from everything that may refer to it.
+ * Returns the number of regions recycled; 0 means the caller has to flush.
+ */
+size_t tcg_region_evict(GTraverseFunc func, gpointer user_data)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    g_autofree unsigned long *skip = NULL;
+    g_autofree unsigned long *victims = NULL;
+    size_t want, n_victims = 0;
+    size_t i;
+
+    if (!region.evict) {
+        return 0;
+    }
+
+    skip = bitmap_new(region.n);
+    victims = bitmap_new(region.n);
+
+    qemu_mutex_lock(&region.lock);
+    /* Only full regions are candidates: not free, not in use by a context. */
+    bitmap_copy(skip, region.free_map, region.n);
+    bitmap_set(skip, region.current, region.n - region.current);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        set_bit(tc_ptr_to_region_idx(s->code_gen_buffer), skip);
+    }
+
+    for (i = 0; i < region.n; i++) {
+        region.heat[i] = region.heat[i] / 2 + region.hits[i];
+        region.hits[i] = 0;
+    }
+
+    want = MAX(1, region.n / TCG_REGION_EVICT_DIV);
+    while (n_victims < want) {
+        ssize_t v = -1;
+
+        for (i = 0; i < region.n; i++) {
+            if (test_bit(i, skip)) {
+                continue;
+            }
+            if (v < 0 || region.heat[i] < region.heat[v] ||
+                (region.heat[i] == region.heat[v] &&
+                 region.gen[i] < region.gen[v])) {
+                v = i;
+            }
+        }
+        if (v < 0) {
+            break;
+        }
+        set_bit(v, skip);
+        set_bit(v, victims);
+        n_victims++;
+    }
+    qemu_mutex_unlock(&region.lock);
+
+    /* Unlink the victims' TBs without region.lock: @func takes page locks. */
+    for (i = find_first_bit(victims, region.n); i < region.n;
+         i = find_next_bit(victims, region.n, i + 1)) {
+        struct tcg_region_tree *rt = region_trees + i * tree_size;
+
+        qemu_mutex_lock(&rt->lock);
+        q_tree_foreach(rt->tree, func, user_data);
+        tcg_region_tree_reset__locked(rt);
+        qemu_mutex_unlock(&rt->lock);
+    }
+
+    qemu_mutex_lock(&region.lock);
+    for (i = find_first_bit(victims, region.n); i < region.n;
+         i = find_next_bit(victims, region.n, i + 1)) {
+        region.agg_size_full -= region.used[i];
+        region.used[i] = 0;
+        set_bit(i, region.free_map);
+        region.n_free++;
+    }
+    qemu_mutex_unlock(&region.lock);
+
+    return n_victims;
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
-#ifdef CONFIG_USER_ONLY
-    return 1;
-#else
     size_t n_regions;
 
     /*
@@ -436,9 +619,15 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
      * dividing the code_gen_buffer among the vCPUs.
      */
     /* Use a single region if all we have is one vCPU thread */
+#ifdef CONFIG_USER_ONLY
+    if (max_cpus == 1) {
+        return 1;
+    }
+#else
     if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
         return 1;
     }
+#endif
 
     /*
      * Try to have more regions than max_cpus, with each region being >= 2 MB.
@@ -449,7 +638,6 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
         return max_cpus;
     }
     return MIN(n_regions, max_cpus * 8);
-#endif
 }
 
 /*
@@ -737,19 +925,22 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
  *
- * In user-mode we use a single region.  Having multiple regions in user-mode
- * is not supported, because the number of vCPU threads (recall that each thread
- * spawned by the guest corresponds to a vCPU thread) is only bounded by the
- * OS, and usually this number is huge (tens of thousands is not uncommon).
- * Thus, given this large bound on the number of vCPU threads and the fact
- * that code_gen_buffer is allocated at compile-time, we cannot guarantee
- * that the availability of at least one region per vCPU thread.
+ * In user-mode regions are not assigned to vCPU threads, because the number
+ * of vCPU threads (recall that each thread spawned by the guest corresponds
+ * to a vCPU thread) is only bounded by the OS, and usually this number is
+ * huge (tens of thousands is not uncommon).  Instead, @max_cpus is the number
+ * of contexts: the one shared by all threads under mmap_lock, plus spares
+ * that vCPU threads borrow to translate in parallel while another thread
+ * holds the lock (see tcg_ctx_borrow()).  Multi-threaded guests share most
+ * of their translated code, but their start-up translates a lot at once.
  *
- * However, this user-mode limitation is unlikely to be a significant problem
- * in practice. Multi-threaded guests share most if not all of their translated
- * code, which makes parallel code generation less appealing than in system-mode
+ * With @evict, the buffer is split into more regions than there are contexts
+ * (see TCG_REGION_EVICT_MIN), in user-mode too: the shared context
+ * then fills them one after the other, and a full buffer is handled by
+ * recycling cold regions rather than by flushing.
  */
-void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus,
+                     bool evict)
 {
     const size_t page_size = qemu_real_host_page_size();
     size_t region_size;
@@ -788,6 +979,13 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
      * the buffer; we will assign those to the last region.
      */
     region.n = tcg_n_regions(tb_size, max_cpus);
+    if (evict) {
+        size_t n_evict = MAX(TCG_REGION_EVICT_MIN, 2 * max_cpus);
+
+        n_evict = MIN(n_evict, tb_size / TCG_REGION_EVICT_MIN_SIZE);
+        region.n = MAX(region.n, n_evict);
+    }
+    region.evict = evict && region.n > 1;
     region_size = tb_size / region.n;
     region_size = QEMU_ALIGN_DOWN(region_size, page_size);
 
@@ -808,6 +1006,11 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.free_map = bitmap_new(region.n);
+    region.gen = g_new0(uint64_t, region.n);
+    region.heat = g_new0(uint32_t, region.n);
+    region.hits = g_new0(uint32_t, region.n);
+    region.used = g_new0(size_t, region.n);
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
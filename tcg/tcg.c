@@ -761,13 +761,39 @@ QEMU_BUILD_BUG_ON((int)(offsetof(CPUNegativeOffsetState, tlb.f[0]) -
                   < MIN_TLB_MASK_TABLE_OFS);
 #endif
 
+/* Copy tcg_init_ctx, once the target's TCG globals are registered. */
+static TCGContext *tcg_context_clone(void)
+{
+    TCGContext *s = g_malloc(sizeof(*s));
+    unsigned int i, n;
+
+    *s = tcg_init_ctx;
+
+    /* Relink mem_base.  */
+    for (i = 0, n = tcg_init_ctx.nb_globals; i < n; ++i) {
+        if (tcg_init_ctx.temps[i].mem_base) {
+            ptrdiff_t b = tcg_init_ctx.temps[i].mem_base - tcg_init_ctx.temps;
+            tcg_debug_assert(b >= 0 && b < n);
+            s->temps[i].mem_base = &s->temps[b];
+        }
+    }
+
+    /* What previous translations allocated belongs to tcg_init_ctx. */
+    s->pool_cur = s->pool_end = NULL;
+    s->pool_first = s->pool_current = s->pool_first_large = NULL;
+    memset(s->const_table, 0, sizeof(s->const_table));
+    s->plugin_tb = NULL;
+    return s;
+}
+
 /*
  * All TCG threads except the parent (i.e. the one that called tcg_context_init
  * and registered the target's TCG globals) must register with this function
  * before initiating translation.
  *
  * In user-mode we just point tcg_ctx to tcg_init_ctx. See the documentation
- * of tcg_region_init() for the reasoning behind this.
+ * of tcg_region_init() for the reasoning behind this, and tcg_ctx_borrow()
+ * for the spare contexts used to translate in parallel.
  *
  * In system-mode each caller registers its context in tcg_ctxs[]. Note that in
  * system-mode tcg_ctxs[] does not track tcg_ctx_init, since the initial context
@@ -778,26 +804,99 @@ QEMU_BUILD_BUG_ON((int)(offsetof(CPUNegativeOffsetState, tlb.f[0]) -
  * modes.
  */
 #ifdef CONFIG_USER_ONLY
+/* Bit i is set when tcg_ctxs[i] is a spare context free for borrowing. */
+static unsigned long tcg_spare_free;
+/* The spares still have to be created, see tcg_spare_init(). */
+static bool tcg_spare_due;
+/* Index in tcg_ctxs[] of the spare borrowed by this thread, or 0. */
+static __thread unsigned int tcg_spare_borrowed;
+
 void tcg_register_thread(void)
 {
     tcg_ctx = &tcg_init_ctx;
+
+    /* A second thread: it is worth having spares from now on. */
+    if (tcg_max_ctxs > 1) {
+        qatomic_set(&tcg_spare_due, true);
+    }
 }
-#else
-void tcg_register_thread(void)
+
+/*
+ * Called with mmap_lock held, so that tcg_init_ctx is not in use and
+ * that no flush or eviction walks tcg_ctxs[] meanwhile.
+ */
+static void tcg_spare_init(void)
 {
-    TCGContext *s = g_malloc(sizeof(*s));
-    unsigned int i, n;
+    while (tcg_cur_ctxs < tcg_max_ctxs) {
+        unsigned int n = tcg_cur_ctxs;
+        TCGContext *s;
 
-    *s = tcg_init_ctx;
+        /* Without a free region, try again after the next flush. */
+        if (!tcg_region_available()) {
+            return;
+        }
+        s = tcg_context_clone();
+        if (tcg_region_late_alloc(s)) {
+            g_free(s);
+            return;
+        }
+        qatomic_set(&tcg_ctxs[n], s);
+        qatomic_set(&tcg_cur_ctxs, n + 1);
+        qatomic_or(&tcg_spare_free, 1ul << n);
+    }
+    qatomic_set(&tcg_spare_due, false);
+}
 
-    /* Relink mem_base.  */
-    for (i = 0, n = tcg_init_ctx.nb_globals; i < n; ++i) {
-        if (tcg_init_ctx.temps[i].mem_base) {
-            ptrdiff_t b = tcg_init_ctx.temps[i].mem_base - tcg_init_ctx.temps;
-            tcg_debug_assert(b >= 0 && b < n);
-            s->temps[i].mem_base = &s->temps[b];
+/*
+ * User-mode threads are not bounded in number, so they do not own a
+ * context: they share tcg_init_ctx under mmap_lock.  A vCPU thread about
+ * to translate may instead borrow one of the tcg_max_ctxs - 1 spare
+ * contexts, each with a region of its own, and drop mmap_lock while it
+ * generates code; see tb_gen_code().
+ *
+ * Called with mmap_lock held.  Returns false if no spare is free, in
+ * which case tcg_ctx is still tcg_init_ctx.
+ */
+bool tcg_ctx_borrow(void)
+{
+    unsigned long free;
+    unsigned int i;
+
+    tcg_debug_assert(tcg_spare_borrowed == 0);
+    if (unlikely(qatomic_read(&tcg_spare_due))) {
+        tcg_spare_init();
+    }
+
+    do {
+        free = qatomic_read(&tcg_spare_free);
+        if (free == 0) {
+            return false;
         }
+        i = ctzl(free);
+    } while (qatomic_cmpxchg(&tcg_spare_free, free, free & ~(1ul << i))
+             != free);
+
+    tcg_spare_borrowed = i;
+    tcg_ctx = tcg_ctxs[i];
+    return true;
+}
+
+/* Give back the spare context borrowed by this thread, if any. */
+void tcg_ctx_return(void)
+{
+    unsigned int i = tcg_spare_borrowed;
+
+    if (i) {
+        tcg_spare_borrowed = 0;
+        tcg_ctx = &tcg_init_ctx;
+        qatomic_or(&tcg_spare_free, 1ul << i);
     }
+}
+#else
+void tcg_register_thread(void)
+{
+    TCGContext *s = tcg_context_clone();
+    unsigned int n;
 
     /* Claim an entry in tcg_ctxs */
     n = qatomic_fetch_inc(&tcg_cur_ctxs);
@@ -1353,18 +1452,17 @@ static void tcg_context_init(unsigned max_cpus)
 
     tcg_ctx = s;
     /*
-     * In user-mode we simply share the init context among threads, since we
-     * use a single region. See the documentation tcg_region_init() for the
-     * reasoning behind this.
+     * In user-mode we share the init context among threads, plus up to
+     * max_cpus - 1 spare contexts used for parallel translation. See the
+     * documentation of tcg_region_init() and tcg_ctx_borrow().
      * In system-mode we will have at most max_cpus TCG threads.
      */
-#ifdef CONFIG_USER_ONLY
-    tcg_ctxs = &tcg_ctx;
-    tcg_cur_ctxs = 1;
-    tcg_max_ctxs = 1;
-#else
     tcg_max_ctxs = max_cpus;
     tcg_ctxs = g_new0(TCGContext *, max_cpus);
+#ifdef CONFIG_USER_ONLY
+    g_assert(max_cpus <= TCG_USER_MAX_CTXS);
+    tcg_ctxs[0] = s;
+    tcg_cur_ctxs = 1;
 #endif
 
     tcg_debug_assert(!tcg_regset_test_reg(s->reserved_regs, TCG_AREG0));
@@ -1372,10 +1470,10 @@ static void tcg_context_init(unsigned max_cpus)
     tcg_env = temp_tcgv_ptr(ts);
 }
 
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus, bool evict)
 {
     tcg_context_init(max_cpus);
-    tcg_region_init(tb_size, splitwx, max_cpus);
+    tcg_region_init(tb_size, splitwx, max_cpus, evict);
 }
 
 /*
@@ -1483,8 +1581,219 @@ void tcg_prologue_init(void)
     tcg_region_prologue_set(s);
 }
 
+/*
+ * Globals pinned in host registers across TBs (-accel tcg,pin-regs=N).
+ *
+ * The uses of each global are counted over the first TCG_PIN_WARMUP
+ * translations.  The execution loop then calls tcg_pin_select() in an
+ * exclusive context and flushes the TBs; from the next translation on,
+ * each context keeps the most used globals in callee-saved registers
+ * taken out of the allocatable set.
+ *
+ * A pinned global remains a TEMP_GLOBAL backed by env: every write is
+ * still synced at the end of the basic block, but the value is also
+ * left in its register there (see temp_pin()).  A TB entered from the
+ * execution loop loads the pinned registers from env first; chained
+ * jumps and goto_ptr enter past these loads (tb->warm_offset).  Helpers
+ * that may write globals only drop the register until the next end of
+ * basic block, like any other global.
+ */
+#ifndef TCG_TARGET_PIN_GLOBALS
+#define TCG_TARGET_PIN_GLOBALS 0
+#endif
+
+#define TCG_PIN_WARMUP      2048
+/* Callee-saved registers left to the allocator for values across calls. */
+#define TCG_PIN_SPARE_REGS  2
+
+enum {
+    TCG_PIN_OFF,
+    TCG_PIN_PROFILE,
+    TCG_PIN_DUE,
+    TCG_PIN_SELECT,
+    TCG_PIN_DONE,
+};
+
+static struct {
+    unsigned max;
+    int state;
+    unsigned translations;
+    unsigned generation;
+    int n;
+    unsigned share;            /* percentage of the uses of globals */
+    uint16_t index[TCG_MAX_PINNED];
+    TCGReg reg[TCG_MAX_PINNED];
+} tcg_pin;
+
+void tcg_pin_init(unsigned max)
+{
+    if (TCG_TARGET_PIN_GLOBALS && max) {
+        tcg_pin.max = MIN(max, TCG_MAX_PINNED);
+        tcg_pin.state = TCG_PIN_PROFILE;
+    }
+}
+
+static void tcg_pin_profile(TCGContext *s)
+{
+    TCGOp *op;
+
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        const TCGOpDef *def = &tcg_op_defs[op->opc];
+        int nb_args;
+
+        if (op->opc == INDEX_op_call) {
+            nb_args = TCGOP_CALLO(op) + TCGOP_CALLI(op);
+        } else {
+            nb_args = def->nb_oargs + def->nb_iargs;
+        }
+        for (int i = 0; i < nb_args; i++) {
+            TCGTemp *ts = arg_temp(op->args[i]);
+
+            if (ts && ts->kind == TEMP_GLOBAL) {
+                s->pin_uses[temp_idx(ts)]++;
+            }
+        }
+    }
+
+    if (qatomic_fetch_inc(&tcg_pin.translations) == TCG_PIN_WARMUP - 1) {
+        qatomic_set(&tcg_pin.state, TCG_PIN_DUE);
+    }
+}
+
+/* Return true, to a single caller, once the profile is complete. */
+bool tcg_pin_due(void)
+{
+    return qatomic_read(&tcg_pin.state) == TCG_PIN_DUE &&
+           qatomic_cmpxchg(&tcg_pin.state, TCG_PIN_DUE,
+                           TCG_PIN_SELECT) == TCG_PIN_DUE;
+}
+
+static bool tcg_pin_eligible(const TCGTemp *ts)
+{
+    /* Neither indirect nor split into two host registers. */
+    return ts->kind == TEMP_GLOBAL &&
+           ts->base_type == ts->type &&
+           (ts->type == TCG_TYPE_I32 || ts->type == TCG_TYPE_I64) &&
+           ts->mem_base->kind == TEMP_FIXED;
+}
+
+/*
+ * Pick the most used globals and their registers.  Must be called in an
+ * exclusive context, and be followed by a flush: chained TBs must agree
+ * on which global lives in which register.
+ */
+void tcg_pin_select(void)
+{
+    const TCGContext *s0 = &tcg_init_ctx;
+    unsigned n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    g_autofree uint64_t *uses = g_new0(uint64_t, s0->nb_globals);
+    TCGRegSet reserved = s0->reserved_regs & ~s0->pin_regs;
+    TCGReg regs[TCG_TARGET_NB_REGS];
+    uint64_t total = 0, pinned = 0;
+    int n_regs = 0, n = 0;
+
+    for (unsigned c = 0; c < n_ctxs; c++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[c]);
+
+        for (int i = 0; i < s0->nb_globals; i++) {
+            uses[i] += s->pin_uses[i];
+            total += s->pin_uses[i];
+        }
+    }
+
+    /* The allocator picks registers in order: take the last ones. */
+    for (int i = ARRAY_SIZE(tcg_target_reg_alloc_order) - 1; i >= 0; i--) {
+        TCGReg reg = tcg_target_reg_alloc_order[i];
+
+        if (tcg_regset_test_reg(tcg_target_available_regs[TCG_TYPE_I64],
+                                reg) &&
+            !tcg_regset_test_reg(tcg_target_call_clobber_regs, reg) &&
+            !tcg_regset_test_reg(reserved, reg)) {
+            regs[n_regs++] = reg;
+        }
+    }
+    n_regs = MIN(n_regs - TCG_PIN_SPARE_REGS, (int)tcg_pin.max);
+
+    while (n < n_regs) {
+        int best = -1;
+
+        for (int i = 0; i < s0->nb_globals; i++) {
+            if (uses[i] && tcg_pin_eligible(&s0->temps[i]) &&
+                (best < 0 || uses[i] > uses[best])) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        tcg_pin.index[n] = best;
+        tcg_pin.reg[n] = regs[n];
+        n++;
+        pinned += uses[best];
+        uses[best] = 0;
+    }
+    tcg_pin.n = n;
+    tcg_pin.share = total ? pinned * 100 / total : 0;
+
+    qatomic_set(&tcg_pin.state, TCG_PIN_DONE);
+    qatomic_store_release(&tcg_pin.generation, tcg_pin.generation + 1);
+}
+
+/* Switch @s to the current selection of tcg_pin_select(). */
+static void tcg_pin_apply(TCGContext *s, unsigned generation)
+{
+    for (int i = 0; i < s->nb_pinned; i++) {
+        s->temps[s->pin_temps[i]].pinned = 0;
+    }
+    s->reserved_regs &= ~s->pin_regs;
+    s->pin_regs = 0;
+
+    s->nb_pinned = tcg_pin.n;
+    for (int i = 0; i < tcg_pin.n; i++) {
+        TCGTemp *ts = &s->temps[tcg_pin.index[i]];
+
+        ts->pinned = 1;
+        ts->pin_reg = tcg_pin.reg[i];
+        s->pin_temps[i] = tcg_pin.index[i];
+        tcg_regset_set_reg(s->pin_regs, ts->pin_reg);
+    }
+    s->reserved_regs |= s->pin_regs;
+    s->pin_generation = generation;
+}
+
+void tcg_pin_dump_info(GString *buf)
+{
+    switch (qatomic_read(&tcg_pin.state)) {
+    case TCG_PIN_OFF:
+        return;
+    case TCG_PIN_DONE:
+        break;
+    default:
+        g_string_append_printf(buf, "Pinned globals      profiling, "
+                               "%u/%u TBs\n",
+                               qatomic_read(&tcg_pin.translations),
+                               TCG_PIN_WARMUP);
+        return;
+    }
+
+    g_string_append_printf(buf, "Pinned globals      %d (%u%% of uses)",
+                           tcg_pin.n, tcg_pin.share);
+    for (int i = 0; i < tcg_pin.n; i++) {
+        g_string_append_printf(buf, " %s:r%d",
+                               tcg_init_ctx.temps[tcg_pin.index[i]].name,
+                               tcg_pin.reg[i]);
+    }
+    g_string_append_c(buf, '\n');
+}
+
 void tcg_func_start(TCGContext *s)
 {
+    unsigned pin_generation = qatomic_load_acquire(&tcg_pin.generation);
+
+    if (unlikely(s->pin_generation != pin_generation)) {
+        tcg_pin_apply(s, pin_generation);
+    }
+
     tcg_pool_reset(s);
     s->nb_temps = s->nb_globals;
 
@@ -2415,6 +2724,16 @@ static void tcg_reg_alloc_start(TCGContext *s)
     }
 
     memset(s->reg_to_temp, 0, sizeof(s->reg_to_temp));
+
+    /* Loaded at the cold entry of the TB, or passed by the previous TB. */
+    for (i = 0; i < s->nb_pinned; i++) {
+        TCGTemp *ts = &s->temps[s->pin_temps[i]];
+
+        ts->val_type = TEMP_VAL_REG;
+        ts->reg = ts->pin_reg;
+        ts->mem_coherent = 1;
+        s->reg_to_temp[ts->reg] = ts;
+    }
 }
 
 static char *tcg_get_arg_str_ptr(TCGContext *s, char *buf, int buf_size,
@@ -3399,13 +3718,13 @@ static inline void la_reset_pref(TCGTemp *ts)
 }
 
 /* liveness analysis: end of function: all temps are dead, and globals
-   should be in memory. */
+   should be in memory.  Pinned globals also stay live in their register. */
 static void la_func_end(TCGContext *s, int ng, int nt)
 {
     int i;
 
     for (i = 0; i < ng; ++i) {
-        s->temps[i].state = TS_DEAD | TS_MEM;
+        s->temps[i].state = s->temps[i].pinned ? TS_MEM : TS_DEAD | TS_MEM;
         la_reset_pref(&s->temps[i]);
     }
     for (i = ng; i < nt; ++i) {
@@ -3425,8 +3744,10 @@ static void la_bb_end(TCGContext *s, int ng, int nt)
         int state;
 
         switch (ts->kind) {
-        case TEMP_FIXED:
         case TEMP_GLOBAL:
+            state = ts->pinned ? TS_MEM : TS_DEAD | TS_MEM;
+            break;
+        case TEMP_FIXED:
         case TEMP_TB:
             state = TS_DEAD | TS_MEM;
             break;
@@ -3466,6 +3787,14 @@ static void la_bb_sync(TCGContext *s, int ng, int nt)
 {
     la_global_sync(s, ng);
 
+    /* The branch target expects pinned globals in their register. */
+    for (int i = 0; i < ng; ++i) {
+        if (s->temps[i].pinned && (s->temps[i].state & TS_DEAD)) {
+            s->temps[i].state = TS_MEM;
+            la_reset_pref(&s->temps[i]);
+        }
+    }
+
     for (int i = ng; i < nt; ++i) {
         TCGTemp *ts = &s->temps[i];
         int state;
@@ -4482,9 +4811,105 @@ static void temp_save(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs)
 {
     /* The liveness analysis already ensures that globals are back
        in memory. Keep an tcg_debug_assert for safety. */
+    if (ts->pinned) {
+        /* Still in its register if unused so far; temp_pin() restores it. */
+        tcg_debug_assert(ts->val_type == TEMP_VAL_MEM || ts->mem_coherent);
+        temp_free_or_dead(s, ts, -1);
+        return;
+    }
     tcg_debug_assert(ts->val_type == TEMP_VAL_MEM || temp_readonly(ts));
 }
 
+/*
+ * Put a pinned global back in its register, where the code after the
+ * end of the basic block, or the TB chained by goto_tb, expects it.
+ * The liveness analysis already ensures that memory is coherent.
+ */
+static void temp_pin(TCGContext *s, TCGTemp *ts)
+{
+    TCGReg reg = ts->pin_reg;
+
+    tcg_debug_assert(ts->val_type == TEMP_VAL_MEM || ts->mem_coherent);
+    switch (ts->val_type) {
+    case TEMP_VAL_REG:
+        if (ts->reg == reg) {
+            return;
+        }
+        tcg_out_mov(s, ts->type, reg, ts->reg);
+        break;
+    case TEMP_VAL_CONST:
+        tcg_out_movi(s, ts->type, reg, ts->val);
+        break;
+    case TEMP_VAL_MEM:
+        tcg_out_ld(s, ts->type, reg, ts->mem_base->reg, ts->mem_offset);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    set_temp_val_reg(s, ts, reg);
+    ts->mem_coherent = 1;
+}
+
+static void pin_globals(TCGContext *s)
+{
+    for (int i = 0; i < s->nb_pinned; i++) {
+        temp_pin(s, &s->temps[s->pin_temps[i]]);
+    }
+}
+
+/*
+ * A host store may overwrite the env slot of a pinned global, which then
+ * has to be reloaded.  Stores relative to env are checked precisely; the
+ * env slots are out of reach of other fixed bases, and any other base is
+ * assumed to alias.
+ */
+static void pin_clobber(TCGContext *s, const TCGOp *op,
+                        TCGRegSet allocated_regs)
+{
+    TCGTemp *base;
+    intptr_t ofs, size;
+
+    switch (op->opc) {
+    case INDEX_op_st8_i32:
+    case INDEX_op_st8_i64:
+        size = 1;
+        break;
+    case INDEX_op_st16_i32:
+    case INDEX_op_st16_i64:
+        size = 2;
+        break;
+    case INDEX_op_st_i32:
+    case INDEX_op_st32_i64:
+        size = 4;
+        break;
+    case INDEX_op_st_i64:
+        size = 8;
+        break;
+    case INDEX_op_st_vec:
+        size = 8 << TCGOP_VECL(op);
+        break;
+    default:
+        return;
+    }
+
+    base = arg_temp(op->args[1]);
+    ofs = op->args[2];
+    for (int i = 0; i < s->nb_pinned; i++) {
+        TCGTemp *ts = &s->temps[s->pin_temps[i]];
+
+        if (ts->val_type == TEMP_VAL_MEM) {
+            continue;
+        }
+        if (base->kind == TEMP_FIXED &&
+            (base != ts->mem_base ||
+             ofs >= ts->mem_offset + tcg_type_size(ts->type) ||
+             ofs + size <= ts->mem_offset)) {
+            continue;
+        }
+        temp_sync(s, ts, allocated_regs, 0, -1);
+    }
+}
+
 /* save globals to their canonical location and assume they can be
    modified be the following code. 'allocated_regs' is used in case a
    temporary registers needs to be allocated to store a constant. */
@@ -4513,7 +4938,8 @@ static void sync_globals(TCGContext *s, TCGRegSet allocated_regs)
 }
 
 /* at the end of a basic block, we assume all temporaries are dead and
-   all globals are stored at their canonical location. */
+   all globals are stored at their canonical location; pinned globals
+   are also in their register. */
 static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
 {
     int i;
@@ -4539,7 +4965,15 @@ static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
         }
     }
 
-    save_globals(s, allocated_regs);
+    for (i = 0; i < s->nb_globals; i++) {
+        TCGTemp *ts = &s->temps[i];
+
+        if (ts->pinned) {
+            temp_pin(s, ts);
+        } else {
+            temp_save(s, ts, allocated_regs);
+        }
+    }
 }
 
 /*
@@ -4550,6 +4984,7 @@ static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
 static void tcg_reg_alloc_cbranch(TCGContext *s, TCGRegSet allocated_regs)
 {
     sync_globals(s, allocated_regs);
+    pin_globals(s);
 
     for (int i = s->nb_globals; i < s->nb_temps; i++) {
         TCGTemp *ts = &s->temps[i];
@@ -4650,7 +5085,8 @@ static void tcg_reg_alloc_mov(TCGContext *s, const TCGOp *op)
         return;
     }
 
-    if (IS_DEAD_ARG(1) && ts->kind != TEMP_FIXED) {
+    if (IS_DEAD_ARG(1) && ts->kind != TEMP_FIXED &&
+        !(ts->pinned && ireg == ts->pin_reg)) {
         /*
          * The mov can be suppressed.  Kill input first, so that it
          * is unlinked from reg_to_temp, then set the output to the
@@ -5140,6 +5576,10 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
         }
     }
 
+    if (unlikely(s->nb_pinned)) {
+        pin_clobber(s, op, i_allocated_regs);
+    }
+
     /* emit instruction */
     switch (op->opc) {
     case INDEX_op_ext8s_i32:
@@ -6129,6 +6569,9 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
     tcg_optimize(s);
 
     reachable_code_pass(s);
+    if (unlikely(qatomic_read(&tcg_pin.state) == TCG_PIN_PROFILE)) {
+        tcg_pin_profile(s);
+    }
     liveness_pass_0(s);
     liveness_pass_1(s);
 
@@ -6192,6 +6635,18 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
 
     tcg_out_tb_start(s);
 
+    /* Cold entry: load the pinned globals.  Chained jumps skip it. */
+    tb->warm_offset = 0;
+    if (s->nb_pinned) {
+        for (i = 0; i < s->nb_pinned; i++) {
+            TCGTemp *ts = &s->temps[s->pin_temps[i]];
+            tcg_out_ld(s, ts->type, ts->pin_reg,
+                       ts->mem_base->reg, ts->mem_offset);
+        }
+        tb->warm_offset = tcg_current_code_size(s);
+        tcg_out_tb_start(s);
+    }
+
     num_insns = -1;
     QTAILQ_FOREACH(op, &s->ops, link) {
         TCGOpcode opc = op->opc;
@@ -6232,6 +6687,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
             tcg_out_exit_tb(s, op->args[0]);
             break;
         case INDEX_op_goto_tb:
+            pin_globals(s);
             tcg_out_goto_tb(s, op->args[0]);
             break;
         case INDEX_op_dup2_vec:
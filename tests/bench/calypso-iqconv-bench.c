@@ -0,0 +1,86 @@
+/*
+ * Calypso BSP I/Q conversion stage speed benchmark
+ *
+ * Mesure, pour chaque implementation (avx2, sse2, scalaire), le cout par
+ * burst des etages de hw/arm/calypso/calypso_iqconv.c sur un burst SB
+ * (190 complexes) : synthese GMSK, suppression DC, rotation AFC, mise en
+ * mots DSP. Le cout par burst ne depend que de la longueur du burst, pas du
+ * nombre d'ARFCN nourris.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "hw/arm/calypso/calypso_iqconv.h"
+
+#define BURST_CPLX  190
+
+static const char *const stage_names[] = {
+    "gmsk", "dc_remove", "rotate", "pack",
+};
+
+static void run_stage(int stage, int16_t *iq, uint16_t *words,
+                      const uint8_t *bits, uint32_t fn)
+{
+    unsigned phase = 0;
+
+    switch (stage) {
+    case 0:
+        calypso_iq_gmsk(iq, bits, BURST_CPLX, &phase);
+        break;
+    case 1:
+        calypso_iq_dc_remove(iq, BURST_CPLX);
+        break;
+    case 2:
+        /* Meme pas et meme reference de phase (fn x 1250) que l'AFC TWL3025. */
+        calypso_iq_rotate(iq, BURST_CPLX, -1.3e-3 * fn * 1250.0, -1.3e-3);
+        break;
+    case 3:
+        calypso_iq_pack(words, iq, 2 * BURST_CPLX, 0);
+        break;
+    }
+}
+
+static void test(const void *opaque)
+{
+    int16_t iq[2 * BURST_CPLX];
+    uint16_t words[2 * BURST_CPLX];
+    uint8_t bits[BURST_CPLX];
+    int accel_index = 0;
+
+    for (int i = 0; i < BURST_CPLX; i++) {
+        bits[i] = g_test_rand_bit();
+    }
+
+    do {
+        if (accel_index != 0) {
+            g_test_message("%s", "");  /* gnu_printf Werror for simple "" */
+        }
+        for (int stage = 0; stage < ARRAY_SIZE(stage_names); stage++) {
+            uint64_t bursts = 0;
+
+            for (int i = 0; i < 2 * BURST_CPLX; i++) {
+                iq[i] = g_test_rand_int_range(-20000, 20000);
+            }
+            g_test_timer_start();
+            do {
+                run_stage(stage, iq, words, bits, bursts);
+                bursts++;
+            } while (g_test_timer_elapsed() < 0.5);
+
+            g_test_message("calypso_iq #%d %-8s %-9s %8.1f ns/burst",
+                           accel_index, calypso_iqconv_accel_name(),
+                           stage_names[stage],
+                           g_test_timer_last() * 1e9 / bursts);
+        }
+        accel_index++;
+    } while (test_calypso_iqconv_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_data_func("/calypso/iqconv/speed", NULL, test);
+    return g_test_run();
+}
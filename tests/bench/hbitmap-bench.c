@@ -0,0 +1,121 @@
+/*
+ * Scans an HBitmap the way block jobs do, with hbitmap_next_dirty_area()
+ *
+ * The bitmap covers a large disk at a small granularity, as for
+ * incremental backup of a multi-TB image, and is filled with a few
+ * typical patterns before each run.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/hbitmap.h"
+#include "qemu/host-utils.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+
+typedef struct BenchPattern {
+    const char *name;
+    /* Dirty runs of @run bytes every @period bytes; @run == 0: all dirty */
+    uint64_t run;
+    uint64_t period;
+    /* Largest area returned by one call, like block-copy chunks */
+    int64_t max_area;
+} BenchPattern;
+
+static const BenchPattern patterns[] = {
+    { "all dirty, one area",       0,         0,         INT64_MAX },
+    { "all dirty, 64 MiB areas",   0,         0,         64 * MiB },
+    { "1 GiB runs every 2 GiB",    GiB,       2 * GiB,   INT64_MAX },
+    { "64 KiB runs every 16 MiB",  64 * KiB,  16 * MiB,  INT64_MAX },
+};
+
+static uint64_t disk_size = 2 * TiB;
+static uint32_t granularity = 64 * KiB;
+static unsigned int passes = 10;
+
+static void fill(HBitmap *hb, const BenchPattern *p)
+{
+    hbitmap_reset_all(hb);
+    if (!p->run) {
+        hbitmap_set(hb, 0, disk_size);
+        return;
+    }
+    for (uint64_t off = 0; off < disk_size; off += p->period) {
+        hbitmap_set(hb, off, MIN(p->run, disk_size - off));
+    }
+}
+
+static uint64_t scan(HBitmap *hb, const BenchPattern *p)
+{
+    int64_t offset = 0, area_start, area_bytes;
+    uint64_t dirty = 0;
+
+    while (hbitmap_next_dirty_area(hb, offset, disk_size, p->max_area,
+                                   &area_start, &area_bytes)) {
+        dirty += area_bytes;
+        offset = area_start + area_bytes;
+    }
+    return dirty;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [-s disk_size_in_GiB] [-g granularity] [-n passes]\n",
+           name);
+}
+
+int main(int argc, char **argv)
+{
+    HBitmap *hb;
+    int c;
+
+    while ((c = getopt(argc, argv, "hs:g:n:")) != -1) {
+        switch (c) {
+        case 's':
+            disk_size = (uint64_t)atoll(optarg) * GiB;
+            break;
+        case 'g':
+            granularity = atoi(optarg);
+            break;
+        case 'n':
+            passes = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (disk_size == 0 || passes == 0 || !is_power_of_2(granularity)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    hb = hbitmap_alloc(disk_size, ctz32(granularity));
+    printf("%" PRIu64 " GiB disk, granularity %" PRIu32 ", %u passes\n",
+           disk_size / GiB, granularity, passes);
+
+    for (int i = 0; i < ARRAY_SIZE(patterns); i++) {
+        const BenchPattern *p = &patterns[i];
+        uint64_t dirty = 0;
+        int64_t start;
+        double secs;
+
+        fill(hb, p);
+        start = get_clock();
+        for (unsigned int n = 0; n < passes; n++) {
+            dirty = scan(hb, p);
+        }
+        secs = (double)(get_clock() - start) / NANOSECONDS_PER_SECOND;
+
+        printf("%-26s %8.3f ms/pass %10.1f TiB/s  (%" PRIu64 " GiB dirty)\n",
+               p->name, secs * 1000 / passes,
+               (double)disk_size * passes / secs / TiB, dirty / GiB);
+    }
+
+    hbitmap_free(hb);
+    return EXIT_SUCCESS;
+}
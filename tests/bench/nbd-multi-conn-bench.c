@@ -0,0 +1,159 @@
+/*
+ * Reads from an NBD export over 1, 2, 4, ... connections
+ *
+ * The export is served by a separate process, for example
+ *
+ *   qemu-nbd -t -k /tmp/nbd.sock -e 8 -f raw --cache=none disk.img
+ *
+ * where -e must allow at least as many clients as connections are
+ * tested; otherwise the server does not advertise NBD_FLAG_CAN_MULTI_CONN
+ * and the client falls back to a single connection.  All requests are
+ * submitted to one BlockBackend from the main loop, so the difference
+ * between the rows is only due to the number of connections.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "block/block.h"
+#include "sysemu/block-backend.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "qemu/error-report.h"
+#include "qemu/main-loop.h"
+#include "qemu/memalign.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+
+#define QUEUE_DEPTH 64
+
+static BlockBackend *bench_blk;
+static int64_t bench_len;
+static unsigned int bench_req_size = 65536;
+static unsigned int bench_reads = 32768;
+static unsigned int bench_next;
+static unsigned int bench_running;
+
+static void coroutine_fn bench_read_co(void *opaque)
+{
+    void *buf = opaque;
+    int64_t nb_blocks = bench_len / bench_req_size;
+    unsigned int i;
+    int ret;
+
+    while ((i = bench_next++) < bench_reads) {
+        /* Spread requests over the export, not only its first blocks */
+        int64_t block = ((int64_t)i * 7919) % nb_blocks;
+
+        ret = blk_co_pread(bench_blk, block * bench_req_size, bench_req_size,
+                           buf, 0);
+        if (ret < 0) {
+            error_report("read failed: %s", strerror(-ret));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    qemu_vfree(buf);
+    bench_running--;
+}
+
+static double bench_run(const char *sock_path, const char *export, int conns)
+{
+    QDict *options;
+    int64_t start;
+
+    options = qdict_new();
+    qdict_put_str(options, "driver", "nbd");
+    qdict_put_str(options, "server.type", "unix");
+    qdict_put_str(options, "server.path", sock_path);
+    if (export) {
+        qdict_put_str(options, "export", export);
+    }
+    qdict_put_int(options, "multi-conn", conns);
+    bench_blk = blk_new_open(NULL, NULL, options, 0, &error_fatal);
+
+    bench_len = blk_getlength(bench_blk);
+    if (bench_len < bench_req_size) {
+        error_report("export is smaller than one request");
+        exit(EXIT_FAILURE);
+    }
+
+    bench_next = 0;
+    bench_running = QUEUE_DEPTH;
+    start = get_clock();
+    for (int q = 0; q < QUEUE_DEPTH; q++) {
+        void *buf = blk_blockalign(bench_blk, bench_req_size);
+
+        qemu_coroutine_enter(qemu_coroutine_create(bench_read_co, buf));
+    }
+    while (bench_running > 0) {
+        main_loop_wait(false);
+    }
+    start = get_clock() - start;
+
+    blk_unref(bench_blk);
+
+    return (double)bench_reads * bench_req_size /
+           ((double)start / NANOSECONDS_PER_SECOND);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s -k socket [-x export] [-n reads] [-s request_size] "
+           "[-c max_connections]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *sock_path = NULL, *export = NULL;
+    int max_conns = 8;
+    double base = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "hk:x:n:s:c:")) != -1) {
+        switch (c) {
+        case 'k':
+            sock_path = optarg;
+            break;
+        case 'x':
+            export = optarg;
+            break;
+        case 'n':
+            bench_reads = atoi(optarg);
+            break;
+        case 's':
+            bench_req_size = atoi(optarg);
+            break;
+        case 'c':
+            max_conns = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!sock_path || bench_reads == 0 || bench_req_size == 0 ||
+        max_conns < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+
+    printf("%u reads of %u bytes, queue depth %d\n",
+           bench_reads, bench_req_size, QUEUE_DEPTH);
+    for (int n = 1; n <= max_conns; n *= 2) {
+        double rate = bench_run(sock_path, export, n);
+
+        if (n == 1) {
+            base = rate;
+        }
+        printf("%3d connections: %10.1f MiB/s  %5.2fx\n", n, rate / MiB,
+               rate / base);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+/*
+ * Allocating writes to a qcow2 image from several IOThreads
+ *
+ * Every write goes to a cluster that was never written before, so the
+ * image grows with each request and the cost is dominated by cluster
+ * allocation, as for a freshly installed guest.  The requests are
+ * submitted to one BlockBackend from 1, 2, 4, ... IOThreads, like
+ * virtio-blk does with iothread-vq-mapping.
+ *
+ * With -r, the clusters are written in random order and the L2 cache
+ * only holds two 4 KiB slices, so that nearly every request has to load
+ * its L2 slice from the disk first, as for random writes to a large
+ * image.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "block/block.h"
+#include "sysemu/block-backend.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "qemu/error-report.h"
+#include "qemu/main-loop.h"
+#include "qemu/memalign.h"
+#include "qemu/timer.h"
+#include "iothread.h"
+
+#define CLUSTER_SIZE 65536
+#define REQ_SIZE 4096
+#define QUEUE_DEPTH 16
+
+static BlockBackend *bench_blk;
+static unsigned int *bench_order;
+static unsigned int bench_writes = 16384;
+static unsigned int bench_next;
+static unsigned int bench_running;
+
+static void coroutine_fn bench_write_co(void *opaque)
+{
+    void *buf = opaque;
+    unsigned int i;
+    int ret;
+
+    while ((i = qatomic_fetch_inc(&bench_next)) < bench_writes) {
+        if (bench_order) {
+            i = bench_order[i];
+        }
+        ret = blk_co_pwrite(bench_blk, (int64_t)i * CLUSTER_SIZE, REQ_SIZE,
+                            buf, 0);
+        if (ret < 0) {
+            error_report("write failed: %s", strerror(-ret));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    qatomic_dec(&bench_running);
+    aio_wait_kick();
+}
+
+static double bench_run(const char *filename, int nb_threads)
+{
+    IOThread *iothreads[nb_threads];
+    QDict *options;
+    int64_t start;
+    void *buf;
+
+    bdrv_img_create(filename, "qcow2", NULL, NULL, NULL,
+                    (uint64_t)bench_writes * CLUSTER_SIZE, 0, true,
+                    &error_abort);
+
+    options = qdict_new();
+    qdict_put_str(options, "driver", "qcow2");
+    if (bench_order) {
+        qdict_put_str(options, "l2-cache-entry-size", "4096");
+        qdict_put_str(options, "l2-cache-size", "8192");
+    }
+    bench_blk = blk_new_open(filename, NULL, options, BDRV_O_RDWR,
+                             &error_abort);
+
+    buf = blk_blockalign(bench_blk, REQ_SIZE);
+    memset(buf, 0xa5, REQ_SIZE);
+
+    for (int t = 0; t < nb_threads; t++) {
+        iothreads[t] = iothread_new();
+    }
+
+    qatomic_set(&bench_next, 0);
+    qatomic_set(&bench_running, nb_threads * QUEUE_DEPTH);
+    start = get_clock();
+    for (int t = 0; t < nb_threads; t++) {
+        AioContext *ctx = iothread_get_aio_context(iothreads[t]);
+
+        for (int q = 0; q < QUEUE_DEPTH; q++) {
+            aio_co_enter(ctx, qemu_coroutine_create(bench_write_co, buf));
+        }
+    }
+    AIO_WAIT_WHILE_UNLOCKED(NULL, qatomic_read(&bench_running) > 0);
+    start = get_clock() - start;
+
+    for (int t = 0; t < nb_threads; t++) {
+        iothread_join(iothreads[t]);
+    }
+    qemu_vfree(buf);
+    blk_unref(bench_blk);
+    unlink(filename);
+
+    return bench_writes / ((double)start / NANOSECONDS_PER_SECOND);
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [-r] [-d dir] [-n writes] [-t max_iothreads]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    g_autofree char *filename = NULL;
+    const char *dir = g_get_tmp_dir();
+    int max_threads = 4;
+    bool random_order = false;
+    double base = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "hd:n:rt:")) != -1) {
+        switch (c) {
+        case 'r':
+            random_order = true;
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'n':
+            bench_writes = atoi(optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (bench_writes == 0 || max_threads < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (random_order) {
+        GRand *rand = g_rand_new_with_seed(bench_writes);
+
+        bench_order = g_new(unsigned int, bench_writes);
+        for (unsigned int i = 0; i < bench_writes; i++) {
+            unsigned int j = g_rand_int_range(rand, 0, i + 1);
+
+            bench_order[i] = bench_order[j];
+            bench_order[j] = i;
+        }
+        g_rand_free(rand);
+    }
+
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+    filename = g_strdup_printf("%s/qcow2-alloc-bench-%d.qcow2", dir,
+                               (int)getpid());
+
+    printf("%u allocating writes of %d bytes in %s order, "
+           "queue depth %d per IOThread\n",
+           bench_writes, REQ_SIZE, bench_order ? "random" : "sequential",
+           QUEUE_DEPTH);
+    for (int t = 1; t <= max_threads; t *= 2) {
+        double rate = bench_run(filename, t);
+
+        if (t == 1) {
+            base = rate;
+        }
+        printf("%3d IOThreads: %10.0f writes/s  %5.2fx\n", t, rate,
+               rate / base);
+    }
+    return EXIT_SUCCESS;
+}
@@ -42,6 +42,9 @@ static const char *hmp_cmds[] = {
     "hostfwd_add tcp::43210-:43210",
     "hostfwd_remove tcp::43210-:43210",
     "i /w 0",
+    "jit-profile on 100",
+    "info jit-profile",
+    "jit-profile off",
     "log all",
     "log none",
     "memsave 0 4096 \"/dev/null\"",
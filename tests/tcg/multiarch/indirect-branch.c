@@ -0,0 +1,173 @@
+/*
+ * Indirect branch exerciser
+ *
+ * Runs the same bytecode through a table of function pointers, through
+ * a switch and through a chain of compares. The first two end most
+ * translation blocks with an indirect branch whose target changes at
+ * every step, which stresses the branch target and jump caches; the
+ * results of all three must agree.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NB_OPS 8
+#define PROG_LEN 4096
+#define PASSES 64
+
+typedef uint32_t (*op_fn)(uint32_t acc, uint32_t arg);
+
+static __attribute__((noinline)) uint32_t op_add(uint32_t acc, uint32_t arg)
+{
+    return acc + arg;
+}
+
+static __attribute__((noinline)) uint32_t op_sub(uint32_t acc, uint32_t arg)
+{
+    return acc - arg;
+}
+
+static __attribute__((noinline)) uint32_t op_xor(uint32_t acc, uint32_t arg)
+{
+    return acc ^ arg;
+}
+
+static __attribute__((noinline)) uint32_t op_mul(uint32_t acc, uint32_t arg)
+{
+    return acc * (arg | 1);
+}
+
+static __attribute__((noinline)) uint32_t op_rol(uint32_t acc, uint32_t arg)
+{
+    arg &= 31;
+    return arg ? (acc << arg) | (acc >> (32 - arg)) : acc;
+}
+
+static __attribute__((noinline)) uint32_t op_not(uint32_t acc, uint32_t arg)
+{
+    return ~acc + (arg & 0xff);
+}
+
+static __attribute__((noinline)) uint32_t op_shr(uint32_t acc, uint32_t arg)
+{
+    return acc ^ (acc >> ((arg & 15) + 1));
+}
+
+static __attribute__((noinline)) uint32_t op_or(uint32_t acc, uint32_t arg)
+{
+    return (acc | arg) - (acc & arg);
+}
+
+static const op_fn op_table[NB_OPS] = {
+    op_add, op_sub, op_xor, op_mul, op_rol, op_not, op_shr, op_or,
+};
+
+static uint8_t prog_op[PROG_LEN];
+static uint32_t prog_arg[PROG_LEN];
+
+static uint32_t run_table(void)
+{
+    uint32_t acc = 1;
+
+    for (int p = 0; p < PASSES; p++) {
+        for (int i = 0; i < PROG_LEN; i++) {
+            acc = op_table[prog_op[i]](acc, prog_arg[i]);
+        }
+    }
+    return acc;
+}
+
+static uint32_t run_switch(void)
+{
+    uint32_t acc = 1;
+
+    for (int p = 0; p < PASSES; p++) {
+        for (int i = 0; i < PROG_LEN; i++) {
+            switch (prog_op[i]) {
+            case 0:
+                acc = op_add(acc, prog_arg[i]);
+                break;
+            case 1:
+                acc = op_sub(acc, prog_arg[i]);
+                break;
+            case 2:
+                acc = op_xor(acc, prog_arg[i]);
+                break;
+            case 3:
+                acc = op_mul(acc, prog_arg[i]);
+                break;
+            case 4:
+                acc = op_rol(acc, prog_arg[i]);
+                break;
+            case 5:
+                acc = op_not(acc, prog_arg[i]);
+                break;
+            case 6:
+                acc = op_shr(acc, prog_arg[i]);
+                break;
+            default:
+                acc = op_or(acc, prog_arg[i]);
+                break;
+            }
+        }
+    }
+    return acc;
+}
+
+static uint32_t run_compare(void)
+{
+    uint32_t acc = 1;
+
+    for (int p = 0; p < PASSES; p++) {
+        for (int i = 0; i < PROG_LEN; i++) {
+            uint8_t op = prog_op[i];
+
+            if (op == 0) {
+                acc = op_add(acc, prog_arg[i]);
+            } else if (op == 1) {
+                acc = op_sub(acc, prog_arg[i]);
+            } else if (op == 2) {
+                acc = op_xor(acc, prog_arg[i]);
+            } else if (op == 3) {
+                acc = op_mul(acc, prog_arg[i]);
+            } else if (op == 4) {
+                acc = op_rol(acc, prog_arg[i]);
+            } else if (op == 5) {
+                acc = op_not(acc, prog_arg[i]);
+            } else if (op == 6) {
+                acc = op_shr(acc, prog_arg[i]);
+            } else {
+                acc = op_or(acc, prog_arg[i]);
+            }
+        }
+    }
+    return acc;
+}
+
+int main(void)
+{
+    uint32_t seed = 0x12345678;
+    uint32_t r_table, r_switch, r_compare;
+
+    for (int i = 0; i < PROG_LEN; i++) {
+        seed = seed * 1103515245 + 12345;
+        prog_op[i] = (seed >> 16) % NB_OPS;
+        seed = seed * 1103515245 + 12345;
+        prog_arg[i] = seed;
+    }
+
+    r_table = run_table();
+    r_switch = run_switch();
+    r_compare = run_compare();
+
+    printf("table %08x switch %08x compare %08x\n",
+           r_table, r_switch, r_compare);
+    if (r_table != r_compare || r_switch != r_compare) {
+        printf("FAIL: dispatch results differ\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+/*
+ * Multi-threaded cold start
+ *
+ * Each thread runs code of its own that nothing has executed yet, as
+ * at the start-up of a program whose threads do different jobs, so the
+ * threads translate at the same time. The results are checked against
+ * a second, serial pass once everything is translated.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define NB_THREADS 8
+#define NB_FNS 1024
+#define FNS_PER_THREAD (NB_FNS / NB_THREADS)
+
+typedef uint64_t (*fn_t)(uint64_t x);
+
+/* 1024 distinct functions, numbered in base 4 (which reads as octal). */
+#define FN(n)                                                   \
+    static __attribute__((noinline)) uint64_t fn##n(uint64_t x) \
+    {                                                           \
+        x ^= x >> (n % 7 + 1);                                  \
+        x *= 0x9e3779b97f4a7c15ull + n;                         \
+        if (x & 1) {                                            \
+            x = ~x + n;                                         \
+        }                                                       \
+        return x ^ (x >> (n % 13 + 3));                         \
+    }
+#define FN4(n)    FN(n##0) FN(n##1) FN(n##2) FN(n##3)
+#define FN16(n)   FN4(n##0) FN4(n##1) FN4(n##2) FN4(n##3)
+#define FN64(n)   FN16(n##0) FN16(n##1) FN16(n##2) FN16(n##3)
+#define FN256(n)  FN64(n##0) FN64(n##1) FN64(n##2) FN64(n##3)
+#define FN1024(n) FN256(n##0) FN256(n##1) FN256(n##2) FN256(n##3)
+
+#define PTR(n)     fn##n,
+#define PTR4(n)    PTR(n##0) PTR(n##1) PTR(n##2) PTR(n##3)
+#define PTR16(n)   PTR4(n##0) PTR4(n##1) PTR4(n##2) PTR4(n##3)
+#define PTR64(n)   PTR16(n##0) PTR16(n##1) PTR16(n##2) PTR16(n##3)
+#define PTR256(n)  PTR64(n##0) PTR64(n##1) PTR64(n##2) PTR64(n##3)
+#define PTR1024(n) PTR256(n##0) PTR256(n##1) PTR256(n##2) PTR256(n##3)
+
+FN1024(1)
+
+static const fn_t fns[NB_FNS] = { PTR1024(1) };
+
+static pthread_barrier_t start;
+static uint64_t results[NB_THREADS];
+
+static uint64_t run(int t)
+{
+    uint64_t x = t + 1;
+
+    for (int i = 0; i < FNS_PER_THREAD; i++) {
+        x = fns[t * FNS_PER_THREAD + i](x);
+    }
+    return x;
+}
+
+static void *thread_fn(void *arg)
+{
+    int t = (intptr_t)arg;
+
+    pthread_barrier_wait(&start);
+    results[t] = run(t);
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t threads[NB_THREADS];
+    int errors = 0;
+
+    pthread_barrier_init(&start, NULL, NB_THREADS);
+    for (int t = 0; t < NB_THREADS; t++) {
+        if (pthread_create(&threads[t], NULL, thread_fn, (void *)(intptr_t)t)) {
+            perror("pthread_create");
+            return EXIT_FAILURE;
+        }
+    }
+    for (int t = 0; t < NB_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    for (int t = 0; t < NB_THREADS; t++) {
+        uint64_t expected = run(t);
+
+        if (results[t] != expected) {
+            printf("FAIL: thread %d: %016llx, expected %016llx\n", t,
+                   (unsigned long long)results[t],
+                   (unsigned long long)expected);
+            errors++;
+        }
+    }
+    printf("%d threads, %d functions each: %s\n", NB_THREADS,
+           FNS_PER_THREAD, errors ? "FAIL" : "PASS");
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -20,6 +20,11 @@ typedef struct {
     uint64_t count_insn_inline;
     uint64_t count_mem;
     uint64_t count_mem_inline;
+    uint64_t count_mem_buf;
+    uint64_t count_mem_buf_early;
+    uint64_t sum_vaddr;
+    uint64_t sum_vaddr_buf;
+    uint64_t sum_vaddr_buf_early;
     uint64_t tb_cond_num_trigger;
     uint64_t tb_cond_track_count;
     uint64_t insn_cond_num_trigger;
@@ -27,6 +32,8 @@ typedef struct {
 } CPUCount;
 
 static const uint64_t cond_trigger_limit = 100;
+/* small, so that buffers fill often */
+static const size_t mem_buf_records = 64;
 
 typedef struct {
     uint64_t data_insn;
@@ -41,6 +48,20 @@ static qemu_plugin_u64 count_insn;
 static qemu_plugin_u64 count_insn_inline;
 static qemu_plugin_u64 count_mem;
 static qemu_plugin_u64 count_mem_inline;
+static qemu_plugin_u64 sum_vaddr;
+
+typedef struct {
+    struct qemu_plugin_mem_buf *buf;
+    qemu_plugin_u64 count;
+    qemu_plugin_u64 sum_vaddr;
+} MemBuf;
+
+/*
+ * mem_buf_early is the first memory callback of each instruction and
+ * mem_buf the last one: the code appended for a buffer must not clobber
+ * the address seen by the callbacks that follow it.
+ */
+static MemBuf mem_buf, mem_buf_early;
 static qemu_plugin_u64 tb_cond_num_trigger;
 static qemu_plugin_u64 tb_cond_track_count;
 static qemu_plugin_u64 insn_cond_num_trigger;
@@ -111,14 +132,21 @@ static void stats_mem(void)
     const uint64_t per_vcpu = qemu_plugin_u64_sum(count_mem);
     const uint64_t inl_per_vcpu =
         qemu_plugin_u64_sum(count_mem_inline);
+    const uint64_t buffered = qemu_plugin_u64_sum(mem_buf.count);
+    const uint64_t buffered_early = qemu_plugin_u64_sum(mem_buf_early.count);
     g_autoptr(GString) stats = g_string_new("");
     g_string_append_printf(stats, "mem: %" PRIu64 "\n", expected);
     g_string_append_printf(stats, "mem: %" PRIu64 " (per vcpu)\n", per_vcpu);
     g_string_append_printf(stats, "mem: %" PRIu64 " (per vcpu inline)\n", inl_per_vcpu);
+    g_string_append_printf(stats, "mem: %" PRIu64 " (buffered)\n", buffered);
+    g_string_append_printf(stats, "mem: %" PRIu64 " (buffered first)\n",
+                           buffered_early);
     qemu_plugin_outs(stats->str);
     g_assert(expected > 0);
     g_assert(per_vcpu == expected);
     g_assert(inl_per_vcpu == expected);
+    g_assert(buffered == expected);
+    g_assert(buffered_early == expected);
 }
 
 static void plugin_exit(qemu_plugin_id_t id, void *udata)
@@ -127,6 +155,10 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
     g_autoptr(GString) stats = g_string_new("");
     g_assert(num_cpus == max_cpu_index + 1);
 
+    /* deliver what is left in the buffers before comparing */
+    qemu_plugin_mem_buf_free(mem_buf.buf);
+    qemu_plugin_mem_buf_free(mem_buf_early.buf);
+
     for (int i = 0; i < num_cpus ; ++i) {
         const uint64_t tb = qemu_plugin_u64_get(count_tb, i);
         const uint64_t tb_inline = qemu_plugin_u64_get(count_tb_inline, i);
@@ -134,6 +166,10 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
         const uint64_t insn_inline = qemu_plugin_u64_get(count_insn_inline, i);
         const uint64_t mem = qemu_plugin_u64_get(count_mem, i);
         const uint64_t mem_inline = qemu_plugin_u64_get(count_mem_inline, i);
+        const uint64_t mem_buffered = qemu_plugin_u64_get(mem_buf.count, i);
+        const uint64_t mem_buffered_early =
+            qemu_plugin_u64_get(mem_buf_early.count, i);
+        const uint64_t vaddrs = qemu_plugin_u64_get(sum_vaddr, i);
         const uint64_t tb_cond_trigger =
             qemu_plugin_u64_get(tb_cond_num_trigger, i);
         const uint64_t tb_cond_left =
@@ -148,18 +184,22 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
                         "insn (%" PRIu64 ", %" PRIu64
                         ", %" PRIu64 " * %" PRIu64 " + %" PRIu64
                         ") | "
-                        "mem (%" PRIu64 ", %" PRIu64 ")"
+                        "mem (%" PRIu64 ", %" PRIu64 ", %" PRIu64 ")"
                         "\n",
                         i,
                         tb, tb_inline,
                         tb_cond_trigger, cond_trigger_limit, tb_cond_left,
                         insn, insn_inline,
                         insn_cond_trigger, cond_trigger_limit, insn_cond_left,
-                        mem, mem_inline);
+                        mem, mem_inline, mem_buffered);
         qemu_plugin_outs(stats->str);
         g_assert(tb == tb_inline);
         g_assert(insn == insn_inline);
         g_assert(mem == mem_inline);
+        g_assert(mem == mem_buffered);
+        g_assert(mem == mem_buffered_early);
+        g_assert(vaddrs == qemu_plugin_u64_get(mem_buf.sum_vaddr, i));
+        g_assert(vaddrs == qemu_plugin_u64_get(mem_buf_early.sum_vaddr, i));
         g_assert(tb_cond_trigger == tb / cond_trigger_limit);
         g_assert(tb_cond_left == tb % cond_trigger_limit);
         g_assert(insn_cond_trigger == insn / cond_trigger_limit);
@@ -217,12 +257,27 @@ static void vcpu_mem_access(unsigned int cpu_index,
                             void *udata)
 {
     qemu_plugin_u64_add(count_mem, cpu_index, 1);
+    qemu_plugin_u64_add(sum_vaddr, cpu_index, vaddr);
     g_assert(qemu_plugin_u64_get(data_mem, cpu_index) == (uintptr_t) udata);
     g_mutex_lock(&mem_lock);
     global_count_mem++;
     g_mutex_unlock(&mem_lock);
 }
 
+static void vcpu_mem_buf(unsigned int cpu_index,
+                         const qemu_plugin_mem_record *records,
+                         size_t n_records, void *udata)
+{
+    MemBuf *mb = udata;
+
+    g_assert(n_records > 0 && n_records <= mem_buf_records);
+    for (size_t i = 0; i < n_records; i++) {
+        g_assert(records[i].userdata != NULL);
+        qemu_plugin_u64_add(mb->sum_vaddr, cpu_index, records[i].vaddr);
+    }
+    qemu_plugin_u64_add(mb->count, cpu_index, n_records);
+}
+
 static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 {
     void *tb_store = tb;
@@ -259,6 +314,8 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
             QEMU_PLUGIN_COND_EQ, insn_cond_track_count, cond_trigger_limit,
             insn_store);
 
+        qemu_plugin_register_vcpu_mem_buf(insn, QEMU_PLUGIN_MEM_RW,
+                                          mem_buf_early.buf, mem_store);
         qemu_plugin_register_vcpu_mem_inline_per_vcpu(
             insn, QEMU_PLUGIN_MEM_RW,
             QEMU_PLUGIN_INLINE_STORE_U64,
@@ -270,6 +327,8 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
             insn, QEMU_PLUGIN_MEM_RW,
             QEMU_PLUGIN_INLINE_ADD_U64,
             count_mem_inline, 1);
+        qemu_plugin_register_vcpu_mem_buf(insn, QEMU_PLUGIN_MEM_RW,
+                                          mem_buf.buf, mem_store);
     }
 }
 
@@ -290,6 +349,16 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
         counts, CPUCount, count_insn_inline);
     count_mem_inline = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, count_mem_inline);
+    sum_vaddr = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, sum_vaddr);
+    mem_buf.count = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_mem_buf);
+    mem_buf.sum_vaddr = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, sum_vaddr_buf);
+    mem_buf_early.count = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_mem_buf_early);
+    mem_buf_early.sum_vaddr = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, sum_vaddr_buf_early);
     tb_cond_num_trigger = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, tb_cond_num_trigger);
     tb_cond_track_count = qemu_plugin_scoreboard_u64_in_struct(
@@ -302,6 +371,10 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
     data_insn = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_insn);
     data_tb = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_tb);
     data_mem = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_mem);
+    mem_buf.buf = qemu_plugin_mem_buf_new(mem_buf_records, vcpu_mem_buf,
+                                          &mem_buf);
+    mem_buf_early.buf = qemu_plugin_mem_buf_new(mem_buf_records, vcpu_mem_buf,
+                                                &mem_buf_early);
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
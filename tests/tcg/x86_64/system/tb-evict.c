@@ -0,0 +1,71 @@
+/*
+ * Code buffer eviction test
+ *
+ * Generate many small functions and call all of them a few times, so
+ * that with a small code buffer ("-accel tcg,tb-size=1") their
+ * translations do not fit and regions of the buffer get recycled.  Each
+ * function returns its own constant: a call that ran a stale or
+ * half-evicted translation would return the wrong one.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <minilib.h>
+
+/* In RAM, above the kernel image and its stack */
+#define FUNC_BASE       0x1000000ul
+#define FUNC_SIZE       16
+#define N_FUNCS         16384
+#define N_ROUNDS        4
+
+typedef uint32_t (*func_t)(void);
+
+static uint32_t func_value(unsigned i)
+{
+    return i * 2654435761u;
+}
+
+/* Each function is "mov $value, %eax; ret", padded with int3 */
+static void gen_funcs(void)
+{
+    for (unsigned i = 0; i < N_FUNCS; i++) {
+        uint8_t *p = (uint8_t *)(FUNC_BASE + i * FUNC_SIZE);
+        uint32_t value = func_value(i);
+
+        p[0] = 0xb8;
+        p[1] = value;
+        p[2] = value >> 8;
+        p[3] = value >> 16;
+        p[4] = value >> 24;
+        p[5] = 0xc3;
+        for (unsigned j = 6; j < FUNC_SIZE; j++) {
+            p[j] = 0xcc;
+        }
+    }
+}
+
+int main(void)
+{
+    int fails = 0;
+
+    gen_funcs();
+
+    for (unsigned round = 0; round < N_ROUNDS; round++) {
+        for (unsigned i = 0; i < N_FUNCS; i++) {
+            /* Walk in a different order each round */
+            unsigned k = (i * (2 * round + 1)) % N_FUNCS;
+            func_t f = (func_t)(FUNC_BASE + k * FUNC_SIZE);
+            uint32_t value = f();
+
+            if (value != func_value(k)) {
+                ml_printf("FAIL: round %d, function %d returned 0x%x, "
+                          "expected 0x%x\n", round, k, value, func_value(k));
+                fails++;
+            }
+        }
+    }
+
+    ml_printf("Test complete: %d failures\n", fails);
+    return fails;
+}
@@ -0,0 +1,102 @@
+/*
+ * Large page TLB flush test
+ *
+ * The boot code maps the first 4GB with 2MB pages.  Two of those above
+ * the end of RAM are pointed at RAM, accessed, and then remapped behind
+ * the TLB's back: only the translations that were flushed see the new
+ * mapping.  Flushing one 4k page of a 2MB page must drop the whole 2MB
+ * page, but keep the translations of the other one.
+ *
+ * Keeping a stale translation is allowed on real hardware as well; this
+ * checks that QEMU does not flush more than asked.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <minilib.h>
+
+#define PAGE_2M         (2 * 1024 * 1024)
+/* As in boot.S: present, writable, user, accessed, dirty, 2MB, global */
+#define PDE_FLAGS       0x1e7
+
+/* Above the end of RAM, so nothing else uses these addresses */
+#define LARGE_VA        0x40000000ul
+#define OTHER_VA        (LARGE_VA + PAGE_2M)
+
+/* RAM backing them */
+#define FRAME_A         (32ul * PAGE_2M)
+#define FRAME_B         (33ul * PAGE_2M)
+#define FRAME_C         (34ul * PAGE_2M)
+
+static inline void invlpg(uintptr_t addr)
+{
+    asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+static inline uint64_t load(uintptr_t addr)
+{
+    return *(volatile uint64_t *)addr;
+}
+
+static void fill(uintptr_t frame, uint64_t marker)
+{
+    *(volatile uint64_t *)frame = marker;
+    *(volatile uint64_t *)(frame + 0x1000) = marker;
+}
+
+/* Returns the page directory covering 1-2GB */
+static volatile uint64_t *get_pd(void)
+{
+    uint64_t cr3, *pml4, *pdp;
+
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    pml4 = (uint64_t *)(cr3 & ~0xfffull);
+    pdp = (uint64_t *)(pml4[0] & ~0xfffull);
+    return (uint64_t *)(pdp[1] & ~0xfffull);
+}
+
+static int check(const char *what, uintptr_t addr, uint64_t expected)
+{
+    uint64_t val = load(addr);
+
+    if (val != expected) {
+        ml_printf("FAIL: %s: read 0x%lx at 0x%lx, expected 0x%lx\n",
+                  what, val, addr, expected);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    volatile uint64_t *pd = get_pd();
+    int fails = 0;
+
+    fill(FRAME_A, 0xaaaa);
+    fill(FRAME_B, 0xbbbb);
+    fill(FRAME_C, 0xcccc);
+
+    pd[0] = FRAME_A | PDE_FLAGS;
+    pd[1] = FRAME_B | PDE_FLAGS;
+    invlpg(LARGE_VA);
+    invlpg(OTHER_VA);
+
+    /* Load a translation for each 2MB page */
+    fails += check("large page", LARGE_VA + 0x1000, 0xaaaa);
+    fails += check("other page", OTHER_VA, 0xbbbb);
+
+    /* Remap both, and flush a page of the first one that was not used */
+    pd[0] = FRAME_C | PDE_FLAGS;
+    pd[1] = FRAME_C | PDE_FLAGS;
+    invlpg(LARGE_VA + 0x3000);
+
+    fails += check("flushed large page", LARGE_VA + 0x1000, 0xcccc);
+    fails += check("unrelated large page", OTHER_VA, 0xbbbb);
+
+    invlpg(OTHER_VA);
+    fails += check("flushed other page", OTHER_VA, 0xcccc);
+
+    ml_printf("Test complete: %d failures\n", fails);
+    return fails;
+}
@@ -920,6 +920,30 @@ static void test_hbitmap_next_x_after_truncate(TestHBitmapData *data,
     test_hbitmap_next_x_check(data, 0);
 }
 
+static void test_hbitmap_next_zero_long_run(TestHBitmapData *data,
+                                            const void *unused)
+{
+    int64_t i;
+
+    hbitmap_test_init(data, L3, 0);
+    hbitmap_set(data->hb, 0, L3);
+    test_hbitmap_next_x_check(data, 0);
+
+    /*
+     * Place a single zero bit at every position of the first words, so that
+     * it falls at each offset within and across the groups of words that
+     * hbitmap_next_zero() looks at together.
+     */
+    for (i = 0; i < L1 * 20; i += 7) {
+        hbitmap_reset(data->hb, i + L2, 1);
+        test_hbitmap_next_x_check(data, 0);
+        test_hbitmap_next_x_check(data, L1 + 3);
+        test_hbitmap_next_x_check(data, i + L2);
+        test_hbitmap_next_x_check_range(data, L1, i + L2 - L1);
+        hbitmap_set(data->hb, i + L2, 1);
+    }
+}
+
 static void test_hbitmap_next_dirty_area_check_limited(TestHBitmapData *data,
                                                        int64_t offset,
                                                        int64_t count,
@@ -1103,6 +1127,8 @@ int main(int argc, char **argv)
                      test_hbitmap_next_x_4);
     hbitmap_test_add("/hbitmap/next_zero/next_x_after_truncate",
                      test_hbitmap_next_x_after_truncate);
+    hbitmap_test_add("/hbitmap/next_zero/long_run",
+                     test_hbitmap_next_zero_long_run);
 
     hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_area_0",
                      test_hbitmap_next_dirty_area_0);
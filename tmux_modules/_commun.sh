@@ -85,16 +85,19 @@ _fenetre_dsp() {
     #   mail_dissam.log = le croisement mailbox × désassemblage : quelle cellule,
     #     dans quel sens, combien de fois, et QUELLE instruction la touche. C'est
     #     un TABLEAU réécrit toutes les 2 s, pas un flux — donc `watch`, pas `tail`.
-    #   mailbox.log = le flux brut, replié au changement de valeur.
+    #   mailbox.mbx = le flux brut, replié au changement de valeur, rendu en
+    #     texte par mailbox-decode.py --suivre (trace binaire depuis 2026-10-18).
     #
     # Fenêtre séparée à dessein : ces deux vues méritent de la place, et les
     # écraser dans `radio` rendrait les quatre panes existants illisibles.
     local L="${LOG_DIR:-/root/calypso/logs}"
+    local T="${QEMU_TREE:-/opt/GSM/osmo-qemu-calypso}"
     _w     dsp "mailbox x desassemblage | quelle instruction touche quelle cellule" \
         "while :; do clear; cat '$L/mail_dissam.log' 2>/dev/null || echo 'en attente du premier cycle...'; sleep 2; done" \
         "${C_RADIO:-}"
     _split dsp "mailbox | flux ARM<->DSP brut, replie au changement" \
-        "$(_tail "'$L/mailbox.log'")" "${C_RADIO:-}"
+        "python3 '$T/tools/mailbox-decode.py' '$L/mailbox.mbx' --derniers 40 --suivre 2>/dev/null || sleep infinity" \
+        "${C_RADIO:-}"
 }
 
 _fenetre_asm() {
@@ -116,7 +119,7 @@ _fenetre_asm() {
         "while :; do clear; cat '$L/mail_dissam.log' 2>/dev/null || echo 'en attente du premier cycle...'; sleep 2; done" \
         "${C_RADIO:-}"
     _split asm "mailbox ASM | chaque acces suivi de son instruction c54x" \
-        "tail -n 40 -F '$L/mailbox.log' 2>/dev/null | stdbuf -oL python3 '$T/tools/mailbox-annote.py' --flux 2>/dev/null || sleep infinity" \
+        "python3 '$T/tools/mailbox-decode.py' '$L/mailbox.mbx' --derniers 40 --suivre 2>/dev/null | stdbuf -oL python3 '$T/tools/mailbox-annote.py' --flux 2>/dev/null || sleep infinity" \
         "${C_RADIO:-}"
 }
 
@@ -9,7 +9,9 @@ dphi (rotation moyenne/sample), exprime en unites de pi/2 -> infere le SPS :
   negatif       = miroir spectral (I/Q swap -> CALYPSO_DL_IQ_CONJ=1)
 
 Sources :
-  shunt  : /dev/shm/dsp_iq.cfile (fc32) -- I/Q d'entree du shunt (reference propre)
+  shunt  : /dev/shm/dsp_iq.iq16[.zst] (IQ16, cs16, zstd optionnel) -- I/Q
+           d'entree du shunt (reference propre) ; un ancien record
+           dsp_iq.cfile (fc32) est encore lu si on le passe via --shunt
   rxdump : /tmp/iq_rx_*.bin (CALYPSO_IQDUMP) -- bursts FCCH ecrits en DARAM 0x2a00
   bursts : /dev/shm/bursts.cfile (BSP_DUMP_RX_FILE, IQ16) -- idem, avec fn/tn
   daram  : 0x2a00 live via monitor qemu (best-effort, racy)
@@ -84,6 +86,51 @@ def report(iq, fs, label):
 
 
 # ---------- loaders ----------
+# Record du shunt : IQ16 (compresse ou non, cf. calypso_iq_rec.h) par defaut
+# depuis le 18/10 ; fc32 .cfile avant.
+SHUNT_DEFAULTS = ("/dev/shm/dsp_iq.iq16.zst", "/dev/shm/dsp_iq.iq16",
+                  "/dev/shm/dsp_iq.cfile")
+
+
+def default_shunt():
+    for p in SHUNT_DEFAULTS:
+        if os.path.exists(p):
+            return p
+    return SHUNT_DEFAULTS[0]
+
+
+def open_iq16(path):
+    """Flux IQ16 brut, decompresse si le fichier est une suite de trames zstd
+    (magic 28 b5 2f fd)."""
+    f = open(path, "rb")
+    if f.read(4) != b"\x28\xb5\x2f\xfd":
+        f.seek(0)
+        return f
+    f.close()
+    try:
+        import zstandard
+        return zstandard.ZstdDecompressor().stream_reader(
+            open(path, "rb"), read_across_frames=True)
+    except ImportError:
+        import io, subprocess
+        return io.BytesIO(subprocess.run(["zstd", "-dc", path], check=True,
+                                         stdout=subprocess.PIPE).stdout)
+
+
+def load_iq16_tail(path, n):
+    """Les n derniers echantillons du record IQ16, concatenes et normalises
+    comme l'ancien cfile fc32 (/32768)."""
+    bufs, tot = [], 0
+    for _name, iq in iter_iq16(path):
+        bufs.append(iq)
+        tot += len(iq)
+        while tot - len(bufs[0]) >= n:
+            tot -= len(bufs.pop(0))
+    if not bufs:
+        return np.zeros(0, dtype=np.complex128)
+    return np.concatenate(bufs)[-n:].astype(np.complex128) / 32768.0
+
+
 def load_fc32(path, n, off):
     with open(path, "rb") as f:
         f.seek(off * 8, os.SEEK_SET)
@@ -100,21 +147,31 @@ def load_raw_bins(rxdir):
     return out
 
 
-def load_iq16(path, maxrec=400):
-    out = []
-    with open(path, "rb") as f:
-        while len(out) < maxrec:
-            hdr = f.read(12)
+def iter_iq16(path):
+    with open_iq16(path) as f:
+        hdr = b""
+        while True:
+            hdr += f.read(12 - len(hdr))
             if len(hdr) < 12:
                 break
             magic, fn, tn, nint16, _pad = struct.unpack("<4sIBHB", hdr)
             if magic != b"IQ16":
-                f.seek(-11, os.SEEK_CUR); continue
+                # resynchro octet par octet (le flux zstd ne sait pas seek)
+                hdr = hdr[1:]; continue
+            hdr = b""
             raw = f.read(nint16 * 2)
             if len(raw) < nint16 * 2:
                 break
             a = np.frombuffer(raw, dtype="<i2").astype(np.float32)
-            out.append(("fn=%u/tn=%u" % (fn, tn), a[0::2] + 1j * a[1::2]))
+            yield ("fn=%u/tn=%u" % (fn, tn), a[0::2] + 1j * a[1::2])
+
+
+def load_iq16(path, maxrec=400):
+    out = []
+    for rec in iter_iq16(path):
+        if len(out) >= maxrec:
+            break
+        out.append(rec)
     return out
 
 
@@ -248,7 +305,7 @@ def resolve_daram_addr(verbose=True):
 def main():
     ap = argparse.ArgumentParser(description="Diag I/Q correlateur DSP")
     ap.add_argument("--src", choices=["auto", "shunt", "rxdump", "bursts", "daram", "ddump", "all"], default="auto")
-    ap.add_argument("--shunt", default="/dev/shm/dsp_iq.cfile")
+    ap.add_argument("--shunt", default=default_shunt())
     ap.add_argument("--rxdir", default="/tmp")
     ap.add_argument("--bursts", default="/dev/shm/bursts.cfile")
     # [2026-07-30] Chemin CORRIGÉ. L'ancien défaut /tmp/qemu-calypso-mon.sock
@@ -267,10 +324,13 @@ def main():
     a = ap.parse_args()
 
     def do_shunt():
-        if not os.path.exists(a.shunt): print("shunt: absent"); return
-        sz = os.path.getsize(a.shunt); tot = sz // 8
-        off = a.off if a.off >= 0 else max(0, tot - a.n)
-        report(load_fc32(a.shunt, a.n, off), a.fs or 1083333.0, "shunt dsp_iq.cfile @%d (fc32, entree 4SPS)" % off)
+        if not os.path.exists(a.shunt): print("shunt: %s absent" % a.shunt); return
+        if a.shunt.endswith(".cfile"):
+            sz = os.path.getsize(a.shunt); tot = sz // 8
+            off = a.off if a.off >= 0 else max(0, tot - a.n)
+            report(load_fc32(a.shunt, a.n, off), a.fs or 1083333.0, "shunt %s @%d (fc32, entree 4SPS)" % (os.path.basename(a.shunt), off))
+            return
+        report(load_iq16_tail(a.shunt, a.n), a.fs or 1083333.0, "shunt %s (IQ16, %d derniers, entree 4SPS)" % (os.path.basename(a.shunt), a.n))
 
     def do_rxdump():
         recs = load_raw_bins(a.rxdir)
@@ -16,7 +16,10 @@ Exemple de ce que ça donne — un cas réel du 2026-07-29 :
                                d_burst_d s'expliquent d'un coup.
 
 Usage :
-    tools/mailbox-annote.py [mailbox.log] [--rom ...] [--cellule 0x0829]
+    tools/mailbox-annote.py [mailbox.mbx|mailbox.log] [--rom ...] [--cellule 0x0829]
+
+La trace binaire (mailbox.mbx, défaut depuis le 2026-10-18) est lue via
+mailbox-decode.py ; l'ancien journal texte reste accepté.
 """
 import argparse
 import collections
@@ -34,6 +37,11 @@ _spec = importlib.util.spec_from_file_location(
 _dis = importlib.util.module_from_spec(_spec)
 _spec.loader.exec_module(_dis)
 
+_spec = importlib.util.spec_from_file_location(
+    "mailboxdecode", os.path.join(ICI, "mailbox-decode.py"))
+_dec = importlib.util.module_from_spec(_spec)
+_spec.loader.exec_module(_dec)
+
 # « insn fn sens mot nom ... @0xPC » — le nom peut être vide.
 LIGNE = re.compile(
     r"^\s*(\d+)\s+(\d+)\s+(ARM>WR|ARM<RD|DSP>WR|DSP<RD)\s+(0x[0-9a-f]{4})\s+"
@@ -84,6 +92,31 @@ def desassembler_pc(tab, roms, pc):
     return None
 
 
+def lignes_journal(chemin, binaire, fenetre):
+    """Les lignes du journal, texte ou binaire, limitées aux `fenetre` dernières.
+
+    En binaire la fenêtre est exacte (records de taille fixe) ; en texte on se
+    place à la fin moins une estimation généreuse (les lignes font ~70 o), puis
+    on jette la première, forcément tronquée."""
+    if binaire:
+        t = _dec.Trace(chemin)
+        debut, fin = t.bornes()
+        if fenetre:
+            debut = max(debut, fin - fenetre)
+        for n in range(debut, fin):
+            yield _dec.ligne(t.rec(n))
+        return
+    with io.open(chemin, encoding="utf-8", errors="replace") as f:
+        if fenetre:
+            taille = os.fstat(f.fileno()).st_size
+            saut = taille - fenetre * 80
+            if saut > 0:
+                f.seek(saut)
+                f.readline()
+        for l in f:
+            yield l
+
+
 def flux(tab, roms, cible):
     """Annote le flux au fil de l'eau. Une ligne d'entrée -> une ligne de sortie.
 
@@ -116,7 +149,7 @@ def main():
     import time
     p = argparse.ArgumentParser(description=__doc__,
                                 formatter_class=argparse.RawDescriptionHelpFormatter)
-    p.add_argument("journal", nargs="?", default="/tmp/calypso/logs/mailbox.log")
+    p.add_argument("journal", nargs="?", default="/tmp/calypso/logs/mailbox.mbx")
     p.add_argument("--rom", action="append", default=[],
                    help="ROM à utiliser (répétable ; défaut PROM0 + PDROM)")
     p.add_argument("--table", default=None, help="table binutils tic54x-opc.c")
@@ -163,35 +196,26 @@ def main():
     compte = collections.Counter()
     noms = {}
     try:
-        f = io.open(a.journal, encoding="utf-8", errors="replace")
+        with open(a.journal, "rb") as f:
+            binaire = f.read(4) == b"MBXB"
     except OSError as e:
         sys.exit("journal illisible : %s" % e)
-    with f:
-        if a.fenetre:
-            # On se place à la fin moins une estimation généreuse (les lignes
-            # font ~70 o), puis on jette la première, forcément tronquée.
-            import os as _os
-            taille = _os.fstat(f.fileno()).st_size
-            saut = taille - a.fenetre * 80
-            if saut > 0:
-                f.seek(saut)
-                f.readline()
-        for l in f:
-            if l.startswith("#"):
-                continue
-            m = LIGNE.match(l.rstrip("\n"))
-            if not m:
-                continue
-            _insn, _fn, sens, mot, reste, pc, rep = m.groups()
-            if not sens.startswith("DSP"):
-                continue              # côté ARM le contexte est un offset MMIO
-            mo = int(mot, 16)
-            if cible is not None and mo != cible:
-                continue
-            nom = reste.split()[0] if reste.split() else ""
-            if nom and not nom.startswith("0x") and nom not in ("=",):
-                noms[mo] = nom
-            compte[(mo, sens, int(pc, 16))] += 1 + (int(rep) - 1 if rep else 0)
+    for l in lignes_journal(a.journal, binaire, a.fenetre):
+        if l.startswith("#"):
+            continue
+        m = LIGNE.match(l.rstrip("\n"))
+        if not m:
+            continue
+        _insn, _fn, sens, mot, reste, pc, rep = m.groups()
+        if not sens.startswith("DSP"):
+            continue              # côté ARM le contexte est un offset MMIO
+        mo = int(mot, 16)
+        if cible is not None and mo != cible:
+            continue
+        nom = reste.split()[0] if reste.split() else ""
+        if nom and not nom.startswith("0x") and nom not in ("=",):
+            noms[mo] = nom
+        compte[(mo, sens, int(pc, 16))] += 1 + (int(rep) - 1 if rep else 0)
 
     if not compte:
         sys.exit("aucun accès DSP trouvé dans %s" % a.journal)
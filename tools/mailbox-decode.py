@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+"""
+mailbox-decode.py — rend lisible la trace BINAIRE du moniteur mailbox.
+
+Depuis le 2026-10-18 calypso_mailbox.c écrit par défaut $LOG_DIR/mailbox.mbx :
+un anneau mmap'é de records de 24 o (format décrit en tête de
+calypso_mailbox.c). Cet outil le rend dans EXACTEMENT le format de l'ancien
+mailbox.log, ligne pour ligne :
+
+    54068145     0        DSP>WR 0x0829 d_burst_d/rp0  0x0002 -> 0x0000  @0xb007
+
+donc tout ce qui lisait le texte (mailbox-annote.py, grep, diff de deux runs)
+marche sur sa sortie. Comme le fichier est à taille fixe, on peut aussi y
+chercher directement, sans tout relire :
+
+    tools/mailbox-decode.py mailbox.mbx --cellule 0x08f8,0x0829 --fn 1200:1300
+    tools/mailbox-decode.py mailbox.mbx --insn 50000000: --sens DSP>WR
+    tools/mailbox-decode.py mailbox.mbx --derniers 2000
+    tools/mailbox-decode.py mailbox.mbx --suivre | tools/mailbox-annote.py --flux
+    tools/mailbox-decode.py mailbox.mbx --stats
+
+Les bornes de --fn / --insn sont « A:B » (inclusives, l'une ou l'autre
+facultative). insn est un compteur 32 bits qui reboucle : l'anneau est
+découpé en segments où il croît (un seul parcours du champ insn), puis --insn
+est résolu par dichotomie dans chacun.
+"""
+import argparse
+import mmap
+import os
+import struct
+import sys
+import time
+
+HDR = struct.Struct("<4sIIIQQ32x")
+REC = struct.Struct("<IIIIHHHBx")
+INSN = struct.Struct("<I20x")
+SENS = ("ARM>WR", "ARM<RD", "DSP>WR", "DSP<RD")
+
+# Même table que mbx_nom() dans calypso_mailbox.c : garder les deux alignées.
+NOMS = {
+    0x0804: "d_task_md/wp0", 0x0818: "d_task_md/wp1",
+    0x0828: "d_task_d/rp0", 0x0829: "d_burst_d/rp0",
+    0x083C: "d_task_d/rp1", 0x083D: "d_burst_d/rp1",
+    0x0810: "d_ctrl_system", 0x08D4: "d_dsp_page",
+    0x08D5: "d_error_status", 0x08E2: "d_dsp_state",
+    0x08F8: "d_fb_det", 0x08F9: "d_fb_mode",
+    0x08FA: "a_sync[TOA]", 0x08FB: "a_sync[PM]",
+    0x08FC: "a_sync[ANGLE]", 0x08FD: "a_sync[SNR]",
+    0x098A: "d_backgnd_en", 0x098B: "d_backgnd_?b",
+    0x098C: "d_backgnd_st", 0x098D: "d_backgnd_?d",
+    0x098E: "tab_handlers", 0x0FFF: "d_task_word",
+    0x43D8: "slot_handler",
+}
+
+
+class Trace:
+    """Vue sur un mailbox.mbx. Relit `total` à chaque appel de bornes() : le
+    fichier peut être en cours d'écriture par QEMU."""
+
+    def __init__(self, chemin):
+        self.f = open(chemin, "rb")
+        self.m = mmap.mmap(self.f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, ver, trec, thdr, cap, _total = HDR.unpack_from(self.m, 0)
+        if magic != b"MBXB":
+            sys.exit("%s : pas une trace mailbox binaire (magic %r)"
+                     % (chemin, magic))
+        if ver != 1 or trec != REC.size or thdr != HDR.size:
+            sys.exit("%s : version %d / record %d o non supportés"
+                     % (chemin, ver, trec))
+        self.cap = cap
+
+    def total(self):
+        return HDR.unpack_from(self.m, 0)[5]
+
+    def bornes(self):
+        """(premier, fin) en numéros absolus de record, fin exclue."""
+        t = self.total()
+        return max(0, t - self.cap), t
+
+    def rec(self, n):
+        return REC.unpack_from(self.m, HDR.size + (n % self.cap) * REC.size)
+
+    def segments(self, lo, hi):
+        """Découpe [lo, hi) en segments où insn ne décroît pas : au-delà de
+        2^32 instructions le compteur reboucle et la dichotomie n'a de sens
+        qu'entre deux rebouclages."""
+        debut, prec, n = lo, None, lo
+        while n < hi:
+            # tranche contiguë dans le fichier (l'anneau peut se refermer)
+            i = n % self.cap
+            k = min(hi - n, self.cap - i)
+            zone = memoryview(self.m)[HDR.size + i * REC.size:
+                                      HDR.size + (i + k) * REC.size]
+            for (insn,) in INSN.iter_unpack(zone):
+                if prec is not None and insn < prec:
+                    yield debut, n
+                    debut = n
+                prec = insn
+                n += 1
+        if debut < hi:
+            yield debut, hi
+
+    def chercher_insn(self, insn, lo, hi):
+        """Premier record >= lo dont insn >= `insn` (dichotomie)."""
+        while lo < hi:
+            mid = (lo + hi) // 2
+            if self.rec(mid)[0] < insn:
+                lo = mid + 1
+            else:
+                hi = mid
+        return lo
+
+
+def ligne(r):
+    insn, fn, ctx, rep, mot, val, avant, sens = r
+    suffixe = "  x%d" % (rep + 1) if rep else ""
+    nom = NOMS.get(mot, "")
+    if sens in (0, 2):
+        return ("%-12u %-8u %-6s 0x%04x %-14s 0x%04x -> 0x%04x  @0x%04x%s"
+                % (insn, fn, SENS[sens], mot, nom, avant, val, ctx, suffixe))
+    return ("%-12u %-8u %-6s 0x%04x %-14s = 0x%04x            @0x%04x%s"
+            % (insn, fn, SENS[sens], mot, nom, val, ctx, suffixe))
+
+
+def intervalle(txt):
+    if not txt:
+        return None
+    a, _, b = txt.partition(":")
+    return (int(a, 0) if a else 0,
+            int(b, 0) if b else (1 << 64))
+
+
+def retenu(r, a):
+    insn, fn, _ctx, _rep, mot, _val, _avant, sens = r
+    if a.cellules and mot not in a.cellules:
+        return False
+    if a.fn and not (a.fn[0] <= fn <= a.fn[1]):
+        return False
+    if a.insn and not (a.insn[0] <= insn <= a.insn[1]):
+        return False
+    if a.sens is not None and sens != a.sens:
+        return False
+    return True
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("trace", nargs="?", default=os.path.join(
+        os.environ.get("LOG_DIR") or "/tmp/calypso/logs", "mailbox.mbx"))
+    p.add_argument("--cellule", action="append", default=[],
+                   help="ne garder que ces cellules (répétable, ou liste a,b,c)")
+    p.add_argument("--fn", default=None, metavar="A:B", help="plage de FN")
+    p.add_argument("--insn", default=None, metavar="A:B",
+                   help="plage de compteur d'instructions")
+    p.add_argument("--sens", default=None, choices=SENS)
+    p.add_argument("--derniers", type=int, default=0, metavar="N",
+                   help="ne considérer que les N derniers records")
+    p.add_argument("--suivre", action="store_true",
+                   help="après la fin, attendre les nouveaux records (live)")
+    p.add_argument("--stats", action="store_true",
+                   help="résumé : capacité, remplissage, accès par cellule")
+    a = p.parse_args()
+
+    a.cellules = {int(c, 0) for x in a.cellule for c in x.split(",") if c}
+    a.fn = intervalle(a.fn)
+    a.insn = intervalle(a.insn)
+    a.sens = SENS.index(a.sens) if a.sens else None
+
+    # Comme `tail -F` : en mode live on attend que QEMU ait créé l'anneau.
+    while a.suivre and not (os.path.exists(a.trace)
+                            and os.path.getsize(a.trace) >= HDR.size):
+        time.sleep(0.5)
+    t = Trace(a.trace)
+    debut, fin = t.bornes()
+    if a.derniers:
+        debut = max(debut, fin - a.derniers)
+    if a.insn:
+        plages = [(t.chercher_insn(a.insn[0], d, f), f)
+                  for d, f in t.segments(debut, fin)]
+    else:
+        plages = [(debut, fin)]
+
+    if a.stats:
+        import collections
+        compte = collections.Counter()
+        for d, f in plages:
+            for n in range(d, f):
+                r = t.rec(n)
+                if retenu(r, a):
+                    compte[(r[4], r[7])] += 1 + r[3]
+        print("# %s : capacité %d, %d records écrits, %d présents%s"
+              % (a.trace, t.cap, fin, fin - max(0, fin - t.cap),
+                 " (anneau plein : les plus anciens sont écrasés)"
+                 if fin > t.cap else ""))
+        for (mot, sens), n in compte.most_common(40):
+            print("  0x%04x  %-14s %-6s %10d" % (mot, NOMS.get(mot, ""),
+                                                 SENS[sens], n))
+        return
+
+    sortie = sys.stdout
+    try:
+        while True:
+            for d, f in plages:
+                for n in range(d, f):
+                    r = t.rec(n)
+                    if a.insn and r[0] > a.insn[1]:
+                        break   # fin de la plage dans ce segment
+                    if retenu(r, a):
+                        sortie.write(ligne(r) + "\n")
+            if not a.suivre:
+                return
+            sortie.flush()
+            debut = fin
+            while True:
+                premier, fin = t.bornes()
+                if fin != debut:
+                    break
+                time.sleep(0.2)
+            if premier > debut:
+                sortie.write("# %d records écrasés avant lecture (anneau)\n"
+                             % (premier - debut))
+                debut = premier
+            plages = [(debut, fin)]
+    except (BrokenPipeError, KeyboardInterrupt):
+        pass
+
+
+if __name__ == "__main__":
+    main()
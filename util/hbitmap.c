@@ -101,6 +101,42 @@ struct HBitmap {
     uint64_t sizes[HBITMAP_LEVELS];
 };
 
+/*
+ * A group of words of the last level.  Operations on it are lowered to SIMD
+ * instructions where the host has them, and split into several narrower
+ * operations elsewhere.  The levels are only aligned like unsigned long,
+ * hence the explicit alignment.
+ */
+typedef unsigned long HBitmapVec
+    __attribute__((vector_size(32), aligned(sizeof(unsigned long)),
+                   may_alias));
+#define HBITMAP_VEC_WORDS (sizeof(HBitmapVec) / sizeof(unsigned long))
+
+/* Return the first word in [pos, end) that is not all ones, or end.  */
+static size_t hb_skip_ones(const unsigned long *words, size_t pos, size_t end)
+{
+    /* Look at two vectors at a time; a long dirty run rarely ends early.  */
+    while (pos + 2 * HBITMAP_VEC_WORDS <= end) {
+        const HBitmapVec *v = (const HBitmapVec *)&words[pos];
+        HBitmapVec t = v[0] & v[1];
+        unsigned long all = ~0UL;
+        unsigned i;
+
+        for (i = 0; i < HBITMAP_VEC_WORDS; i++) {
+            all &= t[i];
+        }
+        if (all != ~0UL) {
+            break;
+        }
+        pos += 2 * HBITMAP_VEC_WORDS;
+    }
+
+    while (pos < end && words[pos] == ~0UL) {
+        pos++;
+    }
+    return pos;
+}
+
 /* Advance hbi to the next nonzero word and return it.  hbi->pos
  * is updated.  Returns zero if we reach the end of the bitmap.
  */
@@ -245,10 +281,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
     assert((start >> hb->granularity) < hb->size);
 
     if (cur == (unsigned long)-1) {
-        do {
-            pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
-
+        pos = hb_skip_ones(last_lev, pos + 1, sz);
         if (pos >= sz) {
             return -1;
         }
@@ -143,6 +143,11 @@ void qemu_progress_print(float delta, int max)
 {
     float current;
 
+    /* Block drivers may report progress in programs that never enable it */
+    if (!state.print) {
+        return;
+    }
+
     if (max == 0) {
         current = delta;
     } else {